@@ -0,0 +1,280 @@
+////////////////////////////////////////////////////////////////////////////////
+#include <CLI/CLI.hpp>
+#include <polyfem/State.hpp>
+#include <polyfem/AssemblerUtils.hpp>
+#include <polyfem/ElementAssemblyValues.hpp>
+#include <polyfem/RhsAssembler.hpp>
+#include <polyfem/StringUtils.hpp>
+#include <polyfem/Logger.hpp>
+
+#include <igl/Timer.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#ifdef POLYFEM_WITH_TBB
+#include <tbb/task_scheduler_init.h>
+#endif
+////////////////////////////////////////////////////////////////////////////////
+
+using namespace polyfem;
+
+namespace
+{
+	struct BenchOptions
+	{
+		int repeat = 5;
+		int warmup = 1;
+	};
+
+	//runs f warmup + repeat times, the setup is not timed
+	json run(const std::string &name, const json &params, const BenchOptions &opts, const std::function<void()> &f, const std::function<void()> &setup = nullptr)
+	{
+		std::vector<double> times;
+		igl::Timer timer;
+		for (int i = 0; i < opts.warmup + opts.repeat; ++i)
+		{
+			if (setup)
+				setup();
+
+			timer.start();
+			f();
+			timer.stop();
+
+			if (i >= opts.warmup)
+				times.push_back(timer.getElapsedTime());
+		}
+
+		std::vector<double> sorted = times;
+		std::sort(sorted.begin(), sorted.end());
+		const double mean = std::accumulate(times.begin(), times.end(), 0.) / times.size();
+		double var = 0;
+		for (const double t : times)
+			var += (t - mean) * (t - mean);
+
+		json res;
+		res["name"] = name;
+		res["params"] = params;
+		res["times"] = times;
+		res["min"] = sorted.front();
+		res["max"] = sorted.back();
+		res["median"] = sorted[sorted.size() / 2];
+		res["mean"] = mean;
+		res["stddev"] = std::sqrt(var / times.size());
+
+		logger().info("{} {}: median {}s, min {}s", name, params.dump(), res["median"].get<double>(), res["min"].get<double>());
+		return res;
+	}
+
+	std::string default_problem(const std::string &formulation)
+	{
+		const auto &assembler = AssemblerUtils::instance();
+		if (assembler.is_scalar(formulation))
+			return "Franke";
+		if (assembler.is_fluid(formulation))
+			return "DrivenCavity";
+		return "ElasticExact";
+	}
+} // namespace
+
+int main(int argc, char **argv)
+{
+	CLI::App command_line{"polyfem benchmarks"};
+
+	std::string mesh_path = POLYFEM_DATA_DIR "/circle2.msh";
+	std::string output = "polyfem_bench.json";
+	std::string vtu_path = "polyfem_bench.vtu";
+	std::string formulations_str = "Laplacian,LinearElasticity,NeoHookean,SaintVenant";
+	std::string orders_str = "1,2";
+	std::string filter = "";
+	int n_refs = 0;
+	int threads = -1;
+	BenchOptions opts;
+
+	command_line.add_option("-m,--mesh", mesh_path, "Mesh path")->check(CLI::ExistingFile);
+	command_line.add_option("-o,--output", output, "Output json file");
+	command_line.add_option("--vtu", vtu_path, "Path of the vtu written by the save_vtu benchmark");
+	command_line.add_option("--formulations", formulations_str, "Comma separated formulations");
+	command_line.add_option("--orders", orders_str, "Comma separated discretization orders");
+	command_line.add_option("--filter", filter, "Run only the benchmarks whose name contains this string");
+	command_line.add_option("--n_refs", n_refs, "Number of refinements");
+	command_line.add_option("--repeat", opts.repeat, "Timed runs per benchmark");
+	command_line.add_option("--warmup", opts.warmup, "Untimed runs per benchmark");
+	command_line.add_option("--threads", threads, "Number of threads");
+
+	try
+	{
+		command_line.parse(argc, argv);
+	}
+	catch (const CLI::ParseError &e)
+	{
+		return command_line.exit(e);
+	}
+
+	if (opts.repeat <= 0)
+	{
+		logger().error("--repeat must be positive");
+		return EXIT_FAILURE;
+	}
+
+#ifdef POLYFEM_WITH_TBB
+	if (threads <= 0)
+		threads = tbb::task_scheduler_init::default_num_threads();
+	tbb::task_scheduler_init scheduler(threads);
+#else
+	threads = 1;
+#endif
+
+	const auto enabled = [&](const std::string &name) { return filter.empty() || name.find(filter) != std::string::npos; };
+
+	json results;
+	results["mesh"] = mesh_path;
+	results["n_refs"] = n_refs;
+	results["threads"] = threads;
+	results["repeat"] = opts.repeat;
+	results["warmup"] = opts.warmup;
+#ifdef NDEBUG
+	results["build"] = "release";
+#else
+	results["build"] = "debug";
+#endif
+#ifdef __VERSION__
+	results["compiler"] = __VERSION__;
+#endif
+	results["benchmarks"] = json::array();
+	json &benchmarks = results["benchmarks"];
+
+	const auto &assembler = AssemblerUtils::instance();
+
+	for (const std::string &formulation : StringUtils::split(formulations_str, ","))
+	{
+		for (const std::string &order_str : StringUtils::split(orders_str, ","))
+		{
+			const int order = std::stoi(order_str);
+
+			State state;
+			state.init_logger(std::cout, 2);
+
+			json in_args = {
+				{"mesh", mesh_path},
+				{"n_refs", n_refs},
+				{"discr_order", order},
+				{"problem", default_problem(formulation)},
+				{"scalar_formulation", formulation},
+				{"tensor_formulation", formulation},
+			};
+			state.init(in_args);
+			state.load_mesh();
+			if (!state.mesh)
+			{
+				logger().error("Unable to load {}", mesh_path);
+				return EXIT_FAILURE;
+			}
+
+			json params = {{"formulation", formulation}, {"order", order}, {"n_elements", state.mesh->n_elements()}, {"dim", state.mesh->dimension()}};
+
+			if (enabled("load_mesh"))
+				benchmarks.push_back(run("load_mesh", params, opts, [&]() { state.load_mesh(); }));
+
+			if (enabled("build_basis"))
+				benchmarks.push_back(run("build_basis", params, opts, [&]() { state.build_basis(); }));
+			else
+				state.build_basis();
+			params["n_bases"] = state.n_bases;
+
+			const bool is_volume = state.mesh->is_volume();
+			const auto &gbases = state.iso_parametric() ? state.bases : state.geom_bases;
+
+			if (enabled("element_values"))
+			{
+				ElementAssemblyValues vals;
+				benchmarks.push_back(run("element_values", params, opts, [&]() {
+					for (int e = 0; e < int(state.bases.size()); ++e)
+						vals.compute(e, is_volume, state.bases[e], gbases[e]);
+				}));
+			}
+
+			if (assembler.is_linear(formulation) && !assembler.is_mixed(formulation))
+			{
+				if (enabled("assemble"))
+				{
+					StiffnessMatrix stiffness;
+					benchmarks.push_back(run("assemble", params, opts, [&]() {
+						assembler.assemble_problem(formulation, is_volume, state.n_bases, state.bases, gbases, stiffness);
+					}));
+				}
+			}
+			else if (!assembler.is_linear(formulation))
+			{
+				//reproducible small displacement
+				const int size = state.mesh->dimension();
+				std::srand(0);
+				const Eigen::MatrixXd displacement = 1e-3 * Eigen::MatrixXd::Random(state.n_bases * size, 1);
+
+				if (enabled("assemble_hessian"))
+				{
+					StiffnessMatrix hessian;
+					benchmarks.push_back(run("assemble_hessian", params, opts, [&]() {
+						assembler.assemble_energy_hessian(formulation, is_volume, state.n_bases, state.bases, gbases, displacement, hessian);
+					}));
+				}
+				if (enabled("assemble_gradient"))
+				{
+					Eigen::MatrixXd grad;
+					benchmarks.push_back(run("assemble_gradient", params, opts, [&]() {
+						assembler.assemble_energy_gradient(formulation, is_volume, state.n_bases, state.bases, gbases, displacement, grad);
+					}));
+				}
+			}
+
+			state.assemble_rhs();
+			if (enabled("set_bc") && state.rhs.size() > 0)
+			{
+				const int size = state.problem->is_scalar() ? 1 : state.mesh->dimension();
+				const RhsAssembler rhs_assembler(*state.mesh, state.n_bases, size, state.bases, gbases, state.formulation(), *state.problem);
+				const Eigen::MatrixXd rhs = state.rhs;
+				Eigen::MatrixXd tmp;
+				benchmarks.push_back(run(
+					"set_bc", params, opts,
+					[&]() { rhs_assembler.set_bc(state.local_boundary, state.boundary_nodes, state.args["n_boundary_samples"], state.local_neumann_boundary, tmp); },
+					[&]() { tmp = rhs; }));
+			}
+
+			if (enabled("solve"))
+			{
+				//solve_problem reassembles the stiffness and resets the rhs
+				benchmarks.push_back(run(
+					"solve", params, opts,
+					[&]() { state.assemble_stiffness_mat(); state.solve_problem(); },
+					[&]() { state.assemble_rhs(); }));
+			}
+
+			if (enabled("save_vtu"))
+			{
+				if (state.sol.size() <= 0)
+				{
+					state.assemble_stiffness_mat();
+					state.solve_problem();
+				}
+				benchmarks.push_back(run("save_vtu", params, opts, [&]() { state.save_vtu(vtu_path, 1); }));
+			}
+		}
+	}
+
+	std::ofstream out(output);
+	if (!out.good())
+	{
+		logger().error("Unable to write {}", output);
+		return EXIT_FAILURE;
+	}
+	out << results.dump(4) << std::endl;
+	logger().info("Results written to {}", output);
+
+	return EXIT_SUCCESS;
+}
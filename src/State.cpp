@@ -13,6 +13,7 @@
 
 #include <polyfem/SplineBasis2d.hpp>
 #include <polyfem/SplineBasis3d.hpp>
+#include <polyfem/DofRenumbering.hpp>
 
 #include <polyfem/EdgeSampler.hpp>
 #include <polyfem/BoundarySampler.hpp>
@@ -40,6 +41,12 @@
 #include <polyfem/SparseNewtonDescentSolver.hpp>
 #include <polyfem/NavierStokesSolver.hpp>
 #include <polyfem/TransientNavierStokesSolver.hpp>
+#include <polyfem/TimeStepController.hpp>
+#include <polyfem/SolutionPredictor.hpp>
+#include <polyfem/SaddlePointSolver.hpp>
+#include <polyfem/MatrixFreeSolver.hpp>
+#include <polyfem/StaticCondensation.hpp>
+#include <polyfem/MultigridSolver.hpp>
 
 #include <polyfem/auto_p_bases.hpp>
 #include <polyfem/auto_q_bases.hpp>
@@ -51,12 +58,15 @@
 #include <polyfem/BDF.hpp>
 
 #include <polyfem/Logger.hpp>
+#include <polyfem/Profiler.hpp>
+#include <polyfem/MemoryTracker.hpp>
 
 #ifdef POLYFEM_WITH_TBB
 #include <tbb/task_scheduler_init.h>
+#include <tbb/parallel_for.h>
+#include <tbb/enumerable_thread_specific.h>
 #endif
 
-#include <igl/Timer.h>
 #include <igl/remove_unreferenced.h>
 #include <igl/remove_duplicate_vertices.h>
 #include <igl/isolines.h>
@@ -80,8 +90,6 @@ DECLARE_DIFFSCALAR_BASE();
 
 using namespace Eigen;
 
-extern "C" size_t getPeakRSS();
-
 namespace polyfem
 {
 	using namespace polysolve;
@@ -103,6 +111,63 @@ double angle3(const V1 &v1, const V2 &v2)
 	return std::abs(atan2(v1.cross(v2).norm(), v1.dot(v2)));
 }
 
+//per thread buffers and partial sums of State::compute_errors
+struct LocalThreadErrorStorage
+{
+	ElementAssemblyValues vals;
+	Eigen::MatrixXd v_approx, v_approx_grad;
+
+	double l2 = 0, h1 = 0, lp = 0, linf = 0, grad_max = 0;
+};
+
+//values and gradients (one block of dim columns per component) of fun at the quadrature points of vals
+void interpolate_at_quadrature(const ElementAssemblyValues &vals, const Eigen::MatrixXd &fun, const int actual_dim, const int dim, Eigen::MatrixXd &v, Eigen::MatrixXd &v_grad)
+{
+	v.resize(vals.val.rows(), actual_dim);
+	v.setZero();
+
+	v_grad.resize(vals.val.rows(), dim * actual_dim);
+	v_grad.setZero();
+
+	for (const AssemblyValues &val : vals.basis_values)
+	{
+		for (size_t ii = 0; ii < val.global.size(); ++ii)
+		{
+			for (int d = 0; d < actual_dim; ++d)
+			{
+				const double coeff = val.global[ii].val * fun(val.global[ii].index * actual_dim + d);
+				v.col(d) += coeff * val.val;
+				v_grad.block(0, d * dim, v_grad.rows(), dim) += coeff * val.grad_t_m;
+			}
+		}
+	}
+}
+
+//exponents of the monomials of total degree at most degree in dim variables, the constant first
+void monomial_exponents(const int dim, const int degree, std::vector<Eigen::VectorXi> &exponents)
+{
+	exponents.clear();
+	Eigen::VectorXi e(dim);
+	for (int total = 0; total <= degree; ++total)
+	{
+		for (int i = 0; i <= total; ++i)
+		{
+			if (dim == 2)
+			{
+				e << total - i, i;
+				exponents.push_back(e);
+				continue;
+			}
+
+			for (int j = 0; i + j <= total; ++j)
+			{
+				e << total - i - j, i, j;
+				exponents.push_back(e);
+			}
+		}
+	}
+}
+
 class GeoLoggerForward : public GEO::LoggerClient
 {
 	std::shared_ptr<spdlog::logger> logger_;
@@ -192,6 +257,56 @@ State::State()
 
 		{"tend", 1},
 		{"time_steps", 10},
+		{"time_adaptivity", {
+			{"enabled", false},
+			{"tol_abs", 1e-6},
+			{"tol_rel", 1e-4},
+			{"dt0", 0},
+			{"dt_min", 1e-10},
+			{"dt_max", 0},
+			{"safety", 0.9},
+			{"min_factor", 0.2},
+			{"max_factor", 5},
+			{"max_rejections", 20}
+		}},
+		{"predictor", {
+			{"type", "linearized"},
+			{"extrapolation_order", 2},
+			{"reuse_factorization", false},
+			{"stokes_skip_tol", 0}
+		}},
+		{"adaptive_p", {
+			{"max_cycles", 0},
+			{"fraction", 0.3},
+			{"tolerance", 0},
+			{"max_dofs", 0}
+		}},
+		{"saddle_point_solver", {
+			{"enabled", false},
+			{"krylov", "auto"},
+			{"velocity_solver", ""},
+			{"velocity_precond", ""},
+			{"velocity_solver_params", json({})},
+			{"tolerance", 1e-10},
+			{"max_iter", 1000},
+			{"restart", 50},
+			{"viscosity", 0}
+		}},
+		{"matrix_free", {
+			{"enabled", false},
+			{"solver", "cg"},
+			{"tolerance", 1e-10},
+			{"max_iter", 10000},
+			{"eigenvalue_iterations", 20}
+		}},
+		{"static_condensation", false},
+		{"multigrid", {
+			{"enabled", false},
+			{"tolerance", 1e-10},
+			{"max_iter", 500},
+			{"smoothing_steps", 2},
+			{"omega", 0.6}
+		}},
 
 		{"scalar_formulation", "Laplacian"},
 		{"tensor_formulation", "LinearElasticity"},
@@ -208,8 +323,14 @@ State::State()
 		{"pressure_discr_order", 1},
 		{"use_p_ref", false},
 		{"use_spline", false},
+		{"dof_renumbering", "none"},
 		{"iso_parametric", false},
 		{"integral_constraints", 2},
+		{"polytope_cache", {
+			{"enabled", false},
+			{"tolerance", 1e-8},
+			{"path", ""}
+		}},
 
 		{"fit_nodes", false},
 
@@ -222,6 +343,8 @@ State::State()
 		{"line_search", "armijo"},
 		{"nl_solver", "newton"},
 		{"nl_solver_rhs_steps", 1},
+		{"autodiff_backend", "dofs"},
+		{"parallel_assembly", "thread_local"},
 		{"save_solve_sequence", false},
 		{"save_solve_sequence_debug", false},
 		{"save_time_sequence", true},
@@ -249,6 +372,7 @@ State::State()
 			{"paraview", ""},
 			{"vis_boundary_only", false},
 			{"material_params", false},
+			{"element_errors", false},
 			{"nodes", ""},
 			{"wire_mesh", ""},
 			{"iso_mesh", ""},
@@ -258,7 +382,8 @@ State::State()
 			{"stiffness_mat", ""},
 			{"solution_mat", ""},
 			{"stress_mat", ""},
-			{"mises", ""}
+			{"mises", ""},
+			{"profile", ""}
 		}}};
 }
 
@@ -397,6 +522,40 @@ void State::compute_mesh_size(const Mesh &mesh_in, const std::vector<ElementBase
 	logger().info("havg: {}", average_edge_length);
 }
 
+void State::update_memory_usage()
+{
+	const auto bases_bytes = [](const std::vector<ElementBases> &bs) {
+		size_t res = memory_bytes(bs);
+		for (const auto &b : bs)
+		{
+			res += memory_bytes(b.bases);
+			//the node positions of Local2Global are stored inline
+			for (const auto &basis : b.bases)
+				res += memory_bytes(basis.global());
+		}
+		return res;
+	};
+
+	MemoryTracker &tracker = MemoryTracker::instance();
+	tracker.set_bytes("bases", bases_bytes(bases));
+	tracker.set_bytes("geom_bases", bases_bytes(geom_bases));
+	tracker.set_bytes("pressure_bases", bases_bytes(pressure_bases));
+	tracker.set_bytes("stiffness", memory_bytes(stiffness));
+	tracker.set_bytes("mass", memory_bytes(mass));
+	tracker.set_bytes("matrix_free_operator", matrix_free_operator ? matrix_free_operator->memory_bytes() : 0);
+	tracker.set_bytes("static_condensation", static_condensation ? static_condensation->memory_bytes() : 0);
+	tracker.set_bytes("multigrid", multigrid ? multigrid->memory_bytes() : 0);
+	tracker.set_bytes("vectors", memory_bytes(rhs) + memory_bytes(rhs_in) + memory_bytes(sol) + memory_bytes(pressure));
+
+	size_t frames = memory_bytes(solution_frames);
+	for (const auto &f : solution_frames)
+	{
+		frames += memory_bytes(f.points) + memory_bytes(f.connectivity) + memory_bytes(f.solution) + memory_bytes(f.pressure);
+		frames += memory_bytes(f.exact) + memory_bytes(f.error) + memory_bytes(f.scalar_value) + memory_bytes(f.scalar_value_avg);
+	}
+	tracker.set_bytes("solution_frames", frames);
+}
+
 void State::save_json()
 {
 	const std::string out_path = args["output"];
@@ -485,6 +644,18 @@ void State::save_json(nlohmann::json &j)
 	j["err_linf_grad"] = grad_max_err;
 	j["err_lp"] = lp_err;
 
+	if (args["export"]["element_errors"] && element_errors.size() > 0)
+	{
+		const auto to_vector = [](const Eigen::VectorXd &v) { return std::vector<double>(v.data(), v.data() + v.size()); };
+		j["err_per_element"] = {
+			{"l2", to_vector(element_errors.col(0))},
+			{"h1_semi", to_vector(element_errors.col(1))},
+			{"linf", to_vector(element_errors.col(2))},
+			{"indicator", to_vector(element_errors.col(3))}};
+	}
+	if (args["export"]["element_errors"] && stress_recovery_errors.size() > 0)
+		j["stress_recovery_error"] = {{"total", stress_recovery_errors.norm()}, {"per_element", std::vector<double>(stress_recovery_errors.data(), stress_recovery_errors.data() + stress_recovery_errors.size())}};
+
 	j["spectrum"] = {spectrum(0), spectrum(1), spectrum(2), spectrum(3)};
 	j["spectrum_condest"] = std::abs(spectrum(3)) / std::abs(spectrum(0));
 
@@ -493,12 +664,17 @@ void State::save_json(nlohmann::json &j)
 	j["time_building_basis"] = building_basis_time;
 	j["time_loading_mesh"] = loading_mesh_time;
 	j["time_computing_poly_basis"] = computing_poly_basis_time;
+	if (!poly_basis_timings.empty())
+		j["time_computing_poly_basis_phases"] = poly_basis_timings;
 	j["time_assembling_stiffness_mat"] = assembling_stiffness_mat_time;
 	j["time_assigning_rhs"] = assigning_rhs_time;
 	j["time_solving"] = solving_time;
 	j["time_computing_errors"] = computing_errors_time;
+	j["profile"] = Profiler::instance().summary();
 
 	j["solver_info"] = solver_info;
+	if (!adaptive_info.empty())
+		j["adaptive_p"] = adaptive_info;
 
 	j["count_simplex"] = simplex_count;
 	j["count_regular"] = regular_count;
@@ -513,7 +689,9 @@ void State::save_json(nlohmann::json &j)
 
 	j["is_simplicial"] = mesh->n_elements() == simplex_count;
 
-	j["peak_memory"] = getPeakRSS() / (1024 * 1024);
+	j["peak_memory"] = MemoryTracker::peak_rss() / (1024 * 1024);
+	update_memory_usage();
+	j["memory"] = MemoryTracker::instance().summary();
 
 	const int actual_dim = problem->is_scalar() ? 1 : mesh->dimension();
 
@@ -539,7 +717,8 @@ void State::save_json(nlohmann::json &j)
 
 	if (args["export"]["sol_at_node"] >= 0)
 	{
-		const int node_id = args["export"]["sol_at_node"];
+		//the node id refers to the numbering before the renumbering
+		const int node_id = bases_new_index.size() > 0 ? bases_new_index(int(args["export"]["sol_at_node"])) : int(args["export"]["sol_at_node"]);
 
 		for (int d = 0; d < actual_dim; ++d)
 		{
@@ -1064,88 +1243,269 @@ void State::interpolate_boundary_tensor_function(const MatrixXd &pts, const Matr
 	assert(counter == result.rows());
 }
 
-void State::average_grad_based_function(const int n_points, const MatrixXd &fun, MatrixXd &result_scalar, MatrixXd &result_tensor, const bool boundary_only)
+void State::probe_solution(const Eigen::MatrixXd &pts, Eigen::MatrixXd &values, Eigen::MatrixXd &grads, Eigen::MatrixXd &tensors)
 {
 	if (!mesh)
 	{
 		logger().error("Load the mesh first!");
 		return;
 	}
-	if (fun.size() <= 0)
+	if (sol.size() <= 0)
 	{
 		logger().error("Solve the problem first!");
 		return;
 	}
+
+	const int dim = mesh->dimension();
+	const int actual_dim = problem->is_scalar() ? 1 : dim;
+	const auto &gbases = iso_parametric() ? bases : geom_bases;
+
+	if (!point_probe)
+	{
+		point_probe = std::make_shared<PointProbe>();
+		point_probe->init(*mesh, bases, gbases, n_bases);
+	}
+	point_probe->set_points(pts);
+
+	point_probe->evaluate(sol, actual_dim, values);
+	point_probe->evaluate_grad(sol, actual_dim, grads);
+
+	tensors.resize(0, 0);
 	if (problem->is_scalar())
+		return;
+
+	//the fluids have no stress tensor of the velocity alone
+	const auto &assembler = AssemblerUtils::instance();
+	if (assembler.is_fluid(formulation()))
 	{
-		logger().error("Define a tensor problem!");
+		tensors = grads;
 		return;
 	}
 
-	assert(!problem->is_scalar());
-	const int actual_dim = mesh->dimension();
+	tensors.setZero(pts.rows(), dim * dim);
+	point_probe->for_each_element([&](const int e, const Eigen::MatrixXd &local_pts, const std::vector<int> &probes) {
+		Eigen::MatrixXd local_val;
+		assembler.compute_tensor_value(formulation(), e, bases[e], gbases[e], local_pts, sol, local_val);
+		if (local_val.size() <= 0)
+			return;
 
-	MatrixXd avg_scalar(n_bases, 1);
-	// MatrixXd avg_tensor(n_points * actual_dim*actual_dim, 1);
-	MatrixXd areas(n_bases, 1);
-	avg_scalar.setZero();
-	// avg_tensor.setZero();
-	areas.setZero();
+		for (size_t k = 0; k < probes.size(); ++k)
+			tensors.row(probes[k]) = local_val.row(k);
+	});
+}
 
-	const auto &assembler = AssemblerUtils::instance();
+void State::recover_stresses(const MatrixXd &fun, Eigen::MatrixXd &recovered, Eigen::VectorXd &errors)
+{
+	if (!mesh)
+	{
+		logger().error("Load the mesh first!");
+		return;
+	}
+	if (fun.size() <= 0)
+	{
+		logger().error("Solve the problem first!");
+		return;
+	}
 
-	Eigen::MatrixXd local_val;
+	const int dim = mesh->dimension();
+	const int n_el = int(bases.size());
+	const bool is_scalar = problem->is_scalar();
+	const int n_tensor = is_scalar ? dim : dim * dim;
+	const bool is_volume = mesh->is_volume();
+	const auto &assembler = AssemblerUtils::instance();
 	const auto &gbases = iso_parametric() ? bases : geom_bases;
+	//the fluids have no stress tensor of the velocity alone, their gradient is recovered instead
+	const bool recover_gradient = is_scalar || assembler.is_fluid(formulation());
+
+	//the patch polynomials have the degree of the elements of the patch
+	const int max_degree = std::max(1, disc_orders.size() > 0 ? disc_orders.maxCoeff() : 1);
+	std::vector<std::vector<Eigen::VectorXi>> exponents(max_degree + 1);
+	for (int degree = 1; degree <= max_degree; ++degree)
+		monomial_exponents(dim, degree, exponents[degree]);
+
+	//node to element adjacency (compressed rows) and node positions
+	std::vector<int> node_offsets(n_bases + 1, 0);
+	std::vector<int> node_elements;
+	Eigen::MatrixXd nodes(n_bases, dim);
+	std::vector<bool> has_node(n_bases, false);
+	{
+		std::vector<std::vector<int>> element_nodes(n_el);
+		for (int e = 0; e < n_el; ++e)
+		{
+			for (const Basis &b : bases[e].bases)
+			{
+				for (const auto &lg : b.global())
+				{
+					element_nodes[e].push_back(lg.index);
+					if (!has_node[lg.index] && lg.node.size() == dim)
+					{
+						nodes.row(lg.index) = lg.node;
+						has_node[lg.index] = true;
+					}
+				}
+			}
 
-	ElementAssemblyValues vals;
-	for (int i = 0; i < int(bases.size()); ++i)
-	{
-		const ElementBases &bs = bases[i];
-		const ElementBases &gbs = gbases[i];
-		Eigen::MatrixXd local_pts;
+			std::sort(element_nodes[e].begin(), element_nodes[e].end());
+			element_nodes[e].erase(std::unique(element_nodes[e].begin(), element_nodes[e].end()), element_nodes[e].end());
+			for (const int g : element_nodes[e])
+				++node_offsets[g + 1];
+		}
 
-		if (mesh->is_simplex(i))
+		for (int g = 0; g < n_bases; ++g)
+			node_offsets[g + 1] += node_offsets[g];
+
+		node_elements.resize(node_offsets.back());
+		std::vector<int> pos(node_offsets.begin(), node_offsets.end() - 1);
+		for (int e = 0; e < n_el; ++e)
 		{
-			if (mesh->dimension() == 3)
-				autogen::p_nodes_3d(bs.bases.front().order(), local_pts);
-			else
-				autogen::p_nodes_2d(bs.bases.front().order(), local_pts);
+			for (const int g : element_nodes[e])
+				node_elements[pos[g]++] = e;
+		}
+	}
+
+	//raw tensor and scalar value at the quadrature points (physical coordinates)
+	std::vector<Eigen::MatrixXd> sample_pts(n_el), sample_vals(n_el);
+	const auto compute_samples = [&](const int e, ElementAssemblyValues &vals) {
+		vals.compute(e, is_volume, bases[e], gbases[e]);
+
+		Eigen::MatrixXd tensor, scalar;
+		if (recover_gradient)
+		{
+			Eigen::MatrixXd value;
+			interpolate_at_quadrature(vals, fun, is_scalar ? 1 : dim, dim, value, tensor);
+			scalar = tensor.rowwise().norm();
 		}
 		else
+			assembler.compute_stress_and_von_mises(formulation(), e, bases[e], gbases[e], vals.quadrature.points, fun, tensor, scalar);
+		assert(tensor.cols() == n_tensor);
+		assert(scalar.rows() == tensor.rows());
+
+		sample_pts[e] = vals.val;
+		sample_vals[e].resize(tensor.rows(), n_tensor + 1);
+		sample_vals[e] << tensor, scalar;
+	};
+
+	//the polynomial is centered at the node, its value there is the constant coefficient
+	recovered.resize(n_bases, n_tensor + 1);
+	recovered.setZero();
+	const auto fit_node = [&](const int g) {
+		int n_samples = 0;
+		int degree = 1;
+		for (int k = node_offsets[g]; k < node_offsets[g + 1]; ++k)
 		{
-			if (mesh->dimension() == 3)
-				autogen::q_nodes_3d(bs.bases.front().order(), local_pts);
-			else
-				autogen::q_nodes_2d(bs.bases.front().order(), local_pts);
+			const int e = node_elements[k];
+			n_samples += sample_pts[e].rows();
+			if (e < disc_orders.size())
+				degree = std::max(degree, disc_orders(e));
 		}
-		// else if(mesh->is_cube(i))
-		// 	local_pts = sampler.cube_points();
-		// // else
-		// 	// local_pts = vis_pts_poly[i];
+		if (n_samples <= 0)
+			return;
 
-		vals.compute(i, actual_dim == 3, bases[i], gbases[i]);
-		const Quadrature &quadrature = vals.quadrature;
-		const double area = (vals.det.array() * quadrature.weights.array()).sum();
+		Eigen::MatrixXd local(n_samples, dim);
+		Eigen::MatrixXd rhs(n_samples, n_tensor + 1);
+		int index = 0;
+		for (int k = node_offsets[g]; k < node_offsets[g + 1]; ++k)
+		{
+			const int e = node_elements[k];
+			local.middleRows(index, sample_pts[e].rows()) = sample_pts[e];
+			rhs.middleRows(index, sample_vals[e].rows()) = sample_vals[e];
+			index += sample_pts[e].rows();
+		}
 
-		assembler.compute_scalar_value(formulation(), i, bs, gbs, local_pts, fun, local_val);
-		// assembler.compute_tensor_value(formulation(), i, bs, gbs, local_pts, fun, local_val);
+		const Eigen::RowVectorXd center = has_node[g] ? nodes.row(g) : local.colwise().mean().eval();
+		local.rowwise() -= center;
+		//patch size scaling for the conditioning of the fit
+		const double h = local.cwiseAbs().maxCoeff();
+		if (h > 0)
+			local /= h;
 
-		for (size_t j = 0; j < bs.bases.size(); ++j)
+		//lower degrees for the patches without enough samples (e.g., on the boundary)
+		for (; degree >= 1; --degree)
 		{
-			const Basis &b = bs.bases[j];
-			if (b.global().size() > 1)
+			const std::vector<Eigen::VectorXi> &exps = exponents[degree];
+			if (int(exps.size()) > n_samples)
 				continue;
 
-			auto &global = b.global().front();
-			areas(global.index) += area;
-			avg_scalar(global.index) += local_val(j) * area;
+			Eigen::MatrixXd A(n_samples, exps.size());
+			for (size_t m = 0; m < exps.size(); ++m)
+			{
+				A.col(m).setOnes();
+				for (int d = 0; d < dim; ++d)
+				{
+					if (exps[m](d) > 0)
+						A.col(m).array() *= local.col(d).array().pow(exps[m](d));
+				}
+			}
+
+			Eigen::ColPivHouseholderQR<Eigen::MatrixXd> qr(A);
+			if (qr.rank() == A.cols())
+			{
+				recovered.row(g) = qr.solve(rhs).row(0);
+				return;
+			}
 		}
-	}
 
-	avg_scalar.array() /= areas.array();
+		recovered.row(g) = rhs.colwise().mean();
+	};
+
+	errors.resize(n_el);
+	const auto compute_error = [&](const int e, ElementAssemblyValues &vals) {
+		vals.compute(e, is_volume, bases[e], gbases[e]);
+
+		Eigen::MatrixXd rec = Eigen::MatrixXd::Zero(vals.val.rows(), n_tensor);
+		for (const AssemblyValues &v : vals.basis_values)
+		{
+			for (const auto &g : v.global)
+				rec += (g.val * v.val) * recovered.block(g.index, 0, 1, n_tensor);
+		}
+
+		const Eigen::VectorXd da = vals.det.array() * vals.quadrature.weights.array();
+		errors(e) = sqrt(((rec - sample_vals[e].leftCols(n_tensor)).rowwise().squaredNorm().array() * da.array()).sum());
+	};
+
+#ifdef POLYFEM_WITH_TBB
+	typedef tbb::enumerable_thread_specific<ElementAssemblyValues> LocalStorage;
+	LocalStorage storages;
+	tbb::parallel_for(tbb::blocked_range<int>(0, n_el), [&](const tbb::blocked_range<int> &r) {
+		LocalStorage::reference vals = storages.local();
+		for (int e = r.begin(); e != r.end(); ++e)
+			compute_samples(e, vals);
+	});
+	tbb::parallel_for(tbb::blocked_range<int>(0, n_bases), [&](const tbb::blocked_range<int> &r) {
+		for (int g = r.begin(); g != r.end(); ++g)
+			fit_node(g);
+	});
+	tbb::parallel_for(tbb::blocked_range<int>(0, n_el), [&](const tbb::blocked_range<int> &r) {
+		LocalStorage::reference vals = storages.local();
+		for (int e = r.begin(); e != r.end(); ++e)
+			compute_error(e, vals);
+	});
+#else
+	ElementAssemblyValues vals;
+	for (int e = 0; e < n_el; ++e)
+		compute_samples(e, vals);
+	for (int g = 0; g < n_bases; ++g)
+		fit_node(g);
+	for (int e = 0; e < n_el; ++e)
+		compute_error(e, vals);
+#endif
+
+	logger().debug("stress recovery estimate {}", errors.norm());
+}
+
+void State::average_grad_based_function(const int n_points, const MatrixXd &fun, MatrixXd &result_scalar, MatrixXd &result_tensor, const bool boundary_only)
+{
+	Eigen::MatrixXd recovered;
+	recover_stresses(fun, recovered, stress_recovery_errors);
+	if (recovered.size() <= 0)
+		return;
+
+	const int n_tensor = recovered.cols() - 1;
+	interpolate_function(n_points, 1, bases, recovered.col(n_tensor), result_scalar, boundary_only);
 
-	interpolate_function(n_points, 1, bases, avg_scalar, result_scalar, boundary_only);
-	// interpolate_function(n_points, actual_dim*actual_dim, bases, avg_tensor, result_tensor, boundary_only);
+	//interpolate_function expects the components of each node next to each other
+	const Eigen::MatrixXd tensor_t = recovered.leftCols(n_tensor).transpose();
+	interpolate_function(n_points, n_tensor, bases, Eigen::Map<const Eigen::MatrixXd>(tensor_t.data(), tensor_t.size(), 1), result_tensor, boundary_only);
 }
 
 void State::compute_vertex_values(int actual_dim,
@@ -1287,18 +1647,16 @@ void State::compute_stress_at_quadrature_points(const MatrixXd &fun, Eigen::Matr
 
 	const auto &assembler = AssemblerUtils::instance();
 
-	Eigen::MatrixXd local_val, local_stress, local_mises;
 	const auto &gbases = iso_parametric() ? bases : geom_bases;
+	const int n_el = int(mesh->n_elements());
 
-	int num_quadr_pts = 0;
-	result.resize(disc_orders.sum(), actual_dim == 2 ? 3 : 6);
-	result.setZero();
-	von_mises.resize(disc_orders.sum(), 1);
-	von_mises.setZero();
-	for (int e = 0; e < mesh->n_elements(); ++e)
+	//quadratures and output offsets first, so that the elements can be processed independently
+	std::vector<Quadrature> quadratures(n_el);
+	std::vector<int> offsets(n_el + 1, 0);
+	for (int e = 0; e < n_el; ++e)
 	{
 		// Compute quadrature points for element
-		Quadrature quadr;
+		Quadrature &quadr = quadratures[e];
 		if (mesh->is_simplex(e))
 		{
 			if (mesh->is_volume())
@@ -1325,30 +1683,38 @@ void State::compute_stress_at_quadrature_points(const MatrixXd &fun, Eigen::Matr
 				f.get_quadrature(disc_orders(e), quadr);
 			}
 		}
-		else
-		{
-			continue;
-		}
 
-		assembler.compute_scalar_value(formulation(), e, bases[e], gbases[e],
-									   quadr.points, fun, local_mises);
-		assembler.compute_tensor_value(formulation(), e, bases[e], gbases[e],
-									   quadr.points, fun, local_val);
+		offsets[e + 1] = offsets[e] + quadr.points.rows();
+	}
+
+	result.resize(offsets[n_el], actual_dim == 2 ? 3 : 6);
+	result.setZero();
+	von_mises.resize(offsets[n_el], 1);
+	von_mises.setZero();
+
+	const auto compute_element = [&](const int e) {
+		const Quadrature &quadr = quadratures[e];
+		if (quadr.points.rows() <= 0)
+			return;
+
+		Eigen::MatrixXd local_val, local_stress, local_mises;
+		assembler.compute_stress_and_von_mises(formulation(), e, bases[e], gbases[e],
+											   quadr.points, fun, local_val, local_mises);
 
-		if (num_quadr_pts + local_val.rows() >= result.rows())
-		{
-			result.conservativeResize(
-				std::max(num_quadr_pts + local_val.rows() + 1, 2 * result.rows()),
-				result.cols());
-			von_mises.conservativeResize(result.rows(), von_mises.cols());
-		}
 		flattened_tensor_coeffs(local_val, local_stress);
-		result.block(num_quadr_pts, 0, local_stress.rows(), local_stress.cols()) = local_stress;
-		von_mises.block(num_quadr_pts, 0, local_mises.rows(), local_mises.cols()) = local_mises;
-		num_quadr_pts += local_val.rows();
-	}
-	result.conservativeResize(num_quadr_pts, result.cols());
-	von_mises.conservativeResize(num_quadr_pts, von_mises.cols());
+		result.block(offsets[e], 0, local_stress.rows(), local_stress.cols()) = local_stress;
+		von_mises.block(offsets[e], 0, local_mises.rows(), local_mises.cols()) = local_mises;
+	};
+
+#ifdef POLYFEM_WITH_TBB
+	tbb::parallel_for(tbb::blocked_range<int>(0, n_el), [&](const tbb::blocked_range<int> &r) {
+		for (int e = r.begin(); e != r.end(); ++e)
+			compute_element(e);
+	});
+#else
+	for (int e = 0; e < n_el; ++e)
+		compute_element(e);
+#endif
 }
 
 void State::interpolate_function(const int n_points, const MatrixXd &fun, MatrixXd &result, const bool boundary_only)
@@ -1435,40 +1801,56 @@ void State::compute_scalar_value(const int n_points, const Eigen::MatrixXd &fun,
 	result.resize(n_points, 1);
 	assert(!problem->is_scalar());
 
-	int index = 0;
 	const auto &sampler = RefElementSampler::sampler();
 	const auto &assembler = AssemblerUtils::instance();
 
 	Eigen::MatrixXi vis_faces_poly;
-	Eigen::MatrixXd local_val;
 	const auto &gbases = iso_parametric() ? bases : geom_bases;
+	const int n_el = int(bases.size());
 
-	for (int i = 0; i < int(bases.size()); ++i)
+	//the sampling is serial (the polygon sampler is not thread safe), the evaluation is parallel over the elements
+	std::vector<Eigen::MatrixXd> local_pts(n_el);
+	std::vector<int> offsets(n_el + 1, 0);
+	for (int i = 0; i < n_el; ++i)
 	{
-		if (boundary_only && mesh->is_volume() && !mesh->is_boundary_element(i))
-			continue;
-
-		const ElementBases &bs = bases[i];
-		const ElementBases &gbs = gbases[i];
-		Eigen::MatrixXd local_pts;
-
-		if (mesh->is_simplex(i))
-			local_pts = sampler.simplex_points();
-		else if (mesh->is_cube(i))
-			local_pts = sampler.cube_points();
-		else
+		if (!(boundary_only && mesh->is_volume() && !mesh->is_boundary_element(i)))
 		{
-			if (mesh->is_volume())
-				sampler.sample_polyhedron(polys_3d[i].first, polys_3d[i].second, local_pts, vis_faces_poly);
+			if (mesh->is_simplex(i))
+				local_pts[i] = sampler.simplex_points();
+			else if (mesh->is_cube(i))
+				local_pts[i] = sampler.cube_points();
 			else
-				sampler.sample_polygon(polys[i], local_pts, vis_faces_poly);
+			{
+				if (mesh->is_volume())
+					sampler.sample_polyhedron(polys_3d[i].first, polys_3d[i].second, local_pts[i], vis_faces_poly);
+				else
+					sampler.sample_polygon(polys[i], local_pts[i], vis_faces_poly);
+			}
 		}
 
-		assembler.compute_scalar_value(formulation(), i, bs, gbs, local_pts, fun, local_val);
-
-		result.block(index, 0, local_val.rows(), 1) = local_val;
-		index += local_val.rows();
+		offsets[i + 1] = offsets[i] + local_pts[i].rows();
 	}
+	assert(offsets[n_el] <= result.rows());
+
+	const auto compute_element = [&](const int i) {
+		if (local_pts[i].rows() <= 0)
+			return;
+
+		Eigen::MatrixXd local_val;
+		assembler.compute_scalar_value(formulation(), i, bases[i], gbases[i], local_pts[i], fun, local_val);
+
+		result.block(offsets[i], 0, local_val.rows(), 1) = local_val;
+	};
+
+#ifdef POLYFEM_WITH_TBB
+	tbb::parallel_for(tbb::blocked_range<int>(0, n_el), [&](const tbb::blocked_range<int> &r) {
+		for (int i = r.begin(); i != r.end(); ++i)
+			compute_element(i);
+	});
+#else
+	for (int i = 0; i < n_el; ++i)
+		compute_element(i);
+#endif
 }
 
 void State::compute_tensor_value(const int n_points, const Eigen::MatrixXd &fun, Eigen::MatrixXd &result, const bool boundary_only)
@@ -1488,40 +1870,56 @@ void State::compute_tensor_value(const int n_points, const Eigen::MatrixXd &fun,
 	result.resize(n_points, actual_dim * actual_dim);
 	assert(!problem->is_scalar());
 
-	int index = 0;
 	const auto &sampler = RefElementSampler::sampler();
 	const auto &assembler = AssemblerUtils::instance();
 
 	Eigen::MatrixXi vis_faces_poly;
-	Eigen::MatrixXd local_val;
 	const auto &gbases = iso_parametric() ? bases : geom_bases;
+	const int n_el = int(bases.size());
 
-	for (int i = 0; i < int(bases.size()); ++i)
+	//the sampling is serial (the polygon sampler is not thread safe), the evaluation is parallel over the elements
+	std::vector<Eigen::MatrixXd> local_pts(n_el);
+	std::vector<int> offsets(n_el + 1, 0);
+	for (int i = 0; i < n_el; ++i)
 	{
-		if (boundary_only && mesh->is_volume() && !mesh->is_boundary_element(i))
-			continue;
-
-		const ElementBases &bs = bases[i];
-		const ElementBases &gbs = gbases[i];
-		Eigen::MatrixXd local_pts;
-
-		if (mesh->is_simplex(i))
-			local_pts = sampler.simplex_points();
-		else if (mesh->is_cube(i))
-			local_pts = sampler.cube_points();
-		else
+		if (!(boundary_only && mesh->is_volume() && !mesh->is_boundary_element(i)))
 		{
-			if (mesh->is_volume())
-				sampler.sample_polyhedron(polys_3d[i].first, polys_3d[i].second, local_pts, vis_faces_poly);
+			if (mesh->is_simplex(i))
+				local_pts[i] = sampler.simplex_points();
+			else if (mesh->is_cube(i))
+				local_pts[i] = sampler.cube_points();
 			else
-				sampler.sample_polygon(polys[i], local_pts, vis_faces_poly);
+			{
+				if (mesh->is_volume())
+					sampler.sample_polyhedron(polys_3d[i].first, polys_3d[i].second, local_pts[i], vis_faces_poly);
+				else
+					sampler.sample_polygon(polys[i], local_pts[i], vis_faces_poly);
+			}
 		}
 
-		assembler.compute_tensor_value(formulation(), i, bs, gbs, local_pts, fun, local_val);
-
-		result.block(index, 0, local_val.rows(), local_val.cols()) = local_val;
-		index += local_val.rows();
+		offsets[i + 1] = offsets[i] + local_pts[i].rows();
 	}
+	assert(offsets[n_el] <= result.rows());
+
+	const auto compute_element = [&](const int i) {
+		if (local_pts[i].rows() <= 0)
+			return;
+
+		Eigen::MatrixXd local_val;
+		assembler.compute_tensor_value(formulation(), i, bases[i], gbases[i], local_pts[i], fun, local_val);
+
+		result.block(offsets[i], 0, local_val.rows(), local_val.cols()) = local_val;
+	};
+
+#ifdef POLYFEM_WITH_TBB
+	tbb::parallel_for(tbb::blocked_range<int>(0, n_el), [&](const tbb::blocked_range<int> &r) {
+		for (int i = r.begin(); i != r.end(); ++i)
+			compute_element(i);
+	});
+#else
+	for (int i = 0; i < n_el; ++i)
+		compute_element(i);
+#endif
 }
 
 void State::get_sidesets(Eigen::MatrixXd &pts, Eigen::MatrixXi &faces, Eigen::MatrixXd &sidesets)
@@ -1615,9 +2013,40 @@ void State::get_sidesets(Eigen::MatrixXd &pts, Eigen::MatrixXi &faces, Eigen::Ma
 	}
 }
 
+void State::build_mesh_hierarchy(const std::function<std::unique_ptr<Mesh>()> &create, const int n_refs)
+{
+	ScopedZone zone("build_mesh_hierarchy");
+	coarse_meshes.clear();
+
+	//the same refinement as the mesh, stopped after l steps
+	for (int l = 0; l < n_refs; ++l)
+	{
+		std::unique_ptr<Mesh> level = create();
+		if (!level)
+		{
+			logger().warn("Unable to reload the mesh, no geometric multigrid");
+			coarse_meshes.clear();
+			return;
+		}
+
+		if (args["normalize_mesh"])
+			level->normalize();
+
+		std::vector<int> level_parents;
+		level->refine(l, args["refinenemt_location"], level_parents);
+		coarse_meshes.push_back(std::move(level));
+	}
+	logger().debug("mesh hierarchy with {} coarse levels, {}s", n_refs, zone.stop());
+}
+
 void State::load_mesh(GEO::Mesh &meshin, const std::function<int(const RowVectorNd &)> &boundary_marker, bool skip_boundary_sideset)
 {
+	colorings.clear();
+	dof_map.clear();
+	pressure_dof_map.clear();
 	bases.clear();
+	adaptive_disc_orders.resize(0);
+	element_matrix_cache.clear();
 	pressure_bases.clear();
 	geom_bases.clear();
 	boundary_nodes.clear();
@@ -1626,6 +2055,8 @@ void State::load_mesh(GEO::Mesh &meshin, const std::function<int(const RowVector
 	polys.clear();
 	poly_edge_to_data.clear();
 	parent_elements.clear();
+	coarse_meshes.clear();
+	multigrid.reset();
 
 	stiffness.resize(0, 0);
 	rhs.resize(0, 0);
@@ -1635,8 +2066,8 @@ void State::load_mesh(GEO::Mesh &meshin, const std::function<int(const RowVector
 	n_bases = 0;
 	n_pressure_bases = 0;
 
-	igl::Timer timer;
-	timer.start();
+	ScopedZone zone("load_mesh");
+	ScopedMemoryPhase memory_phase("load_mesh");
 	logger().info("Loading mesh...");
 	mesh = Mesh::create(meshin);
 	if (!mesh)
@@ -1669,18 +2100,28 @@ void State::load_mesh(GEO::Mesh &meshin, const std::function<int(const RowVector
 	if (n_refs > 0)
 		mesh->refine(n_refs, args["refinenemt_location"], parent_elements);
 
+	if (args["multigrid"]["enabled"] && n_refs > 0)
+		build_mesh_hierarchy([&meshin]() { return Mesh::create(meshin); }, n_refs);
+
 	if (!skip_boundary_sideset)
 		mesh->compute_boundary_ids(boundary_marker);
 
-	timer.stop();
-	logger().info(" took {}s", timer.getElapsedTime());
+	loading_mesh_time = zone.stop();
+	logger().info(" took {}s", loading_mesh_time);
+	//the mesh storage is not accounted, the RSS growth of the loading is used instead
+	MemoryTracker::instance().set_bytes("mesh", std::max(0l, memory_phase.stop()));
 
 	RefElementSampler::sampler().init(mesh->is_volume(), mesh->n_elements(), args["vismesh_rel_area"]);
 }
 
 void State::load_mesh()
 {
+	colorings.clear();
+	dof_map.clear();
+	pressure_dof_map.clear();
 	bases.clear();
+	adaptive_disc_orders.resize(0);
+	element_matrix_cache.clear();
 	pressure_bases.clear();
 	geom_bases.clear();
 	boundary_nodes.clear();
@@ -1689,6 +2130,8 @@ void State::load_mesh()
 	polys.clear();
 	poly_edge_to_data.clear();
 	parent_elements.clear();
+	coarse_meshes.clear();
+	multigrid.reset();
 
 	stiffness.resize(0, 0);
 	rhs.resize(0, 0);
@@ -1698,8 +2141,8 @@ void State::load_mesh()
 	n_bases = 0;
 	n_pressure_bases = 0;
 
-	igl::Timer timer;
-	timer.start();
+	ScopedZone zone("load_mesh");
+	ScopedMemoryPhase memory_phase("load_mesh");
 	logger().info("Loading mesh...");
 
 	if (!mesh || !mesh_path().empty())
@@ -1743,6 +2186,15 @@ void State::load_mesh()
 	if (n_refs > 0)
 		mesh->refine(n_refs, args["refinenemt_location"], parent_elements);
 
+	if (args["multigrid"]["enabled"] && n_refs > 0)
+	{
+		const std::string path = mesh_path();
+		if (path.empty())
+			logger().warn("Geometric multigrid needs to reload the mesh from a file, ignoring");
+		else
+			build_mesh_hierarchy([&path]() { return Mesh::create(path); }, n_refs);
+	}
+
 	// mesh->set_tag(1712, ElementType::InteriorPolytope);
 
 	const std::string bc_tag_path = args["bc_tag"];
@@ -1759,8 +2211,10 @@ void State::load_mesh()
 			mesh->load_boundary_ids(bc_tag_path);
 	}
 
-	timer.stop();
-	logger().info(" took {}s", timer.getElapsedTime());
+	loading_mesh_time = zone.stop();
+	logger().info(" took {}s", loading_mesh_time);
+	//the mesh storage is not accounted, the RSS growth of the loading is used instead
+	MemoryTracker::instance().set_bytes("mesh", std::max(0l, memory_phase.stop()));
 
 	RefElementSampler::sampler().init(mesh->is_volume(), mesh->n_elements(), args["vismesh_rel_area"]);
 
@@ -1874,7 +2328,12 @@ void State::compute_mesh_stats()
 		return;
 	}
 
+	colorings.clear();
+	dof_map.clear();
+	pressure_dof_map.clear();
 	bases.clear();
+	adaptive_disc_orders.resize(0);
+	element_matrix_cache.clear();
 	pressure_bases.clear();
 	geom_bases.clear();
 	boundary_nodes.clear();
@@ -2030,6 +2489,18 @@ void compute_integral_constraints(
 	basis_integrals -= rhs;
 }
 
+std::unique_ptr<polysolve::LinearSolver> State::create_linear_solver() const
+{
+	//the skeleton system of the static condensation is not on the hierarchy dofs
+	if (multigrid && !static_condensation && !AssemblerUtils::instance().is_mixed(formulation()))
+	{
+		const int problem_dim = problem->is_scalar() ? 1 : mesh->dimension();
+		return std::make_unique<MultigridSolver>(multigrid, problem_dim, boundary_nodes, args["multigrid"]);
+	}
+
+	return LinearSolver::create(args["solver_type"], args["precond_type"]);
+}
+
 void State::build_basis()
 {
 	if (!mesh)
@@ -2038,9 +2509,16 @@ void State::build_basis()
 		return;
 	}
 
+	colorings.clear();
+	dof_map.clear();
+	pressure_dof_map.clear();
 	bases.clear();
 	pressure_bases.clear();
 	geom_bases.clear();
+	point_probe.reset();
+	matrix_free_operator.reset();
+	static_condensation.reset();
+	multigrid.reset();
 	boundary_nodes.clear();
 	local_boundary.clear();
 	local_neumann_boundary.clear();
@@ -2050,6 +2528,8 @@ void State::build_basis()
 	rhs.resize(0, 0);
 	sol.resize(0, 0);
 	pressure.resize(0, 0);
+	element_errors.resize(0, 0);
+	stress_recovery_errors.resize(0);
 
 	n_bases = 0;
 	n_pressure_bases = 0;
@@ -2088,8 +2568,8 @@ void State::build_basis()
 			geom_disc_orders = mesh->orders();
 	}
 
-	igl::Timer timer;
-	timer.start();
+	ScopedZone zone("build_basis");
+	ScopedMemoryPhase memory_phase("build_basis");
 	if (args["use_p_ref"])
 	{
 		if (mesh->is_volume())
@@ -2100,6 +2580,12 @@ void State::build_basis()
 		logger().info("min p: {} max p: {}", disc_orders.minCoeff(), disc_orders.maxCoeff());
 	}
 
+	if (adaptive_disc_orders.size() == disc_orders.size())
+	{
+		disc_orders = adaptive_disc_orders;
+		logger().info("adaptive orders, min p: {} max p: {}", disc_orders.minCoeff(), disc_orders.maxCoeff());
+	}
+
 	if (mesh->is_volume())
 	{
 		const Mesh3D &tmp_mesh = *dynamic_cast<Mesh3D *>(mesh.get());
@@ -2163,10 +2649,44 @@ void State::build_basis()
 			n_pressure_bases = FEBasis2d::build_bases(tmp_mesh, args["quadrature_order"], int(args["pressure_discr_order"]), false, has_polys, false, pressure_bases, local_boundary, poly_edge_to_data_geom);
 		}
 	}
-	timer.stop();
+	building_basis_time = zone.stop();
 
 	build_polygonal_basis();
 
+	bases_new_index.resize(0);
+	pressure_bases_new_index.resize(0);
+	const std::string renumbering = args["dof_renumbering"];
+	if (renumbering != "none")
+	{
+		logger().info("Renumbering the dofs ({})...", renumbering);
+		ScopedZone renumbering_zone("renumbering");
+
+		const int old_bandwidth = DofRenumbering::bandwidth(bases);
+		DofRenumbering::compute(renumbering, bases, n_bases, bases_new_index);
+		DofRenumbering::apply(bases_new_index, bases);
+
+		if (n_pressure_bases > 0)
+		{
+			DofRenumbering::compute(renumbering, pressure_bases, n_pressure_bases, pressure_bases_new_index);
+			DofRenumbering::apply(pressure_bases_new_index, pressure_bases);
+		}
+
+		const double renumbering_time = renumbering_zone.stop();
+		logger().info(" took {}s, bandwidth {} -> {}", renumbering_time, old_bandwidth, DofRenumbering::bandwidth(bases));
+	}
+
+	if (!coarse_meshes.empty())
+	{
+		if (args["use_spline"] || has_polys || disc_orders.minCoeff() != disc_orders.maxCoeff())
+			logger().warn("Geometric multigrid requires uniform order Lagrange bases, ignoring");
+		else
+		{
+			ScopedZone multigrid_zone("multigrid_hierarchy");
+			multigrid = std::make_shared<GeometricMultigrid>();
+			if (!multigrid->init(coarse_meshes, bases, n_bases, disc_orders(0), args["quadrature_order"], args["serendipity"]))
+				multigrid.reset();
+		}
+	}
 
 	auto &gbases = iso_parametric() ? bases : geom_bases;
 
@@ -2246,7 +2766,24 @@ void State::build_basis()
 	const int n_samples = 10;
 	compute_mesh_size(*mesh, curret_bases, n_samples);
 
-	building_basis_time = timer.getElapsedTime();
+	//the expression based material parameters are evaluated once here instead of at every assembly
+	assembler.precompute_material_parameters(mesh->is_volume(), bases, curret_bases);
+	//the element dof maps are built once on the renumbered bases and given to all the assemblies
+	dof_map.build(bases, n_bases);
+	if (n_pressure_bases > 0)
+		pressure_dof_map.build(pressure_bases, n_pressure_bases);
+	//the assemblies scatter through the maps, the Local2Global of the bases are only read for their node
+	//positions (geometric mapping, boundary, output) and keep no spare capacity
+	for (auto *bs : {&bases, &pressure_bases})
+	{
+		for (auto &b : *bs)
+		{
+			for (auto &basis : b.bases)
+				basis.global().shrink_to_fit();
+		}
+	}
+	update_memory_usage();
+
 	logger().info(" took {}s", building_basis_time);
 
 	logger().info("flipped elements {}", n_flipped);
@@ -2273,8 +2810,9 @@ void State::build_polygonal_basis()
 	sol.resize(0, 0);
 	pressure.resize(0, 0);
 
-	igl::Timer timer;
-	timer.start();
+	poly_basis_timings = json({});
+	ScopedZone zone("build_polygonal_basis");
+	ScopedMemoryPhase memory_phase("build_polygonal_basis");
 	logger().info("Computing polygonal basis...");
 
 	// std::sort(boundary_nodes.begin(), boundary_nodes.end());
@@ -2284,13 +2822,22 @@ void State::build_polygonal_basis()
 
 	int new_bases = 0;
 
+	const json &cache_params = args["polytope_cache"];
+	const std::string cache_path = cache_params["path"];
+	if (cache_params["enabled"] && !polytope_cache)
+	{
+		polytope_cache = std::make_shared<PolytopeBasisCache>(cache_params["tolerance"].get<double>());
+		if (!cache_path.empty() && polytope_cache->load(cache_path))
+			logger().info("Loaded {} polytope fits from {}", polytope_cache->size(), cache_path);
+	}
+
 	if (iso_parametric())
 	{
 		if (mesh->is_volume())
 		{
 			if (args["poly_bases"] == "MeanValue")
 				logger().error("MeanValue bases not supported in 3D");
-			new_bases = PolygonalBasis3d::build_bases(formulation(), args["n_harmonic_samples"], *dynamic_cast<Mesh3D *>(mesh.get()), n_bases, args["quadrature_order"], args["integral_constraints"], bases, bases, poly_edge_to_data, polys_3d);
+			new_bases = PolygonalBasis3d::build_bases(formulation(), args["n_harmonic_samples"], *dynamic_cast<Mesh3D *>(mesh.get()), n_bases, args["quadrature_order"], args["integral_constraints"], bases, bases, poly_edge_to_data, polys_3d, poly_basis_timings, polytope_cache.get());
 		}
 		else
 		{
@@ -2299,7 +2846,7 @@ void State::build_polygonal_basis()
 				new_bases = MVPolygonalBasis2d::build_bases(formulation(), *dynamic_cast<Mesh2D *>(mesh.get()), n_bases, args["quadrature_order"], bases, bases, poly_edge_to_data, local_boundary, polys);
 			}
 			else
-				new_bases = PolygonalBasis2d::build_bases(formulation(), args["n_harmonic_samples"], *dynamic_cast<Mesh2D *>(mesh.get()), n_bases, args["quadrature_order"], args["integral_constraints"], bases, bases, poly_edge_to_data, polys);
+				new_bases = PolygonalBasis2d::build_bases(formulation(), args["n_harmonic_samples"], *dynamic_cast<Mesh2D *>(mesh.get()), n_bases, args["quadrature_order"], args["integral_constraints"], bases, bases, poly_edge_to_data, polys, poly_basis_timings, polytope_cache.get());
 		}
 	}
 	else
@@ -2308,21 +2855,27 @@ void State::build_polygonal_basis()
 		{
 			if (args["poly_bases"] == "MeanValue")
 				logger().error("MeanValue bases not supported in 3D");
-			new_bases = PolygonalBasis3d::build_bases(formulation(), args["n_harmonic_samples"], *dynamic_cast<Mesh3D *>(mesh.get()), n_bases, args["quadrature_order"], args["integral_constraints"], bases, geom_bases, poly_edge_to_data, polys_3d);
+			new_bases = PolygonalBasis3d::build_bases(formulation(), args["n_harmonic_samples"], *dynamic_cast<Mesh3D *>(mesh.get()), n_bases, args["quadrature_order"], args["integral_constraints"], bases, geom_bases, poly_edge_to_data, polys_3d, poly_basis_timings, polytope_cache.get());
 		}
 		else
 		{
 			if (args["poly_bases"] == "MeanValue")
 				new_bases = MVPolygonalBasis2d::build_bases(formulation(), *dynamic_cast<Mesh2D *>(mesh.get()), n_bases, args["quadrature_order"], bases, geom_bases, poly_edge_to_data, local_boundary, polys);
 			else
-				new_bases = PolygonalBasis2d::build_bases(formulation(), args["n_harmonic_samples"], *dynamic_cast<Mesh2D *>(mesh.get()), n_bases, args["quadrature_order"], args["integral_constraints"], bases, geom_bases, poly_edge_to_data, polys);
+				new_bases = PolygonalBasis2d::build_bases(formulation(), args["n_harmonic_samples"], *dynamic_cast<Mesh2D *>(mesh.get()), n_bases, args["quadrature_order"], args["integral_constraints"], bases, geom_bases, poly_edge_to_data, polys, poly_basis_timings, polytope_cache.get());
 		}
 	}
 
-	timer.stop();
-	computing_poly_basis_time = timer.getElapsedTime();
+	computing_poly_basis_time = zone.stop();
 	logger().info(" took {}s", computing_poly_basis_time);
 
+	if (polytope_cache && poly_basis_timings.count("cache_hits"))
+	{
+		logger().info("Polytope cache: {} hits, {} misses", poly_basis_timings["cache_hits"].get<int>(), poly_basis_timings["cache_misses"].get<int>());
+		if (!cache_path.empty() && poly_basis_timings["cache_misses"].get<int>() > 0 && !polytope_cache->save(cache_path))
+			logger().error("Unable to save the polytope cache to {}", cache_path);
+	}
+
 	n_bases += new_bases;
 }
 
@@ -2518,6 +3071,8 @@ json State::build_json_params()
 {
 	json params = args["params"];
 	params["size"] = mesh->dimension();
+	params["autodiff_backend"] = args["autodiff_backend"];
+	params["parallel_assembly"] = args["parallel_assembly"];
 
 	return params;
 }
@@ -2538,22 +3093,52 @@ void State::assemble_stiffness_mat()
 	stiffness.resize(0, 0);
 	sol.resize(0, 0);
 	pressure.resize(0, 0);
+	matrix_free_operator.reset();
+	static_condensation.reset();
 
-	igl::Timer timer;
-	timer.start();
+	ScopedZone zone("assemble_stiffness_mat");
+	ScopedMemoryPhase memory_phase("assemble_stiffness_mat");
 	logger().info("Assembling stiffness mat...");
 
 	auto &assembler = AssemblerUtils::instance();
 
+	//the adaptive p-refinement integrates again only the elements whose order changed
+	ElementMatrixCache *element_matrices = args["adaptive_p"]["max_cycles"] > 0 ? &element_matrix_cache : nullptr;
+
+	if (args["matrix_free"]["enabled"])
+	{
+		if (!problem->is_time_dependent() && SumFactorizationOperator::is_supported_formulation(formulation()))
+		{
+			auto op = std::make_shared<SumFactorizationOperator>();
+			const int size = problem->is_scalar() ? 1 : mesh->dimension();
+			const LameParameters *lame = formulation() == "LinearElasticity" ? &assembler.lame_params() : nullptr;
+			if (op->init(formulation(), size, *mesh, bases, iso_parametric() ? bases : geom_bases, n_bases, lame))
+			{
+				matrix_free_operator = op;
+
+				assembling_stiffness_mat_time = zone.stop();
+				logger().info(" matrix-free Q{} operator, took {}s", op->order(), assembling_stiffness_mat_time);
+
+				nn_zero = 0;
+				num_dofs = op->rows();
+				mat_size = 0;
+				update_memory_usage();
+				return;
+			}
+		}
+
+		logger().warn("Matrix-free operators need a static {} problem on a conforming Q1 to Q3 hexahedral mesh, assembling the matrix", formulation());
+	}
+
 	// if(problem->is_mixed())
 	if (assembler.is_mixed(formulation()))
 	{
 		if (assembler.is_linear(formulation()))
 		{
 			StiffnessMatrix velocity_stiffness, mixed_stiffness, pressure_stiffness;
-			assembler.assemble_problem(formulation(), mesh->is_volume(), n_bases, bases, iso_parametric() ? bases : geom_bases, velocity_stiffness);
-			assembler.assemble_mixed_problem(formulation(), mesh->is_volume(), n_pressure_bases, n_bases, pressure_bases, bases, iso_parametric() ? bases : geom_bases, mixed_stiffness);
-			assembler.assemble_pressure_problem(formulation(), mesh->is_volume(), n_pressure_bases, pressure_bases, iso_parametric() ? bases : geom_bases, pressure_stiffness);
+			assembler.assemble_problem(formulation(), mesh->is_volume(), n_bases, bases, iso_parametric() ? bases : geom_bases, velocity_stiffness, nullptr, &dof_map, &colorings, element_matrices);
+			assembler.assemble_mixed_problem(formulation(), mesh->is_volume(), n_pressure_bases, n_bases, pressure_bases, bases, iso_parametric() ? bases : geom_bases, mixed_stiffness, &pressure_dof_map, &dof_map, &colorings);
+			assembler.assemble_pressure_problem(formulation(), mesh->is_volume(), n_pressure_bases, pressure_bases, iso_parametric() ? bases : geom_bases, pressure_stiffness, &pressure_dof_map, &colorings);
 
 			const int problem_dim = problem->is_scalar() ? 1 : mesh->dimension();
 
@@ -2564,7 +3149,7 @@ void State::assemble_stiffness_mat()
 			if (problem->is_time_dependent())
 			{
 				StiffnessMatrix velocity_mass;
-				assembler.assemble_mass_matrix(formulation(), mesh->is_volume(), n_bases, bases, iso_parametric() ? bases : geom_bases, velocity_mass);
+				assembler.assemble_mass_matrix(formulation(), mesh->is_volume(), n_bases, bases, iso_parametric() ? bases : geom_bases, velocity_mass, &dof_map);
 
 				std::vector<Eigen::Triplet<double>> mass_blocks;
 				mass_blocks.reserve(velocity_mass.nonZeros());
@@ -2585,21 +3170,31 @@ void State::assemble_stiffness_mat()
 	}
 	else
 	{
-		assembler.assemble_problem(formulation(), mesh->is_volume(), n_bases, bases, iso_parametric() ? bases : geom_bases, stiffness);
+		if (args["static_condensation"] && assembler.is_linear(formulation()) && !problem->is_time_dependent())
+		{
+			static_condensation = std::make_shared<StaticCondensation>();
+			const int problem_dim = problem->is_scalar() ? 1 : mesh->dimension();
+			const int n_condensed = static_condensation->build(bases, n_bases, problem_dim, boundary_nodes);
+			logger().info("static condensation of {}/{} dofs", n_condensed, n_bases * problem_dim);
+			if (n_condensed <= 0)
+				static_condensation.reset();
+		}
+
+		assembler.assemble_problem(formulation(), mesh->is_volume(), n_bases, bases, iso_parametric() ? bases : geom_bases, stiffness, static_condensation.get(), &dof_map, &colorings, element_matrices);
 		if (problem->is_time_dependent())
 		{
-			assembler.assemble_mass_matrix(formulation(), mesh->is_volume(), n_bases, bases, iso_parametric() ? bases : geom_bases, mass);
+			assembler.assemble_mass_matrix(formulation(), mesh->is_volume(), n_bases, bases, iso_parametric() ? bases : geom_bases, mass, &dof_map);
 		}
 	}
 
-	timer.stop();
-	assembling_stiffness_mat_time = timer.getElapsedTime();
+	assembling_stiffness_mat_time = zone.stop();
 	logger().info(" took {}s", assembling_stiffness_mat_time);
 
 	nn_zero = stiffness.nonZeros();
 	num_dofs = stiffness.rows();
 	mat_size = (long long)stiffness.rows() * (long long)stiffness.cols();
 	logger().info("sparsity: {}/{}", nn_zero, mat_size);
+	update_memory_usage();
 }
 
 void State::assemble_rhs()
@@ -2615,7 +3210,6 @@ void State::assemble_rhs()
 		return;
 	}
 
-	igl::Timer timer;
 	const std::string rhs_path = args["rhs_path"];
 
 	auto p_params = args["problem_params"];
@@ -2640,7 +3234,8 @@ void State::assemble_rhs()
 	sol.resize(0, 0);
 	pressure.resize(0, 0);
 
-	timer.start();
+	ScopedZone zone("assemble_rhs");
+	ScopedMemoryPhase memory_phase("assemble_rhs");
 	logger().info("Assigning rhs...");
 
 	const int size = problem->is_scalar() ? 1 : mesh->dimension();
@@ -2656,7 +3251,7 @@ void State::assemble_rhs()
 			read_matrix(args["rhs_path"], rhs);
 
 		StiffnessMatrix tmp_mass;
-		assembler.assemble_mass_matrix(formulation(), mesh->is_volume(), n_bases, bases, iso_parametric() ? bases : geom_bases, tmp_mass);
+		assembler.assemble_mass_matrix(formulation(), mesh->is_volume(), n_bases, bases, iso_parametric() ? bases : geom_bases, tmp_mass, &dof_map);
 		rhs = tmp_mass * rhs;
 		logger().debug("done!");
 	}
@@ -2692,8 +3287,7 @@ void State::assemble_rhs()
 		}
 	}
 
-	timer.stop();
-	assigning_rhs_time = timer.getElapsedTime();
+	assigning_rhs_time = zone.stop();
 	logger().info(" took {}s", assigning_rhs_time);
 }
 
@@ -2712,7 +3306,7 @@ void State::solve_problem()
 
 	const auto &assembler = AssemblerUtils::instance();
 
-	if (assembler.is_linear(formulation()) && stiffness.rows() <= 0)
+	if (assembler.is_linear(formulation()) && stiffness.rows() <= 0 && !matrix_free_operator)
 	{
 		logger().error("Assemble the stiffness matrix first!");
 		return;
@@ -2727,8 +3321,8 @@ void State::solve_problem()
 	pressure.resize(0, 0);
 	spectrum.setZero();
 
-	igl::Timer timer;
-	timer.start();
+	ScopedZone zone("solve_problem");
+	ScopedMemoryPhase memory_phase("solve_problem");
 	logger().info("Solving {} with", formulation());
 
 	const json &params = solver_params();
@@ -2744,7 +3338,6 @@ void State::solve_problem()
 
 		const double tend = args["tend"];
 		const int time_steps = args["time_steps"];
-		const double dt = tend / time_steps;
 
 		const auto &gbases = iso_parametric() ? bases : geom_bases;
 		RhsAssembler rhs_assembler(*mesh, n_bases, problem->is_scalar() ? 1 : mesh->dimension(), bases, gbases, formulation(), *problem);
@@ -2755,7 +3348,7 @@ void State::solve_problem()
 		if (formulation() == "NavierStokes")
 		{
 			StiffnessMatrix velocity_mass;
-			assembler.assemble_mass_matrix(formulation(), mesh->is_volume(), n_bases, bases, gbases, velocity_mass);
+			assembler.assemble_mass_matrix(formulation(), mesh->is_volume(), n_bases, bases, gbases, velocity_mass, &dof_map);
 
 			StiffnessMatrix velocity_stiffness, mixed_stiffness, pressure_stiffness;
 
@@ -2771,7 +3364,7 @@ void State::solve_problem()
 			int BDF_order = args["BDF_order"];
 			// int aux_steps = BDF_order-1;
 			BDF bdf(BDF_order);
-			bdf.new_solution(c_sol);
+			bdf.new_solution(c_sol, 0);
 
 			sol = c_sol;
 			sol_to_pressure();
@@ -2782,21 +3375,32 @@ void State::solve_problem()
 				save_wire("step_" + std::to_string(0) + ".obj");
 			}
 
-			assembler.assemble_problem(formulation(), mesh->is_volume(), n_bases, bases, gbases, velocity_stiffness);
-			assembler.assemble_mixed_problem(formulation(), mesh->is_volume(), n_pressure_bases, n_bases, pressure_bases, bases, gbases, mixed_stiffness);
-			assembler.assemble_pressure_problem(formulation(), mesh->is_volume(), n_pressure_bases, pressure_bases, gbases, pressure_stiffness);
+			assembler.assemble_problem(formulation(), mesh->is_volume(), n_bases, bases, gbases, velocity_stiffness, nullptr, &dof_map, &colorings);
+			assembler.assemble_mixed_problem(formulation(), mesh->is_volume(), n_pressure_bases, n_bases, pressure_bases, bases, gbases, mixed_stiffness, &pressure_dof_map, &dof_map, &colorings);
+			assembler.assemble_pressure_problem(formulation(), mesh->is_volume(), n_pressure_bases, pressure_bases, gbases, pressure_stiffness, &pressure_dof_map, &colorings);
 
 			TransientNavierStokesSolver ns_solver(solver_params(), build_json_params(), solver_type(), precond_type());
+			SolutionPredictor predictor(args["predictor"], solver_type(), precond_type(), solver_params());
+			ns_solver.set_stokes_skip_tol(predictor.stokes_skip_tol());
+			predictor.new_solution(c_sol, 0);
+			json ns_info;
 			const int n_larger = n_pressure_bases + (use_avg_pressure ? 1 : 0);
+			const int n_velocity = n_bases * mesh->dimension();
 
-			for (int t = 1; t <= time_steps; ++t)
+			TimeStepController controller(args["time_adaptivity"], tend, time_steps);
+			while (!controller.finished())
 			{
-				double time = t * dt;
-				double current_dt = dt;
+				ScopedZone step_zone("time_step");
+				const int t = controller.step() + 1;
+				const double time = controller.next_time();
+				const double current_dt = controller.dt();
 
 				logger().info("{}/{} steps, dt={}s t={}s", t, time_steps, current_dt, time);
 
-				bdf.rhs(prev_sol);
+				if (controller.is_adaptive())
+					bdf.rhs(current_dt, prev_sol);
+				else
+					bdf.rhs(prev_sol);
 				rhs_assembler.compute_energy_grad(local_boundary, boundary_nodes, args["n_boundary_samples"], local_neumann_boundary, rhs, time, current_rhs);
 				rhs_assembler.set_bc(local_boundary, boundary_nodes, args["n_boundary_samples"], local_neumann_boundary, current_rhs, time);
 
@@ -2807,10 +3411,21 @@ void State::solve_problem()
 					current_rhs.block(prev_size, 0, n_larger, current_rhs.cols()).setZero();
 				}
 
-				ns_solver.minimize(*this, bdf.alpha(), current_dt, prev_sol,
+				if (predictor.type() == SolutionPredictor::Type::Extrapolation)
+					predictor.extrapolate(time, c_sol);
+
+				ns_solver.minimize(*this, controller.is_adaptive() ? bdf.alpha(current_dt) : bdf.alpha(), current_dt, prev_sol,
 								   velocity_stiffness, mixed_stiffness, pressure_stiffness,
 								   velocity_mass, current_rhs, c_sol);
-				bdf.new_solution(c_sol);
+
+				//the pressure is not a differential variable, the error is measured on the velocity only
+				if (!controller.check_bdf_step(bdf, BDF_order, current_dt, n_velocity, c_sol))
+					continue;
+
+				bdf.new_solution(c_sol, time);
+				predictor.new_solution(c_sol, time);
+				ns_solver.getInfo(ns_info);
+				predictor.add_step(ns_info["iterations"]);
 				sol = c_sol;
 				sol_to_pressure();
 
@@ -2822,6 +3437,9 @@ void State::solve_problem()
 					save_wire("step_" + std::to_string(t) + ".obj");
 				}
 			}
+
+			controller.save_info(solver_info["time_stepping"]);
+			predictor.save_info(solver_info["predictor"]);
 		}
 		else //if (formulation() != "NavierStokes")
 		{
@@ -2831,7 +3449,7 @@ void State::solve_problem()
 				pressure.setZero();
 			}
 
-			auto solver = LinearSolver::create(args["solver_type"], args["precond_type"]);
+			auto solver = create_linear_solver();
 			solver->setParameters(params);
 			logger().info("{}...", solver->name());
 
@@ -2863,15 +3481,20 @@ void State::solve_problem()
 				// const int aux_steps = BDF_order-1;
 				BDF bdf(BDF_order);
 				x = sol;
-				bdf.new_solution(x);
+				bdf.new_solution(x, 0);
 
 				const int problem_dim = problem->is_scalar() ? 1 : mesh->dimension();
 				const int precond_num = problem_dim * n_bases;
 
-				for (int t = 1; t <= time_steps; ++t)
+				auto saddle_point_solver = SaddlePointSolver::create(*this);
+
+				TimeStepController controller(args["time_adaptivity"], tend, time_steps);
+				while (!controller.finished())
 				{
-					double time = t * dt;
-					double current_dt = dt;
+					ScopedZone step_zone("time_step");
+					const int t = controller.step() + 1;
+					const double time = controller.next_time();
+					const double current_dt = controller.dt();
 
 					logger().info("{}/{} {}s", t, time_steps, time);
 					rhs_assembler.compute_energy_grad(local_boundary, boundary_nodes, args["n_boundary_samples"], local_neumann_boundary, rhs, time, current_rhs);
@@ -2885,15 +3508,32 @@ void State::solve_problem()
 						current_rhs.block(current_rhs.rows() - n_pressure_bases - use_avg_pressure, 0, n_pressure_bases + use_avg_pressure, current_rhs.cols()).setZero();
 					}
 
-					A = (bdf.alpha() / current_dt) * mass + stiffness;
-					bdf.rhs(x);
+					if (controller.is_adaptive())
+					{
+						A = (bdf.alpha(current_dt) / current_dt) * mass + stiffness;
+						bdf.rhs(current_dt, x);
+					}
+					else
+					{
+						A = (bdf.alpha() / current_dt) * mass + stiffness;
+						bdf.rhs(x);
+					}
+					if (saddle_point_solver)
+						saddle_point_solver->set_mass_coefficient((controller.is_adaptive() ? bdf.alpha(current_dt) : bdf.alpha()) / current_dt);
 					b = (mass * x) / current_dt;
 					for (int i : boundary_nodes)
 						b[i] = 0;
 					b += current_rhs;
 
-					spectrum = dirichlet_solve(*solver, A, b, boundary_nodes, x, precond_num, args["export"]["stiffness_mat"], t == time_steps && args["export"]["spectrum"]);
-					bdf.new_solution(x);
+					if (saddle_point_solver)
+						saddle_point_solver->solve(A, precond_num, n_pressure_bases, true, b, boundary_nodes, x);
+					else
+						spectrum = dirichlet_solve(*solver, A, b, boundary_nodes, x, precond_num, args["export"]["stiffness_mat"], t == time_steps && args["export"]["spectrum"]);
+
+					if (!controller.check_bdf_step(bdf, BDF_order, current_dt, precond_num, x))
+						continue;
+
+					bdf.new_solution(x, time);
 					sol = x;
 
 					if (assembler.is_mixed(formulation()))
@@ -2910,6 +3550,8 @@ void State::solve_problem()
 						save_wire("step_" + std::to_string(t) + ".obj");
 					}
 				}
+
+				controller.save_info(solver_info["time_stepping"]);
 			}
 			else //tensor time dependent
 			{
@@ -2931,9 +3573,14 @@ void State::solve_problem()
 					StiffnessMatrix A;
 					Eigen::VectorXd x, btmp;
 
-					for (int t = 1; t <= time_steps; ++t)
+					TimeStepController controller(args["time_adaptivity"], tend, time_steps);
+					while (!controller.finished())
 					{
-						const double dt2 = dt * dt;
+						ScopedZone step_zone("time_step");
+						const int t = controller.step() + 1;
+						const double time = controller.next_time();
+						const double current_dt = controller.dt();
+						const double dt2 = current_dt * current_dt;
 
 						const Eigen::MatrixXd aOld = acceleration;
 						const Eigen::MatrixXd vOld = velocity;
@@ -2941,36 +3588,44 @@ void State::solve_problem()
 
 						if (!problem->is_linear_in_time())
 						{
-							rhs_assembler.assemble(current_rhs, dt * t);
+							rhs_assembler.assemble(current_rhs, time);
 							current_rhs *= -1;
 						}
-						temp = -(uOld + dt * vOld + ((1 / 2. - beta) * dt2) * aOld);
+						temp = -(uOld + current_dt * vOld + ((1 / 2. - beta) * dt2) * aOld);
 						b = stiffness * temp + current_rhs;
 
-						rhs_assembler.set_acceleration_bc(local_boundary, boundary_nodes, args["n_boundary_samples"], local_neumann_boundary, b, dt * t);
+						rhs_assembler.set_acceleration_bc(local_boundary, boundary_nodes, args["n_boundary_samples"], local_neumann_boundary, b, time);
 
 						A = stiffness * beta * dt2 + mass;
 						btmp = b;
 						spectrum = dirichlet_solve(*solver, A, btmp, boundary_nodes, x, precond_num, args["export"]["stiffness_mat"], t == 1 && args["export"]["spectrum"]);
+
+						//Zienkiewicz-Xie estimate of the local error in the displacement
+						const double err = controller.is_adaptive() ? controller.error_norm(((beta - 1. / 6.) * dt2) * (x - aOld), uOld) : 0;
+						if (!controller.check_step(err, 2))
+							continue;
+
 						acceleration = x;
 
-						sol += dt * vOld + dt2 * ((1 / 2.0 - beta) * aOld + beta * acceleration);
-						velocity += dt * ((1 - gamma) * aOld + gamma * acceleration);
+						sol += current_dt * vOld + dt2 * ((1 / 2.0 - beta) * aOld + beta * acceleration);
+						velocity += current_dt * ((1 - gamma) * aOld + gamma * acceleration);
 
-						rhs_assembler.set_bc(local_boundary, boundary_nodes, args["n_boundary_samples"], local_neumann_boundary, sol, dt * t);
-						rhs_assembler.set_velocity_bc(local_boundary, boundary_nodes, args["n_boundary_samples"], local_neumann_boundary, velocity, dt * t);
-						rhs_assembler.set_acceleration_bc(local_boundary, boundary_nodes, args["n_boundary_samples"], local_neumann_boundary, acceleration, dt * t);
+						rhs_assembler.set_bc(local_boundary, boundary_nodes, args["n_boundary_samples"], local_neumann_boundary, sol, time);
+						rhs_assembler.set_velocity_bc(local_boundary, boundary_nodes, args["n_boundary_samples"], local_neumann_boundary, velocity, time);
+						rhs_assembler.set_acceleration_bc(local_boundary, boundary_nodes, args["n_boundary_samples"], local_neumann_boundary, acceleration, time);
 
 						if (args["save_time_sequence"])
 						{
 							if (!solve_export_to_file)
 								solution_frames.emplace_back();
-							save_vtu("step_" + std::to_string(t) + ".vtu", dt * t);
+							save_vtu("step_" + std::to_string(t) + ".vtu", time);
 							save_wire("step_" + std::to_string(t) + ".obj");
 						}
 
 						logger().info("{}/{}", t, time_steps);
 					}
+
+					controller.save_info(solver_info["time_stepping"]);
 				}
 				else //if (!assembler.is_linear(formulation()))
 				{
@@ -3040,32 +3695,78 @@ void State::solve_problem()
 					const int reduced_size = n_bases * mesh->dimension() - boundary_nodes.size();
 					VectorXd tmp_sol;
 
+					TimeStepController controller(args["time_adaptivity"], tend, time_steps);
+
 					NLProblem nl_problem(*this, rhs_assembler, 0);
-					nl_problem.init_timestep(sol, velocity, dt);
+					nl_problem.init_timestep(sol, velocity, controller.dt());
 					nl_problem.full_to_reduced(sol, tmp_sol);
 
-					for (int t = 1; t <= time_steps; ++t)
+					SolutionPredictor predictor(args["predictor"], solver_type(), precond_type(), solver_params());
+					predictor.new_solution(sol, 0);
+
+					while (!controller.finished())
 					{
+						ScopedZone step_zone("time_step");
+						const int t = controller.step() + 1;
+						const double time = controller.next_time();
+						nl_problem.set_dt(controller.dt());
+
+						//starting point of the step, restored if the step is rejected
+						const VectorXd prev_tmp_sol = tmp_sol;
+
+						if (predictor.type() == SolutionPredictor::Type::Extrapolation)
+						{
+							VectorXd guess;
+							if (predictor.extrapolate(time, guess))
+								nl_problem.full_to_reduced(guess, tmp_sol);
+						}
+
 						cppoptlib::SparseNewtonDescentSolver<NLProblem> nlsolver(solver_params(), solver_type(), precond_type());
+						if (multigrid)
+							nlsolver.set_linear_solver_factory([this]() { return create_linear_solver(); });
 						nlsolver.setLineSearch(args["line_search"]);
 						nlsolver.minimize(nl_problem, tmp_sol);
 
 						if (nlsolver.error_code() == -10)
 						{
-							logger().error("Unable to solve t={}", t*dt);
+							tmp_sol = prev_tmp_sol;
+							if (controller.step_failed())
+								continue;
+
+							logger().error("Unable to solve t={}", time);
 							break;
 						}
 
+						Eigen::MatrixXd full;
+						nl_problem.reduced_to_full(tmp_sol, full);
+
+						if (controller.is_adaptive())
+						{
+							//the local error of backward Euler is half the distance from the explicit prediction
+							VectorXd pred;
+							nl_problem.predicted_solution(pred);
+							const double err = controller.error_norm(0.5 * (full - pred), full);
+							if (!controller.check_step(err, 1))
+							{
+								tmp_sol = prev_tmp_sol;
+								continue;
+							}
+						}
+						else
+							controller.check_step(0, 1);
+
 						nlsolver.getInfo(solver_info);
-						nl_problem.reduced_to_full(tmp_sol, sol);
+						predictor.add_step(solver_info["iterations"]);
+						sol = full;
 						if (assembler.is_mixed(formulation()))
 						{
 							sol_to_pressure();
 						}
 
-						rhs_assembler.set_bc(local_boundary, boundary_nodes, args["n_boundary_samples"], local_neumann_boundary, sol, dt * t);
+						rhs_assembler.set_bc(local_boundary, boundary_nodes, args["n_boundary_samples"], local_neumann_boundary, sol, time);
 
-						nl_problem.update_quantities(t*dt, sol);
+						nl_problem.update_quantities(time, sol);
+						predictor.new_solution(sol, time);
 
 
 
@@ -3073,21 +3774,35 @@ void State::solve_problem()
 						{
 							if (!solve_export_to_file)
 								solution_frames.emplace_back();
-							save_vtu("step_" + std::to_string(t) + ".vtu", dt * t);
+							save_vtu("step_" + std::to_string(t) + ".vtu", time);
 							save_wire("step_" + std::to_string(t) + ".obj");
 						}
 
 						logger().info("{}/{}", t, time_steps);
 					}
+
+					controller.save_info(solver_info["time_stepping"]);
+					predictor.save_info(solver_info["predictor"]);
 				}
 			}
 		}
 	}
 	else //if(!problem->is_time_dependent())
 	{
-		if (assembler.is_linear(formulation()))
+		if (assembler.is_linear(formulation()) && matrix_free_operator)
 		{
-			auto solver = LinearSolver::create(args["solver_type"], args["precond_type"]);
+			MatrixFreeSolver solver(args["matrix_free"]);
+			logger().info("matrix-free {}...", std::string(args["matrix_free"]["solver"]));
+
+			Eigen::VectorXd x;
+			const Eigen::VectorXd b = rhs;
+			solver.solve(*matrix_free_operator, b, boundary_nodes, x);
+			solver.getInfo(solver_info);
+			sol = x;
+		}
+		else if (assembler.is_linear(formulation()))
+		{
+			auto solver = create_linear_solver();
 			solver->setParameters(params);
 			StiffnessMatrix A;
 			Eigen::VectorXd b;
@@ -3099,11 +3814,44 @@ void State::solve_problem()
 			A = stiffness;
 			Eigen::VectorXd x;
 			b = rhs;
-			spectrum = dirichlet_solve(*solver, A, b, boundary_nodes, x, precond_num, args["export"]["stiffness_mat"], args["export"]["spectrum"]);
-			sol = x;
-			solver->getInfo(solver_info);
+			auto saddle_point_solver = SaddlePointSolver::create(*this);
+			if (saddle_point_solver)
+			{
+				saddle_point_solver->solve(A, precond_num, n_pressure_bases, true, b, boundary_nodes, x);
+				saddle_point_solver->getInfo(solver_info);
+			}
+			else if (static_condensation)
+			{
+				//skeleton system only, the condensed dofs are recovered element by element
+				std::vector<int> skeleton_boundary_nodes;
+				static_condensation->condense_rhs(rhs, b);
+				static_condensation->condense_boundary_nodes(boundary_nodes, skeleton_boundary_nodes);
+
+				ScopedMemoryPhase solve_phase("linear_solve");
+				spectrum = dirichlet_solve(*solver, A, b, skeleton_boundary_nodes, x, A.rows(), args["export"]["stiffness_mat"], args["export"]["spectrum"]);
+				MemoryTracker::instance().set_bytes("factorization", std::max(0l, solve_phase.stop()));
+				solver->getInfo(solver_info);
+				solver_info["skeleton_dofs"] = static_condensation->n_skeleton_dofs();
+				solver_info["condensed_dofs"] = static_condensation->n_condensed_dofs();
+			}
+			else
+			{
+				ScopedMemoryPhase solve_phase("linear_solve");
+				spectrum = dirichlet_solve(*solver, A, b, boundary_nodes, x, precond_num, args["export"]["stiffness_mat"], args["export"]["spectrum"]);
+				//the factors are alive until the solver is destroyed, the RSS growth estimates their size
+				MemoryTracker::instance().set_bytes("factorization", std::max(0l, solve_phase.stop()));
+				solver->getInfo(solver_info);
+			}
 
-			logger().debug("Solver error: {}", (A * sol - b).norm());
+			logger().debug("Solver error: {}", (A * x - b).norm());
+
+			if (static_condensation)
+			{
+				Eigen::VectorXd full;
+				static_condensation->recover(x, rhs, full);
+				x = full;
+			}
+			sol = x;
 
 			if (assembler.is_mixed(formulation()))
 			{
@@ -3143,7 +3891,7 @@ void State::solve_problem()
 				RhsAssembler rhs_assembler(*mesh, n_bases, mesh->dimension(), bases, iso_parametric() ? bases : geom_bases, formulation(), *problem);
 
 				StiffnessMatrix nlstiffness;
-				auto solver = LinearSolver::create(args["solver_type"], args["precond_type"]);
+				auto solver = create_linear_solver();
 				Eigen::VectorXd x, b;
 				Eigen::MatrixXd grad;
 				Eigen::MatrixXd prev_rhs;
@@ -3157,6 +3905,9 @@ void State::solve_problem()
 				sol.resizeLike(rhs);
 				sol.setZero();
 
+				SolutionPredictor predictor(args["predictor"], solver_type(), precond_type(), solver_params());
+				predictor.new_solution(sol, 0);
+
 				prev_rhs.resizeLike(rhs);
 				prev_rhs.setZero();
 
@@ -3175,9 +3926,9 @@ void State::solve_problem()
 				}
 
 				const auto &gbases = iso_parametric() ? bases : geom_bases;
-				igl::Timer update_timer;
 				while (t <= 1)
 				{
+					ScopedZone step_zone("load_step");
 					if (step_t < 1e-10)
 					{
 						logger().error("Step too small, giving up");
@@ -3189,21 +3940,39 @@ void State::solve_problem()
 					NLProblem nl_problem(*this, rhs_assembler, t);
 
 					logger().debug("Updating starting point...");
-					update_timer.start();
+					ScopedZone update_zone("update_starting_point");
+					if (predictor.type() == SolutionPredictor::Type::Previous)
+					{
+						x = sol;
+						nl_problem.full_to_reduced(x, tmp_sol);
+					}
+					else if (predictor.type() == SolutionPredictor::Type::Extrapolation && predictor.extrapolate(t, x))
 					{
-						nl_problem.hessian_full(sol, nlstiffness);
+						nl_problem.full_to_reduced(x, tmp_sol);
+					}
+					else
+					{
+						if (predictor.needs_factorization())
+							nl_problem.hessian_full(sol, nlstiffness);
 						nl_problem.gradient_no_rhs(sol, grad);
 
 						b = grad;
 						for (int bId : boundary_nodes)
 							b(bId) = -(nl_problem.current_rhs()(bId) - prev_rhs(bId));
-						dirichlet_solve(*solver, nlstiffness, b, boundary_nodes, x, precond_num, args["export"]["stiffness_mat"], args["export"]["spectrum"]);
+						if (predictor.reuse_factorization())
+						{
+							//the tangent of an earlier step is kept until a step fails
+							if (predictor.needs_factorization())
+								predictor.factorize(nlstiffness, boundary_nodes, precond_num);
+							predictor.solve(b, x);
+						}
+						else
+							dirichlet_solve(*solver, nlstiffness, b, boundary_nodes, x, precond_num, args["export"]["stiffness_mat"], args["export"]["spectrum"]);
 						// logger().debug("Solver error: {}", (nlstiffness * sol - b).norm());
 						x = sol - x;
 						nl_problem.full_to_reduced(x, tmp_sol);
 					}
-					update_timer.stop();
-					logger().debug("done!, took {}s", update_timer.getElapsedTime());
+					logger().debug("done!, took {}s", update_zone.stop());
 
 					if (args["save_solve_sequence_debug"])
 					{
@@ -3232,6 +4001,7 @@ void State::solve_problem()
 
 					if (has_nan)
 					{
+						predictor.invalidate_factorization();
 						do
 						{
 							step_t /= 2;
@@ -3243,11 +4013,14 @@ void State::solve_problem()
 					if (args["nl_solver"] == "newton")
 					{
 						cppoptlib::SparseNewtonDescentSolver<NLProblem> nlsolver(solver_params(), solver_type(), precond_type());
+						if (multigrid)
+							nlsolver.set_linear_solver_factory([this]() { return create_linear_solver(); });
 						nlsolver.setLineSearch(args["line_search"]);
 						nlsolver.minimize(nl_problem, tmp_sol);
 
 						if (nlsolver.error_code() == -10) //Nan
 						{
+							predictor.invalidate_factorization();
 							do
 							{
 								step_t /= 2;
@@ -3265,6 +4038,7 @@ void State::solve_problem()
 							step_t = 1.0 / steps;
 
 						nlsolver.getInfo(solver_info);
+						predictor.add_step(solver_info["iterations"]);
 					}
 					else if (args["nl_solver"] == "lbfgs")
 					{
@@ -3274,6 +4048,7 @@ void State::solve_problem()
 						nlsolver.minimize(nl_problem, tmp_sol);
 
 						prev_t = t;
+						predictor.add_step(nlsolver.criteria().iterations);
 					}
 					else
 					{
@@ -3285,6 +4060,7 @@ void State::solve_problem()
 						t = 1;
 
 					nl_problem.reduced_to_full(tmp_sol, sol);
+					predictor.new_solution(sol, prev_t);
 
 					// std::ofstream of("sol.txt");
 					// of<<sol<<std::endl;
@@ -3299,6 +4075,8 @@ void State::solve_problem()
 					}
 				}
 
+				predictor.save_info(solver_info["predictor"]);
+
 				if (assembler.is_mixed(formulation()))
 				{
 					sol_to_pressure();
@@ -3364,9 +4142,9 @@ void State::solve_problem()
 		}
 	}
 
-	timer.stop();
-	solving_time = timer.getElapsedTime();
+	solving_time = zone.stop();
 	logger().info(" took {}s", solving_time);
+	update_memory_usage();
 }
 
 void State::compute_errors()
@@ -3397,122 +4175,106 @@ void State::compute_errors()
 	if (!problem->is_scalar())
 		actual_dim = mesh->dimension();
 
-	igl::Timer timer;
-	timer.start();
+	ScopedZone zone("compute_errors");
+	ScopedMemoryPhase memory_phase("compute_errors");
 	logger().info("Computing errors...");
 	using std::max;
 
 	const int n_el = int(bases.size());
-
-	MatrixXd v_exact, v_approx;
-	MatrixXd v_exact_grad(0, 0), v_approx_grad;
-
-	l2_err = 0;
-	h1_err = 0;
-	grad_max_err = 0;
-	h1_semi_err = 0;
-	linf_err = 0;
-	lp_err = 0;
-	// double pred_norm = 0;
+	const int dim = mesh->dimension();
+	const bool is_volume = mesh->is_volume();
+	const bool has_exact = problem->has_exact_sol();
+	const auto &gbases = iso_parametric() ? bases : geom_bases;
 
 	static const int p = 8;
 
-	// Eigen::MatrixXd err_per_el(n_el, 5);
-	ElementAssemblyValues vals;
-
 	const double tend = args["tend"];
 
-	for (int e = 0; e < n_el; ++e)
-	{
-		// const auto &vals    = values[e];
-		// const auto &gvalues = iso_parametric() ? values[e] : geom_values[e];
+	//without exact solution the indicator is the superconvergent patch recovery error, this also updates the exported recovery errors
+	Eigen::MatrixXd recovered;
+	recover_stresses(sol, recovered, stress_recovery_errors);
+	const bool has_recovery = stress_recovery_errors.size() == n_el;
 
-		if (iso_parametric())
-			vals.compute(e, mesh->is_volume(), bases[e], bases[e]);
-		else
-			vals.compute(e, mesh->is_volume(), bases[e], geom_bases[e]);
+	//the expressions of the json exact solutions share their variables and are not thread safe,
+	//so the exact solution is evaluated serially at the quadrature points before the parallel loop
+	std::vector<Eigen::MatrixXd> exact_vals, exact_grads;
+	if (has_exact)
+	{
+		exact_vals.resize(n_el);
+		exact_grads.resize(n_el);
 
-		if (problem->has_exact_sol())
+		Quadrature quadrature;
+		Eigen::MatrixXd mapped;
+		for (int e = 0; e < n_el; ++e)
 		{
-			problem->exact(vals.val, tend, v_exact);
-			problem->exact_grad(vals.val, tend, v_exact_grad);
+			bases[e].compute_quadrature(quadrature);
+			gbases[e].eval_geom_mapping(quadrature.points, mapped);
+
+			problem->exact(mapped, tend, exact_vals[e]);
+			problem->exact_grad(mapped, tend, exact_grads[e]);
 		}
+	}
 
-		v_approx.resize(vals.val.rows(), actual_dim);
-		v_approx.setZero();
+	//columns: L2, H1 semi-norm, Linf, indicator
+	element_errors.resize(n_el, 4);
 
-		v_approx_grad.resize(vals.val.rows(), mesh->dimension() * actual_dim);
-		v_approx_grad.setZero();
+	const auto compute_element_error = [&](const int e, LocalThreadErrorStorage &storage) {
+		ElementAssemblyValues &vals = storage.vals;
+		vals.compute(e, is_volume, bases[e], gbases[e]);
 
-		const int n_loc_bases = int(vals.basis_values.size());
+		interpolate_at_quadrature(vals, sol, actual_dim, dim, storage.v_approx, storage.v_approx_grad);
 
-		for (int i = 0; i < n_loc_bases; ++i)
-		{
-			auto val = vals.basis_values[i];
+		const Eigen::VectorXd err = has_exact ? (exact_vals[e] - storage.v_approx).rowwise().norm().eval() : storage.v_approx.rowwise().norm().eval();
+		const Eigen::VectorXd err_grad = has_exact ? (exact_grads[e] - storage.v_approx_grad).rowwise().norm().eval() : storage.v_approx_grad.rowwise().norm().eval();
+		const Eigen::VectorXd da = vals.det.array() * vals.quadrature.weights.array();
 
-			for (size_t ii = 0; ii < val.global.size(); ++ii)
-			{
-				for (int d = 0; d < actual_dim; ++d)
-				{
-					v_approx.col(d) += val.global[ii].val * sol(val.global[ii].index * actual_dim + d) * val.val;
-					v_approx_grad.block(0, d * val.grad_t_m.cols(), v_approx_grad.rows(), val.grad_t_m.cols()) += val.global[ii].val * sol(val.global[ii].index * actual_dim + d) * val.grad_t_m;
-				}
-			}
-		}
+		const double el_l2 = (err.array() * err.array() * da.array()).sum();
+		const double el_h1 = (err_grad.array() * err_grad.array() * da.array()).sum();
 
-		const auto err = problem->has_exact_sol() ? (v_exact - v_approx).eval().rowwise().norm().eval() : (v_approx).eval().rowwise().norm().eval();
-		const auto err_grad = problem->has_exact_sol() ? (v_exact_grad - v_approx_grad).eval().rowwise().norm().eval() : (v_approx_grad).eval().rowwise().norm().eval();
-
-		// for(long i = 0; i < err.size(); ++i)
-		// errors.push_back(err(i));
-
-		linf_err = max(linf_err, err.maxCoeff());
-		grad_max_err = max(linf_err, err_grad.maxCoeff());
-
-		// {
-		// 	const auto &mesh3d = *dynamic_cast<Mesh3D *>(mesh.get());
-		// 	const auto v0 = mesh3d.point(mesh3d.cell_vertex(e, 0));
-		// 	const auto v1 = mesh3d.point(mesh3d.cell_vertex(e, 1));
-		// 	const auto v2 = mesh3d.point(mesh3d.cell_vertex(e, 2));
-		// 	const auto v3 = mesh3d.point(mesh3d.cell_vertex(e, 3));
-
-		// 	Eigen::Matrix<double, 6, 3> ee;
-		// 	ee.row(0) = v0 - v1;
-		// 	ee.row(1) = v1 - v2;
-		// 	ee.row(2) = v2 - v0;
-
-		// 	ee.row(3) = v0 - v3;
-		// 	ee.row(4) = v1 - v3;
-		// 	ee.row(5) = v2 - v3;
-
-		// 	Eigen::Matrix<double, 6, 1> en = ee.rowwise().norm();
-
-		// 	// Eigen::Matrix<double, 3*4, 1> alpha;
-		// 	// alpha(0) = angle3(e.row(0), -e.row(1));	 	alpha(1) = angle3(e.row(1), -e.row(2));	 	alpha(2) = angle3(e.row(2), -e.row(0));
-		// 	// alpha(3) = angle3(e.row(0), -e.row(4));	 	alpha(4) = angle3(e.row(4), e.row(3));	 	alpha(5) = angle3(-e.row(3), -e.row(0));
-		// 	// alpha(6) = angle3(-e.row(4), -e.row(1));	alpha(7) = angle3(e.row(1), -e.row(5));	 	alpha(8) = angle3(e.row(5), e.row(4));
-		// 	// alpha(9) = angle3(-e.row(2), -e.row(5));	alpha(10) = angle3(e.row(5), e.row(3));		alpha(11) = angle3(-e.row(3), e.row(2));
-
-		// 	const double S = (ee.row(0).cross(ee.row(1)).norm() + ee.row(0).cross(ee.row(4)).norm() + ee.row(4).cross(ee.row(1)).norm() + ee.row(2).cross(ee.row(5)).norm()) / 2;
-		// 	const double V = std::abs(ee.row(3).dot(ee.row(2).cross(-ee.row(0))))/6;
-		// 	const double rho = 3 * V / S;
-		// 	const double hp = en.maxCoeff();
-		// 	const int pp = disc_orders(e);
-		// 	const int p_ref = args["discr_order"];
-
-		// 	err_per_el(e, 0) = err.mean();
-		// 	err_per_el(e, 1) = err.maxCoeff();
-		// 	err_per_el(e, 2) = std::pow(hp, pp+1)/(rho/hp); // /std::pow(average_edge_length, p_ref+1) * (sqrt(6)/12);
-		// 	err_per_el(e, 3) = rho/hp;
-		// 	err_per_el(e, 4) = (vals.det.array() * vals.quadrature.weights.array()).sum();
-
-		// 	// pred_norm += (pow(std::pow(hp, pp+1)/(rho/hp),p) * vals.det.array() * vals.quadrature.weights.array()).sum();
-		// }
+		element_errors(e, 0) = sqrt(el_l2);
+		element_errors(e, 1) = sqrt(el_h1);
+		element_errors(e, 2) = err.maxCoeff();
+		element_errors(e, 3) = has_exact || !has_recovery ? sqrt(el_h1) : stress_recovery_errors(e);
 
-		l2_err += (err.array() * err.array() * vals.det.array() * vals.quadrature.weights.array()).sum();
-		h1_err += (err_grad.array() * err_grad.array() * vals.det.array() * vals.quadrature.weights.array()).sum();
-		lp_err += (err.array().pow(p) * vals.det.array() * vals.quadrature.weights.array()).sum();
-	}
+		storage.l2 += el_l2;
+		storage.h1 += el_h1;
+		storage.lp += (err.array().pow(p) * da.array()).sum();
+		storage.linf = max(storage.linf, err.maxCoeff());
+		storage.grad_max = max(storage.grad_max, err_grad.maxCoeff());
+	};
+
+	l2_err = 0;
+	h1_err = 0;
+	grad_max_err = 0;
+	h1_semi_err = 0;
+	linf_err = 0;
+	lp_err = 0;
+
+	const auto reduce = [&](const LocalThreadErrorStorage &storage) {
+		l2_err += storage.l2;
+		h1_err += storage.h1;
+		lp_err += storage.lp;
+		linf_err = max(linf_err, storage.linf);
+		grad_max_err = max(grad_max_err, storage.grad_max);
+	};
+
+#ifdef POLYFEM_WITH_TBB
+	typedef tbb::enumerable_thread_specific<LocalThreadErrorStorage> LocalStorage;
+	LocalStorage storages((LocalThreadErrorStorage()));
+	tbb::parallel_for(tbb::blocked_range<int>(0, n_el), [&](const tbb::blocked_range<int> &r) {
+		LocalStorage::reference loc_storage = storages.local();
+		for (int e = r.begin(); e != r.end(); ++e)
+			compute_element_error(e, loc_storage);
+	});
+
+	for (LocalStorage::iterator i = storages.begin(); i != storages.end(); ++i)
+		reduce(*i);
+#else
+	LocalThreadErrorStorage loc_storage;
+	for (int e = 0; e < n_el; ++e)
+		compute_element_error(e, loc_storage);
+	reduce(loc_storage);
+#endif
 
 	h1_semi_err = sqrt(fabs(h1_err));
 	h1_err = sqrt(fabs(l2_err) + fabs(h1_err));
@@ -3522,8 +4284,7 @@ void State::compute_errors()
 
 	// pred_norm = pow(fabs(pred_norm), 1./p);
 
-	timer.stop();
-	computing_errors_time = timer.getElapsedTime();
+	computing_errors_time = zone.stop();
 	logger().info(" took {}s", computing_errors_time);
 
 	logger().info("-- L2 error: {}", l2_err);
@@ -3544,6 +4305,102 @@ void State::compute_errors()
 	// }
 }
 
+void State::adaptive_p_refinement()
+{
+	const json &params = args["adaptive_p"];
+	const int max_cycles = params["max_cycles"];
+	if (max_cycles <= 0)
+		return;
+
+	if (!mesh)
+	{
+		logger().error("Load the mesh first!");
+		return;
+	}
+	if (element_errors.rows() != int(bases.size()))
+	{
+		logger().error("Compute the errors first!");
+		return;
+	}
+
+	//mixed orders are supported by the FE bases only on simplices
+	bool all_simplices = !args["use_spline"];
+	for (int e = 0; e < mesh->n_elements() && all_simplices; ++e)
+		all_simplices = mesh->is_simplex(e);
+	if (!all_simplices)
+	{
+		logger().error("Adaptive p-refinement requires FE bases on a simplicial mesh, skipping...");
+		return;
+	}
+
+	const double fraction = params["fraction"];
+	const double tolerance = params["tolerance"];
+	const int max_dofs = params["max_dofs"];
+	const int p_max = std::min(autogen::MAX_P_BASES, args["discr_order_max"].get<int>());
+	const int actual_dim = problem->is_scalar() ? 1 : mesh->dimension();
+
+	adaptive_info = json::array();
+
+	for (int cycle = 0;; ++cycle)
+	{
+		const int n_el = int(element_errors.rows());
+		const Eigen::VectorXd eta2 = element_errors.col(3).array().square();
+		const double eta = sqrt(eta2.sum());
+
+		adaptive_info.push_back({{"cycle", cycle},
+								 {"num_dofs", n_bases * actual_dim},
+								 {"reused_elements", element_matrix_cache.n_reused()},
+								 {"min_p", disc_orders.minCoeff()},
+								 {"max_p", disc_orders.maxCoeff()},
+								 {"estimate", eta},
+								 {"err_l2", l2_err},
+								 {"err_h1", h1_err},
+								 {"time_solving", solving_time}});
+		logger().info("adaptive p cycle {}: dofs {}, estimate {}, {}/{} element matrices reused", cycle, n_bases * actual_dim, eta, element_matrix_cache.n_reused(), n_el);
+
+		if (cycle >= max_cycles || eta <= tolerance || (max_dofs > 0 && n_bases * actual_dim >= max_dofs))
+			break;
+
+		//Dorfler marking: the smallest set of elements carrying the given fraction of the estimate
+		std::vector<int> order(n_el);
+		for (int e = 0; e < n_el; ++e)
+			order[e] = e;
+		std::sort(order.begin(), order.end(), [&](int a, int b) { return eta2(a) > eta2(b); });
+
+		Eigen::VectorXi new_orders = disc_orders;
+		const double target = fraction * eta2.sum();
+		double marked = 0;
+		int n_marked = 0;
+		for (int e : order)
+		{
+			if (marked >= target)
+				break;
+			marked += eta2(e);
+
+			if (new_orders(e) < p_max)
+			{
+				++new_orders(e);
+				++n_marked;
+			}
+		}
+
+		if (n_marked == 0)
+		{
+			logger().info("adaptive p: no element can be refined further");
+			break;
+		}
+		logger().info("adaptive p: raising the order of {} elements", n_marked);
+
+		adaptive_disc_orders = new_orders;
+
+		build_basis();
+		assemble_rhs();
+		assemble_stiffness_mat();
+		solve_problem();
+		compute_errors();
+	}
+}
+
 void State::init(const json &args_in)
 {
 	this->args.merge_patch(args_in);
@@ -3560,6 +4417,10 @@ void State::init(const json &args_in)
 		this->args["export"]["solution"] = args_in["solution"];
 	}
 
+	//keeps the individual zones for the chrome trace
+	const std::string profile_path = args["export"]["profile"];
+	Profiler::instance().set_tracing(!profile_path.empty());
+
 	problem = ProblemFactory::factory().get_problem(args["problem"]);
 	//important for the BC
 	problem->set_parameters(args["problem_params"]);
@@ -3594,6 +4455,9 @@ void State::export_data()
 		return;
 	}
 
+	ScopedZone zone("export_data");
+	ScopedMemoryPhase memory_phase("export_data");
+
 	// Export vtu mesh of solution + wire mesh of deformed input
 	// + mesh colored with the bases
 	const std::string paraview_path = args["export"]["paraview"];
@@ -3612,7 +4476,10 @@ void State::export_data()
 		std::ofstream out(solution_path);
 		out.precision(100);
 		out << std::scientific;
-		out << sol << std::endl;
+		//exported in the numbering of the input, independently of the renumbering
+		Eigen::MatrixXd tmp;
+		DofRenumbering::to_original(bases_new_index, problem->is_scalar() ? 1 : mesh->dimension(), pressure_bases_new_index, sol, tmp);
+		out << tmp << std::endl;
 		out.close();
 	}
 
@@ -3645,9 +4512,11 @@ void State::export_data()
 				}
 			}
 		}
+		Eigen::MatrixXd tmp;
+		DofRenumbering::to_original(bases_new_index, 1, nodes, tmp);
 		std::ofstream out(nodes_path);
 		out.precision(100);
-		out << nodes;
+		out << tmp;
 		out.close();
 	}
 	if (!solmat_path.empty())
@@ -3677,6 +4546,11 @@ void State::export_data()
 		out.precision(20);
 		out << mises;
 	}
+
+	zone.stop();
+	const std::string profile_path = args["export"]["profile"];
+	if (!profile_path.empty() && !Profiler::instance().write_chrome_trace(profile_path))
+		logger().error("Unable to write the profile {}", profile_path);
 }
 
 void State::build_vis_mesh(Eigen::MatrixXd &points, Eigen::MatrixXi &tets, Eigen::MatrixXi &el_id, Eigen::MatrixXd &discr)
@@ -3929,14 +4803,39 @@ void State::save_vtu(const std::string &path, const double t)
 				writer.add_field("scalar_value_avg", vals);
 			else
 				solution_frames.back().scalar_value_avg = vals;
-			// for(int i = 0; i < tvals.cols(); ++i){
-			// 	const int ii = (i / mesh->dimension()) + 1;
-			// 	const int jj = (i % mesh->dimension()) + 1;
-			// 	writer.add_field("tensor_value_avg_" + std::to_string(ii) + std::to_string(jj), tvals.col(i));
-			// }
+
+			if (solve_export_to_file)
+			{
+				for (int i = 0; i < tvals.cols(); ++i)
+				{
+					const int ii = (i / mesh->dimension()) + 1;
+					const int jj = (i % mesh->dimension()) + 1;
+					writer.add_field("tensor_value_avg_" + std::to_string(ii) + std::to_string(jj), tvals.col(i));
+				}
+
+			}
+
+			if (solve_export_to_file && stress_recovery_errors.size() == int(bases.size()))
+			{
+				Eigen::MatrixXd recovery_errors(points.rows(), 1);
+				for (int i = 0; i < points.rows(); ++i)
+					recovery_errors(i) = stress_recovery_errors(el_id(i));
+				writer.add_field("stress_recovery_error", recovery_errors);
+			}
 		}
 	}
 
+	if (solve_export_to_file && args["export"]["element_errors"] && element_errors.rows() == int(bases.size()))
+	{
+		Eigen::MatrixXd el_errors(points.rows(), element_errors.cols());
+		for (int i = 0; i < points.rows(); ++i)
+			el_errors.row(i) = element_errors.row(el_id(i));
+
+		writer.add_field("element_error_l2", el_errors.col(0));
+		writer.add_field("element_error_h1_semi", el_errors.col(1));
+		writer.add_field("element_indicator", el_errors.col(3));
+	}
+
 	if(material_params)
 	{
 		LameParameters params;
@@ -8,6 +8,14 @@
 #include <polyfem/Problem.hpp>
 #include <polyfem/LocalBoundary.hpp>
 #include <polyfem/InterfaceData.hpp>
+#include <polyfem/PolytopeBasisCache.hpp>
+#include <polyfem/PointProbe.hpp>
+#include <polyfem/SumFactorizationOperator.hpp>
+#include <polyfem/StaticCondensation.hpp>
+#include <polyfem/ElementMatrixCache.hpp>
+#include <polyfem/ElementDofMap.hpp>
+#include <polyfem/ColoredAssembly.hpp>
+#include <polyfem/GeometricMultigrid.hpp>
 #include <polyfem/Common.hpp>
 #include <polyfem/Logger.hpp>
 
@@ -16,6 +24,9 @@
 
 #include <Eigen/Dense>
 #include <Eigen/Sparse>
+#include <polysolve/LinearSolver.hpp>
+
+#include <functional>
 #include <memory>
 #include <string>
 
@@ -69,6 +80,11 @@ namespace polyfem
 		std::vector< ElementBases >    bases;
 		std::vector< ElementBases >    pressure_bases;
 		std::vector< ElementBases >    geom_bases;
+		//element dof maps of bases and pressure_bases, built by build_basis and given to the assemblies
+		ElementDofMap dof_map, pressure_dof_map;
+		//colorings of the dof maps used by args["parallel_assembly"] = "coloring", the assemblies of a State
+		//must not run concurrently
+		ColoredAssemblyCache colorings;
 
 		std::vector< int >                   boundary_nodes;
 		std::vector< LocalBoundary >         local_boundary;
@@ -83,7 +99,18 @@ namespace polyfem
 
 		std::map<int, Eigen::MatrixXd> polys;
 		std::map<int, std::pair<Eigen::MatrixXd, Eigen::MatrixXi> > polys_3d;
+		//fits of the polyhedral bases, kept across the solves
+		std::shared_ptr<PolytopeBasisCache> polytope_cache;
 		std::vector<int> parent_elements;
+		//point location of probe_solution, reset by build_basis
+		std::shared_ptr<PointProbe> point_probe;
+		//replaces stiffness when args["matrix_free"]["enabled"], reset by build_basis
+		std::shared_ptr<SumFactorizationOperator> matrix_free_operator;
+		//stiffness is the skeleton system when args["static_condensation"], reset by build_basis
+		std::shared_ptr<StaticCondensation> static_condensation;
+		//coarser levels of the n_refs refinement (coarsest first) and the FE hierarchy, when args["multigrid"]["enabled"]
+		std::vector<std::unique_ptr<Mesh>> coarse_meshes;
+		std::shared_ptr<GeometricMultigrid> multigrid;
 
 		StiffnessMatrix stiffness, mass;
 		Eigen::MatrixXd rhs, rhs_in;
@@ -101,19 +128,31 @@ namespace polyfem
 		bool use_avg_pressure;
 
 		int n_bases, n_pressure_bases;
+		//new index of every node when args["dof_renumbering"] is used, empty otherwise
+		Eigen::VectorXi bases_new_index, pressure_bases_new_index;
 		Eigen::VectorXi disc_orders;
+		//orders used by build_basis instead of args["discr_order"], set by the adaptive refinement
+		Eigen::VectorXi adaptive_disc_orders;
+		//local matrices of the last assembly, reused by the adaptive p-refinement for the elements that keep their order
+		ElementMatrixCache element_matrix_cache;
+		json adaptive_info;
 
 		double mesh_size;
 		double min_edge_length;
 		double average_edge_length;
 
 		double l2_err, linf_err, lp_err, h1_err, h1_semi_err, grad_max_err;
+		//per element L2, H1 semi-norm, and Linf errors, and the indicator (the stress recovery error)
+		Eigen::MatrixXd element_errors;
+		//per element L2 norm of the difference between the recovered and the raw stress, set by compute_errors and average_grad_based_function
+		Eigen::VectorXd stress_recovery_errors;
 
 		long long nn_zero, mat_size, num_dofs;
 
 		double building_basis_time;
 		double loading_mesh_time;
 		double computing_poly_basis_time;
+		json poly_basis_timings;
 		double assembling_stiffness_mat_time;
 		double assigning_rhs_time;
 		double solving_time;
@@ -142,6 +181,8 @@ namespace polyfem
 		void compute_mesh_size(const Mesh &mesh, const std::vector< ElementBases > &bases, const int n_samples);
 
 		void load_mesh();
+		//fills coarse_meshes, create returns the unrefined mesh
+		void build_mesh_hierarchy(const std::function<std::unique_ptr<Mesh>()> &create, const int n_refs);
 		void load_febio(const std::string &path);
 		void load_mesh(GEO::Mesh &meshin, const std::function<int(const RowVectorNd&)> &boundary_marker, bool skip_boundary_sideset = false);
 		void load_mesh(const std::string &path)
@@ -188,12 +229,20 @@ namespace polyfem
 
 		void build_basis();
 		void extract_boundary_mesh();
+		//multigrid solver when the hierarchy is available (not for the mixed and statically condensed systems),
+		//otherwise args["solver_type"] with args["precond_type"]
+		std::unique_ptr<polysolve::LinearSolver> create_linear_solver() const;
 
 		void assemble_stiffness_mat();
 		void assemble_rhs();
 		void solve_problem();
 		void compute_errors();
+		//solve, estimate, mark, and raise the order of the marked elements, driven by args["adaptive_p"]
+		//expects a solved problem with computed errors, does nothing if max_cycles is 0
+		void adaptive_p_refinement();
 		void export_data();
+		//updates the bytes held by the bases, matrices, vectors and frames in the MemoryTracker
+		void update_memory_usage();
 
 		void compute_vertex_values(int actual_dim, const std::vector< ElementBases > &basis,
 			const MatrixXd &fun, Eigen::MatrixXd &result);
@@ -204,6 +253,16 @@ namespace polyfem
 
 		void compute_scalar_value(const int n_points, const Eigen::MatrixXd &fun, Eigen::MatrixXd &result, const bool boundary_only = false);
 		void compute_tensor_value(const int n_points, const Eigen::MatrixXd &fun, Eigen::MatrixXd &result, const bool boundary_only = false);
+		//solution, gradient (one block of dim columns per component), and tensor value (dim*dim columns, empty for scalar problems,
+		//the velocity gradient for the fluids) at physical points, 0 outside of the mesh. The point location is kept for repeated queries at the same points
+		void probe_solution(const Eigen::MatrixXd &pts, Eigen::MatrixXd &values, Eigen::MatrixXd &grads, Eigen::MatrixXd &tensors);
+
+		//superconvergent patch recovery (Zienkiewicz-Zhu): for every node, least squares fit of a polynomial of the degree of the
+		//elements around the node to the stresses at their quadrature points. recovered has one row per node with the
+		//dim*dim tensor entries followed by the scalar value, errors is the per element L2 norm of the recovered minus the raw tensor.
+		//For scalar problems the recovered field is the gradient of fun (dim entries) followed by its norm, for the fluids the
+		//velocity gradient (dim*dim entries) followed by its norm
+		void recover_stresses(const MatrixXd &fun, Eigen::MatrixXd &recovered, Eigen::VectorXd &errors);
 		void average_grad_based_function(const int n_points, const MatrixXd &fun, MatrixXd &result_scalar, MatrixXd &result_tensor, const bool boundary_only = false);
 
 		void interpolate_boundary_function(const MatrixXd &pts, const MatrixXi &faces, const MatrixXd &fun, const bool compute_avg, MatrixXd &result);
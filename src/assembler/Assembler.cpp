@@ -15,8 +15,10 @@
 #include <polyfem/IncompressibleLinElast.hpp>
 
 #include <polyfem/Logger.hpp>
-
-#include <igl/Timer.h>
+#include <polyfem/Profiler.hpp>
+#include <polyfem/MemoryTracker.hpp>
+#include <polyfem/ElementDofMap.hpp>
+#include <polyfem/ColoredAssembly.hpp>
 
 #ifdef POLYFEM_WITH_TBB
 #include <tbb/parallel_for.h>
@@ -37,7 +39,11 @@ namespace polyfem
 			StiffnessMatrix tmp_mat;
 			StiffnessMatrix stiffness;
             ElementAssemblyValues vals;
+			//psi values of the mixed assembly, vals holds the phi ones
+			ElementAssemblyValues psi_vals;
             QuadratureVector da;
+			//element matrix and Schur complement of the static condensation
+			Eigen::MatrixXd local, schur;
 
 			LocalThreadMatStorage(const int buffer_size, const int rows, const int cols)
 			{
@@ -45,35 +51,113 @@ namespace polyfem
 				tmp_mat.resize(rows, cols);
 				stiffness.resize(rows, cols);
 			}
+
+			//the triplets are moved to the stiffness when the buffer is full
+			void add(const int i, const int j, const double value)
+			{
+				entries.emplace_back(i, j, value);
+
+				if(entries.size() >= 1e8)
+				{
+					tmp_mat.setFromTriplets(entries.begin(), entries.end());
+					stiffness += tmp_mat;
+
+					tmp_mat.setZero();
+					tmp_mat.data().squeeze();
+
+					stiffness.makeCompressed();
+
+					entries.clear();
+					logger().debug("cleaning memory. Current storage: {}. mat nnz: {}", entries.capacity(), stiffness.nonZeros());
+				}
+			}
 		};
 
-		class LocalThreadVecStorage
+		//all the quantities of the non linear assembly, the unused ones are empty
+		class LocalThreadNLStorage : public LocalThreadMatStorage
 		{
 		public:
 			Eigen::MatrixXd vec;
-            ElementAssemblyValues vals;
-            QuadratureVector da;
+			double val;
 
-			LocalThreadVecStorage(const int size)
+			LocalThreadNLStorage(const int buffer_size, const int mat_size, const int vec_size)
+				: LocalThreadMatStorage(buffer_size, mat_size, mat_size)
 			{
-				vec.resize(size, 1);
-				vec.setZero();
+				vec.setZero(vec_size, 1);
+				val = 0;
 			}
 		};
 
-		class LocalThreadScalarStorage
+		//storage of the colored assembly, the values go directly in the shared matrix and vector
+		class LocalThreadColoredStorage
 		{
 		public:
+			StiffnessMatrix *mat;
+			Eigen::Map<Eigen::MatrixXd> vec;
+			ElementAssemblyValues vals;
+			ElementAssemblyValues psi_vals;
+			QuadratureVector da;
+			Eigen::MatrixXd local, schur;
 			double val;
-            ElementAssemblyValues vals;
-            QuadratureVector da;
 
-			LocalThreadScalarStorage()
+			LocalThreadColoredStorage(StiffnessMatrix *mat_, double *vec_data, const int vec_size)
+				: mat(mat_), vec(vec_data, vec_size, 1), val(0)
+			{ }
+
+			void add(const int i, const int j, const double value)
 			{
-				val = 0;
+				ColoredAssembly::add(*mat, i, j, value);
 			}
 		};
 
+		//calls f(e, storage) color by color, the elements of a color in parallel, and returns the sum of the storage values
+		template <typename F>
+		double colored_for_each(const ColoredAssembly &coloring, const LocalThreadColoredStorage &exemplar, F f)
+		{
+#ifdef POLYFEM_WITH_TBB
+			tbb::enumerable_thread_specific< LocalThreadColoredStorage > storages(exemplar);
+			for (int c = 0; c < coloring.n_colors(); ++c)
+			{
+				const std::vector<int> &elements = coloring.color(c);
+				tbb::parallel_for(tbb::blocked_range<int>(0, int(elements.size())), [&](const tbb::blocked_range<int> &r) {
+					LocalThreadColoredStorage &loc_storage = storages.local();
+					for (int k = r.begin(); k != r.end(); ++k)
+						f(elements[k], loc_storage);
+				});
+			}
+
+			double val = 0;
+			for (auto i = storages.begin(); i != storages.end(); ++i)
+				val += i->val;
+			return val;
+#else
+			LocalThreadColoredStorage loc_storage(exemplar);
+			for (int c = 0; c < coloring.n_colors(); ++c)
+			{
+				for (const int e : coloring.color(c))
+					f(e, loc_storage);
+			}
+			return loc_storage.val;
+#endif
+		}
+
+		//triplets and partial matrices held by the threads before the merge
+#ifdef POLYFEM_WITH_TBB
+		template <typename LTM>
+		void record_buffers_memory(tbb::enumerable_thread_specific<LTM> &storages)
+		{
+			size_t bytes = 0;
+			for (auto i = storages.begin(); i != storages.end(); ++i)
+				bytes += memory_bytes(i->entries) + memory_bytes(i->tmp_mat) + memory_bytes(i->stiffness);
+			MemoryTracker::instance().set_bytes("assembly_buffers", bytes);
+		}
+#else
+		void record_buffers_memory(const LocalThreadMatStorage &storage)
+		{
+			MemoryTracker::instance().set_bytes("assembly_buffers", memory_bytes(storage.entries) + memory_bytes(storage.tmp_mat) + memory_bytes(storage.stiffness));
+		}
+#endif
+
 #ifdef POLYFEM_WITH_TBB
 		template <typename LTM>
 		void merge_matrices(tbb::enumerable_thread_specific<LTM> &storages, StiffnessMatrix &mat)
@@ -128,7 +212,11 @@ namespace polyfem
 		const int n_basis,
 		const std::vector< ElementBases > &bases,
 		const std::vector< ElementBases > &gbases,
-		StiffnessMatrix &stiffness) const
+		StiffnessMatrix &stiffness,
+		StaticCondensation *condensation,
+		const ElementDofMap *cached_dof_map,
+		ColoredAssemblyCache *colorings,
+		ElementMatrixCache *element_matrices) const
 	{
 		const int buffer_size = std::min(long(1e8), long(n_basis) * local_assembler_.size());
 // #ifdef POLYFEM_WITH_TBB
@@ -136,33 +224,121 @@ namespace polyfem
 // #endif
 		logger().debug("buffer_size {}", buffer_size);
 		try{
-		stiffness.resize(n_basis*local_assembler_.size(), n_basis*local_assembler_.size());
+		const int n_dofs = condensation ? condensation->n_skeleton_dofs() : n_basis*local_assembler_.size();
+		stiffness.resize(n_dofs, n_dofs);
 		stiffness.setZero();
 
-#ifdef POLYFEM_WITH_TBB
-		typedef tbb::enumerable_thread_specific< LocalThreadMatStorage > LocalStorage;
-		LocalStorage storages(LocalThreadMatStorage(buffer_size, stiffness.rows(), stiffness.cols()));
-#else
-		LocalThreadMatStorage loc_storage(buffer_size, stiffness.rows(), stiffness.cols());
-#endif
-
 		const int n_bases = int(bases.size());
-		igl::Timer timerg;
-		timerg.start();
-#ifdef POLYFEM_WITH_TBB
-		tbb::parallel_for( tbb::blocked_range<int>(0, n_bases), [&](const tbb::blocked_range<int> &r) {
-		LocalStorage::reference loc_storage = storages.local();
-		loc_storage.entries.reserve(buffer_size);
-		loc_storage.stiffness.resize(stiffness.rows(), stiffness.cols());
-		loc_storage.tmp_mat.resize(stiffness.rows(), stiffness.cols());
+		//the map is normally built once per basis set by the caller
+		ElementDofMap local_dof_map;
+		if (!cached_dof_map)
+			local_dof_map.build(bases, n_basis);
+		const ElementDofMap &dof_map = cached_dof_map ? *cached_dof_map : local_dof_map;
+		assert(dof_map.n_elements() == n_bases);
 
-		for (int e = r.begin(); e != r.end(); ++e) {
-#else
-		for(int e=0; e < n_bases; ++e) {
-#endif
+		if (element_matrices)
+			element_matrices->resize(n_bases);
+
+		const auto assemble_element = [&](const int e, auto &loc_storage) {
             ElementAssemblyValues &vals = loc_storage.vals;
-			// igl::Timer timer; timer.start();
-			vals.compute(e, is_volume, bases[e], gbases[e]);
+			const int size = local_assembler_.size();
+			const bool conforming = dof_map.is_conforming(e);
+			const int *dofs = dof_map.element_dofs(e);
+
+			//identity without condensation, these elements have no condensed dofs
+			const auto global_dof = [condensation](const int dof) { return condensation ? condensation->skeleton_dof(dof) : dof; };
+
+			const bool condensed = condensation && condensation->has_condensed_dofs(e);
+			//polygonal bases depend on the neighbors, their matrices are not kept
+			const bool cacheable = element_matrices && bases[e].has_parameterization;
+			if (condensed || cacheable)
+			{
+				//dense element matrix, kept in the cache for the next assemblies
+				const int n_loc_bases = int(bases[e].bases.size());
+				const int order = n_loc_bases > 0 ? bases[e].bases.front().order() : 0;
+				const Eigen::MatrixXd *cached = cacheable ? element_matrices->find(e, order, n_loc_bases) : nullptr;
+				if (!cached)
+				{
+					//the scatter uses the dof map, the local nodes are not copied
+					vals.compute(e, is_volume, bases[e], gbases[e], false);
+					loc_storage.da = vals.det.array() * vals.quadrature.weights.array();
+
+					Eigen::MatrixXd &local = loc_storage.local;
+					local.resize(n_loc_bases*size, n_loc_bases*size);
+					for(int i = 0; i < n_loc_bases; ++i)
+					{
+						for(int j = 0; j <= i; ++j)
+						{
+							const auto stiffness_val = local_assembler_.assemble(vals, i, j, loc_storage.da);
+							assert(stiffness_val.size() == size * size);
+
+							for(int n = 0; n < size; ++n)
+							{
+								for(int m = 0; m < size; ++m)
+								{
+									local(i*size+m, j*size+n) = stiffness_val(n*size+m);
+									local(j*size+n, i*size+m) = stiffness_val(n*size+m);
+								}
+							}
+						}
+					}
+
+					if (cacheable)
+						element_matrices->store(e, order, n_loc_bases, local);
+				}
+				const Eigen::MatrixXd &local = cached ? *cached : loc_storage.local;
+
+				if (condensed)
+				{
+					//its Schur complement goes to the skeleton system
+					Eigen::MatrixXd &schur = loc_storage.schur;
+					condensation->condense_element(e, local, schur);
+
+					const std::vector<int> &skeleton_dofs = condensation->element_skeleton_dofs(e);
+					for(int i = 0; i < schur.rows(); ++i)
+					{
+						for(int j = 0; j < schur.cols(); ++j)
+						{
+							if (std::abs(schur(i, j)) >= 1e-30)
+								loc_storage.add(skeleton_dofs[i], skeleton_dofs[j], schur(i, j));
+						}
+					}
+
+					return;
+				}
+
+				for(int i = 0; i < n_loc_bases; ++i)
+				{
+					for(int j = 0; j < n_loc_bases; ++j)
+					{
+						for(int n = 0; n < size; ++n)
+						{
+							for(int m = 0; m < size; ++m)
+							{
+								const double local_value = local(i*size+m, j*size+n);
+								if (std::abs(local_value) < 1e-30) { continue; }
+
+								if (conforming)
+								{
+									loc_storage.add(global_dof(dofs[i]*size+m), global_dof(dofs[j]*size+n), local_value);
+									continue;
+								}
+
+								dof_map.for_each_node(e, i, [&](const int index_i, const double wi) {
+									dof_map.for_each_node(e, j, [&](const int index_j, const double wj) {
+										loc_storage.add(global_dof(index_i*size+m), global_dof(index_j*size+n), local_value * wi * wj);
+									});
+								});
+							}
+						}
+					}
+				}
+
+				return;
+			}
+
+			//the scatter uses the dof map, the local nodes are not copied
+			vals.compute(e, is_volume, bases[e], gbases[e], false);
 
 			const Quadrature &quadrature = vals.quadrature;
 
@@ -172,57 +348,38 @@ namespace polyfem
 
 			for(int i = 0; i < n_loc_bases; ++i)
 			{
-				// const AssemblyValues &values_i = vals.basis_values[i];
-				// const Eigen::MatrixXd &gradi = values_i.grad_t_m;
-				const auto &global_i = vals.basis_values[i].global;
-
 				for(int j = 0; j <= i; ++j)
 				{
-					// const AssemblyValues &values_j = vals.basis_values[j];
-					// const Eigen::MatrixXd &gradj = values_j.grad_t_m;
-					const auto &global_j = vals.basis_values[j].global;
-
 					const auto stiffness_val = local_assembler_.assemble(vals, i, j, loc_storage.da);
-					assert(stiffness_val.size() == local_assembler_.size() * local_assembler_.size());
+					assert(stiffness_val.size() == size * size);
 
-					// igl::Timer t1; t1.start();
-					for(int n = 0; n < local_assembler_.size(); ++n)
+					for(int n = 0; n < size; ++n)
 					{
-						for(int m = 0; m < local_assembler_.size(); ++m)
+						for(int m = 0; m < size; ++m)
 						{
-							const double local_value = stiffness_val(n*local_assembler_.size()+m);
+							const double local_value = stiffness_val(n*size+m);
 							if (std::abs(local_value) < 1e-30) { continue; }
 
-							for(size_t ii = 0; ii < global_i.size(); ++ii)
+							//one node with weight 1 per local basis, no weights to apply
+							if (conforming)
 							{
-								const auto gi = global_i[ii].index*local_assembler_.size()+m;
-								const auto wi = global_i[ii].val;
-
-								for(size_t jj = 0; jj < global_j.size(); ++jj)
-								{
-									const auto gj = global_j[jj].index*local_assembler_.size()+n;
-									const auto wj = global_j[jj].val;
-
-									loc_storage.entries.emplace_back(gi, gj, local_value * wi * wj);
-									if (j < i) {
-										loc_storage.entries.emplace_back(gj, gi, local_value * wj * wi);
-									}
-
-									if(loc_storage.entries.size() >= 1e8)
-									{
-										loc_storage.tmp_mat.setFromTriplets(loc_storage.entries.begin(), loc_storage.entries.end());
-										loc_storage.stiffness += loc_storage.tmp_mat;
-
-										loc_storage.tmp_mat.setZero();
-										loc_storage.tmp_mat.data().squeeze();
-
-										loc_storage.stiffness.makeCompressed();
-
-										loc_storage.entries.clear();
-										logger().debug("cleaning memory. Current storage: {}. mat nnz: {}", loc_storage.entries.capacity(), loc_storage.stiffness.nonZeros());
-									}
-								}
+								const int gi = global_dof(dofs[i]*size+m);
+								const int gj = global_dof(dofs[j]*size+n);
+								loc_storage.add(gi, gj, local_value);
+								if (j < i)
+									loc_storage.add(gj, gi, local_value);
+								continue;
 							}
+
+							dof_map.for_each_node(e, i, [&](const int index_i, const double wi) {
+								const int gi = global_dof(index_i*size+m);
+								dof_map.for_each_node(e, j, [&](const int index_j, const double wj) {
+									const int gj = global_dof(index_j*size+n);
+									loc_storage.add(gi, gj, local_value * wi * wj);
+									if (j < i)
+										loc_storage.add(gj, gi, local_value * wj * wi);
+								});
+							});
 						}
 					}
 
@@ -232,19 +389,54 @@ namespace polyfem
 				}
 
 			}
+		};
+
+		//the skeleton numbering of the condensation has no element dof map to color
+		if (colored_ && !condensation)
+		{
+			//the coloring of a precomputed map is built at the first assembly and reused
+			const int size = local_assembler_.size();
+			ColoredAssembly local_coloring;
+			const bool cached = colorings && cached_dof_map;
+			if (!cached)
+				local_coloring.build(dof_map, n_basis, size);
+			const ColoredAssembly &coloring = cached ? colorings->get(dof_map, n_basis, size, dof_map, n_basis, size) : local_coloring;
+			coloring.init_matrix(stiffness);
+			MemoryTracker::instance().set_bytes("assembly_buffers", coloring.memory_bytes());
+
+			ScopedZone colored_zone("colored assembly");
+			colored_for_each(coloring, LocalThreadColoredStorage(&stiffness, nullptr, 0), assemble_element);
+			logger().debug("done colored assembly {}s...", colored_zone.stop());
+			return;
+		}
 
-			// timer.stop();
-			// if (!vals.has_parameterization) { std::cout << "-- Timer: " << timer.getElapsedTime() << std::endl; }
 #ifdef POLYFEM_WITH_TBB
-		}});
+		typedef tbb::enumerable_thread_specific< LocalThreadMatStorage > LocalStorage;
+		LocalStorage storages(LocalThreadMatStorage(buffer_size, stiffness.rows(), stiffness.cols()));
 #else
-		}
+		LocalThreadMatStorage loc_storage(buffer_size, stiffness.rows(), stiffness.cols());
 #endif
-		timerg.stop();
-		logger().debug("done separate assembly {}s...", timerg.getElapsedTime());
 
-		timerg.start();
+		ScopedZone local_zone("local assembly");
 #ifdef POLYFEM_WITH_TBB
+		tbb::parallel_for( tbb::blocked_range<int>(0, n_bases), [&](const tbb::blocked_range<int> &r) {
+		LocalStorage::reference loc_storage = storages.local();
+		loc_storage.entries.reserve(buffer_size);
+		loc_storage.stiffness.resize(stiffness.rows(), stiffness.cols());
+		loc_storage.tmp_mat.resize(stiffness.rows(), stiffness.cols());
+
+		for (int e = r.begin(); e != r.end(); ++e)
+			assemble_element(e, loc_storage);
+		});
+#else
+		for(int e=0; e < n_bases; ++e)
+			assemble_element(e, loc_storage);
+#endif
+		logger().debug("done separate assembly {}s...", local_zone.stop());
+
+		ScopedZone merge_zone("merge assembly");
+#ifdef POLYFEM_WITH_TBB
+		record_buffers_memory(storages);
 		merge_matrices(storages, stiffness);
 		// for (LocalStorage::iterator i = storages.begin(); i != storages.end();  ++i)
 		// {
@@ -269,14 +461,14 @@ namespace polyfem
 		// 	stiffness.makeCompressed();
 		// }
 #else
+		record_buffers_memory(loc_storage);
 		stiffness = loc_storage.stiffness;
 		loc_storage.tmp_mat.setFromTriplets(loc_storage.entries.begin(), loc_storage.entries.end());
 		stiffness += loc_storage.tmp_mat;
 		stiffness.makeCompressed();
 #endif
 
-		timerg.stop();
-		logger().debug("done merge assembly {}s...", timerg.getElapsedTime());
+		logger().debug("done merge assembly {}s...", merge_zone.stop());
 
 		} catch(std::bad_alloc &ba)
     	{
@@ -297,7 +489,10 @@ namespace polyfem
 		const std::vector< ElementBases > &psi_bases,
 		const std::vector< ElementBases > &phi_bases,
 		const std::vector< ElementBases > &gbases,
-		StiffnessMatrix &stiffness) const
+		StiffnessMatrix &stiffness,
+		const ElementDofMap *cached_psi_map,
+		const ElementDofMap *cached_phi_map,
+		ColoredAssemblyCache *colorings) const
 	{
 		assert(phi_bases.size() == psi_bases.size());
 
@@ -307,28 +502,21 @@ namespace polyfem
 		stiffness.resize(n_phi_basis*local_assembler_.rows(), n_psi_basis*local_assembler_.cols());
 		stiffness.setZero();
 
-#ifdef POLYFEM_WITH_TBB
-		typedef tbb::enumerable_thread_specific< LocalThreadMatStorage > LocalStorage;
-		LocalStorage storages(LocalThreadMatStorage(buffer_size, stiffness.rows(), stiffness.cols()));
-#else
-		LocalThreadMatStorage loc_storage(buffer_size, stiffness.rows(), stiffness.cols());
-        ElementAssemblyValues psi_vals, phi_vals;
-#endif
-
 		const int n_bases = int(phi_bases.size());
-		igl::Timer timerg;
-		timerg.start();
-#ifdef POLYFEM_WITH_TBB
-		tbb::parallel_for( tbb::blocked_range<int>(0, n_bases), [&](const tbb::blocked_range<int> &r) {
-		LocalStorage::reference loc_storage = storages.local();
-        ElementAssemblyValues psi_vals, phi_vals;
-		for (int e = r.begin(); e != r.end(); ++e) {
-#else
-		for(int e=0; e < n_bases; ++e) {
-#endif
-			igl::Timer timer; timer.start();
-			psi_vals.compute(e, is_volume, psi_bases[e], gbases[e]);
-			phi_vals.compute(e, is_volume, phi_bases[e], gbases[e]);
+		ElementDofMap local_psi_map, local_phi_map;
+		if (!cached_psi_map)
+			local_psi_map.build(psi_bases, n_psi_basis);
+		if (!cached_phi_map)
+			local_phi_map.build(phi_bases, n_phi_basis);
+		const ElementDofMap &psi_map = cached_psi_map ? *cached_psi_map : local_psi_map;
+		const ElementDofMap &phi_map = cached_phi_map ? *cached_phi_map : local_phi_map;
+		assert(psi_map.n_elements() == n_bases && phi_map.n_elements() == n_bases);
+
+		const auto assemble_element = [&](const int e, auto &loc_storage) {
+			ElementAssemblyValues &psi_vals = loc_storage.psi_vals;
+			ElementAssemblyValues &phi_vals = loc_storage.vals;
+			psi_vals.compute(e, is_volume, psi_bases[e], gbases[e], false);
+			phi_vals.compute(e, is_volume, phi_bases[e], gbases[e], false);
 
 			const Quadrature &quadrature = phi_vals.quadrature;
 
@@ -337,48 +525,39 @@ namespace polyfem
 			const int n_phi_loc_bases = int(phi_vals.basis_values.size());
 			const int n_psi_loc_bases = int(psi_vals.basis_values.size());
 
+			const bool conforming = psi_map.is_conforming(e) && phi_map.is_conforming(e);
+			const int *psi_dofs = psi_map.element_dofs(e);
+			const int *phi_dofs = phi_map.element_dofs(e);
+			const int rows = local_assembler_.rows();
+			const int cols = local_assembler_.cols();
+
 			for(int i = 0; i < n_psi_loc_bases; ++i)
 			{
-				const auto &global_i = psi_vals.basis_values[i].global;
-
 				for(int j = 0; j < n_phi_loc_bases; ++j)
 				{
-					const auto &global_j = phi_vals.basis_values[j].global;
-
 					const auto stiffness_val = local_assembler_.assemble(psi_vals, phi_vals, i, j, loc_storage.da);
-					assert(stiffness_val.size() == local_assembler_.rows() * local_assembler_.cols());
+					assert(stiffness_val.size() == rows * cols);
 
-					// igl::Timer t1; t1.start();
-					for(int n = 0; n < local_assembler_.rows(); ++n)
+					for(int n = 0; n < rows; ++n)
 					{
-						for(int m = 0; m < local_assembler_.cols(); ++m)
+						for(int m = 0; m < cols; ++m)
 						{
-							const double local_value = stiffness_val(n*local_assembler_.cols() + m);
+							const double local_value = stiffness_val(n*cols + m);
 							if (std::abs(local_value) < 1e-30) { continue; }
 
-							for(size_t ii = 0; ii < global_i.size(); ++ii)
+							if (conforming)
 							{
-								const auto gi = global_i[ii].index*local_assembler_.cols()+m;
-								const auto wi = global_i[ii].val;
-
-								for(size_t jj = 0; jj < global_j.size(); ++jj)
-								{
-									const auto gj = global_j[jj].index*local_assembler_.rows()+n;
-									const auto wj = global_j[jj].val;
-
-									loc_storage.entries.emplace_back(gj, gi, local_value * wi * wj);
-
-									if(loc_storage.entries.size() >= 1e8)
-									{
-										loc_storage.tmp_mat.setFromTriplets(loc_storage.entries.begin(), loc_storage.entries.end());
-										loc_storage.stiffness += loc_storage.tmp_mat;
-										loc_storage.stiffness.makeCompressed();
-
-										loc_storage.entries.clear();
-										logger().debug("cleaning memory...");
-									}
-								}
+								loc_storage.add(phi_dofs[j]*rows+n, psi_dofs[i]*cols+m, local_value);
+								continue;
 							}
+
+							psi_map.for_each_node(e, i, [&](const int index_i, const double wi) {
+								const int gi = index_i*cols+m;
+								phi_map.for_each_node(e, j, [&](const int index_j, const double wj) {
+									const int gj = index_j*rows+n;
+									loc_storage.add(gj, gi, local_value * wi * wj);
+								});
+							});
 						}
 					}
 
@@ -388,20 +567,51 @@ namespace polyfem
 				}
 
 			}
+		};
+
+		//the columns are the psi nodes, the elements are colored on them
+		if (colored_)
+		{
+			const int rows = local_assembler_.rows();
+			const int cols = local_assembler_.cols();
+			ColoredAssembly local_coloring;
+			const bool cached = colorings && cached_psi_map && cached_phi_map;
+			if (!cached)
+				local_coloring.build(phi_map, n_phi_basis, rows, psi_map, n_psi_basis, cols);
+			const ColoredAssembly &coloring = cached ? colorings->get(phi_map, n_phi_basis, rows, psi_map, n_psi_basis, cols) : local_coloring;
+			coloring.init_matrix(stiffness);
+			MemoryTracker::instance().set_bytes("assembly_buffers", coloring.memory_bytes());
+
+			ScopedZone colored_zone("colored assembly");
+			colored_for_each(coloring, LocalThreadColoredStorage(&stiffness, nullptr, 0), assemble_element);
+			logger().trace("done colored assembly {}s...", colored_zone.stop());
+			return;
+		}
+
+#ifdef POLYFEM_WITH_TBB
+		typedef tbb::enumerable_thread_specific< LocalThreadMatStorage > LocalStorage;
+		LocalStorage storages(LocalThreadMatStorage(buffer_size, stiffness.rows(), stiffness.cols()));
+#else
+		LocalThreadMatStorage loc_storage(buffer_size, stiffness.rows(), stiffness.cols());
+#endif
 
-			// timer.stop();
-			// if (!vals.has_parameterization) { std::cout << "-- Timer: " << timer.getElapsedTime() << std::endl; }
+		ScopedZone local_zone("local assembly");
 #ifdef POLYFEM_WITH_TBB
-		}});
+		tbb::parallel_for( tbb::blocked_range<int>(0, n_bases), [&](const tbb::blocked_range<int> &r) {
+		LocalStorage::reference loc_storage = storages.local();
+		for (int e = r.begin(); e != r.end(); ++e)
+			assemble_element(e, loc_storage);
+		});
 #else
-		}
+		for(int e=0; e < n_bases; ++e)
+			assemble_element(e, loc_storage);
 #endif
 
-		timerg.stop();
-		logger().trace("done separate assembly {}s...", timerg.getElapsedTime());
+		logger().trace("done separate assembly {}s...", local_zone.stop());
 
-		timerg.start();
+		ScopedZone merge_zone("merge assembly");
 #ifdef POLYFEM_WITH_TBB
+		record_buffers_memory(storages);
 		merge_matrices(storages, stiffness);
 		// for (LocalStorage::iterator i = storages.begin(); i != storages.end();  ++i)
 		// {
@@ -410,13 +620,13 @@ namespace polyfem
 		// 	stiffness += i->tmp_mat;
 		// }
 #else
+		record_buffers_memory(loc_storage);
 		stiffness = loc_storage.stiffness;
 		loc_storage.tmp_mat.setFromTriplets(loc_storage.entries.begin(), loc_storage.entries.end());
 		stiffness += loc_storage.tmp_mat;
 		stiffness.makeCompressed();
 #endif
-		timerg.stop();
-		logger().trace("done merge assembly {}s...", timerg.getElapsedTime());
+		logger().trace("done merge assembly {}s...", merge_zone.stop());
 
 		// stiffness.resize(n_basis*local_assembler_.size(), n_basis*local_assembler_.size());
 		// stiffness.setFromTriplets(entries.begin(), entries.end());
@@ -430,83 +640,11 @@ namespace polyfem
 		const std::vector< ElementBases > &bases,
 		const std::vector< ElementBases > &gbases,
 		const Eigen::MatrixXd &displacement,
-		Eigen::MatrixXd &rhs) const
-	{
-		rhs.resize(n_basis*local_assembler_.size(), 1);
-		rhs.setZero();
-
-#ifdef POLYFEM_WITH_TBB
-		typedef tbb::enumerable_thread_specific< LocalThreadVecStorage > LocalStorage;
-		LocalStorage storages(LocalThreadVecStorage(rhs.size()));
-#else
-		LocalThreadVecStorage loc_storage(rhs.size());
-#endif
-
-
-		const int n_bases = int(bases.size());
-
-#ifdef POLYFEM_WITH_TBB
-		tbb::parallel_for(tbb::blocked_range<int>(0, n_bases), [&](const tbb::blocked_range<int> &r) {
-		LocalStorage::reference loc_storage = storages.local();
-		for (int e = r.begin(); e != r.end(); ++e) {
-#else
-		for(int e=0; e < n_bases; ++e) {
-#endif
-			// igl::Timer timer; timer.start();
-
-			ElementAssemblyValues &vals = loc_storage.vals;
-			vals.compute(e, is_volume, bases[e], gbases[e]);
-
-			const Quadrature &quadrature = vals.quadrature;
-
-			assert(MAX_QUAD_POINTS == -1 || quadrature.weights.size() < MAX_QUAD_POINTS);
-			loc_storage.da = vals.det.array() * quadrature.weights.array();
-			const int n_loc_bases = int(vals.basis_values.size());
-			const auto val = local_assembler_.assemble(vals, displacement, loc_storage.da);
-			assert(val.size() == n_loc_bases*local_assembler_.size());
-
-			for(int j = 0; j < n_loc_bases; ++j)
-			{
-				const auto &global_j = vals.basis_values[j].global;
-
-				// igl::Timer t1; t1.start();
-				for(int m = 0; m < local_assembler_.size(); ++m)
-				{
-					const double local_value = val(j*local_assembler_.size() + m);
-					if (std::abs(local_value) < 1e-30) { continue; }
-
-					for(size_t jj = 0; jj < global_j.size(); ++jj)
-					{
-						const auto gj = global_j[jj].index*local_assembler_.size() + m;
-						const auto wj = global_j[jj].val;
-
-						loc_storage.vec(gj) += local_value * wj;
-					}
-				}
-
-				// t1.stop();
-				// if (!vals.has_parameterization) { std::cout << "-- t1: " << t1.getElapsedTime() << std::endl; }
-			}
-
-			// timer.stop();
-			// if (!vals.has_parameterization) { std::cout << "-- Timer: " << timer.getElapsedTime() << std::endl; }
-
-#ifdef POLYFEM_WITH_TBB
-		} });
-#else
-		}
-#endif
-
-#ifdef POLYFEM_WITH_TBB
-	for (LocalStorage::iterator i = storages.begin(); i != storages.end();  ++i)
+		Eigen::MatrixXd &rhs,
+		const ElementDofMap *dof_map) const
 	{
-		rhs += i->vec;
+		assemble_quantities(is_volume, n_basis, bases, gbases, displacement, nullptr, &rhs, nullptr, dof_map);
 	}
-#else
-		rhs = loc_storage.vec;
-#endif
-	}
-
 
 	template<class LocalAssembler>
 	void NLAssembler<LocalAssembler>::assemble_hessian(
@@ -515,34 +653,61 @@ namespace polyfem
 		const std::vector< ElementBases > &bases,
 		const std::vector< ElementBases > &gbases,
 		const Eigen::MatrixXd &displacement,
-		StiffnessMatrix &grad) const
+		StiffnessMatrix &grad,
+		const ElementDofMap *dof_map,
+		ColoredAssemblyCache *colorings) const
 	{
-		const int buffer_size = std::min(long(1e8), long(n_basis) * local_assembler_.size());
-		// std::cout<<"buffer_size "<<buffer_size<<std::endl;
+		assemble_quantities(is_volume, n_basis, bases, gbases, displacement, nullptr, nullptr, &grad, dof_map, colorings);
+	}
 
-		grad.resize(n_basis*local_assembler_.size(), n_basis*local_assembler_.size());
-		grad.setZero();
+	template<class LocalAssembler>
+	double NLAssembler<LocalAssembler>::assemble(
+		const bool is_volume,
+		const std::vector< ElementBases > &bases,
+		const std::vector< ElementBases > &gbases,
+		const Eigen::MatrixXd &displacement) const
+	{
+		double energy = 0;
+		assemble_quantities(is_volume, 0, bases, gbases, displacement, &energy, nullptr, nullptr);
+		return energy;
+	}
 
-#ifdef POLYFEM_WITH_TBB
-		typedef tbb::enumerable_thread_specific< LocalThreadMatStorage > LocalStorage;
-		LocalStorage storages(LocalThreadMatStorage(buffer_size, grad.rows(), grad.cols()));
-#else
-		LocalThreadMatStorage loc_storage(buffer_size, grad.rows(), grad.cols());
-#endif
+	template<class LocalAssembler>
+	void NLAssembler<LocalAssembler>::assemble_quantities(
+		const bool is_volume,
+		const int n_basis,
+		const std::vector< ElementBases > &bases,
+		const std::vector< ElementBases > &gbases,
+		const Eigen::MatrixXd &displacement,
+		double *energy,
+		Eigen::MatrixXd *grad,
+		StiffnessMatrix *hessian,
+		const ElementDofMap *cached_dof_map,
+		ColoredAssemblyCache *colorings) const
+	{
+		const int size = local_assembler_.size();
+		const int n_dofs = n_basis * size;
+		//only the requested quantities get a buffer
+		const int buffer_size = hessian ? std::min(long(1e8), long(n_dofs)) : 0;
+		const int mat_size = hessian ? n_dofs : 0;
+		const int vec_size = grad ? n_dofs : 0;
+
+		if (hessian)
+		{
+			hessian->resize(n_dofs, n_dofs);
+			hessian->setZero();
+		}
 
 		const int n_bases = int(bases.size());
-		igl::Timer timerg;
-		timerg.start();
-
-#ifdef POLYFEM_WITH_TBB
-		tbb::parallel_for(tbb::blocked_range<int>(0, n_bases), [&](const tbb::blocked_range<int> &r) {
-		LocalStorage::reference loc_storage = storages.local();
-		for (int e = r.begin(); e != r.end(); ++e) {
-#else
-		for(int e=0; e < n_bases; ++e) {
-#endif
+		ElementDofMap local_dof_map;
+		if ((grad || hessian) && !cached_dof_map)
+			local_dof_map.build(bases, n_basis);
+		const ElementDofMap &dof_map = cached_dof_map ? *cached_dof_map : local_dof_map;
+		assert(!(grad || hessian) || dof_map.n_elements() == n_bases);
+
+		const auto assemble_element = [&](const int e, auto &loc_storage) {
+			//the geometric quantities are computed once for all the requested terms
 			ElementAssemblyValues &vals = loc_storage.vals;
-			// igl::Timer timer; timer.start();
 			vals.compute(e, is_volume, bases[e], gbases[e]);
 
 			const Quadrature &quadrature = vals.quadrature;
@@ -551,176 +716,150 @@ namespace polyfem
 			loc_storage.da = vals.det.array() * quadrature.weights.array();
 			const int n_loc_bases = int(vals.basis_values.size());
 
-			const auto stiffness_val = local_assembler_.assemble_grad(vals, displacement, loc_storage.da);
-			assert(stiffness_val.rows() == n_loc_bases * local_assembler_.size());
-			assert(stiffness_val.cols() == n_loc_bases * local_assembler_.size());
+			if (energy)
+				loc_storage.val += local_assembler_.compute_energy(vals, displacement, loc_storage.da);
 
-			// bool has_nan = false;
-			// for(int k = 0; k < stiffness_val.size(); ++k)
-			// {
-			// 	if(std::isnan(stiffness_val(k)))
-			// 	{
-			// 		has_nan = true;
-			// 		break;
-			// 	}
-			// }
+			if (grad)
+			{
+				const auto val = local_assembler_.assemble(vals, displacement, loc_storage.da);
+				assert(val.size() == n_loc_bases*size);
 
-			// if(has_nan)
-			// {
-			// 	loc_storage.entries.emplace_back(0, 0, std::nan(""));
-			// 	break;
-			// }
+				for(int j = 0; j < n_loc_bases; ++j)
+				{
+					for(int m = 0; m < size; ++m)
+					{
+						const double local_value = val(j*size + m);
+						if (std::abs(local_value) < 1e-30) { continue; }
 
+						dof_map.for_each_node(e, j, [&](const int index_j, const double wj) {
+							loc_storage.vec(index_j*size + m) += local_value * wj;
+						});
+					}
+				}
+			}
 
-				// igl::Timer t1; t1.start();
-			for(int i = 0; i < n_loc_bases; ++i)
+			if (hessian)
 			{
-				const auto &global_i = vals.basis_values[i].global;
+				const auto stiffness_val = local_assembler_.assemble_grad(vals, displacement, loc_storage.da);
+				assert(stiffness_val.rows() == n_loc_bases * size);
+				assert(stiffness_val.cols() == n_loc_bases * size);
 
-				for(int j = 0; j < n_loc_bases; ++j)
-				// for(int j = 0; j <= i; ++j)
-				{
-					const auto &global_j = vals.basis_values[j].global;
+				const bool conforming = dof_map.is_conforming(e);
+				const int *dofs = dof_map.element_dofs(e);
 
-					for(int n = 0; n < local_assembler_.size(); ++n)
+				for(int i = 0; i < n_loc_bases; ++i)
+				{
+					for(int j = 0; j < n_loc_bases; ++j)
 					{
-						for(int m = 0; m < local_assembler_.size(); ++m)
+						for(int n = 0; n < size; ++n)
 						{
-							const double local_value = stiffness_val(i*local_assembler_.size() + m, j*local_assembler_.size() + n);
-							if (std::abs(local_value) < 1e-30) { continue; }
-
-							for(size_t ii = 0; ii < global_i.size(); ++ii)
+							for(int m = 0; m < size; ++m)
 							{
-								const auto gi = global_i[ii].index*local_assembler_.size() + m;
-								const auto wi = global_i[ii].val;
+								const double local_value = stiffness_val(i*size + m, j*size + n);
+								if (std::abs(local_value) < 1e-30) { continue; }
 
-								for(size_t jj = 0; jj < global_j.size(); ++jj)
+								if (conforming)
 								{
-									const auto gj = global_j[jj].index*local_assembler_.size() + n;
-									const auto wj = global_j[jj].val;
-
-									loc_storage.entries.emplace_back(gi, gj, local_value * wi * wj);
-									// if (j < i) {
-									// 	loc_storage.entries.emplace_back(gj, gi, local_value * wj * wi);
-									// }
-
-									if(loc_storage.entries.size() >= 1e8)
-									{
-										loc_storage.tmp_mat.setFromTriplets(loc_storage.entries.begin(), loc_storage.entries.end());
-										loc_storage.stiffness += loc_storage.tmp_mat;
-										loc_storage.stiffness.makeCompressed();
-
-										loc_storage.entries.clear();
-										logger().debug("cleaning memory...");
-									}
+									loc_storage.add(dofs[i]*size + m, dofs[j]*size + n, local_value);
+									continue;
 								}
+
+								dof_map.for_each_node(e, i, [&](const int index_i, const double wi) {
+									const int gi = index_i*size + m;
+									dof_map.for_each_node(e, j, [&](const int index_j, const double wj) {
+										loc_storage.add(gi, index_j*size + n, local_value * wi * wj);
+									});
+								});
 							}
 						}
 					}
 				}
-				// t1.stop();
-				// if (!vals.has_parameterization) { std::cout << "-- t1: " << t1.getElapsedTime() << std::endl; }
 			}
+		};
 
-			// timer.stop();
-			// if (!vals.has_parameterization) { std::cout << "-- Timer: " << timer.getElapsedTime() << std::endl; }
-#ifdef POLYFEM_WITH_TBB
-		} });
-#else
+		//the gradient of an element has the same nodes as its hessian columns, it also goes directly in the output
+		if (colored_ && hessian)
+		{
+			ColoredAssembly local_coloring;
+			const bool cached = colorings && cached_dof_map;
+			if (!cached)
+				local_coloring.build(dof_map, n_basis, size);
+			const ColoredAssembly &coloring = cached ? colorings->get(dof_map, n_basis, size, dof_map, n_basis, size) : local_coloring;
+			coloring.init_matrix(*hessian);
+			MemoryTracker::instance().set_bytes("assembly_buffers", coloring.memory_bytes());
+			if (grad)
+				grad->setZero(n_dofs, 1);
+
+			ScopedZone colored_zone("colored assembly");
+			const double val = colored_for_each(coloring, LocalThreadColoredStorage(hessian, grad ? grad->data() : nullptr, vec_size), assemble_element);
+			if (energy)
+				*energy = val;
+			logger().trace("done colored assembly {}s...", colored_zone.stop());
+			return;
 		}
-#endif
-
-		timerg.stop();
-		logger().trace("done separate assembly {}s...", timerg.getElapsedTime());
-
-		timerg.start();
 
 #ifdef POLYFEM_WITH_TBB
-		merge_matrices(storages, grad);
-		// for (LocalStorage::iterator i = storages.begin(); i != storages.end(); ++i)
-		// {
-		// 	// logger().debug("local stiffness: {}, entries: {}", i->stiffness.nonZeros(), i->entries.size());
-		// 	i->tmp_mat.setFromTriplets(i->entries.begin(), i->entries.end());
-		// 	i->entries.clear();
-		// 	i->entries.shrink_to_fit();
-
-		// 	i->stiffness += i->tmp_mat;
-
-		// 	i->tmp_mat.resize(0, 0);
-		// 	i->tmp_mat.data().squeeze();
-
-		// 	i->stiffness.makeCompressed();
-
-		// 	grad += i->stiffness;
-		// 	i->stiffness.resize(0, 0);
-		// 	i->stiffness.data().squeeze();
-
-		// 	grad.makeCompressed();
-		// }
+		typedef tbb::enumerable_thread_specific< LocalThreadNLStorage > LocalStorage;
+		LocalStorage storages(LocalThreadNLStorage(buffer_size, mat_size, vec_size));
 #else
-		grad = loc_storage.stiffness;
-		loc_storage.tmp_mat.setFromTriplets(loc_storage.entries.begin(), loc_storage.entries.end());
-		grad += loc_storage.tmp_mat;
-		grad.makeCompressed();
+		LocalThreadNLStorage loc_storage(buffer_size, mat_size, vec_size);
 #endif
 
-		timerg.stop();
-		logger().trace("done merge assembly {}s...", timerg.getElapsedTime());
-	}
+		ScopedZone local_zone("local assembly");
 
-	template<class LocalAssembler>
-	double NLAssembler<LocalAssembler>::assemble(
-		const bool is_volume,
-		const std::vector< ElementBases > &bases,
-		const std::vector< ElementBases > &gbases,
-		const Eigen::MatrixXd &displacement) const
-	{
 #ifdef POLYFEM_WITH_TBB
-		typedef tbb::enumerable_thread_specific< LocalThreadScalarStorage > LocalStorage;
-		LocalStorage storages((LocalThreadScalarStorage()));
-#else
-		LocalThreadScalarStorage loc_storage;
-#endif
-		const int n_bases = int(bases.size());
-
-#ifdef POLYFEM_WITH_TBB
-		tbb::parallel_for( tbb::blocked_range<int>(0, n_bases), [&](const tbb::blocked_range<int> &r) {
+		tbb::parallel_for(tbb::blocked_range<int>(0, n_bases), [&](const tbb::blocked_range<int> &r) {
 		LocalStorage::reference loc_storage = storages.local();
-		for (int e = r.begin(); e != r.end(); ++e) {
+		for (int e = r.begin(); e != r.end(); ++e)
+			assemble_element(e, loc_storage);
+		});
 #else
-		for(int e=0; e < n_bases; ++e) {
+		for(int e=0; e < n_bases; ++e)
+			assemble_element(e, loc_storage);
 #endif
-			// igl::Timer timer; timer.start();
-
-			ElementAssemblyValues &vals = loc_storage.vals;
-			vals.compute(e, is_volume, bases[e], gbases[e]);
 
-			const Quadrature &quadrature = vals.quadrature;
+		logger().trace("done separate assembly {}s...", local_zone.stop());
 
-			assert(MAX_QUAD_POINTS == -1 || quadrature.weights.size() < MAX_QUAD_POINTS);
-			loc_storage.da = vals.det.array() * quadrature.weights.array();
+		ScopedZone merge_zone("merge assembly");
 
-			const double val = local_assembler_.compute_energy(vals, displacement, loc_storage.da);
-			loc_storage.val += val;
 #ifdef POLYFEM_WITH_TBB
-		}});
-#else
+		if (energy)
+		{
+			*energy = 0;
+			for (LocalStorage::iterator i = storages.begin(); i != storages.end(); ++i)
+				*energy += i->val;
 		}
-#endif
-
 
-#ifdef POLYFEM_WITH_TBB
-	double res = 0;
-	for (LocalStorage::iterator i = storages.begin(); i != storages.end();  ++i)
-	{
-		res += i->val;
-	}
+		if (grad)
+		{
+			grad->setZero(n_dofs, 1);
+			for (LocalStorage::iterator i = storages.begin(); i != storages.end(); ++i)
+				*grad += i->vec;
+		}
 
-	return res;
+		if (hessian)
+		{
+			record_buffers_memory(storages);
+			merge_matrices(storages, *hessian);
+		}
 #else
-		return loc_storage.val;
+		if (energy)
+			*energy = loc_storage.val;
+
+		if (grad)
+			*grad = loc_storage.vec;
+
+		if (hessian)
+		{
+			record_buffers_memory(loc_storage);
+			*hessian = loc_storage.stiffness;
+			loc_storage.tmp_mat.setFromTriplets(loc_storage.entries.begin(), loc_storage.entries.end());
+			*hessian += loc_storage.tmp_mat;
+			hessian->makeCompressed();
+		}
 #endif
 
+		logger().trace("done merge assembly {}s...", merge_zone.stop());
 	}
 
 	//template instantiation
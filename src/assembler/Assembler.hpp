@@ -4,6 +4,10 @@
 #include <polyfem/ElementAssemblyValues.hpp>
 
 #include <polyfem/Problem.hpp>
+#include <polyfem/StaticCondensation.hpp>
+#include <polyfem/ElementDofMap.hpp>
+#include <polyfem/ColoredAssembly.hpp>
+#include <polyfem/ElementMatrixCache.hpp>
 
 #include <Eigen/Sparse>
 #include <vector>
@@ -17,18 +21,30 @@ namespace polyfem
 	class Assembler
 	{
 	public:
+		//with a condensation, the dofs it condenses are eliminated from the local matrices and
+		//stiffness is the skeleton system. dof_map is the map of bases, built here if null, and the colored
+		//assembly of a given dof_map takes its coloring from colorings when there is one.
+		//element_matrices keeps the local matrices, the elements with the same order are not integrated again
 		void assemble(
 			const bool is_volume,
 			const int n_basis,
 			const std::vector< ElementBases > &bases,
 			const std::vector< ElementBases > &gbases,
-			StiffnessMatrix &stiffness) const;
+			StiffnessMatrix &stiffness,
+			StaticCondensation *condensation = nullptr,
+			const ElementDofMap *dof_map = nullptr,
+			ColoredAssemblyCache *colorings = nullptr,
+			ElementMatrixCache *element_matrices = nullptr) const;
 
 		inline LocalAssembler &local_assembler() { return local_assembler_; }
 		inline const LocalAssembler &local_assembler() const { return local_assembler_; }
 
+		//assembles the elements by colors directly in the output matrix, without thread local matrices
+		void set_colored_assembly(const bool colored) { colored_ = colored; }
+
 	private:
 		LocalAssembler local_assembler_;
+		bool colored_ = false;
 	};
 
 
@@ -36,6 +52,7 @@ namespace polyfem
 	class MixedAssembler
 	{
 	public:
+		//psi_map and phi_map are the maps of psi_bases and phi_bases, built here if null, see Assembler for colorings
 		void assemble(
 			const bool is_volume,
 			const int n_psi_basis,
@@ -43,13 +60,20 @@ namespace polyfem
 			const std::vector< ElementBases > &psi_bases,
 			const std::vector< ElementBases > &phi_bases,
 			const std::vector< ElementBases > &gbases,
-			StiffnessMatrix &stiffness) const;
+			StiffnessMatrix &stiffness,
+			const ElementDofMap *psi_map = nullptr,
+			const ElementDofMap *phi_map = nullptr,
+			ColoredAssemblyCache *colorings = nullptr) const;
 
 		inline LocalAssembler &local_assembler() { return local_assembler_; }
 		inline const LocalAssembler &local_assembler() const { return local_assembler_; }
 
+		//assembles the elements by colors directly in the output matrix, without thread local matrices
+		void set_colored_assembly(const bool colored) { colored_ = colored; }
+
 	private:
 		LocalAssembler local_assembler_;
+		bool colored_ = false;
 	};
 
 
@@ -63,7 +87,8 @@ namespace polyfem
 			const std::vector< ElementBases > &bases,
 			const std::vector< ElementBases > &gbases,
 			const Eigen::MatrixXd &displacement,
-			Eigen::MatrixXd &rhs) const;
+			Eigen::MatrixXd &rhs,
+			const ElementDofMap *dof_map = nullptr) const;
 
 		void assemble_hessian(
 			const bool is_volume,
@@ -71,7 +96,9 @@ namespace polyfem
 			const std::vector< ElementBases > &bases,
 			const std::vector< ElementBases > &gbases,
 			const Eigen::MatrixXd &displacement,
-			StiffnessMatrix &grad) const;
+			StiffnessMatrix &grad,
+			const ElementDofMap *dof_map = nullptr,
+			ColoredAssemblyCache *colorings = nullptr) const;
 
 		double assemble(
 			const bool is_volume,
@@ -79,13 +106,31 @@ namespace polyfem
 			const std::vector< ElementBases > &gbases,
 			const Eigen::MatrixXd &displacement) const;
 
+		//energy, gradient and hessian in a single loop over the elements, the null ones are not computed.
+		//dof_map is the map of bases, built here if null and needed, see Assembler for colorings
+		void assemble_quantities(
+			const bool is_volume,
+			const int n_basis,
+			const std::vector< ElementBases > &bases,
+			const std::vector< ElementBases > &gbases,
+			const Eigen::MatrixXd &displacement,
+			double *energy,
+			Eigen::MatrixXd *grad,
+			StiffnessMatrix *hessian,
+			const ElementDofMap *dof_map = nullptr,
+			ColoredAssemblyCache *colorings = nullptr) const;
+
 		inline LocalAssembler &local_assembler() { return local_assembler_; }
 		inline const LocalAssembler &local_assembler() const { return local_assembler_; }
 
+		//assembles the elements by colors directly in the output matrix, without thread local matrices
+		void set_colored_assembly(const bool colored) { colored_ = colored; }
+
 		void clear_cache() { }
 
 	private:
 		LocalAssembler local_assembler_;
+		bool colored_ = false;
 	};
 }
 
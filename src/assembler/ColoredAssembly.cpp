@@ -0,0 +1,199 @@
+#include <polyfem/ColoredAssembly.hpp>
+
+#include <polyfem/Logger.hpp>
+#include <polyfem/MemoryTracker.hpp>
+
+#ifdef POLYFEM_WITH_TBB
+#include <tbb/parallel_for.h>
+#endif
+
+namespace polyfem
+{
+	namespace
+	{
+		//sorted global nodes of every element (compressed rows), including the weighted nodes of the non conforming bases
+		void element_nodes(const ElementDofMap &dof_map, std::vector<int> &offsets, std::vector<int> &nodes)
+		{
+			const int n_elements = dof_map.n_elements();
+			offsets.resize(n_elements + 1);
+			offsets[0] = 0;
+			nodes.clear();
+
+			for (int e = 0; e < n_elements; ++e)
+			{
+				for (int j = 0; j < dof_map.n_local_bases(e); ++j)
+					dof_map.for_each_node(e, j, [&](const int index, const double) { nodes.push_back(index); });
+
+				const auto begin = nodes.begin() + offsets[e];
+				std::sort(begin, nodes.end());
+				nodes.erase(std::unique(begin, nodes.end()), nodes.end());
+				offsets[e + 1] = int(nodes.size());
+			}
+		}
+	} // namespace
+
+	void ColoredAssembly::build(const ElementDofMap &dof_map, const int n_nodes, const int size)
+	{
+		build(dof_map, n_nodes, size, dof_map, n_nodes, size);
+	}
+
+	void ColoredAssembly::build(const ElementDofMap &row_map, const int n_row_nodes, const int row_size,
+								const ElementDofMap &col_map, const int n_col_nodes, const int col_size)
+	{
+		assert(row_map.n_elements() == col_map.n_elements());
+		const int n_elements = col_map.n_elements();
+
+		std::vector<int> col_offsets, col_nodes;
+		element_nodes(col_map, col_offsets, col_nodes);
+		std::vector<int> other_offsets, other_nodes;
+		const bool is_square = &row_map == &col_map;
+		if (!is_square)
+			element_nodes(row_map, other_offsets, other_nodes);
+		const std::vector<int> &row_offsets = is_square ? col_offsets : other_offsets;
+		const std::vector<int> &row_nodes = is_square ? col_nodes : other_nodes;
+
+		//elements of every column node
+		std::vector<int> node_offsets(n_col_nodes + 1, 0);
+		for (const int a : col_nodes)
+			++node_offsets[a + 1];
+		for (int a = 0; a < n_col_nodes; ++a)
+			node_offsets[a + 1] += node_offsets[a];
+
+		std::vector<int> node_elements(col_nodes.size());
+		{
+			std::vector<int> pos(node_offsets.begin(), node_offsets.end() - 1);
+			for (int e = 0; e < n_elements; ++e)
+			{
+				for (int k = col_offsets[e]; k < col_offsets[e + 1]; ++k)
+					node_elements[pos[col_nodes[k]]++] = e;
+			}
+		}
+
+		//greedy coloring, the elements sharing a column node get different colors
+		colors_.clear();
+		std::vector<int> element_color(n_elements, -1);
+		std::vector<int> forbidden;
+		for (int e = 0; e < n_elements; ++e)
+		{
+			for (int k = col_offsets[e]; k < col_offsets[e + 1]; ++k)
+			{
+				const int a = col_nodes[k];
+				for (int l = node_offsets[a]; l < node_offsets[a + 1]; ++l)
+				{
+					const int c = element_color[node_elements[l]];
+					if (c >= 0)
+						forbidden[c] = e;
+				}
+			}
+
+			int c = 0;
+			while (c < int(forbidden.size()) && forbidden[c] == e)
+				++c;
+
+			if (c == int(forbidden.size()))
+			{
+				forbidden.push_back(-1);
+				colors_.emplace_back();
+			}
+
+			element_color[e] = c;
+			colors_[c].push_back(e);
+		}
+
+		//row nodes of every column node, the columns of a node are independent
+		std::vector<std::vector<int>> adjacency(n_col_nodes);
+		const auto node_adjacency = [&](const int a) {
+			std::vector<int> &adj = adjacency[a];
+			for (int l = node_offsets[a]; l < node_offsets[a + 1]; ++l)
+			{
+				const int e = node_elements[l];
+				adj.insert(adj.end(), row_nodes.begin() + row_offsets[e], row_nodes.begin() + row_offsets[e + 1]);
+			}
+
+			std::sort(adj.begin(), adj.end());
+			adj.erase(std::unique(adj.begin(), adj.end()), adj.end());
+			adj.shrink_to_fit();
+		};
+
+#ifdef POLYFEM_WITH_TBB
+		tbb::parallel_for(tbb::blocked_range<int>(0, n_col_nodes), [&](const tbb::blocked_range<int> &r) {
+			for (int a = r.begin(); a != r.end(); ++a)
+				node_adjacency(a);
+		});
+#else
+		for (int a = 0; a < n_col_nodes; ++a)
+			node_adjacency(a);
+#endif
+
+		//compressed pattern, the column a*col_size+n has the rows b*row_size+m for the adjacent nodes b
+		rows_ = n_row_nodes * row_size;
+		cols_ = n_col_nodes * col_size;
+		outer_.resize(cols_ + 1);
+		outer_[0] = 0;
+		for (int a = 0; a < n_col_nodes; ++a)
+		{
+			for (int n = 0; n < col_size; ++n)
+				outer_[a * col_size + n + 1] = outer_[a * col_size + n] + StorageIndex(adjacency[a].size() * row_size);
+		}
+
+		const StorageIndex nnz = outer_[cols_];
+		inner_.resize(nnz);
+		for (int a = 0; a < n_col_nodes; ++a)
+		{
+			for (int n = 0; n < col_size; ++n)
+			{
+				StorageIndex index = outer_[a * col_size + n];
+				for (const int b : adjacency[a])
+				{
+					for (int m = 0; m < row_size; ++m)
+						inner_[index++] = b * row_size + m;
+				}
+			}
+
+			std::vector<int>().swap(adjacency[a]);
+		}
+
+		logger().debug("colored assembly: {} colors for {} elements, {} non zeros", n_colors(), n_elements, nnz);
+	}
+
+	void ColoredAssembly::init_matrix(StiffnessMatrix &mat) const
+	{
+		mat.resize(rows_, cols_);
+		mat.resizeNonZeros(StorageIndex(inner_.size()));
+		std::copy(outer_.begin(), outer_.end(), mat.outerIndexPtr());
+		std::copy(inner_.begin(), inner_.end(), mat.innerIndexPtr());
+		std::fill(mat.valuePtr(), mat.valuePtr() + inner_.size(), 0.);
+	}
+
+	size_t ColoredAssembly::memory_bytes() const
+	{
+		size_t res = polyfem::memory_bytes(colors_) + polyfem::memory_bytes(outer_) + polyfem::memory_bytes(inner_);
+		for (const auto &c : colors_)
+			res += polyfem::memory_bytes(c);
+		return res;
+	}
+
+	const ColoredAssembly &ColoredAssemblyCache::get(const ElementDofMap &row_map, const int n_row_nodes, const int row_size,
+													 const ElementDofMap &col_map, const int n_col_nodes, const int col_size)
+	{
+		for (const auto &entry : entries_)
+		{
+			if (entry->row_map == &row_map && entry->n_row_nodes == n_row_nodes && entry->row_size == row_size
+				&& entry->col_map == &col_map && entry->n_col_nodes == n_col_nodes && entry->col_size == col_size)
+				return entry->coloring;
+		}
+
+		std::unique_ptr<Entry> entry(new Entry{&row_map, &col_map, n_row_nodes, row_size, n_col_nodes, col_size, ColoredAssembly()});
+		entry->coloring.build(row_map, n_row_nodes, row_size, col_map, n_col_nodes, col_size);
+		entries_.push_back(std::move(entry));
+		return entries_.back()->coloring;
+	}
+
+	size_t ColoredAssemblyCache::memory_bytes() const
+	{
+		size_t res = 0;
+		for (const auto &entry : entries_)
+			res += entry->coloring.memory_bytes();
+		return res;
+	}
+} // namespace polyfem
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <polyfem/Types.hpp>
+#include <polyfem/ElementDofMap.hpp>
+
+#include <Eigen/Sparse>
+
+#include <algorithm>
+#include <cassert>
+#include <memory>
+#include <vector>
+
+namespace polyfem
+{
+	//Race free parallel scatter in a single matrix. The elements are greedily colored so that two elements of
+	//the same color have no common column node, build computes the compressed pattern of the matrix once
+	//(only its indices are kept), init_matrix allocates the output with this pattern, and the elements of a
+	//color can then be assembled in parallel adding their values in place: two threads never write in the
+	//same column. There are no thread local matrices and no merge, the memory does not depend on the number
+	//of threads.
+	class ColoredAssembly
+	{
+	public:
+		//square matrix, the rows and the columns are the n_nodes nodes of dof_map with size components each
+		void build(const ElementDofMap &dof_map, const int n_nodes, const int size);
+		//rectangular matrix, the columns (and the colors) are the nodes of col_map, the rows the ones of row_map
+		void build(const ElementDofMap &row_map, const int n_row_nodes, const int row_size,
+				   const ElementDofMap &col_map, const int n_col_nodes, const int col_size);
+
+		int n_colors() const { return int(colors_.size()); }
+		const std::vector<int> &color(const int c) const { return colors_[c]; }
+
+		//mat gets the pattern with zero values, its storage is reused when large enough
+		void init_matrix(StiffnessMatrix &mat) const;
+
+		size_t memory_bytes() const;
+
+		//adds value to the entry (i, j) of a matrix built by build, the entry must be in the pattern
+		static void add(StiffnessMatrix &mat, const int i, const int j, const double value)
+		{
+			typedef StiffnessMatrix::StorageIndex StorageIndex;
+			const StorageIndex *inner = mat.innerIndexPtr();
+			const StorageIndex *begin = inner + mat.outerIndexPtr()[j];
+			const StorageIndex *end = inner + mat.outerIndexPtr()[j + 1];
+			const StorageIndex *it = std::lower_bound(begin, end, StorageIndex(i));
+			assert(it != end && *it == i);
+
+			mat.valuePtr()[it - inner] += value;
+		}
+
+	private:
+		typedef StiffnessMatrix::StorageIndex StorageIndex;
+
+		std::vector<std::vector<int>> colors_;
+		int rows_ = 0, cols_ = 0;
+		std::vector<StorageIndex> outer_, inner_;
+	};
+
+	//colorings of the dof maps of a basis set, every matrix shape is colored at its first assembly and then
+	//reused. get is not thread safe: a cache belongs to one owner of the maps (e.g. State::colorings), whose
+	//assemblies must not run concurrently, and the colorings of a map are dropped before it changes
+	class ColoredAssemblyCache
+	{
+	public:
+		const ColoredAssembly &get(const ElementDofMap &row_map, const int n_row_nodes, const int row_size,
+								   const ElementDofMap &col_map, const int n_col_nodes, const int col_size);
+		void clear() { entries_.clear(); }
+
+		size_t memory_bytes() const;
+
+	private:
+		struct Entry
+		{
+			const ElementDofMap *row_map;
+			const ElementDofMap *col_map;
+			int n_row_nodes, row_size;
+			int n_col_nodes, col_size;
+			ColoredAssembly coloring;
+		};
+		std::vector<std::unique_ptr<Entry>> entries_;
+	};
+} // namespace polyfem
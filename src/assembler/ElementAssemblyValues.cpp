@@ -193,15 +193,17 @@ namespace polyfem
 
 
 
-	void ElementAssemblyValues::compute(const int el_index, const bool is_volume, const ElementBases &basis, const ElementBases &gbasis)
+	void ElementAssemblyValues::compute(const int el_index, const bool is_volume, const ElementBases &basis, const ElementBases &gbasis, const bool with_global)
 	{
 		basis.compute_quadrature(quadrature);
-		compute(el_index, is_volume, quadrature.points, basis, gbasis);
+		compute(el_index, is_volume, quadrature.points, basis, gbasis, with_global);
+		at_quadrature = true;
 	}
 
-	void ElementAssemblyValues::compute(const int el_index, const bool is_volume, const Eigen::MatrixXd &pts, const ElementBases &basis, const ElementBases &gbasis)
+	void ElementAssemblyValues::compute(const int el_index, const bool is_volume, const Eigen::MatrixXd &pts, const ElementBases &basis, const ElementBases &gbasis, const bool with_global)
 	{
 		element_id = el_index;
+		at_quadrature = false;
 		// const bool poly = !gbasis.has_parameterization;
 
 		basis_values.resize(basis.bases.size());
@@ -266,7 +268,10 @@ namespace polyfem
 		for(int j = 0; j < n_local_bases; ++j)
 		{
 			AssemblyValues &ass_val = basis_values[j];
-			ass_val.global = basis.bases[j].global();
+			if (with_global)
+				ass_val.global = basis.bases[j].global();
+			else
+				ass_val.global.clear();
 			assert(ass_val.val.cols()==1);
 			assert(ass_val.grad.cols() == pts.cols());
 		}
@@ -24,8 +24,12 @@ namespace polyfem
 
 		bool has_parameterization = true;
 
-		void compute(const int el_index, const bool is_volume, const ElementBases &basis, const ElementBases &gbasis);
-		void compute(const int el_index, const bool is_volume, const Eigen::MatrixXd &pts, const ElementBases &basis, const ElementBases &gbasis);
+		//true when val are the images of the quadrature points of element_id, false when computed at given points
+		bool at_quadrature = false;
+
+		//without with_global the global nodes of basis_values are left empty, for the assemblers scattering with an ElementDofMap
+		void compute(const int el_index, const bool is_volume, const ElementBases &basis, const ElementBases &gbasis, const bool with_global = true);
+		void compute(const int el_index, const bool is_volume, const Eigen::MatrixXd &pts, const ElementBases &basis, const ElementBases &gbasis, const bool with_global = true);
 		bool is_geom_mapping_positive(const bool is_volume, const ElementBases &gbasis) const;
 
 	private:
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <Eigen/Dense>
+
+#include <algorithm>
+#include <vector>
+
+namespace polyfem
+{
+	//Local element matrices kept between assemblies on the same mesh and material (e.g., the cycles of the adaptive p-refinement).
+	//The local bases of an element only depend on its order, the matrix of an element is reused as long as its order and
+	//number of local bases are the same, only the scatter to the (new) global numbering is redone.
+	class ElementMatrixCache
+	{
+	public:
+		void clear()
+		{
+			orders_.clear();
+			n_local_bases_.clear();
+			matrices_.clear();
+			reused_.clear();
+		}
+
+		//before the assembly loop, entries of distinct elements can then be accessed in parallel
+		void resize(const int n_elements)
+		{
+			orders_.resize(n_elements, -1);
+			n_local_bases_.resize(n_elements, -1);
+			matrices_.resize(n_elements);
+			reused_.assign(n_elements, 0);
+		}
+
+		//nullptr if the element has no matrix for this order
+		const Eigen::MatrixXd *find(const int e, const int order, const int n_local_bases)
+		{
+			if (e >= int(matrices_.size()) || orders_[e] != order || n_local_bases_[e] != n_local_bases)
+				return nullptr;
+
+			reused_[e] = 1;
+			return &matrices_[e];
+		}
+
+		void store(const int e, const int order, const int n_local_bases, const Eigen::MatrixXd &local)
+		{
+			orders_[e] = order;
+			n_local_bases_[e] = n_local_bases;
+			matrices_[e] = local;
+		}
+
+		//elements reused by the last assembly
+		int n_reused() const { return int(std::count(reused_.begin(), reused_.end(), 1)); }
+
+	private:
+		std::vector<int> orders_;
+		std::vector<int> n_local_bases_;
+		std::vector<Eigen::MatrixXd> matrices_;
+		std::vector<char> reused_;
+	};
+} // namespace polyfem
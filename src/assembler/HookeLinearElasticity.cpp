@@ -193,41 +193,52 @@ namespace polyfem
 
 	void HookeLinearElasticity::compute_stress_tensor(const int el_id, const ElementBases &bs, const ElementBases &gbs, const Eigen::MatrixXd &local_pts, const Eigen::MatrixXd &displacement, Eigen::MatrixXd &stresses) const
 	{
-		assign_stress_tensor(el_id, bs, gbs, local_pts, displacement, size()*size(), stresses, [&](const Eigen::MatrixXd &stress)
+		stresses.resize(local_pts.rows(), size()*size());
+		assign_stress_tensor(el_id, bs, gbs, local_pts, displacement, [&](const int p, const StressMatrix &stress)
 		{
-			Eigen::MatrixXd tmp = stress;
-			auto a = Eigen::Map<Eigen::MatrixXd>(tmp.data(), 1, size()*size());
-			return Eigen::MatrixXd(a);
+			stresses.row(p) = Eigen::Map<const Eigen::RowVectorXd>(stress.data(), stress.size());
 		});
 	}
 
 	void HookeLinearElasticity::compute_von_mises_stresses(const int el_id, const ElementBases &bs, const ElementBases &gbs, const Eigen::MatrixXd &local_pts, const Eigen::MatrixXd &displacement, Eigen::MatrixXd &stresses) const
 	{
-		assign_stress_tensor(el_id, bs, gbs, local_pts, displacement, 1, stresses, [&](const Eigen::MatrixXd &stress)
+		stresses.resize(local_pts.rows(), 1);
+		assign_stress_tensor(el_id, bs, gbs, local_pts, displacement, [&](const int p, const StressMatrix &stress)
 		{
-			Eigen::Matrix<double, 1,1> res; res.setConstant(von_mises_stress_for_stress_tensor(stress));
-			return res;
+			stresses(p) = von_mises_stress_for_stress_tensor(stress);
 		});
 	}
 
-	void HookeLinearElasticity::assign_stress_tensor(const int el_id, const ElementBases &bs, const ElementBases &gbs, const Eigen::MatrixXd &local_pts, const Eigen::MatrixXd &displacement, const int all_size, Eigen::MatrixXd &all, const std::function<Eigen::MatrixXd(const Eigen::MatrixXd &)> &fun) const
+	void HookeLinearElasticity::compute_stress_and_von_mises(const int el_id, const ElementBases &bs, const ElementBases &gbs, const Eigen::MatrixXd &local_pts, const Eigen::MatrixXd &displacement, Eigen::MatrixXd &tensor, Eigen::MatrixXd &von_mises) const
 	{
-		Eigen::MatrixXd displacement_grad(size(), size());
+		tensor.resize(local_pts.rows(), size()*size());
+		von_mises.resize(local_pts.rows(), 1);
+		assign_stress_tensor(el_id, bs, gbs, local_pts, displacement, [&](const int p, const StressMatrix &stress)
+		{
+			tensor.row(p) = Eigen::Map<const Eigen::RowVectorXd>(stress.data(), stress.size());
+			von_mises(p) = von_mises_stress_for_stress_tensor(stress);
+		});
+	}
 
-		assert(displacement.cols() == 1);
+	void HookeLinearElasticity::assign_stress_tensor(const int el_id, const ElementBases &bs, const ElementBases &gbs, const Eigen::MatrixXd &local_pts, const Eigen::MatrixXd &displacement, const std::function<void(const int p, const StressMatrix &stress)> &fun) const
+	{
+		StressMatrix displacement_grad(size(), size());
 
-		all.resize(local_pts.rows(), all_size);
+		assert(displacement.cols() == 1);
 
 		ElementAssemblyValues vals;
 		vals.compute(el_id, size() == 3, local_pts, bs, gbs);
 
+		Eigen::MatrixXd local_displacement;
+		compute_local_displacement(size(), bs, displacement, local_displacement);
+
 
 		for(long p = 0; p < local_pts.rows(); ++p)
 		{
-			compute_diplacement_grad(size(), bs, vals, local_pts, p, displacement, displacement_grad);
+			compute_diplacement_grad(size(), vals, local_displacement, p, displacement_grad);
 
-			Eigen::MatrixXd strain = (displacement_grad + displacement_grad.transpose())/2;
-			Eigen::MatrixXd sigma(size(), size());
+			const StressMatrix strain = (displacement_grad + displacement_grad.transpose())/2;
+			StressMatrix sigma(size(), size());
 
 			if(size() == 2)
 			{
@@ -256,7 +267,7 @@ namespace polyfem
 				elasticity_tensor_.compute_stress<6>(eps, 4), elasticity_tensor_.compute_stress<6>(eps, 3), elasticity_tensor_.compute_stress<6>(eps, 2);
 			}
 
-			all.row(p) = fun(sigma);
+			fun(p, sigma);
 		}
 	}
 
@@ -11,6 +11,11 @@ namespace polyfem
 		params_.init_multimaterial(Es, nus);
 	}
 
+	void IncompressibleLinearElasticityDispacement::precompute_parameters(const bool is_volume, const std::vector<ElementBases> &bases, const std::vector<ElementBases> &gbases)
+	{
+		params_.precompute(is_volume, bases, gbases);
+	}
+
 	void IncompressibleLinearElasticityDispacement::set_parameters(const json &params)
 	{
 		set_size(params["size"]);
@@ -58,7 +63,7 @@ namespace polyfem
 					epsj = ((epsj + epsj.transpose()) / 2.0).eval();
 
 					double lambda, mu;
-					params_.lambda_mu(vals.val(p, 0), vals.val(p, 1), size_ == 2 ? 0. : vals.val(p, 2), vals.element_id, lambda, mu);
+					params_.lambda_mu(vals, p, lambda, mu);
 
 					res(dj*size() + di) += 2 * mu * (epsi.array() * epsj.array()).sum() * da(p);
 				}
@@ -79,45 +84,57 @@ namespace polyfem
 
 	void IncompressibleLinearElasticityDispacement::compute_stress_tensor(const int el_id, const ElementBases &bs, const ElementBases &gbs, const Eigen::MatrixXd &local_pts, const Eigen::MatrixXd &displacement, Eigen::MatrixXd &stresses) const
 	{
-		assign_stress_tensor(el_id, bs, gbs, local_pts, displacement, size()*size(), stresses, [&](const Eigen::MatrixXd &stress)
+		stresses.resize(local_pts.rows(), size()*size());
+		assign_stress_tensor(el_id, bs, gbs, local_pts, displacement, [&](const int p, const StressMatrix &stress)
 		{
-			Eigen::MatrixXd tmp = stress;
-			auto a = Eigen::Map<Eigen::MatrixXd>(tmp.data(), 1, size()*size());
-			return Eigen::MatrixXd(a);
+			stresses.row(p) = Eigen::Map<const Eigen::RowVectorXd>(stress.data(), stress.size());
 		});
 	}
 
 	void IncompressibleLinearElasticityDispacement::compute_von_mises_stresses(const int el_id, const ElementBases &bs, const ElementBases &gbs, const Eigen::MatrixXd &local_pts, const Eigen::MatrixXd &displacement, Eigen::MatrixXd &stresses) const
 	{
-		assign_stress_tensor(el_id, bs, gbs, local_pts, displacement, 1, stresses, [&](const Eigen::MatrixXd &stress)
+		stresses.resize(local_pts.rows(), 1);
+		assign_stress_tensor(el_id, bs, gbs, local_pts, displacement, [&](const int p, const StressMatrix &stress)
+		{
+			stresses(p) = von_mises_stress_for_stress_tensor(stress);
+		});
+	}
+
+	void IncompressibleLinearElasticityDispacement::compute_stress_and_von_mises(const int el_id, const ElementBases &bs, const ElementBases &gbs, const Eigen::MatrixXd &local_pts, const Eigen::MatrixXd &displacement, Eigen::MatrixXd &tensor, Eigen::MatrixXd &von_mises) const
+	{
+		tensor.resize(local_pts.rows(), size()*size());
+		von_mises.resize(local_pts.rows(), 1);
+		assign_stress_tensor(el_id, bs, gbs, local_pts, displacement, [&](const int p, const StressMatrix &stress)
 		{
-			Eigen::Matrix<double, 1,1> res; res.setConstant(von_mises_stress_for_stress_tensor(stress));
-			return res;
+			tensor.row(p) = Eigen::Map<const Eigen::RowVectorXd>(stress.data(), stress.size());
+			von_mises(p) = von_mises_stress_for_stress_tensor(stress);
 		});
 	}
 
-	void IncompressibleLinearElasticityDispacement::assign_stress_tensor(const int el_id, const ElementBases &bs, const ElementBases &gbs, const Eigen::MatrixXd &local_pts, const Eigen::MatrixXd &displacement, const int all_size, Eigen::MatrixXd &all, const std::function<Eigen::MatrixXd(const Eigen::MatrixXd &)> &fun) const
+	void IncompressibleLinearElasticityDispacement::assign_stress_tensor(const int el_id, const ElementBases &bs, const ElementBases &gbs, const Eigen::MatrixXd &local_pts, const Eigen::MatrixXd &displacement, const std::function<void(const int p, const StressMatrix &stress)> &fun) const
 	{
 		assert(size_ == 2 || size_ == 3);
-		all.resize(local_pts.rows(), all_size);
 		assert(displacement.cols() == 1);
 
-		Eigen::MatrixXd displacement_grad(size(), size());
+		StressMatrix displacement_grad(size(), size());
 
 		ElementAssemblyValues vals;
 		vals.compute(el_id, size() == 3, local_pts, bs, gbs);
 
+		Eigen::MatrixXd local_displacement;
+		compute_local_displacement(size(), bs, displacement, local_displacement);
+
 		for(long p = 0; p < local_pts.rows(); ++p)
 		{
-			compute_diplacement_grad(size(), bs, vals, local_pts, p, displacement, displacement_grad);
+			compute_diplacement_grad(size(), vals, local_displacement, p, displacement_grad);
 
 			double lambda, mu;
-			params_.lambda_mu(vals.val(p, 0), vals.val(p, 1), size_ == 2 ? 0. : vals.val(p, 2), vals.element_id, lambda, mu);
+			params_.lambda_mu(vals, p, lambda, mu);
 
-			const Eigen::MatrixXd strain = (displacement_grad + displacement_grad.transpose())/2;
-			const Eigen::MatrixXd stress = 2 * mu * strain + lambda * strain.trace() * Eigen::MatrixXd::Identity(size(), size());
+			const StressMatrix strain = (displacement_grad + displacement_grad.transpose())/2;
+			const StressMatrix stress = 2 * mu * strain + lambda * strain.trace() * StressMatrix::Identity(size(), size());
 
-			all.row(p) = fun(stress);
+			fun(p, stress);
 		}
 	}
 
@@ -177,6 +194,11 @@ namespace polyfem
 		params_.init_multimaterial(Es, nus);
 	}
 
+	void IncompressibleLinearElasticityPressure::precompute_parameters(const bool is_volume, const std::vector<ElementBases> &bases, const std::vector<ElementBases> &gbases)
+	{
+		params_.precompute(is_volume, bases, gbases);
+	}
+
 	void IncompressibleLinearElasticityPressure::set_parameters(const json &params)
 	{
 		size_ = params["size"];
@@ -200,7 +222,7 @@ namespace polyfem
 
 		for (long p = 0; p < da.size(); ++p){
 			double lambda, mu;
-			params_.lambda_mu(vals.val(p, 0), vals.val(p, 1), size_ == 2 ? 0. : vals.val(p, 2), vals.element_id, lambda, mu);
+			params_.lambda_mu(vals, p, lambda, mu);
 
 			res += -phii(p) * phij(p) * da(p) / lambda;
 		}
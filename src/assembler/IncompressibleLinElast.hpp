@@ -29,15 +29,18 @@ namespace polyfem
 
 		void set_parameters(const json &params);
 		void init_multimaterial(Eigen::MatrixXd &Es, Eigen::MatrixXd &nus);
+		void precompute_parameters(const bool is_volume, const std::vector<ElementBases> &bases, const std::vector<ElementBases> &gbases);
 
 		void compute_von_mises_stresses(const int el_id, const ElementBases &bs, const ElementBases &gbs, const Eigen::MatrixXd &local_pts, const Eigen::MatrixXd &displacement, Eigen::MatrixXd &stresses) const;
 		void compute_stress_tensor(const int el_id, const ElementBases &bs, const ElementBases &gbs, const Eigen::MatrixXd &local_pts, const Eigen::MatrixXd &displacement, Eigen::MatrixXd &tensor) const;
+		//both in one pass, one row per point
+		void compute_stress_and_von_mises(const int el_id, const ElementBases &bs, const ElementBases &gbs, const Eigen::MatrixXd &local_pts, const Eigen::MatrixXd &displacement, Eigen::MatrixXd &tensor, Eigen::MatrixXd &von_mises) const;
 	private:
 		int size_ = -1;
 
 		LameParameters params_;
 
-		void assign_stress_tensor(const int el_id, const ElementBases &bs, const ElementBases &gbs, const Eigen::MatrixXd &local_pts, const Eigen::MatrixXd &displacement, const int all_size, Eigen::MatrixXd &all, const std::function<Eigen::MatrixXd(const Eigen::MatrixXd &)> &fun) const;
+		void assign_stress_tensor(const int el_id, const ElementBases &bs, const ElementBases &gbs, const Eigen::MatrixXd &local_pts, const Eigen::MatrixXd &displacement, const std::function<void(const int p, const StressMatrix &stress)> &fun) const;
 	};
 
 	class IncompressibleLinearElasticityMixed
@@ -81,6 +84,7 @@ namespace polyfem
 
 		void set_parameters(const json &params);
 		void init_multimaterial(Eigen::MatrixXd &Es, Eigen::MatrixXd &nus);
+		void precompute_parameters(const bool is_volume, const std::vector<ElementBases> &bases, const std::vector<ElementBases> &gbases);
 
 	private:
 		int size_ = -1;
@@ -13,6 +13,11 @@ namespace polyfem
 	}
 
 
+	void LinearElasticity::precompute_parameters(const bool is_volume, const std::vector<ElementBases> &bases, const std::vector<ElementBases> &gbases)
+	{
+		params_.precompute(is_volume, bases, gbases);
+	}
+
 	void LinearElasticity::set_parameters(const json &params)
 	{
 		size() = params["size"];
@@ -52,13 +57,14 @@ namespace polyfem
 //            res_k.setZero();
 			const Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, 0, 3, 3> outer = gradi.row(k).transpose() * gradj.row(k);
             const double dot = gradi.row(k).dot(gradj.row(k));
+
+			double lambda, mu;
+			params_.lambda_mu(vals, k, lambda, mu);
+
 			for(int ii = 0; ii < size(); ++ii)
 			{
 				for(int jj = 0; jj < size(); ++jj)
 				{
-					double lambda, mu;
-					params_.lambda_mu(vals.val(k, 0), vals.val(k, 1), size_ == 2 ? 0. : vals.val(k, 2), vals.element_id, lambda, mu);
-
 					res_k(jj * size() + ii) = outer(ii * size() + jj)* mu + outer(jj * size() + ii) * lambda;
 					if(ii == jj) res_k(jj * size() + ii) += mu * dot;
 				}
@@ -90,33 +96,45 @@ namespace polyfem
 
 	void LinearElasticity::compute_stress_tensor(const int el_id, const ElementBases &bs, const ElementBases &gbs, const Eigen::MatrixXd &local_pts, const Eigen::MatrixXd &displacement, Eigen::MatrixXd &stresses) const
 	{
-		assign_stress_tensor(el_id, bs, gbs, local_pts, displacement, size()*size(), stresses, [&](const Eigen::MatrixXd &stress)
+		stresses.resize(local_pts.rows(), size()*size());
+		assign_stress_tensor(el_id, bs, gbs, local_pts, displacement, [&](const int p, const StressMatrix &stress)
 		{
-			Eigen::MatrixXd tmp = stress;
-			auto a = Eigen::Map<Eigen::MatrixXd>(tmp.data(), 1, size()*size());
-			return Eigen::MatrixXd(a);
+			stresses.row(p) = Eigen::Map<const Eigen::RowVectorXd>(stress.data(), stress.size());
 		});
 	}
 
 	void LinearElasticity::compute_von_mises_stresses(const int el_id, const ElementBases &bs, const ElementBases &gbs, const Eigen::MatrixXd &local_pts, const Eigen::MatrixXd &displacement, Eigen::MatrixXd &stresses) const
 	{
-		assign_stress_tensor(el_id, bs, gbs, local_pts, displacement, 1, stresses, [&](const Eigen::MatrixXd &stress)
+		stresses.resize(local_pts.rows(), 1);
+		assign_stress_tensor(el_id, bs, gbs, local_pts, displacement, [&](const int p, const StressMatrix &stress)
 		{
-			Eigen::Matrix<double, 1,1> res; res.setConstant(von_mises_stress_for_stress_tensor(stress));
-			return res;
+			stresses(p) = von_mises_stress_for_stress_tensor(stress);
 		});
 	}
 
-	void LinearElasticity::assign_stress_tensor(const int el_id, const ElementBases &bs, const ElementBases &gbs, const Eigen::MatrixXd &local_pts, const Eigen::MatrixXd &displacement, const int all_size, Eigen::MatrixXd &all, const std::function<Eigen::MatrixXd(const Eigen::MatrixXd &)> &fun) const
+	void LinearElasticity::compute_stress_and_von_mises(const int el_id, const ElementBases &bs, const ElementBases &gbs, const Eigen::MatrixXd &local_pts, const Eigen::MatrixXd &displacement, Eigen::MatrixXd &tensor, Eigen::MatrixXd &von_mises) const
+	{
+		tensor.resize(local_pts.rows(), size()*size());
+		von_mises.resize(local_pts.rows(), 1);
+		assign_stress_tensor(el_id, bs, gbs, local_pts, displacement, [&](const int p, const StressMatrix &stress)
+		{
+			tensor.row(p) = Eigen::Map<const Eigen::RowVectorXd>(stress.data(), stress.size());
+			von_mises(p) = von_mises_stress_for_stress_tensor(stress);
+		});
+	}
+
+	void LinearElasticity::assign_stress_tensor(const int el_id, const ElementBases &bs, const ElementBases &gbs, const Eigen::MatrixXd &local_pts, const Eigen::MatrixXd &displacement, const std::function<void(const int p, const StressMatrix &stress)> &fun) const
 	{
-		all.resize(local_pts.rows(), all_size);
 		assert(displacement.cols() == 1);
 
-		Eigen::MatrixXd displacement_grad(size(), size());
+		StressMatrix displacement_grad(size(), size());
 
 		ElementAssemblyValues vals;
 		vals.compute(el_id, size() == 3, local_pts, bs, gbs);
 
+		Eigen::MatrixXd local_displacement;
+		compute_local_displacement(size(), bs, displacement, local_displacement);
+
 		for(long p = 0; p < local_pts.rows(); ++p)
 		{
 			// displacement_grad.setZero();
@@ -141,15 +159,15 @@ namespace polyfem
 
 			// displacement_grad = (displacement_grad * vals.jac_it[p]).eval();
 
-			compute_diplacement_grad(size(), bs, vals, local_pts, p, displacement, displacement_grad);
+			compute_diplacement_grad(size(), vals, local_displacement, p, displacement_grad);
 
 			double lambda, mu;
-			params_.lambda_mu(vals.val(p, 0), vals.val(p, 1), size_ == 2 ? 0. : vals.val(p, 2), vals.element_id, lambda, mu);
+			params_.lambda_mu(vals, p, lambda, mu);
 
-			const Eigen::MatrixXd strain = (displacement_grad + displacement_grad.transpose())/2;
-			const Eigen::MatrixXd stress = 2 * mu * strain + lambda * strain.trace() * Eigen::MatrixXd::Identity(size(), size());
+			const StressMatrix strain = (displacement_grad + displacement_grad.transpose())/2;
+			const StressMatrix stress = 2 * mu * strain + lambda * strain.trace() * StressMatrix::Identity(size(), size());
 
-			all.row(p) = fun(stress);
+			fun(p, stress);
 		}
 	}
 }
@@ -1,5 +1,6 @@
 #include "MassMatrixAssembler.hpp"
 
+#include <polyfem/ElementDofMap.hpp>
 #include <polyfem/Logger.hpp>
 
 #ifdef POLYFEM_WITH_TBB
@@ -25,6 +26,22 @@ namespace polyfem
 				tmp_mat.resize(mat_size, mat_size);
 				mass_mat.resize(mat_size, mat_size);
 			}
+
+			//the triplets are moved to the mass matrix when the buffer is full
+			void add(const int i, const int j, const double value)
+			{
+				entries.emplace_back(i, j, value);
+
+				if(entries.size() >= 1e8)
+				{
+					tmp_mat.setFromTriplets(entries.begin(), entries.end());
+					mass_mat += tmp_mat;
+					mass_mat.makeCompressed();
+
+					entries.clear();
+					logger().debug("cleaning memory...");
+				}
+			}
 		};
 	}
 
@@ -34,7 +51,8 @@ namespace polyfem
 		const int n_basis,
 		const std::vector< ElementBases > &bases,
 		const std::vector< ElementBases > &gbases,
-		StiffnessMatrix &mass) const
+		StiffnessMatrix &mass,
+		const ElementDofMap *cached_dof_map) const
 	{
 		const int buffer_size = std::min(long(1e8), long(n_basis) * size);
 		logger().debug("buffer_size {}", buffer_size);
@@ -50,6 +68,11 @@ namespace polyfem
 #endif
 
 		const int n_bases = int(bases.size());
+		ElementDofMap local_dof_map;
+		if (!cached_dof_map)
+			local_dof_map.build(bases, n_basis);
+		const ElementDofMap &dof_map = cached_dof_map ? *cached_dof_map : local_dof_map;
+		assert(dof_map.n_elements() == n_bases);
 
 #ifdef POLYFEM_WITH_TBB
 		tbb::parallel_for( tbb::blocked_range<int>(0, n_bases), [&](const tbb::blocked_range<int> &r) {
@@ -59,7 +82,7 @@ namespace polyfem
 		for(int e=0; e < n_bases; ++e) {
 #endif
 			ElementAssemblyValues vals;
-			vals.compute(e, is_volume, bases[e], gbases[e]);
+			vals.compute(e, is_volume, bases[e], gbases[e], false);
 
 			const Quadrature &quadrature = vals.quadrature;
 
@@ -67,14 +90,13 @@ namespace polyfem
 			const QuadratureVector da = vals.det.array() * quadrature.weights.array();
 			const int n_loc_bases = int(vals.basis_values.size());
 
+			const bool conforming = dof_map.is_conforming(e);
+			const int *dofs = dof_map.element_dofs(e);
+
 			for(int i = 0; i < n_loc_bases; ++i)
 			{
-				const auto &global_i = vals.basis_values[i].global;
-
 				for(int j = 0; j <= i; ++j)
 				{
-					const auto &global_j = vals.basis_values[j].global;
-
 					const double tmp = (vals.basis_values[i].val.array() * vals.basis_values[j].val.array() * da.array()).sum();
 					if (std::abs(tmp) < 1e-30) { continue; }
 
@@ -83,36 +105,25 @@ namespace polyfem
 					{
 						//local matrix is diagonal
 						const int m = n;
-						// for(int m = 0; m < size; ++m)
+						const double local_value = tmp;
+
+						if (conforming)
 						{
-							const double local_value = tmp; //val(n*size+m);
-							for(size_t ii = 0; ii < global_i.size(); ++ii)
-							{
-								const auto gi = global_i[ii].index*size+m;
-								const auto wi = global_i[ii].val;
-
-								for(size_t jj = 0; jj < global_j.size(); ++jj)
-								{
-									const auto gj = global_j[jj].index*size+n;
-									const auto wj = global_j[jj].val;
-
-									loc_storage.entries.emplace_back(gi, gj, local_value * wi * wj);
-									if (j < i) {
-										loc_storage.entries.emplace_back(gj, gi, local_value * wj * wi);
-									}
-
-									if(loc_storage.entries.size() >= 1e8)
-									{
-										loc_storage.tmp_mat.setFromTriplets(loc_storage.entries.begin(), loc_storage.entries.end());
-										loc_storage.mass_mat += loc_storage.tmp_mat;
-										loc_storage.mass_mat.makeCompressed();
-
-										loc_storage.entries.clear();
-										logger().debug("cleaning memory...");
-									}
-								}
-							}
+							loc_storage.add(dofs[i]*size+m, dofs[j]*size+n, local_value);
+							if (j < i)
+								loc_storage.add(dofs[j]*size+n, dofs[i]*size+m, local_value);
+							continue;
 						}
+
+						dof_map.for_each_node(e, i, [&](const int index_i, const double wi) {
+							const int gi = index_i*size+m;
+							dof_map.for_each_node(e, j, [&](const int index_j, const double wj) {
+								const int gj = index_j*size+n;
+								loc_storage.add(gi, gj, local_value * wi * wj);
+								if (j < i)
+									loc_storage.add(gj, gi, local_value * wj * wi);
+							});
+						});
 					}
 
 				// t1.stop();
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <polyfem/ElementAssemblyValues.hpp>
+#include <polyfem/ElementDofMap.hpp>
 
 #include <Eigen/Sparse>
 #include <vector>
@@ -13,12 +14,14 @@ namespace polyfem
 	class MassMatrixAssembler
 	{
 	public:
+		//dof_map is the map of bases, built here if null
 		void assemble(
 			const bool is_volume,
 			const int size,
 			const int n_basis,
 			const std::vector< ElementBases > &bases,
 			const std::vector< ElementBases > &gbases,
-			StiffnessMatrix &mass) const;
+			StiffnessMatrix &mass,
+			const ElementDofMap *dof_map = nullptr) const;
 	};
 }
@@ -22,11 +22,19 @@ namespace polyfem
 		params_.init_multimaterial(Es, nus);
 	}
 
+	void NeoHookeanElasticity::precompute_parameters(const bool is_volume, const std::vector<ElementBases> &bases, const std::vector<ElementBases> &gbases)
+	{
+		params_.precompute(is_volume, bases, gbases);
+	}
+
 	void NeoHookeanElasticity::set_parameters(const json &params)
 	{
 		set_size(params["size"]);
 
 		params_.init(params);
+
+		if (params.count("autodiff_backend"))
+			packet_autodiff_ = params["autodiff_backend"] == "packet";
 	}
 
 	void NeoHookeanElasticity::set_size(const int size)
@@ -59,6 +67,13 @@ namespace polyfem
 	{
 		const int n_bases = vals.basis_values.size();
 
+		if (packet_autodiff_)
+		{
+			return polyfem::gradient_from_density(size(), vals, displacement, da,
+				[&](const int p, double &lambda, double &mu) { params_.lambda_mu(vals, p, lambda, mu); },
+				[](const auto &def_grad, const auto &lambda, const auto &mu) { return compute_density(def_grad, lambda, mu); });
+		}
+
 		return polyfem::gradient_from_energy(size(), n_bases, vals, displacement, da,
 			[&](const ElementAssemblyValues &vals, const Eigen::MatrixXd &displacement, const QuadratureVector &da) { return compute_energy_aux<DScalar1<double, Eigen::Matrix<double, 6, 1>>>(vals, displacement, da); },
 			[&](const ElementAssemblyValues &vals, const Eigen::MatrixXd &displacement, const QuadratureVector &da) { return compute_energy_aux<DScalar1<double, Eigen::Matrix<double, 8, 1>>>(vals, displacement, da); },
@@ -78,6 +93,14 @@ namespace polyfem
 	NeoHookeanElasticity::assemble_grad(const ElementAssemblyValues &vals, const Eigen::MatrixXd &displacement, const QuadratureVector &da) const
 	{
 		const int n_bases = vals.basis_values.size();
+
+		if (packet_autodiff_)
+		{
+			return polyfem::hessian_from_density(size(), vals, displacement, da,
+				[&](const int p, double &lambda, double &mu) { params_.lambda_mu(vals, p, lambda, mu); },
+				[](const auto &def_grad, const auto &lambda, const auto &mu) { return compute_density(def_grad, lambda, mu); });
+		}
+
 		return polyfem::hessian_from_energy(size(), n_bases, vals, displacement, da,
 			[&](const ElementAssemblyValues &vals, const Eigen::MatrixXd &displacement, const QuadratureVector &da) { return compute_energy_aux<DScalar2<double, Eigen::Matrix<double, 6, 1>, Eigen::Matrix<double, 6, 6>>>(vals, displacement, da); },
 			[&](const ElementAssemblyValues &vals, const Eigen::MatrixXd &displacement, const QuadratureVector &da) { return compute_energy_aux<DScalar2<double, Eigen::Matrix<double, 8, 1>, Eigen::Matrix<double, 8, 8>>>(vals, displacement, da); },
@@ -94,53 +117,64 @@ namespace polyfem
 
 	void NeoHookeanElasticity::compute_stress_tensor(const int el_id, const ElementBases &bs, const ElementBases &gbs, const Eigen::MatrixXd &local_pts, const Eigen::MatrixXd &displacement, Eigen::MatrixXd &stresses) const
 	{
-		assign_stress_tensor(el_id, bs, gbs, local_pts, displacement, size()*size(), stresses, [&](const Eigen::MatrixXd &stress)
+		stresses.resize(local_pts.rows(), size()*size());
+		assign_stress_tensor(el_id, bs, gbs, local_pts, displacement, [&](const int p, const StressMatrix &stress)
 		{
-			Eigen::MatrixXd tmp = stress;
-			auto a = Eigen::Map<Eigen::MatrixXd>(tmp.data(), 1, size()*size());
-			return Eigen::MatrixXd(a);
+			stresses.row(p) = Eigen::Map<const Eigen::RowVectorXd>(stress.data(), stress.size());
 		});
 	}
 
 	void NeoHookeanElasticity::compute_von_mises_stresses(const int el_id, const ElementBases &bs, const ElementBases &gbs, const Eigen::MatrixXd &local_pts, const Eigen::MatrixXd &displacement, Eigen::MatrixXd &stresses) const
 	{
-		assign_stress_tensor(el_id, bs, gbs, local_pts, displacement, 1, stresses, [&](const Eigen::MatrixXd &stress)
+		stresses.resize(local_pts.rows(), 1);
+		assign_stress_tensor(el_id, bs, gbs, local_pts, displacement, [&](const int p, const StressMatrix &stress)
 		{
-			Eigen::Matrix<double, 1,1> res; res.setConstant(von_mises_stress_for_stress_tensor(stress));
-			return res;
+			stresses(p) = von_mises_stress_for_stress_tensor(stress);
 		});
 	}
 
-	void NeoHookeanElasticity::assign_stress_tensor(const int el_id, const ElementBases &bs, const ElementBases &gbs, const Eigen::MatrixXd &local_pts, const Eigen::MatrixXd &displacement, const int all_size, Eigen::MatrixXd &all, const std::function<Eigen::MatrixXd(const Eigen::MatrixXd &)> &fun) const
+	void NeoHookeanElasticity::compute_stress_and_von_mises(const int el_id, const ElementBases &bs, const ElementBases &gbs, const Eigen::MatrixXd &local_pts, const Eigen::MatrixXd &displacement, Eigen::MatrixXd &tensor, Eigen::MatrixXd &von_mises) const
 	{
-		Eigen::MatrixXd displacement_grad(size(), size());
+		tensor.resize(local_pts.rows(), size()*size());
+		von_mises.resize(local_pts.rows(), 1);
+		assign_stress_tensor(el_id, bs, gbs, local_pts, displacement, [&](const int p, const StressMatrix &stress)
+		{
+			tensor.row(p) = Eigen::Map<const Eigen::RowVectorXd>(stress.data(), stress.size());
+			von_mises(p) = von_mises_stress_for_stress_tensor(stress);
+		});
+	}
 
-		assert(displacement.cols() == 1);
+	void NeoHookeanElasticity::assign_stress_tensor(const int el_id, const ElementBases &bs, const ElementBases &gbs, const Eigen::MatrixXd &local_pts, const Eigen::MatrixXd &displacement, const std::function<void(const int p, const StressMatrix &stress)> &fun) const
+	{
+		StressMatrix displacement_grad(size(), size());
 
-		all.resize(local_pts.rows(), all_size);
+		assert(displacement.cols() == 1);
 
 		ElementAssemblyValues vals;
 		vals.compute(el_id, size() == 3, local_pts, bs, gbs);
 
+		Eigen::MatrixXd local_displacement;
+		compute_local_displacement(size(), bs, displacement, local_displacement);
+
 		for(long p = 0; p < local_pts.rows(); ++p)
 		{
-			compute_diplacement_grad(size(), bs, vals, local_pts, p, displacement, displacement_grad);
+			compute_diplacement_grad(size(), vals, local_displacement, p, displacement_grad);
 
-			const Eigen::MatrixXd def_grad = Eigen::MatrixXd::Identity(size(), size()) + displacement_grad;
-			const Eigen::MatrixXd FmT = def_grad.inverse().transpose();
+			const StressMatrix def_grad = StressMatrix::Identity(size(), size()) + displacement_grad;
+			const StressMatrix FmT = def_grad.inverse().transpose();
 			// const double J = def_grad.determinant();
 
 			double lambda, mu;
-			params_.lambda_mu(vals.val(p, 0), vals.val(p, 1), size_ == 2 ? 0. : vals.val(p, 2), vals.element_id, lambda, mu);
+			params_.lambda_mu(vals, p, lambda, mu);
 
 			//stress = mu (F - F^{-T}) + lambda ln J F^{-T}
 			//stress = mu * (def_grad - def_grad^{-T}) + lambda ln (det def_grad) def_grad^{-T}
-			Eigen::MatrixXd stress_tensor = mu*(def_grad - FmT) + lambda * std::log(def_grad.determinant()) * FmT;
+			const StressMatrix stress_tensor = mu*(def_grad - FmT) + lambda * std::log(def_grad.determinant()) * FmT;
 
 			//stess = (mu displacement_grad + lambda ln(J) I)/J
 			// Eigen::MatrixXd stress_tensor = (mu_/J) * displacement_grad + (lambda_/J) * std::log(J)  * Eigen::MatrixXd::Identity(size(), size());
 
-			all.row(p) = fun(stress_tensor);
+			fun(p, stress_tensor);
 		}
 	}
 
@@ -214,13 +248,19 @@ namespace polyfem
 
 
 			double lambda, mu;
-			params_.lambda_mu(vals.val(p, 0), vals.val(p, 1), size_ == 2 ? 0. : vals.val(p, 2), vals.element_id, lambda, mu);
+			params_.lambda_mu(vals, p, lambda, mu);
 
-			const T log_det_j = log(polyfem::determinant(def_grad));
-			const T val = mu / 2 * ( (def_grad.transpose() * def_grad).trace() - size() - 2*log_det_j) + lambda /2 * log_det_j * log_det_j;
+			const T val = compute_density(def_grad, lambda, mu);
 
 			energy += val * da(p);
 		}
 		return energy;
 	}
+
+	template<typename T, typename Param>
+	T NeoHookeanElasticity::compute_density(const Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic, 0, 3, 3> &def_grad, const Param &lambda, const Param &mu)
+	{
+		const T log_det_j = log(polyfem::determinant(def_grad));
+		return mu / 2 * ( (def_grad.transpose() * def_grad).trace() - def_grad.rows() - 2*log_det_j) + lambda /2 * log_det_j * log_det_j;
+	}
 }
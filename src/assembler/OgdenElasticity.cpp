@@ -124,24 +124,34 @@ namespace polyfem
 
 	void OgdenElasticity::compute_stress_tensor(const int el_id, const ElementBases &bs, const ElementBases &gbs, const Eigen::MatrixXd &local_pts, const Eigen::MatrixXd &displacement, Eigen::MatrixXd &stresses) const
 	{
-		assign_stress_tensor(el_id, bs, gbs, local_pts, displacement, size()*size(), stresses, [&](const Eigen::MatrixXd &stress)
+		stresses.resize(local_pts.rows(), size()*size());
+		assign_stress_tensor(el_id, bs, gbs, local_pts, displacement, [&](const int p, const StressMatrix &stress)
 		{
-			Eigen::MatrixXd tmp = stress;
-			auto a = Eigen::Map<Eigen::MatrixXd>(tmp.data(), 1, size()*size());
-			return Eigen::MatrixXd(a);
+			stresses.row(p) = Eigen::Map<const Eigen::RowVectorXd>(stress.data(), stress.size());
 		});
 	}
 
 	void OgdenElasticity::compute_von_mises_stresses(const int el_id, const ElementBases &bs, const ElementBases &gbs, const Eigen::MatrixXd &local_pts, const Eigen::MatrixXd &displacement, Eigen::MatrixXd &stresses) const
 	{
-		assign_stress_tensor(el_id, bs, gbs, local_pts, displacement, 1, stresses, [&](const Eigen::MatrixXd &stress)
+		stresses.resize(local_pts.rows(), 1);
+		assign_stress_tensor(el_id, bs, gbs, local_pts, displacement, [&](const int p, const StressMatrix &stress)
 		{
-			Eigen::Matrix<double, 1,1> res; res.setConstant(von_mises_stress_for_stress_tensor(stress));
-			return res;
+			stresses(p) = von_mises_stress_for_stress_tensor(stress);
 		});
 	}
 
-	void OgdenElasticity::assign_stress_tensor(const int el_id, const ElementBases &bs, const ElementBases &gbs, const Eigen::MatrixXd &local_pts, const Eigen::MatrixXd &displacement, const int all_size, Eigen::MatrixXd &all, const std::function<Eigen::MatrixXd(const Eigen::MatrixXd &)> &fun) const
+	void OgdenElasticity::compute_stress_and_von_mises(const int el_id, const ElementBases &bs, const ElementBases &gbs, const Eigen::MatrixXd &local_pts, const Eigen::MatrixXd &displacement, Eigen::MatrixXd &tensor, Eigen::MatrixXd &von_mises) const
+	{
+		tensor.resize(local_pts.rows(), size()*size());
+		von_mises.resize(local_pts.rows(), 1);
+		assign_stress_tensor(el_id, bs, gbs, local_pts, displacement, [&](const int p, const StressMatrix &stress)
+		{
+			tensor.row(p) = Eigen::Map<const Eigen::RowVectorXd>(stress.data(), stress.size());
+			von_mises(p) = von_mises_stress_for_stress_tensor(stress);
+		});
+	}
+
+	void OgdenElasticity::assign_stress_tensor(const int el_id, const ElementBases &bs, const ElementBases &gbs, const Eigen::MatrixXd &local_pts, const Eigen::MatrixXd &displacement, const std::function<void(const int p, const StressMatrix &stress)> &fun) const
 	{
 		Eigen::MatrixXd displacement_grad(size(), size());
 
@@ -149,9 +159,6 @@ namespace polyfem
 		ElementAssemblyValues vals;
 		vals.compute(el_id, size() == 3, local_pts, bs, bs);
 
-
-		all.resize(local_pts.rows(), all_size);
-
 		//TODO implement stresses
 		assert(false);
 
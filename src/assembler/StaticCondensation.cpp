@@ -0,0 +1,240 @@
+#include <polyfem/StaticCondensation.hpp>
+
+#include <polyfem/ElementDofMap.hpp>
+#include <polyfem/MemoryTracker.hpp>
+#include <polyfem/Logger.hpp>
+
+#ifdef POLYFEM_WITH_TBB
+#include <tbb/parallel_for.h>
+#endif
+
+namespace polyfem
+{
+	int StaticCondensation::build(const std::vector<ElementBases> &bases, const int n_bases, const int size, const std::vector<int> &dirichlet_nodes)
+	{
+		const int n_elements = int(bases.size());
+
+		ElementDofMap dof_map;
+		dof_map.build(bases, n_bases);
+
+		//number of elements using each node, the nodes of the non-conforming elements are never condensed
+		std::vector<int> n_node_elements(n_bases, 0);
+		for (int e = 0; e < n_elements; ++e)
+		{
+			const int n_loc_bases = dof_map.n_local_bases(e);
+			if (dof_map.is_conforming(e))
+			{
+				const int *dofs = dof_map.element_dofs(e);
+				for (int i = 0; i < n_loc_bases; ++i)
+					++n_node_elements[dofs[i]];
+			}
+			else
+			{
+				for (int i = 0; i < n_loc_bases; ++i)
+					dof_map.for_each_node(e, i, [&](const int index, const double) { n_node_elements[index] = 2; });
+			}
+		}
+
+		dirichlet_.assign(n_bases * size, false);
+		for (const int i : dirichlet_nodes)
+		{
+			if (i < int(dirichlet_.size()))
+				dirichlet_[i] = true;
+		}
+
+		std::vector<bool> condensed(n_bases, false);
+		for (int n = 0; n < n_bases; ++n)
+		{
+			if (n_node_elements[n] != 1)
+				continue;
+
+			condensed[n] = true;
+			for (int d = 0; d < size; ++d)
+			{
+				if (dirichlet_[n * size + d])
+					condensed[n] = false;
+			}
+		}
+
+		full_to_skeleton_.assign(n_bases * size, -1);
+		skeleton_to_full_.clear();
+		for (int n = 0; n < n_bases; ++n)
+		{
+			if (condensed[n])
+				continue;
+
+			for (int d = 0; d < size; ++d)
+			{
+				full_to_skeleton_[n * size + d] = int(skeleton_to_full_.size());
+				skeleton_to_full_.push_back(n * size + d);
+			}
+		}
+
+		condensed_local_.assign(n_elements, std::vector<int>());
+		condensed_dofs_.assign(n_elements, std::vector<int>());
+		skeleton_local_.assign(n_elements, std::vector<int>());
+		skeleton_dofs_.assign(n_elements, std::vector<int>());
+		factors_.assign(n_elements, Eigen::LDLT<Eigen::MatrixXd>());
+		couplings_.assign(n_elements, Eigen::MatrixXd());
+
+		for (int e = 0; e < n_elements; ++e)
+		{
+			if (!dof_map.is_conforming(e))
+				continue;
+
+			const int n_loc_bases = dof_map.n_local_bases(e);
+			const int *dofs = dof_map.element_dofs(e);
+
+			bool has_condensed = false;
+			for (int i = 0; i < n_loc_bases && !has_condensed; ++i)
+				has_condensed = condensed[dofs[i]];
+			if (!has_condensed)
+				continue;
+
+			for (int i = 0; i < n_loc_bases; ++i)
+			{
+				for (int d = 0; d < size; ++d)
+				{
+					const int dof = dofs[i] * size + d;
+					if (condensed[dofs[i]])
+					{
+						condensed_local_[e].push_back(i * size + d);
+						condensed_dofs_[e].push_back(dof);
+					}
+					else
+					{
+						skeleton_local_[e].push_back(i * size + d);
+						skeleton_dofs_[e].push_back(full_to_skeleton_[dof]);
+					}
+				}
+			}
+		}
+
+		logger().debug("Static condensation: {} skeleton dofs, {} condensed", n_skeleton_dofs(), n_condensed_dofs());
+		return n_condensed_dofs();
+	}
+
+	void StaticCondensation::condense_element(const int e, const Eigen::MatrixXd &local, Eigen::MatrixXd &schur)
+	{
+		const std::vector<int> &cl = condensed_local_[e];
+		const std::vector<int> &sl = skeleton_local_[e];
+		const int n_c = int(cl.size());
+		const int n_s = int(sl.size());
+
+		Eigen::MatrixXd K_II(n_c, n_c), K_IS(n_c, n_s);
+		schur.resize(n_s, n_s);
+		for (int i = 0; i < n_c; ++i)
+		{
+			for (int j = 0; j < n_c; ++j)
+				K_II(i, j) = local(cl[i], cl[j]);
+			for (int j = 0; j < n_s; ++j)
+				K_IS(i, j) = local(cl[i], sl[j]);
+		}
+		for (int i = 0; i < n_s; ++i)
+		{
+			for (int j = 0; j < n_s; ++j)
+				schur(i, j) = local(sl[i], sl[j]);
+		}
+
+		factors_[e].compute(K_II);
+		if (factors_[e].info() != Eigen::Success)
+			logger().error("Static condensation: the interior block of element {} is singular", e);
+
+		couplings_[e] = factors_[e].solve(K_IS);
+		schur.noalias() -= K_IS.transpose() * couplings_[e];
+	}
+
+	void StaticCondensation::condense_rhs(const Eigen::MatrixXd &rhs, Eigen::VectorXd &skeleton_rhs) const
+	{
+		assert(rhs.size() == n_dofs());
+
+		skeleton_rhs.resize(n_skeleton_dofs());
+		for (int k = 0; k < n_skeleton_dofs(); ++k)
+			skeleton_rhs(k) = rhs(skeleton_to_full_[k]);
+
+		Eigen::VectorXd b_I, tmp;
+		for (int e = 0; e < int(condensed_dofs_.size()); ++e)
+		{
+			if (condensed_dofs_[e].empty())
+				continue;
+
+			b_I.resize(condensed_dofs_[e].size());
+			for (int i = 0; i < b_I.size(); ++i)
+				b_I(i) = rhs(condensed_dofs_[e][i]);
+
+			//K_SI K_II^-1 b_I = (K_II^-1 K_IS)^T b_I
+			tmp.noalias() = couplings_[e].transpose() * b_I;
+			for (int s = 0; s < tmp.size(); ++s)
+			{
+				const int k = skeleton_dofs_[e][s];
+				if (!dirichlet_[skeleton_to_full_[k]])
+					skeleton_rhs(k) -= tmp(s);
+			}
+		}
+	}
+
+	void StaticCondensation::condense_boundary_nodes(const std::vector<int> &boundary_nodes, std::vector<int> &skeleton_boundary_nodes) const
+	{
+		skeleton_boundary_nodes.clear();
+		skeleton_boundary_nodes.reserve(boundary_nodes.size());
+		for (const int i : boundary_nodes)
+			skeleton_boundary_nodes.push_back(skeleton_dof(i));
+	}
+
+	void StaticCondensation::recover(const Eigen::VectorXd &skeleton_sol, const Eigen::MatrixXd &rhs, Eigen::VectorXd &sol) const
+	{
+		assert(skeleton_sol.size() == n_skeleton_dofs());
+		assert(rhs.size() == n_dofs());
+
+		sol.resize(n_dofs());
+		for (int k = 0; k < n_skeleton_dofs(); ++k)
+			sol(skeleton_to_full_[k]) = skeleton_sol(k);
+
+		const auto recover_element = [&](const int e, Eigen::VectorXd &b_I, Eigen::VectorXd &x_S) {
+			if (condensed_dofs_[e].empty())
+				return;
+
+			b_I.resize(condensed_dofs_[e].size());
+			for (int i = 0; i < b_I.size(); ++i)
+				b_I(i) = rhs(condensed_dofs_[e][i]);
+			x_S.resize(skeleton_dofs_[e].size());
+			for (int s = 0; s < x_S.size(); ++s)
+				x_S(s) = skeleton_sol(skeleton_dofs_[e][s]);
+
+			//K_II^-1 b_I - (K_II^-1 K_IS) x_S
+			b_I = factors_[e].solve(b_I).eval();
+			b_I.noalias() -= couplings_[e] * x_S;
+
+			//every condensed dof belongs to a single element
+			for (int i = 0; i < b_I.size(); ++i)
+				sol(condensed_dofs_[e][i]) = b_I(i);
+		};
+
+		const int n_elements = int(condensed_dofs_.size());
+#ifdef POLYFEM_WITH_TBB
+		tbb::parallel_for(tbb::blocked_range<int>(0, n_elements), [&](const tbb::blocked_range<int> &r) {
+			Eigen::VectorXd b_I, x_S;
+			for (int e = r.begin(); e != r.end(); ++e)
+				recover_element(e, b_I, x_S);
+		});
+#else
+		Eigen::VectorXd b_I, x_S;
+		for (int e = 0; e < n_elements; ++e)
+			recover_element(e, b_I, x_S);
+#endif
+	}
+
+	size_t StaticCondensation::memory_bytes() const
+	{
+		size_t res = polyfem::memory_bytes(full_to_skeleton_) + polyfem::memory_bytes(skeleton_to_full_) + dirichlet_.capacity() / 8;
+		for (size_t e = 0; e < condensed_local_.size(); ++e)
+		{
+			res += polyfem::memory_bytes(condensed_local_[e]) + polyfem::memory_bytes(condensed_dofs_[e]);
+			res += polyfem::memory_bytes(skeleton_local_[e]) + polyfem::memory_bytes(skeleton_dofs_[e]);
+			//the factor, the transpositions and a temporary vector
+			if (!condensed_dofs_[e].empty())
+				res += polyfem::memory_bytes(couplings_[e]) + polyfem::memory_bytes(factors_[e].matrixLDLT()) + factors_[e].rows() * (sizeof(int) + sizeof(double));
+		}
+		return res;
+	}
+} // namespace polyfem
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <polyfem/ElementBases.hpp>
+
+#include <Eigen/Dense>
+
+#include <vector>
+
+namespace polyfem
+{
+	//Static condensation of the dofs coupled to a single element (the cell nodes of high order elements, but also
+	//corner or face nodes on a Neumann boundary). Their rows only involve the local bases of that element, so they are
+	//eliminated from the local matrices during the assembly (local Schur complement): the global system is assembled
+	//and solved on the remaining skeleton dofs only, and the condensed values are recovered element by element.
+	class StaticCondensation
+	{
+	public:
+		//size is the number of components per node, the dirichlet dofs are never condensed
+		//returns the number of condensed dofs
+		int build(const std::vector<ElementBases> &bases, const int n_bases, const int size, const std::vector<int> &dirichlet_nodes);
+
+		int n_dofs() const { return int(full_to_skeleton_.size()); }
+		int n_skeleton_dofs() const { return int(skeleton_to_full_.size()); }
+		int n_condensed_dofs() const { return n_dofs() - n_skeleton_dofs(); }
+
+		bool has_condensed_dofs(const int e) const { return !condensed_local_[e].empty(); }
+		//index in the skeleton system of a dof which is not condensed
+		int skeleton_dof(const int dof) const
+		{
+			assert(full_to_skeleton_[dof] >= 0);
+			return full_to_skeleton_[dof];
+		}
+		//skeleton system indices of the local dofs of e which are not condensed, in local order
+		const std::vector<int> &element_skeleton_dofs(const int e) const { return skeleton_dofs_[e]; }
+
+		//local is the symmetric element matrix on the local dofs (local basis * size + component), schur its
+		//complement on the element skeleton dofs. The factors are kept for the recovery, thread safe for distinct elements
+		void condense_element(const int e, const Eigen::MatrixXd &local, Eigen::MatrixXd &schur);
+
+		//skeleton rhs b_S - K_SI K_II^-1 b_I, the dirichlet rows are kept
+		void condense_rhs(const Eigen::MatrixXd &rhs, Eigen::VectorXd &skeleton_rhs) const;
+		//dirichlet nodes in the skeleton numbering
+		void condense_boundary_nodes(const std::vector<int> &boundary_nodes, std::vector<int> &skeleton_boundary_nodes) const;
+		//full solution, x_I = K_II^-1 (b_I - K_IS x_S) in parallel over the elements
+		void recover(const Eigen::VectorXd &skeleton_sol, const Eigen::MatrixXd &rhs, Eigen::VectorXd &sol) const;
+
+		size_t memory_bytes() const;
+
+	private:
+		//-1 for the condensed dofs
+		std::vector<int> full_to_skeleton_;
+		std::vector<int> skeleton_to_full_;
+		std::vector<bool> dirichlet_;
+
+		//only filled for the elements with condensed dofs
+		//local indices and full dofs of the condensed dofs
+		std::vector<std::vector<int>> condensed_local_, condensed_dofs_;
+		//local indices and skeleton indices of the other dofs
+		std::vector<std::vector<int>> skeleton_local_, skeleton_dofs_;
+		//K_II factorization and K_II^-1 K_IS
+		std::vector<Eigen::LDLT<Eigen::MatrixXd>> factors_;
+		std::vector<Eigen::MatrixXd> couplings_;
+	};
+} // namespace polyfem
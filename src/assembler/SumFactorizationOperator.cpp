@@ -0,0 +1,445 @@
+#include <polyfem/SumFactorizationOperator.hpp>
+
+#include <polyfem/auto_q_bases.hpp>
+#include <polyfem/Logger.hpp>
+
+#include <Eigen/Eigenvalues>
+
+#include <array>
+#include <cmath>
+
+#ifdef POLYFEM_WITH_TBB
+#include <tbb/parallel_for.h>
+#include <tbb/enumerable_thread_specific.h>
+#endif
+
+namespace polyfem
+{
+	namespace
+	{
+		//Gauss-Legendre rule with n points on [0, 1] (Golub-Welsch)
+		void gauss_legendre(const int n, Eigen::VectorXd &points, Eigen::VectorXd &weights)
+		{
+			Eigen::MatrixXd jacobi = Eigen::MatrixXd::Zero(n, n);
+			for (int k = 1; k < n; ++k)
+			{
+				const double b = k / std::sqrt(4. * k * k - 1.);
+				jacobi(k, k - 1) = b;
+				jacobi(k - 1, k) = b;
+			}
+
+			Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> solver(jacobi);
+			points = (solver.eigenvalues().array() + 1) / 2;
+			weights = solver.eigenvectors().row(0).transpose().array().square();
+		}
+
+		//values and derivatives of the 1D Lagrange polynomials on k+1 equispaced nodes of [0, 1] at the points
+		void lagrange_1d(const int k, const Eigen::VectorXd &pts, Eigen::MatrixXd &val, Eigen::MatrixXd &der)
+		{
+			const int n = k + 1;
+			val.resize(pts.size(), n);
+			der.resize(pts.size(), n);
+
+			for (int i = 0; i < pts.size(); ++i)
+			{
+				const double t = pts(i);
+				for (int a = 0; a < n; ++a)
+				{
+					const double xa = double(a) / k;
+					double v = 1, d = 0;
+					for (int b = 0; b < n; ++b)
+					{
+						if (b == a)
+							continue;
+						const double xb = double(b) / k;
+						//product rule, d is the derivative of the partial product v
+						d = d * (t - xb) / (xa - xb) + v / (xa - xb);
+						v *= (t - xb) / (xa - xb);
+					}
+					val(i, a) = v;
+					der(i, a) = d;
+				}
+			}
+		}
+
+		//applies M (or M^T) along the axis of a tensor stored with the first index fastest
+		//dims are the dimensions of in, out has dims[axis] replaced by the number of rows of M (or M^T)
+		void contract(const Eigen::MatrixXd &M, const bool transpose, const int axis, const std::array<int, 3> &dims, const double *in, double *out, const bool accumulate)
+		{
+			const int n_in = dims[axis];
+			const int n_out = transpose ? int(M.cols()) : int(M.rows());
+			assert(n_in == (transpose ? M.rows() : M.cols()));
+
+			const int pre = axis == 0 ? 1 : (axis == 1 ? dims[0] : dims[0] * dims[1]);
+			const int post = axis == 2 ? 1 : (axis == 1 ? dims[2] : dims[1] * dims[2]);
+
+			if (!accumulate)
+				std::fill(out, out + pre * n_out * post, 0.);
+
+			for (int p = 0; p < post; ++p)
+			{
+				for (int r = 0; r < n_out; ++r)
+				{
+					double *o = out + (p * n_out + r) * pre;
+					for (int a = 0; a < n_in; ++a)
+					{
+						const double m = transpose ? M(a, r) : M(r, a);
+						const double *i = in + (p * n_in + a) * pre;
+						for (int q = 0; q < pre; ++q)
+							o[q] += m * i[q];
+					}
+				}
+			}
+		}
+	} // namespace
+
+	struct SumFactorizationOperator::LocalWork
+	{
+		std::vector<double> u, t_b, t_d, t_bb, t_bd, t_db;
+		//per component, gradients (3 per component) or values at the quadrature points
+		std::vector<std::vector<double>> qp;
+		Eigen::VectorXd y;
+	};
+
+	bool SumFactorizationOperator::is_supported_formulation(const std::string &formulation)
+	{
+		return formulation == "Laplacian" || formulation == "LinearElasticity" || formulation == "Mass";
+	}
+
+	bool SumFactorizationOperator::init(const std::string &formulation, const int size, const Mesh &mesh, const std::vector<ElementBases> &bases, const std::vector<ElementBases> &gbases, const int n_bases, const LameParameters *lame)
+	{
+		if (!mesh.is_volume())
+			return false;
+		for (int e = 0; e < int(bases.size()); ++e)
+		{
+			if (!mesh.is_cube(e))
+				return false;
+		}
+
+		return init_bases(formulation, size, bases, gbases, n_bases, lame);
+	}
+
+	bool SumFactorizationOperator::init_bases(const std::string &formulation, const int size, const std::vector<ElementBases> &bases, const std::vector<ElementBases> &gbases, const int n_bases, const LameParameters *lame)
+	{
+		if (formulation == "Laplacian")
+			kind_ = Kind::Laplacian;
+		else if (formulation == "LinearElasticity")
+			kind_ = Kind::Elasticity;
+		else if (formulation == "Mass")
+			kind_ = Kind::Mass;
+		else
+		{
+			logger().error("Sum factorization is not available for {}", formulation);
+			return false;
+		}
+
+		if (kind_ == Kind::Elasticity && !lame)
+		{
+			logger().error("Sum factorization of LinearElasticity requires the Lame parameters");
+			return false;
+		}
+
+		size_ = kind_ == Kind::Laplacian ? 1 : size;
+		n_bases_ = n_bases;
+		n_elements_ = int(bases.size());
+
+		if (n_elements_ <= 0)
+			return false;
+
+		const int n_loc = int(bases.front().bases.size());
+		n1_ = int(std::round(std::cbrt(double(n_loc))));
+		const int order = n1_ - 1;
+		if (n1_ * n1_ * n1_ != n_loc || order < 1 || order > 3)
+			return false;
+
+		dof_map_.build(bases, n_bases);
+		for (int e = 0; e < n_elements_; ++e)
+		{
+			if (int(bases[e].bases.size()) != n_loc || !dof_map_.is_conforming(e) || !gbases[e].has_parameterization)
+				return false;
+		}
+
+		//the local bases of FEBasis3d are the Lagrange polynomials of the nodes of q_nodes_3d
+		Eigen::MatrixXd nodes;
+		autogen::q_nodes_3d(order, nodes);
+		tensor_to_local_.assign(n_loc, -1);
+		for (int l = 0; l < n_loc; ++l)
+		{
+			const int a = int(std::round(nodes(l, 0) * order));
+			const int b = int(std::round(nodes(l, 1) * order));
+			const int c = int(std::round(nodes(l, 2) * order));
+			const int t = (c * n1_ + b) * n1_ + a;
+			if (tensor_to_local_[t] >= 0)
+				return false;
+			tensor_to_local_[t] = l;
+		}
+
+		//exact for the stiffness and the mass of affine elements
+		nq_ = n1_;
+		Eigen::VectorXd pts;
+		gauss_legendre(nq_, pts, weights_);
+		lagrange_1d(order, pts, B_, D_);
+
+		const int n_qp = nq_ * nq_ * nq_;
+		Eigen::MatrixXd qpts(n_qp, 3);
+		Eigen::VectorXd qweights(n_qp);
+		for (int k = 0; k < nq_; ++k)
+		{
+			for (int j = 0; j < nq_; ++j)
+			{
+				for (int i = 0; i < nq_; ++i)
+				{
+					const int p = (k * nq_ + j) * nq_ + i;
+					qpts.row(p) << pts(i), pts(j), pts(k);
+					qweights(p) = weights_(i) * weights_(j) * weights_(k);
+				}
+			}
+		}
+
+		const int n_factors = kind_ == Kind::Laplacian ? 6 : (kind_ == Kind::Elasticity ? 12 : 1);
+		factors_.resize(n_elements_ * n_qp, n_factors);
+
+		const auto compute_factors = [&](const int e) {
+			std::vector<Eigen::MatrixXd> grads;
+			gbases[e].eval_geom_mapping_grads(qpts, grads);
+			Eigen::MatrixXd mapped;
+			if (kind_ == Kind::Elasticity)
+				gbases[e].eval_geom_mapping(qpts, mapped);
+
+			for (int p = 0; p < n_qp; ++p)
+			{
+				const Eigen::Matrix3d K = grads[p];
+				const Eigen::Matrix3d Kinv = K.inverse();
+				const double wdet = qweights(p) * std::abs(K.determinant());
+				auto row = factors_.row(e * n_qp + p);
+
+				if (kind_ == Kind::Laplacian)
+				{
+					const Eigen::Matrix3d G = wdet * Kinv.transpose() * Kinv;
+					row << G(0, 0), G(0, 1), G(0, 2), G(1, 1), G(1, 2), G(2, 2);
+				}
+				else if (kind_ == Kind::Elasticity)
+				{
+					double lambda, mu;
+					lame->lambda_mu(mapped(p, 0), mapped(p, 1), mapped(p, 2), e, lambda, mu);
+					for (int r = 0; r < 3; ++r)
+						for (int c = 0; c < 3; ++c)
+							row(r * 3 + c) = Kinv(r, c);
+					row(9) = wdet;
+					row(10) = lambda;
+					row(11) = mu;
+				}
+				else
+					row(0) = wdet;
+			}
+		};
+
+#ifdef POLYFEM_WITH_TBB
+		tbb::parallel_for(tbb::blocked_range<int>(0, n_elements_), [&](const tbb::blocked_range<int> &r) {
+			for (int e = r.begin(); e != r.end(); ++e)
+				compute_factors(e);
+		});
+#else
+		for (int e = 0; e < n_elements_; ++e)
+			compute_factors(e);
+#endif
+
+		logger().debug("sum factorization Q{}, {} elements, {} quadrature points per element", order, n_elements_, n_qp);
+		return true;
+	}
+
+	void SumFactorizationOperator::local_apply(const int e, const Eigen::VectorXd &x, Eigen::VectorXd &y, LocalWork &work) const
+	{
+		const int n = n1_, q = nq_;
+		const int n_loc = n * n * n;
+		const int n_qp = q * q * q;
+		const int *dofs = dof_map_.element_dofs(e);
+		const bool values = kind_ == Kind::Mass;
+		const int n_fields = values ? 1 : 3;
+
+		work.u.resize(n_loc);
+		work.t_b.resize(q * n * n);
+		work.t_d.resize(q * n * n);
+		work.t_bb.resize(q * q * n);
+		work.t_bd.resize(q * q * n);
+		work.t_db.resize(q * q * n);
+		work.qp.resize(size_ * n_fields);
+		for (auto &v : work.qp)
+			v.resize(n_qp);
+
+		//interpolation at the quadrature points
+		for (int c = 0; c < size_; ++c)
+		{
+			for (int t = 0; t < n_loc; ++t)
+				work.u[t] = x(dofs[tensor_to_local_[t]] * size_ + c);
+
+			contract(B_, false, 0, {{n, n, n}}, work.u.data(), work.t_b.data(), false);
+			contract(B_, false, 1, {{q, n, n}}, work.t_b.data(), work.t_bb.data(), false);
+
+			if (values)
+			{
+				contract(B_, false, 2, {{q, q, n}}, work.t_bb.data(), work.qp[c].data(), false);
+				continue;
+			}
+
+			contract(D_, false, 0, {{n, n, n}}, work.u.data(), work.t_d.data(), false);
+			contract(D_, false, 1, {{q, n, n}}, work.t_b.data(), work.t_bd.data(), false);
+			contract(B_, false, 1, {{q, n, n}}, work.t_d.data(), work.t_db.data(), false);
+
+			contract(B_, false, 2, {{q, q, n}}, work.t_db.data(), work.qp[3 * c + 0].data(), false);
+			contract(B_, false, 2, {{q, q, n}}, work.t_bd.data(), work.qp[3 * c + 1].data(), false);
+			contract(D_, false, 2, {{q, q, n}}, work.t_bb.data(), work.qp[3 * c + 2].data(), false);
+		}
+
+		//fluxes, in place
+		for (int p = 0; p < n_qp; ++p)
+		{
+			const auto f = factors_.row(e * n_qp + p);
+
+			if (kind_ == Kind::Mass)
+			{
+				for (int c = 0; c < size_; ++c)
+					work.qp[c][p] *= f(0);
+			}
+			else if (kind_ == Kind::Laplacian)
+			{
+				const double g0 = work.qp[0][p], g1 = work.qp[1][p], g2 = work.qp[2][p];
+				work.qp[0][p] = f(0) * g0 + f(1) * g1 + f(2) * g2;
+				work.qp[1][p] = f(1) * g0 + f(3) * g1 + f(4) * g2;
+				work.qp[2][p] = f(2) * g0 + f(4) * g1 + f(5) * g2;
+			}
+			else
+			{
+				const Eigen::Map<const Eigen::Matrix<double, 3, 3, Eigen::RowMajor>> Kinv(f.data());
+				Eigen::Matrix3d grad = Eigen::Matrix3d::Zero();
+				for (int c = 0; c < size_; ++c)
+					grad.row(c) = (Kinv * Eigen::Vector3d(work.qp[3 * c][p], work.qp[3 * c + 1][p], work.qp[3 * c + 2][p])).transpose();
+
+				const Eigen::Matrix3d strain = (grad + grad.transpose()) / 2;
+				const Eigen::Matrix3d stress = 2 * f(11) * strain + f(10) * strain.trace() * Eigen::Matrix3d::Identity();
+
+				for (int c = 0; c < size_; ++c)
+				{
+					const Eigen::Vector3d flux = f(9) * Kinv.transpose() * stress.row(c).transpose();
+					for (int d = 0; d < 3; ++d)
+						work.qp[3 * c + d][p] = flux(d);
+				}
+			}
+		}
+
+		//integration against the test functions
+		for (int c = 0; c < size_; ++c)
+		{
+			if (values)
+			{
+				contract(B_, true, 2, {{q, q, q}}, work.qp[c].data(), work.t_bb.data(), false);
+				contract(B_, true, 1, {{q, q, n}}, work.t_bb.data(), work.t_b.data(), false);
+				contract(B_, true, 0, {{q, n, n}}, work.t_b.data(), work.u.data(), false);
+			}
+			else
+			{
+				contract(B_, true, 2, {{q, q, q}}, work.qp[3 * c + 0].data(), work.t_db.data(), false);
+				contract(B_, true, 2, {{q, q, q}}, work.qp[3 * c + 1].data(), work.t_bd.data(), false);
+				contract(D_, true, 2, {{q, q, q}}, work.qp[3 * c + 2].data(), work.t_bb.data(), false);
+
+				contract(B_, true, 1, {{q, q, n}}, work.t_db.data(), work.t_d.data(), false);
+				contract(D_, true, 1, {{q, q, n}}, work.t_bd.data(), work.t_b.data(), false);
+				contract(B_, true, 1, {{q, q, n}}, work.t_bb.data(), work.t_b.data(), true);
+
+				contract(D_, true, 0, {{q, n, n}}, work.t_d.data(), work.u.data(), false);
+				contract(B_, true, 0, {{q, n, n}}, work.t_b.data(), work.u.data(), true);
+			}
+
+			for (int t = 0; t < n_loc; ++t)
+				y(dofs[tensor_to_local_[t]] * size_ + c) += work.u[t];
+		}
+	}
+
+	void SumFactorizationOperator::apply(const Eigen::VectorXd &x, Eigen::VectorXd &y) const
+	{
+		assert(x.size() == rows());
+		y.setZero(rows());
+
+#ifdef POLYFEM_WITH_TBB
+		tbb::enumerable_thread_specific<LocalWork> storages;
+		tbb::parallel_for(tbb::blocked_range<int>(0, n_elements_), [&](const tbb::blocked_range<int> &r) {
+			LocalWork &work = storages.local();
+			if (work.y.size() != y.size())
+				work.y.setZero(y.size());
+
+			for (int e = r.begin(); e != r.end(); ++e)
+				local_apply(e, x, work.y, work);
+		});
+
+		for (const auto &work : storages)
+			y += work.y;
+#else
+		LocalWork work;
+		for (int e = 0; e < n_elements_; ++e)
+			local_apply(e, x, y, work);
+#endif
+	}
+
+	void SumFactorizationOperator::diagonal(Eigen::VectorXd &diag) const
+	{
+		diag.setZero(rows());
+
+		const int n = n1_, q = nq_;
+		const int n_qp = q * q * q;
+
+		for (int e = 0; e < n_elements_; ++e)
+		{
+			const int *dofs = dof_map_.element_dofs(e);
+
+			for (int c3 = 0; c3 < n; ++c3)
+			{
+				for (int b = 0; b < n; ++b)
+				{
+					for (int a = 0; a < n; ++a)
+					{
+						const int dof = dofs[tensor_to_local_[(c3 * n + b) * n + a]];
+						Eigen::VectorXd local = Eigen::VectorXd::Zero(size_);
+
+						for (int k = 0; k < q; ++k)
+						{
+							for (int j = 0; j < q; ++j)
+							{
+								for (int i = 0; i < q; ++i)
+								{
+									const auto f = factors_.row(e * n_qp + (k * q + j) * q + i);
+									if (kind_ == Kind::Mass)
+									{
+										const double v = B_(i, a) * B_(j, b) * B_(k, c3);
+										local.array() += f(0) * v * v;
+										continue;
+									}
+
+									const Eigen::Vector3d g(D_(i, a) * B_(j, b) * B_(k, c3), B_(i, a) * D_(j, b) * B_(k, c3), B_(i, a) * B_(j, b) * D_(k, c3));
+									if (kind_ == Kind::Laplacian)
+									{
+										local(0) += f(0) * g(0) * g(0) + f(3) * g(1) * g(1) + f(5) * g(2) * g(2)
+													+ 2 * (f(1) * g(0) * g(1) + f(2) * g(0) * g(2) + f(4) * g(1) * g(2));
+										continue;
+									}
+
+									const Eigen::Map<const Eigen::Matrix<double, 3, 3, Eigen::RowMajor>> Kinv(f.data());
+									const Eigen::Vector3d gp = Kinv * g;
+									for (int c = 0; c < size_; ++c)
+										local(c) += f(9) * (f(11) * gp.squaredNorm() + (f(11) + f(10)) * gp(c) * gp(c));
+								}
+							}
+						}
+
+						for (int c = 0; c < size_; ++c)
+							diag(dof * size_ + c) += local(c);
+					}
+				}
+			}
+		}
+	}
+
+	size_t SumFactorizationOperator::memory_bytes() const
+	{
+		return factors_.size() * sizeof(double) + dof_map_.memory_bytes() + tensor_to_local_.capacity() * sizeof(int);
+	}
+} // namespace polyfem
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <polyfem/ElementBases.hpp>
+#include <polyfem/ElementDofMap.hpp>
+#include <polyfem/ElasticityUtils.hpp>
+#include <polyfem/Mesh.hpp>
+
+#include <Eigen/Dense>
+
+#include <string>
+#include <vector>
+
+namespace polyfem
+{
+	//Matrix-free operators on Q_k hexahedral meshes by sum factorization. The local bases are tensor products of
+	//1D Lagrange polynomials, so their values and gradients at a tensor Gauss rule are three 1D contractions:
+	//O(k^4) per element instead of the O(k^6) of the dense bases x quadrature points table, and no matrix.
+	//Only the geometric factors and the material parameters at the quadrature points are stored.
+	class SumFactorizationOperator
+	{
+	public:
+		//formulation is Laplacian, LinearElasticity, or Mass (size components), lame is required for LinearElasticity
+		//returns false if the bases are not a conforming Q1 to Q3 discretization of a hexahedral mesh
+		bool init(const std::string &formulation, const int size, const Mesh &mesh, const std::vector<ElementBases> &bases, const std::vector<ElementBases> &gbases, const int n_bases, const LameParameters *lame = nullptr);
+
+		static bool is_supported_formulation(const std::string &formulation);
+
+		int rows() const { return n_bases_ * size_; }
+		int size() const { return size_; }
+		int order() const { return n1_ - 1; }
+
+		//y = A x
+		void apply(const Eigen::VectorXd &x, Eigen::VectorXd &y) const;
+		//diagonal of A, for Jacobi preconditioning
+		void diagonal(Eigen::VectorXd &diag) const;
+
+		size_t memory_bytes() const;
+
+	private:
+		enum class Kind
+		{
+			Laplacian,
+			Elasticity,
+			Mass
+		};
+
+		struct LocalWork;
+
+		Kind kind_ = Kind::Laplacian;
+		int size_ = 1;
+		int n_bases_ = 0;
+		int n_elements_ = 0;
+		//1D nodes and quadrature points
+		int n1_ = 0, nq_ = 0;
+
+		//1D values and derivatives, nq x n1
+		Eigen::MatrixXd B_, D_;
+		Eigen::VectorXd weights_;
+		//local basis of the tensor index (c * n1 + b) * n1 + a
+		std::vector<int> tensor_to_local_;
+		ElementDofMap dof_map_;
+
+		//one row per element and quadrature point (quadrature points of e are rows e * nq^3 ...)
+		//Laplacian: the 6 entries of w det K^-T K^-1, elasticity: K^-1 (9, row major), w det, lambda, mu, mass: w det
+		//where K is the transposed jacobian of the geometric mapping, physical gradient = K^-1 reference gradient
+		Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> factors_;
+
+		//init without the mesh checks
+		bool init_bases(const std::string &formulation, const int size, const std::vector<ElementBases> &bases, const std::vector<ElementBases> &gbases, const int n_bases, const LameParameters *lame);
+		void local_apply(const int e, const Eigen::VectorXd &x, Eigen::VectorXd &y, LocalWork &work) const;
+	};
+} // namespace polyfem
@@ -1,5 +1,6 @@
 #include <polyfem/AssemblerUtils.hpp>
 #include <polyfem/Logger.hpp>
+#include <polyfem/Profiler.hpp>
 
 #include <unsupported/Eigen/SparseExtra>
 
@@ -77,23 +78,29 @@ namespace polyfem
 		const int n_basis,
 		const std::vector< ElementBases > &bases,
 		const std::vector< ElementBases > &gbases,
-		StiffnessMatrix &stiffness) const
+		StiffnessMatrix &stiffness,
+		StaticCondensation *condensation,
+		const ElementDofMap *dof_map,
+		ColoredAssemblyCache *colorings,
+		ElementMatrixCache *element_matrices) const
 	{
+		ScopedZone zone("assemble_problem " + assembler);
+
 		if(assembler == "Helmholtz")
-			helmholtz_.assemble(is_volume, n_basis, bases, gbases, stiffness);
+			helmholtz_.assemble(is_volume, n_basis, bases, gbases, stiffness, condensation, dof_map, colorings, element_matrices);
 		else if(assembler == "Laplacian")
-			laplacian_.assemble(is_volume, n_basis, bases, gbases, stiffness);
+			laplacian_.assemble(is_volume, n_basis, bases, gbases, stiffness, condensation, dof_map, colorings, element_matrices);
 		else if(assembler == "Bilaplacian")
-			bilaplacian_main_.assemble(is_volume, n_basis, bases, gbases, stiffness);
+			bilaplacian_main_.assemble(is_volume, n_basis, bases, gbases, stiffness, condensation, dof_map, colorings, element_matrices);
 
 		else if(assembler == "LinearElasticity")
-			linear_elasticity_.assemble(is_volume, n_basis, bases, gbases, stiffness);
+			linear_elasticity_.assemble(is_volume, n_basis, bases, gbases, stiffness, condensation, dof_map, colorings, element_matrices);
 		else if(assembler == "HookeLinearElasticity")
-			hooke_linear_elasticity_.assemble(is_volume, n_basis, bases, gbases, stiffness);
+			hooke_linear_elasticity_.assemble(is_volume, n_basis, bases, gbases, stiffness, condensation, dof_map, colorings, element_matrices);
 		else if (assembler == "Stokes" || assembler == "NavierStokes")
-			stokes_velocity_.assemble(is_volume, n_basis, bases, gbases, stiffness);
+			stokes_velocity_.assemble(is_volume, n_basis, bases, gbases, stiffness, condensation, dof_map, colorings, element_matrices);
 		else if(assembler == "IncompressibleLinearElasticity")
-			incompressible_lin_elast_displacement_.assemble(is_volume, n_basis, bases, gbases, stiffness);
+			incompressible_lin_elast_displacement_.assemble(is_volume, n_basis, bases, gbases, stiffness, condensation, dof_map, colorings, element_matrices);
 
 		else if(assembler == "SaintVenant")
 			return;
@@ -107,7 +114,7 @@ namespace polyfem
 		{
 			logger().warn("{} not found, fallback to default", assembler);
 			assert(false);
-			laplacian_.assemble(is_volume, n_basis, bases, gbases, stiffness);
+			laplacian_.assemble(is_volume, n_basis, bases, gbases, stiffness, condensation, dof_map, colorings, element_matrices);
 		}
 	}
 
@@ -116,12 +123,15 @@ namespace polyfem
 		const int n_basis,
 		const std::vector< ElementBases > &bases,
 		const std::vector< ElementBases > &gbases,
-		StiffnessMatrix &mass) const
+		StiffnessMatrix &mass,
+		const ElementDofMap *dof_map) const
 	{
+		ScopedZone zone("assemble_mass_matrix " + assembler);
+
 		if(assembler == "Helmholtz" || assembler == "Laplacian")
-			mass_mat_assembler_.assemble(is_volume, 1, n_basis, bases, gbases, mass);
+			mass_mat_assembler_.assemble(is_volume, 1, n_basis, bases, gbases, mass, dof_map);
 		else
-			mass_mat_assembler_.assemble(is_volume, is_volume ? 3 : 2, n_basis, bases, gbases, mass);
+			mass_mat_assembler_.assemble(is_volume, is_volume ? 3 : 2, n_basis, bases, gbases, mass, dof_map);
 	}
 
 	void AssemblerUtils::assemble_mixed_problem(const std::string &assembler,
@@ -131,21 +141,26 @@ namespace polyfem
 		const std::vector< ElementBases > &psi_bases,
 		const std::vector< ElementBases > &phi_bases,
 		const std::vector< ElementBases > &gbases,
-		StiffnessMatrix &stiffness) const
+		StiffnessMatrix &stiffness,
+		const ElementDofMap *psi_dof_map,
+		const ElementDofMap *phi_dof_map,
+		ColoredAssemblyCache *colorings) const
 	{
+		ScopedZone zone("assemble_mixed_problem " + assembler);
+
 		if(assembler == "Bilaplacian")
-			bilaplacian_mixed_.assemble(is_volume, n_psi_basis, n_phi_basis, psi_bases, phi_bases, gbases, stiffness);
+			bilaplacian_mixed_.assemble(is_volume, n_psi_basis, n_phi_basis, psi_bases, phi_bases, gbases, stiffness, psi_dof_map, phi_dof_map, colorings);
 
 		else if (assembler == "Stokes" || assembler == "NavierStokes")
-			stokes_mixed_.assemble(is_volume, n_psi_basis, n_phi_basis, psi_bases, phi_bases, gbases, stiffness);
+			stokes_mixed_.assemble(is_volume, n_psi_basis, n_phi_basis, psi_bases, phi_bases, gbases, stiffness, psi_dof_map, phi_dof_map, colorings);
 		else if(assembler == "IncompressibleLinearElasticity")
-			incompressible_lin_elast_mixed_.assemble(is_volume, n_psi_basis, n_phi_basis, psi_bases, phi_bases, gbases, stiffness);
+			incompressible_lin_elast_mixed_.assemble(is_volume, n_psi_basis, n_phi_basis, psi_bases, phi_bases, gbases, stiffness, psi_dof_map, phi_dof_map, colorings);
 
 		else
 		{
 			logger().warn("{} not found, fallback to default", assembler);
 			assert(false);
-			stokes_mixed_.assemble(is_volume, n_psi_basis, n_phi_basis, psi_bases, phi_bases, gbases, stiffness);
+			stokes_mixed_.assemble(is_volume, n_psi_basis, n_phi_basis, psi_bases, phi_bases, gbases, stiffness, psi_dof_map, phi_dof_map, colorings);
 		}
 	}
 
@@ -154,21 +169,25 @@ namespace polyfem
 		const int n_basis,
 		const std::vector< ElementBases > &bases,
 		const std::vector< ElementBases > &gbases,
-		StiffnessMatrix &stiffness) const
+		StiffnessMatrix &stiffness,
+		const ElementDofMap *dof_map,
+		ColoredAssemblyCache *colorings) const
 	{
+		ScopedZone zone("assemble_pressure_problem " + assembler);
+
 		if(assembler == "Bilaplacian")
-			bilaplacian_aux_.assemble(is_volume, n_basis, bases, gbases, stiffness);
+			bilaplacian_aux_.assemble(is_volume, n_basis, bases, gbases, stiffness, nullptr, dof_map, colorings);
 
 		else if (assembler == "Stokes" || assembler == "NavierStokes")
-			stokes_pressure_.assemble(is_volume, n_basis, bases, gbases, stiffness);
+			stokes_pressure_.assemble(is_volume, n_basis, bases, gbases, stiffness, nullptr, dof_map, colorings);
 		else if(assembler == "IncompressibleLinearElasticity")
-			incompressible_lin_elast_pressure_.assemble(is_volume, n_basis, bases, gbases, stiffness);
+			incompressible_lin_elast_pressure_.assemble(is_volume, n_basis, bases, gbases, stiffness, nullptr, dof_map, colorings);
 
 		else
 		{
 			logger().warn("{} not found, fallback to default", assembler);
 			assert(false);
-			stokes_pressure_.assemble(is_volume, n_basis, bases, gbases, stiffness);
+			stokes_pressure_.assemble(is_volume, n_basis, bases, gbases, stiffness, nullptr, dof_map, colorings);
 		}
 	}
 
@@ -179,6 +198,8 @@ namespace polyfem
 		const std::vector< ElementBases > &gbases,
 		const Eigen::MatrixXd &displacement) const
 	{
+		ScopedZone zone("assemble_energy " + assembler);
+
 		if(assembler == "SaintVenant")
 			return saint_venant_elasticity_.assemble(is_volume, bases, gbases, displacement);
 		else if(assembler == "NeoHookean")
@@ -195,14 +216,17 @@ namespace polyfem
 		const std::vector< ElementBases > &bases,
 		const std::vector< ElementBases > &gbases,
 		const Eigen::MatrixXd &displacement,
-		Eigen::MatrixXd &grad) const
+		Eigen::MatrixXd &grad,
+		const ElementDofMap *dof_map) const
 	{
+		ScopedZone zone("assemble_energy_gradient " + assembler);
+
 		if(assembler == "SaintVenant")
-			saint_venant_elasticity_.assemble_grad(is_volume, n_basis, bases, gbases, displacement, grad);
+			saint_venant_elasticity_.assemble_grad(is_volume, n_basis, bases, gbases, displacement, grad, dof_map);
 		else if(assembler == "NeoHookean")
-			neo_hookean_elasticity_.assemble_grad(is_volume, n_basis, bases, gbases, displacement, grad);
+			neo_hookean_elasticity_.assemble_grad(is_volume, n_basis, bases, gbases, displacement, grad, dof_map);
 		else if (assembler == "NavierStokes")
-			navier_stokes_velocity_.assemble_grad(is_volume, n_basis, bases, gbases, displacement, grad);
+			navier_stokes_velocity_.assemble_grad(is_volume, n_basis, bases, gbases, displacement, grad, dof_map);
 		//else if(assembler == "Ogden")
 		//	ogden_elasticity_.assemble_grad(is_volume, n_basis, bases, gbases, displacement, grad);
 		else
@@ -215,22 +239,62 @@ namespace polyfem
 		const std::vector< ElementBases > &bases,
 		const std::vector< ElementBases > &gbases,
 		const Eigen::MatrixXd &displacement,
-		StiffnessMatrix &hessian) const
+		StiffnessMatrix &hessian,
+		const ElementDofMap *dof_map,
+		ColoredAssemblyCache *colorings) const
 	{
+		ScopedZone zone("assemble_energy_hessian " + assembler);
+
 		if(assembler == "SaintVenant")
-			saint_venant_elasticity_.assemble_hessian(is_volume, n_basis, bases, gbases, displacement, hessian);
+			saint_venant_elasticity_.assemble_hessian(is_volume, n_basis, bases, gbases, displacement, hessian, dof_map, colorings);
 		else if(assembler == "NeoHookean")
-			neo_hookean_elasticity_.assemble_hessian(is_volume, n_basis, bases, gbases, displacement, hessian);
+			neo_hookean_elasticity_.assemble_hessian(is_volume, n_basis, bases, gbases, displacement, hessian, dof_map, colorings);
 		else if (assembler == "NavierStokesPicard")
-			navier_stokes_velocity_picard_.assemble_hessian(is_volume, n_basis, bases, gbases, displacement, hessian);
+			navier_stokes_velocity_picard_.assemble_hessian(is_volume, n_basis, bases, gbases, displacement, hessian, dof_map, colorings);
 		else if (assembler == "NavierStokes")
-			navier_stokes_velocity_.assemble_hessian(is_volume, n_basis, bases, gbases, displacement, hessian);
+			navier_stokes_velocity_.assemble_hessian(is_volume, n_basis, bases, gbases, displacement, hessian, dof_map, colorings);
 		//else if(assembler == "Ogden")
 		//	ogden_elasticity_.assemble_hessian(is_volume, n_basis, bases, gbases, displacement, hessian);
 		else
 			return;
 	}
 
+	void AssemblerUtils::assemble_energy_quantities(const std::string &assembler,
+		const bool is_volume,
+		const int n_basis,
+		const std::vector< ElementBases > &bases,
+		const std::vector< ElementBases > &gbases,
+		const Eigen::MatrixXd &displacement,
+		double *energy,
+		Eigen::MatrixXd *grad,
+		StiffnessMatrix *hessian,
+		const ElementDofMap *dof_map,
+		ColoredAssemblyCache *colorings) const
+	{
+		ScopedZone zone("assemble_energy_quantities " + assembler);
+
+		if(assembler == "SaintVenant")
+			saint_venant_elasticity_.assemble_quantities(is_volume, n_basis, bases, gbases, displacement, energy, grad, hessian, dof_map, colorings);
+		else if(assembler == "NeoHookean")
+			neo_hookean_elasticity_.assemble_quantities(is_volume, n_basis, bases, gbases, displacement, energy, grad, hessian, dof_map, colorings);
+		//Navier Stokes has no energy, same as assemble_energy
+		else if (assembler == "NavierStokes")
+		{
+			navier_stokes_velocity_.assemble_quantities(is_volume, n_basis, bases, gbases, displacement, nullptr, grad, hessian, dof_map, colorings);
+			if (energy)
+				*energy = 0;
+		}
+		else if (assembler == "NavierStokesPicard")
+		{
+			if (hessian)
+				navier_stokes_velocity_picard_.assemble_hessian(is_volume, n_basis, bases, gbases, displacement, *hessian, dof_map, colorings);
+			if (energy)
+				*energy = 0;
+		}
+		else if (energy)
+			*energy = 0;
+	}
+
 	void AssemblerUtils::compute_scalar_value(const std::string &assembler,
 											  const int el_id,
 											  const ElementBases &bs,
@@ -309,6 +373,34 @@ namespace polyfem
 		}
 	}
 
+	void AssemblerUtils::compute_stress_and_von_mises(const std::string &assembler,
+													  const int el_id,
+													  const ElementBases &bs,
+													  const ElementBases &gbs,
+													  const Eigen::MatrixXd &local_pts,
+													  const Eigen::MatrixXd &fun,
+													  Eigen::MatrixXd &tensor,
+													  Eigen::MatrixXd &von_mises) const
+	{
+		if(assembler == "LinearElasticity")
+			linear_elasticity_.local_assembler().compute_stress_and_von_mises(el_id, bs, gbs, local_pts, fun, tensor, von_mises);
+		else if(assembler == "HookeLinearElasticity")
+			hooke_linear_elasticity_.local_assembler().compute_stress_and_von_mises(el_id, bs, gbs, local_pts, fun, tensor, von_mises);
+		else if(assembler == "SaintVenant")
+			saint_venant_elasticity_.local_assembler().compute_stress_and_von_mises(el_id, bs, gbs, local_pts, fun, tensor, von_mises);
+		else if(assembler == "NeoHookean")
+			neo_hookean_elasticity_.local_assembler().compute_stress_and_von_mises(el_id, bs, gbs, local_pts, fun, tensor, von_mises);
+		else if(assembler == "IncompressibleLinearElasticity")
+			incompressible_lin_elast_displacement_.local_assembler().compute_stress_and_von_mises(el_id, bs, gbs, local_pts, fun, tensor, von_mises);
+
+		//no shared work for the other formulations
+		else
+		{
+			compute_scalar_value(assembler, el_id, bs, gbs, local_pts, fun, von_mises);
+			compute_tensor_value(assembler, el_id, bs, gbs, local_pts, fun, tensor);
+		}
+	}
+
 
 	VectorNd AssemblerUtils::compute_rhs(const std::string &assembler, const AutodiffHessianPt &pt) const
 	{
@@ -444,6 +536,15 @@ namespace polyfem
 		incompressible_lin_elast_pressure_.local_assembler().init_multimaterial(Es, nus);
 	}
 
+	void AssemblerUtils::precompute_material_parameters(const bool is_volume, const std::vector< ElementBases > &bases, const std::vector< ElementBases > &gbases)
+	{
+		linear_elasticity_.local_assembler().precompute_parameters(is_volume, bases, gbases);
+		neo_hookean_elasticity_.local_assembler().precompute_parameters(is_volume, bases, gbases);
+
+		incompressible_lin_elast_displacement_.local_assembler().precompute_parameters(is_volume, bases, gbases);
+		incompressible_lin_elast_pressure_.local_assembler().precompute_parameters(is_volume, bases, gbases);
+	}
+
 	void AssemblerUtils::set_parameters(const json &params)
 	{
 		laplacian_.local_assembler().set_parameters(params);
@@ -470,6 +571,33 @@ namespace polyfem
 		incompressible_lin_elast_displacement_.local_assembler().set_parameters(params);
 		incompressible_lin_elast_mixed_.local_assembler().set_parameters(params);
 		incompressible_lin_elast_pressure_.local_assembler().set_parameters(params);
+
+		//"coloring" assembles in a single shared matrix instead of thread local ones, see ColoredAssembly
+		const bool colored = params.count("parallel_assembly") && params["parallel_assembly"] == "coloring";
+
+		laplacian_.set_colored_assembly(colored);
+		helmholtz_.set_colored_assembly(colored);
+
+		bilaplacian_main_.set_colored_assembly(colored);
+		bilaplacian_mixed_.set_colored_assembly(colored);
+		bilaplacian_aux_.set_colored_assembly(colored);
+
+		linear_elasticity_.set_colored_assembly(colored);
+		hooke_linear_elasticity_.set_colored_assembly(colored);
+
+		saint_venant_elasticity_.set_colored_assembly(colored);
+		neo_hookean_elasticity_.set_colored_assembly(colored);
+
+		stokes_velocity_.set_colored_assembly(colored);
+		stokes_mixed_.set_colored_assembly(colored);
+		stokes_pressure_.set_colored_assembly(colored);
+
+		navier_stokes_velocity_.set_colored_assembly(colored);
+		navier_stokes_velocity_picard_.set_colored_assembly(colored);
+
+		incompressible_lin_elast_displacement_.set_colored_assembly(colored);
+		incompressible_lin_elast_mixed_.set_colored_assembly(colored);
+		incompressible_lin_elast_pressure_.set_colored_assembly(colored);
 	}
 
 	void AssemblerUtils::merge_mixed_matrices(
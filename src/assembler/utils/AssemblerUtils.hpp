@@ -23,6 +23,8 @@
 
 #include <polyfem/ProblemWithSolution.hpp>
 
+#include <polyfem/ElementDofMap.hpp>
+
 #include <vector>
 
 namespace polyfem
@@ -36,19 +38,29 @@ namespace polyfem
 		static AssemblerUtils &instance();
 
 		//Linear
+		//dof_map is the element dof map of bases (built by the caller once per basis set, e.g. State::dof_map),
+		//without it the assembly builds its own. The colored assemblies keep the colorings of the given maps in
+		//colorings (e.g. State::colorings), they are built again at every assembly without it
+		//condensation eliminates the dofs coupled to a single element, stiffness is then its skeleton system
+		//element_matrices keeps the local matrices between assemblies, see ElementMatrixCache
 		void assemble_problem(const std::string &assembler,
 			const bool is_volume,
 			const int n_basis,
 			const std::vector< ElementBases > &bases,
 			const std::vector< ElementBases > &gbases,
-			StiffnessMatrix &stiffness) const;
+			StiffnessMatrix &stiffness,
+			StaticCondensation *condensation = nullptr,
+			const ElementDofMap *dof_map = nullptr,
+			ColoredAssemblyCache *colorings = nullptr,
+			ElementMatrixCache *element_matrices = nullptr) const;
 
 		void assemble_mass_matrix(const std::string &assembler,
 			const bool is_volume,
 			const int n_basis,
 			const std::vector< ElementBases > &bases,
 			const std::vector< ElementBases > &gbases,
-			StiffnessMatrix &mass) const;
+			StiffnessMatrix &mass,
+			const ElementDofMap *dof_map = nullptr) const;
 
 		void assemble_mixed_problem(const std::string &assembler,
 			const bool is_volume,
@@ -57,14 +69,19 @@ namespace polyfem
 			const std::vector< ElementBases > &psi_bases,
 			const std::vector< ElementBases > &phi_bases,
 			const std::vector< ElementBases > &gbases,
-			StiffnessMatrix &stiffness) const;
+			StiffnessMatrix &stiffness,
+			const ElementDofMap *psi_dof_map = nullptr,
+			const ElementDofMap *phi_dof_map = nullptr,
+			ColoredAssemblyCache *colorings = nullptr) const;
 
 		void assemble_pressure_problem(const std::string &assembler,
 			const bool is_volume,
 			const int n_basis,
 			const std::vector< ElementBases > &bases,
 			const std::vector< ElementBases > &gbases,
-			StiffnessMatrix &stiffness) const;
+			StiffnessMatrix &stiffness,
+			const ElementDofMap *dof_map = nullptr,
+			ColoredAssemblyCache *colorings = nullptr) const;
 
 
 		//Non linear
@@ -80,7 +97,8 @@ namespace polyfem
 			const std::vector< ElementBases > &bases,
 			const std::vector< ElementBases > &gbases,
 			const Eigen::MatrixXd &displacement,
-			Eigen::MatrixXd &grad) const;
+			Eigen::MatrixXd &grad,
+			const ElementDofMap *dof_map = nullptr) const;
 
 		void assemble_energy_hessian(const std::string &assembler,
 			const bool is_volume,
@@ -88,7 +106,22 @@ namespace polyfem
 			const std::vector< ElementBases > &bases,
 			const std::vector< ElementBases > &gbases,
 			const Eigen::MatrixXd &displacement,
-			StiffnessMatrix &hessian) const;
+			StiffnessMatrix &hessian,
+			const ElementDofMap *dof_map = nullptr,
+			ColoredAssemblyCache *colorings = nullptr) const;
+
+		//any subset of energy, gradient and hessian with a single loop over the elements, the null ones are skipped
+		void assemble_energy_quantities(const std::string &assembler,
+			const bool is_volume,
+			const int n_basis,
+			const std::vector< ElementBases > &bases,
+			const std::vector< ElementBases > &gbases,
+			const Eigen::MatrixXd &displacement,
+			double *energy,
+			Eigen::MatrixXd *grad,
+			StiffnessMatrix *hessian,
+			const ElementDofMap *dof_map = nullptr,
+			ColoredAssemblyCache *colorings = nullptr) const;
 
 
 		//plotting
@@ -108,6 +141,16 @@ namespace polyfem
 								  const Eigen::MatrixXd &fun,
 								  Eigen::MatrixXd &result) const;
 
+		//tensor and von mises in one pass (one displacement gradient per point)
+		void compute_stress_and_von_mises(const std::string &assembler,
+										  const int el_id,
+										  const ElementBases &bs,
+										  const ElementBases &gbs,
+										  const Eigen::MatrixXd &local_pts,
+										  const Eigen::MatrixXd &fun,
+										  Eigen::MatrixXd &tensor,
+										  Eigen::MatrixXd &von_mises) const;
+
 		//for errors
 		VectorNd compute_rhs(const std::string &assembler, const AutodiffHessianPt &pt) const;
 
@@ -124,6 +167,8 @@ namespace polyfem
 		//aux
 		void set_parameters(const json &params);
 		void init_multimaterial(Eigen::MatrixXd &Es, Eigen::MatrixXd &nus);
+		//resolves the spatially varying material parameters once at the quadrature points, call after set_parameters
+		void precompute_material_parameters(const bool is_volume, const std::vector< ElementBases > &bases, const std::vector< ElementBases > &gbases);
 
 		bool is_linear(const std::string &assembler) const;
 
@@ -140,6 +185,7 @@ namespace polyfem
 		const std::vector<std::string> &scalar_assemblers() const { return scalar_assemblers_; }
 		const std::vector<std::string> &tensor_assemblers() const { return tensor_assemblers_; }
 		// const std::vector<std::string> &mixed_assemblers() const { return mixed_assemblers_; }
+		const LameParameters &lame_params() const { return linear_elasticity_.local_assembler().lame_params(); }
 
 		void clear_cache();
 
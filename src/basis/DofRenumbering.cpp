@@ -0,0 +1,316 @@
+#include <polyfem/DofRenumbering.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+
+namespace polyfem
+{
+	namespace
+	{
+		void element_nodes(const ElementBases &bs, std::vector<int> &nodes)
+		{
+			nodes.clear();
+			for (const Basis &b : bs.bases)
+			{
+				for (const auto &lg : b.global())
+					nodes.push_back(lg.index);
+			}
+
+			std::sort(nodes.begin(), nodes.end());
+			nodes.erase(std::unique(nodes.begin(), nodes.end()), nodes.end());
+		}
+
+		void build_graph(const std::vector<ElementBases> &bases, const int n_bases, std::vector<std::vector<int>> &adj)
+		{
+			adj.clear();
+			adj.resize(n_bases);
+
+			std::vector<int> nodes;
+			for (const ElementBases &bs : bases)
+			{
+				element_nodes(bs, nodes);
+				for (int i : nodes)
+				{
+					assert(i >= 0 && i < n_bases);
+					for (int j : nodes)
+					{
+						if (i != j)
+							adj[i].push_back(j);
+					}
+				}
+			}
+
+			for (auto &a : adj)
+			{
+				std::sort(a.begin(), a.end());
+				a.erase(std::unique(a.begin(), a.end()), a.end());
+			}
+		}
+
+		//breadth first search from start, returns the nodes of the last level
+		int bfs_levels(const std::vector<std::vector<int>> &adj, const int start, std::vector<int> &level, std::vector<int> &touched, std::vector<int> &last_level)
+		{
+			for (int i : touched)
+				level[i] = -1;
+			touched.clear();
+
+			touched.push_back(start);
+			level[start] = 0;
+
+			int depth = 0;
+			for (std::size_t k = 0; k < touched.size(); ++k)
+			{
+				const int i = touched[k];
+				depth = std::max(depth, level[i]);
+				for (int j : adj[i])
+				{
+					if (level[j] >= 0)
+						continue;
+					level[j] = level[i] + 1;
+					touched.push_back(j);
+				}
+			}
+
+			last_level.clear();
+			for (int i : touched)
+			{
+				if (level[i] == depth)
+					last_level.push_back(i);
+			}
+
+			return depth;
+		}
+
+		//George-Liu heuristic for a node with (almost) maximal eccentricity in the component of start
+		int pseudo_peripheral_node(const std::vector<std::vector<int>> &adj, int start, std::vector<int> &level, std::vector<int> &touched)
+		{
+			std::vector<int> last_level;
+			int depth = bfs_levels(adj, start, level, touched, last_level);
+
+			for (int it = 0; it < 10; ++it)
+			{
+				int candidate = last_level.front();
+				for (int i : last_level)
+				{
+					if (adj[i].size() < adj[candidate].size())
+						candidate = i;
+				}
+
+				const int new_depth = bfs_levels(adj, candidate, level, touched, last_level);
+				if (new_depth <= depth)
+					break;
+
+				depth = new_depth;
+				start = candidate;
+			}
+
+			for (int i : touched)
+				level[i] = -1;
+			touched.clear();
+
+			return start;
+		}
+
+		std::uint64_t morton_code(const Eigen::Matrix<std::uint64_t, Eigen::Dynamic, 1> &coords, const int bits)
+		{
+			std::uint64_t code = 0;
+			const int dim = int(coords.size());
+			for (int b = 0; b < bits; ++b)
+			{
+				for (int d = 0; d < dim; ++d)
+					code |= ((coords(d) >> b) & std::uint64_t(1)) << (b * dim + d);
+			}
+
+			return code;
+		}
+	} // namespace
+
+	void DofRenumbering::rcm(const std::vector<ElementBases> &bases, const int n_bases, Eigen::VectorXi &new_index)
+	{
+		std::vector<std::vector<int>> adj;
+		build_graph(bases, n_bases, adj);
+
+		//candidate starting nodes, by increasing degree
+		std::vector<int> by_degree(n_bases);
+		std::iota(by_degree.begin(), by_degree.end(), 0);
+		std::stable_sort(by_degree.begin(), by_degree.end(), [&](int a, int b) { return adj[a].size() < adj[b].size(); });
+
+		std::vector<int> order;
+		order.reserve(n_bases);
+		std::vector<bool> visited(n_bases, false);
+		std::vector<int> level(n_bases, -1);
+		std::vector<int> touched;
+		std::vector<int> neighs;
+
+		for (int s : by_degree)
+		{
+			if (visited[s])
+				continue;
+
+			//one connected component
+			const int start = pseudo_peripheral_node(adj, s, level, touched);
+			std::size_t k = order.size();
+			order.push_back(start);
+			visited[start] = true;
+
+			for (; k < order.size(); ++k)
+			{
+				const int i = order[k];
+
+				neighs.clear();
+				for (int j : adj[i])
+				{
+					if (!visited[j])
+					{
+						neighs.push_back(j);
+						visited[j] = true;
+					}
+				}
+
+				std::stable_sort(neighs.begin(), neighs.end(), [&](int a, int b) { return adj[a].size() < adj[b].size(); });
+				order.insert(order.end(), neighs.begin(), neighs.end());
+			}
+		}
+
+		assert(int(order.size()) == n_bases);
+
+		new_index.resize(n_bases);
+		for (int k = 0; k < n_bases; ++k)
+			new_index(order[k]) = n_bases - 1 - k;
+	}
+
+	void DofRenumbering::morton(const std::vector<ElementBases> &bases, const int n_bases, Eigen::VectorXi &new_index)
+	{
+		new_index.resize(n_bases);
+		if (n_bases <= 0)
+			return;
+
+		Eigen::MatrixXd pts;
+		std::vector<bool> found(n_bases, false);
+		for (const ElementBases &bs : bases)
+		{
+			for (const Basis &b : bs.bases)
+			{
+				for (const auto &lg : b.global())
+				{
+					if (pts.size() == 0)
+						pts.resize(n_bases, lg.node.size());
+					if (found[lg.index])
+						continue;
+
+					pts.row(lg.index) = lg.node;
+					found[lg.index] = true;
+				}
+			}
+		}
+
+		const int dim = int(pts.cols());
+		const int bits = dim == 3 ? 21 : 31;
+		const double max_coord = double((std::uint64_t(1) << bits) - 1);
+
+		Eigen::RowVectorXd min_p(dim), max_p(dim);
+		min_p.setConstant(std::numeric_limits<double>::max());
+		max_p.setConstant(-std::numeric_limits<double>::max());
+		for (int i = 0; i < n_bases; ++i)
+		{
+			if (!found[i])
+				continue;
+			min_p = min_p.cwiseMin(pts.row(i));
+			max_p = max_p.cwiseMax(pts.row(i));
+		}
+		const Eigen::RowVectorXd extent = (max_p - min_p).cwiseMax(1e-16);
+
+		std::vector<std::uint64_t> codes(n_bases, 0);
+		Eigen::Matrix<std::uint64_t, Eigen::Dynamic, 1> coords(dim);
+		for (int i = 0; i < n_bases; ++i)
+		{
+			//nodes without position go at the end
+			if (!found[i])
+			{
+				codes[i] = std::numeric_limits<std::uint64_t>::max();
+				continue;
+			}
+
+			for (int d = 0; d < dim; ++d)
+				coords(d) = std::uint64_t((pts(i, d) - min_p(d)) / extent(d) * max_coord);
+			codes[i] = morton_code(coords, bits);
+		}
+
+		std::vector<int> order(n_bases);
+		std::iota(order.begin(), order.end(), 0);
+		std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return codes[a] < codes[b]; });
+
+		for (int k = 0; k < n_bases; ++k)
+			new_index(order[k]) = k;
+	}
+
+	void DofRenumbering::compute(const std::string &type, const std::vector<ElementBases> &bases, const int n_bases, Eigen::VectorXi &new_index)
+	{
+		if (type.empty() || type == "none")
+		{
+			new_index.resize(n_bases);
+			for (int i = 0; i < n_bases; ++i)
+				new_index(i) = i;
+		}
+		else if (type == "rcm")
+			rcm(bases, n_bases, new_index);
+		else if (type == "morton")
+			morton(bases, n_bases, new_index);
+		else
+			throw std::invalid_argument("[DofRenumbering] invalid renumbering " + type);
+	}
+
+	void DofRenumbering::apply(const Eigen::VectorXi &new_index, std::vector<ElementBases> &bases)
+	{
+		for (ElementBases &bs : bases)
+		{
+			for (Basis &b : bs.bases)
+			{
+				for (auto &lg : b.global())
+					lg.index = new_index(lg.index);
+			}
+		}
+	}
+
+	int DofRenumbering::bandwidth(const std::vector<ElementBases> &bases)
+	{
+		int res = 0;
+		std::vector<int> nodes;
+		for (const ElementBases &bs : bases)
+		{
+			element_nodes(bs, nodes);
+			if (!nodes.empty())
+				res = std::max(res, nodes.back() - nodes.front());
+		}
+
+		return res;
+	}
+
+	void DofRenumbering::to_original(const Eigen::VectorXi &new_index, const int dim, const Eigen::MatrixXd &fun, Eigen::MatrixXd &result)
+	{
+		result = fun;
+		if (fun.rows() < new_index.size() * dim)
+			return;
+
+		for (int i = 0; i < new_index.size(); ++i)
+		{
+			for (int d = 0; d < dim; ++d)
+				result.row(i * dim + d) = fun.row(new_index(i) * dim + d);
+		}
+	}
+
+	void DofRenumbering::to_original(const Eigen::VectorXi &new_index, const int dim, const Eigen::VectorXi &pressure_new_index, const Eigen::MatrixXd &fun, Eigen::MatrixXd &result)
+	{
+		to_original(new_index, dim, fun, result);
+
+		const int offset = new_index.size() * dim;
+		if (fun.rows() < offset + pressure_new_index.size())
+			return;
+
+		for (int i = 0; i < pressure_new_index.size(); ++i)
+			result.row(offset + i) = fun.row(offset + pressure_new_index(i));
+	}
+} // namespace polyfem
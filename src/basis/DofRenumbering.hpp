@@ -0,0 +1,39 @@
+#pragma once
+
+#include <polyfem/ElementBases.hpp>
+
+#include <Eigen/Dense>
+
+#include <string>
+#include <vector>
+
+namespace polyfem
+{
+	//Renumbering of the global nodes of the bases, applied after the bases are built.
+	//A compact numbering reduces the bandwidth of the assembled matrices (better locality in the
+	//assembly scatter, in the matrix-vector products, and less fill for direct solvers that do not reorder)
+	class DofRenumbering
+	{
+	public:
+		//reverse Cuthill-McKee on the node graph, two nodes are adjacent if they share an element
+		//new_index(i) is the new index of node i
+		static void rcm(const std::vector<ElementBases> &bases, const int n_bases, Eigen::VectorXi &new_index);
+
+		//sorts the nodes along a Morton (z-order) curve of their positions
+		static void morton(const std::vector<ElementBases> &bases, const int n_bases, Eigen::VectorXi &new_index);
+
+		//type is "rcm" or "morton", empty or "none" gives the identity
+		static void compute(const std::string &type, const std::vector<ElementBases> &bases, const int n_bases, Eigen::VectorXi &new_index);
+
+		//replaces the global indices of all the bases
+		static void apply(const Eigen::VectorXi &new_index, std::vector<ElementBases> &bases);
+
+		//max |i - j| over the pairs of nodes sharing an element
+		static int bandwidth(const std::vector<ElementBases> &bases);
+
+		//moves the rows of a field with dim values per node back to the numbering before the renumbering
+		static void to_original(const Eigen::VectorXi &new_index, const int dim, const Eigen::MatrixXd &fun, Eigen::MatrixXd &result);
+		//mixed formulations: the dim values per node are followed by one value per pressure node, the rows after them (average constraint) are kept
+		static void to_original(const Eigen::VectorXi &new_index, const int dim, const Eigen::VectorXi &pressure_new_index, const Eigen::MatrixXd &fun, Eigen::MatrixXd &result);
+	};
+} // namespace polyfem
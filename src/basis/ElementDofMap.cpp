@@ -0,0 +1,59 @@
+#include <polyfem/ElementDofMap.hpp>
+
+namespace polyfem
+{
+	void ElementDofMap::build(const std::vector<ElementBases> &bases, const int n_bases)
+	{
+		const int n_elements = int(bases.size());
+		element_offsets_.resize(n_elements + 1);
+		element_offsets_[0] = 0;
+		for (int e = 0; e < n_elements; ++e)
+			element_offsets_[e + 1] = element_offsets_[e] + int(bases[e].bases.size());
+
+		dofs_.resize(element_offsets_.back());
+		conforming_.assign(n_elements, true);
+
+		std::vector<Eigen::Triplet<double>> entries;
+		int n_constrained = 0;
+		for (int e = 0; e < n_elements; ++e)
+		{
+			const auto &b = bases[e].bases;
+			for (size_t j = 0; j < b.size(); ++j)
+			{
+				const auto &global = b[j].global();
+				int &dof = dofs_[element_offsets_[e] + j];
+
+				if (global.size() == 1 && global.front().val == 1)
+				{
+					dof = global.front().index;
+					continue;
+				}
+
+				conforming_[e] = false;
+				for (const auto &g : global)
+					entries.emplace_back(n_constrained, g.index, g.val);
+				dof = -1 - n_constrained;
+				++n_constrained;
+			}
+		}
+
+		constraints_.resize(n_constrained, n_bases);
+		//duplicates are summed
+		constraints_.setFromTriplets(entries.begin(), entries.end());
+		constraints_.makeCompressed();
+	}
+
+	void ElementDofMap::clear()
+	{
+		std::vector<int>().swap(element_offsets_);
+		std::vector<int>().swap(dofs_);
+		std::vector<bool>().swap(conforming_);
+		constraints_ = Eigen::SparseMatrix<double, Eigen::RowMajor>();
+	}
+
+	size_t ElementDofMap::memory_bytes() const
+	{
+		return (element_offsets_.capacity() + dofs_.capacity()) * sizeof(int) + conforming_.capacity() / 8
+			+ constraints_.nonZeros() * (sizeof(double) + sizeof(int)) + (constraints_.outerSize() + 1) * sizeof(int);
+	}
+} // namespace polyfem
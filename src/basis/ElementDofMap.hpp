@@ -0,0 +1,53 @@
+#pragma once
+
+#include <polyfem/ElementBases.hpp>
+
+#include <Eigen/Sparse>
+
+#include <vector>
+
+namespace polyfem
+{
+	//Compact element to global node map used by the assembly scatter. The local bases of all elements
+	//are stored contiguously (compressed rows over the elements): a local basis equal to a single global
+	//node with weight 1 stores the node index, the others (polygonal, spline, non-conforming) store
+	//-1 - r where r is their row in a sparse constraint matrix of weighted global nodes.
+	class ElementDofMap
+	{
+	public:
+		void build(const std::vector<ElementBases> &bases, const int n_bases);
+		void clear();
+
+		int n_elements() const { return int(element_offsets_.size()) - 1; }
+		int n_local_bases(const int e) const { return element_offsets_[e + 1] - element_offsets_[e]; }
+
+		//all the local bases of e are single nodes with weight 1
+		bool is_conforming(const int e) const { return conforming_[e]; }
+		//global node of every local basis of e, only meaningful for conforming elements
+		const int *element_dofs(const int e) const { return dofs_.data() + element_offsets_[e]; }
+
+		//calls f(global index, weight) for the nodes of the local basis j of element e
+		template <typename F>
+		void for_each_node(const int e, const int j, F f) const
+		{
+			const int d = dofs_[element_offsets_[e] + j];
+			if (d >= 0)
+			{
+				f(d, 1.);
+				return;
+			}
+
+			for (Eigen::SparseMatrix<double, Eigen::RowMajor>::InnerIterator it(constraints_, -1 - d); it; ++it)
+				f(int(it.col()), it.value());
+		}
+
+		const Eigen::SparseMatrix<double, Eigen::RowMajor> &constraints() const { return constraints_; }
+		size_t memory_bytes() const;
+
+	private:
+		std::vector<int> element_offsets_;
+		std::vector<int> dofs_;
+		std::vector<bool> conforming_;
+		Eigen::SparseMatrix<double, Eigen::RowMajor> constraints_;
+	};
+} // namespace polyfem
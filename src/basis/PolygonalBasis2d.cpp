@@ -11,6 +11,13 @@
 
 #include <polyfem/auto_q_bases.hpp>
 
+#include <igl/Timer.h>
+
+#ifdef POLYFEM_WITH_TBB
+#include <tbb/parallel_for.h>
+#include <tbb/enumerable_thread_specific.h>
+#endif
+
 #include <random>
 #include <memory>
 ////////////////////////////////////////////////////////////////////////////////
@@ -22,6 +29,16 @@ namespace polyfem
 namespace
 {
 
+//scratch buffers and phase times of one thread
+struct LocalThreadPolytopeStorage
+{
+	std::vector<int> local_to_global;
+	Eigen::MatrixXd collocation_points, kernel_centers, rhs;
+
+	double sampling_time = 0;
+	double weights_time = 0;
+};
+
 // -----------------------------------------------------------------------------
 
 std::vector<int> compute_nonzero_bases_ids(const Mesh2D &mesh, const int element_index,
@@ -370,7 +387,9 @@ int PolygonalBasis2d::build_bases(
 	std::vector<ElementBases> &bases,
 	const std::vector<ElementBases> &gbases,
 	const std::map<int, InterfaceData> &poly_edge_to_data,
-	std::map<int, Eigen::MatrixXd> &mapped_boundary)
+	std::map<int, Eigen::MatrixXd> &mapped_boundary,
+	json &timings,
+	PolytopeBasisCache *cache)
 {
 	assert(!mesh.is_volume());
 	if (poly_edge_to_data.empty())
@@ -381,61 +400,74 @@ int PolygonalBasis2d::build_bases(
 	const auto &assembler = AssemblerUtils::instance();
 	const int dim = assembler.is_tensor(assembler_name) ? 2 : 1;
 
+	if (integral_constraints < 0 || integral_constraints > 2)
+	{
+		throw std::runtime_error("Unsupported constraint order: " + std::to_string(integral_constraints));
+	}
+
+	//the cached operators are the ones of the constraints of the Laplacian
+	if (assembler_name != "Laplacian")
+	{
+		cache = nullptr;
+	}
+
+	if (cache)
+	{
+		cache->reset_stats();
+	}
+
 	// Step 1: Compute integral constraints
+	igl::Timer timer;
+	timer.start();
 	Eigen::MatrixXd basis_integrals;
 	compute_integral_constraints(assembler_name, mesh, n_bases, bases, gbases, basis_integrals);
+	timer.stop();
+	timings["integral_constraints"] = timer.getElapsedTime();
 
-	// Step 2: Compute the rest =)
-	PolygonQuadrature poly_quadr;
+	// The polygons are independent, the entries of mapped_boundary are created here and filled in parallel
+	std::vector<int> polytopes;
 	for (int e = 0; e < mesh.n_elements(); ++e)
 	{
-		if (!mesh.is_polytope(e))
+		if (mesh.is_polytope(e))
 		{
-			continue;
+			polytopes.push_back(e);
+			mapped_boundary[e];
 		}
+	}
+
+	// Step 2: Compute the rest =)
+	const auto build_polygon = [&](const int e, LocalThreadPolytopeStorage &storage) {
 		// No boundary polytope
 		// assert(element_type[e] != ElementType::BoundaryPolytope);
 
 		// Kernel distance to polygon boundary
 		const double eps = compute_epsilon(mesh, e);
 
-		std::vector<int> local_to_global; // map local basis id (the ones that are nonzero on the polygon boundary) to global basis id
-		Eigen::MatrixXd collocation_points, kernel_centers;
-		Eigen::MatrixXd rhs; // 1 row per collocation point, 1 column per basis that is nonzero on the polygon boundary
+		std::vector<int> &local_to_global = storage.local_to_global; // map local basis id (the ones that are nonzero on the polygon boundary) to global basis id
+		Eigen::MatrixXd &collocation_points = storage.collocation_points;
+		Eigen::MatrixXd &kernel_centers = storage.kernel_centers;
+		Eigen::MatrixXd &rhs = storage.rhs; // 1 row per collocation point, 1 column per basis that is nonzero on the polygon boundary
+
+		igl::Timer phase_timer;
+		phase_timer.start();
 
 		sample_polygon(e, n_samples_per_edge, mesh, poly_edge_to_data, bases, gbases,
 					   eps, local_to_global, collocation_points, kernel_centers, rhs);
 
-		// igl::opengl::glfw::Viewer viewer;
-		// viewer.data().add_points(kernel_centers, Eigen::Vector3d(0,1,1).transpose());
-
-		// Eigen::MatrixXd asd(collocation_points.rows(), 3);
-		// asd.col(0)=collocation_points.col(0);
-		// asd.col(1)=collocation_points.col(1);
-		// asd.col(2)=rhs.col(0);
-		// viewer.data().add_points(asd, Eigen::Vector3d(1,0,1).transpose());
-
-		// for(int asd = 0; asd < collocation_points.rows(); ++asd) {
-		//     viewer.data().add_label(collocation_points.row(asd), std::to_string(asd));
-		// }
-
-		// viewer.launch();
-
-		// igl::opengl::glfw::Viewer & viewer = UIState::ui_state().viewer;
-		// viewer.data().clear();
-		// viewer.data().set_mesh(triangulated_vertices, triangulated_faces);
-		// viewer.data().add_points(kernel_centers, Eigen::Vector3d(0,1,1).transpose());
-		// add_spheres(viewer, kernel_centers, 0.01);
-
 		ElementBases &b = bases[e];
 		b.has_parameterization = false;
 
 		// Compute quadrature points for the polygon
 		Quadrature tmp_quadrature;
+		PolygonQuadrature poly_quadr;
 		poly_quadr.get_quadrature(collocation_points, quadrature_order, tmp_quadrature);
 
 		b.set_quadrature([tmp_quadrature](Quadrature &quad) { quad = tmp_quadrature; });
 
+		phase_timer.stop();
+		storage.sampling_time += phase_timer.getElapsedTime();
+		phase_timer.start();
+
 		// Compute the weights of the harmonic kernels
 		Eigen::MatrixXd local_basis_integrals(rhs.cols(), basis_integrals.cols());
 		for (long k = 0; k < rhs.cols(); ++k)
@@ -481,16 +513,25 @@ int PolygonalBasis2d::build_bases(
 			set_rbf(std::make_shared<RBFWithLinear>(
 				kernel_centers, collocation_points, local_basis_integrals, tmp_quadrature, rhs));
 		}
-		else if (integral_constraints == 2)
+		else if (cache)
 		{
-			set_rbf(std::make_shared<RBFWithQuadraticLagrange>(
-				assembler_name, kernel_centers, collocation_points, local_basis_integrals, tmp_quadrature, rhs));
+			PolytopeBasisCache::Geometry geom;
+			cache->canonicalize(kernel_centers, collocation_points, tmp_quadrature, geom);
+			const auto entry = cache->get(geom);
+
+			Eigen::MatrixXd weights;
+			PolytopeBasisCache::weights(geom, *entry, local_basis_integrals, rhs, weights);
+			set_rbf(std::make_shared<CanonicalRBF>(geom, *entry, weights));
 		}
 		else
 		{
-			throw std::runtime_error("Unsupported constraint order: " + std::to_string(integral_constraints));
+			set_rbf(std::make_shared<RBFWithQuadraticLagrange>(
+				assembler_name, kernel_centers, collocation_points, local_basis_integrals, tmp_quadrature, rhs));
 		}
 
+		phase_timer.stop();
+		storage.weights_time += phase_timer.getElapsedTime();
+
 		// Set the bases which are nonzero inside the polygon
 		const int n_poly_bases = int(local_to_global.size());
 		b.bases.resize(n_poly_bases);
@@ -500,7 +541,44 @@ int PolygonalBasis2d::build_bases(
 		}
 
 		// Polygon boundary after geometric mapping from neighboring elements
-		mapped_boundary[e] = collocation_points;
+		mapped_boundary.at(e) = collocation_points;
+	};
+
+	timer.start();
+	double sampling_time = 0, weights_time = 0;
+#ifdef POLYFEM_WITH_TBB
+	typedef tbb::enumerable_thread_specific<LocalThreadPolytopeStorage> LocalStorage;
+	LocalStorage storages((LocalThreadPolytopeStorage()));
+	tbb::parallel_for(tbb::blocked_range<int>(0, int(polytopes.size())), [&](const tbb::blocked_range<int> &r) {
+		LocalStorage::reference loc_storage = storages.local();
+		for (int i = r.begin(); i != r.end(); ++i)
+			build_polygon(polytopes[i], loc_storage);
+	});
+
+	for (LocalStorage::iterator i = storages.begin(); i != storages.end(); ++i)
+	{
+		sampling_time += i->sampling_time;
+		weights_time += i->weights_time;
+	}
+#else
+	LocalThreadPolytopeStorage loc_storage;
+	for (int e : polytopes)
+		build_polygon(e, loc_storage);
+
+	sampling_time = loc_storage.sampling_time;
+	weights_time = loc_storage.weights_time;
+#endif
+	timer.stop();
+
+	//the phases are summed over the threads
+	timings["polytopes"] = timer.getElapsedTime();
+	timings["sampling"] = sampling_time;
+	timings["weights"] = weights_time;
+	timings["n_polytopes"] = polytopes.size();
+	if (cache && integral_constraints == 2)
+	{
+		timings["cache_hits"] = cache->hits();
+		timings["cache_misses"] = cache->misses();
 	}
 
 	return 0;
@@ -1,10 +1,12 @@
 #ifndef POLYGONAL_BASIS_HPP
 #define POLYGONAL_BASIS_HPP
 
+#include <polyfem/Common.hpp>
 #include <polyfem/Mesh2D.hpp>
 #include <polyfem/ElementBases.hpp>
 #include <polyfem/ElementAssemblyValues.hpp>
 #include <polyfem/InterfaceData.hpp>
+#include <polyfem/PolytopeBasisCache.hpp>
 
 #include <Eigen/Dense>
 #include <vector>
@@ -59,6 +61,11 @@ namespace polyfem
 		///                                      geometric mapping of the element across the edge,
 		///                                      so this polyline may differ from the original
 		///                                      polygon. }
+		/// @param[out]    timings               { Time of the integral constraints, the sampling, and the
+		///                                      kernel weights (summed over the threads) }
+		/// @param[in,out] cache                 { Optional cache of the fits, shared by the polygons
+		///                                      equal up to rigid motion and scale (quadratic
+		///                                      constraints of the Laplacian only) }
 		/// @param[in]  element_types  { Per-element tag indicating the type of each element (see Mesh.hpp) }
 		/// @param[in]  values         { Per-element shape functions for the PDE, evaluated over the element,
 		///                            used for the system matrix assembly (used for linear reproduction) }
@@ -75,7 +82,9 @@ namespace polyfem
 			std::vector< ElementBases > &bases,
 			const std::vector< ElementBases > &gbases,
 			const  std::map<int, InterfaceData> &poly_edge_to_data,
-			std::map<int, Eigen::MatrixXd> &mapped_boundary);
+			std::map<int, Eigen::MatrixXd> &mapped_boundary,
+			json &timings,
+			PolytopeBasisCache *cache = nullptr);
 	};
 }
 #endif //POLYGONAL_BASIS_HPP
@@ -12,6 +12,13 @@
 #include <polyfem/auto_q_bases.hpp>
 
 #include <igl/per_vertex_normals.h>
+#include <igl/Timer.h>
+
+#ifdef POLYFEM_WITH_TBB
+#include <tbb/parallel_for.h>
+#include <tbb/enumerable_thread_specific.h>
+#endif
+
 #include <random>
 #include <memory>
 ////////////////////////////////////////////////////////////////////////////////
@@ -23,6 +30,16 @@ namespace
 
 const int max_num_kernels = 300;
 
+//scratch buffers and phase times of one thread
+struct LocalThreadPolytopeStorage
+{
+	std::vector<int> local_to_global;
+	Eigen::MatrixXd collocation_points, kernel_centers, rhs;
+
+	double sampling_time = 0;
+	double weights_time = 0;
+};
+
 // -----------------------------------------------------------------------------
 
 std::vector<int> compute_nonzero_bases_ids(const Mesh3D &mesh, const int c,
@@ -570,7 +587,9 @@ int PolygonalBasis3d::build_bases(
 	std::vector<ElementBases> &bases,
 	const std::vector<ElementBases> &gbases,
 	const std::map<int, InterfaceData> &poly_face_to_data,
-	std::map<int, std::pair<Eigen::MatrixXd, Eigen::MatrixXi>> &mapped_boundary)
+	std::map<int, std::pair<Eigen::MatrixXd, Eigen::MatrixXi>> &mapped_boundary,
+	json &timings,
+	PolytopeBasisCache *cache)
 {
 	assert(mesh.is_volume());
 	if (poly_face_to_data.empty())
@@ -580,31 +599,56 @@ int PolygonalBasis3d::build_bases(
 	int n_kernels_per_edge = 4; //(int) std::round(n_samples_per_edge / 3.0);
 	int n_samples_per_edge = 3 * n_kernels_per_edge;
 
+	if (integral_constraints < 0 || integral_constraints > 2)
+	{
+		throw std::runtime_error("Unsupported constraint order: " + std::to_string(integral_constraints));
+	}
+
+	if (cache)
+	{
+		cache->reset_stats();
+	}
+
 	// Step 1: Compute integral constraints
+	igl::Timer timer;
+	timer.start();
 	Eigen::MatrixXd basis_integrals;
 	compute_integral_constraints(assembler_name, mesh, n_bases, bases, gbases, basis_integrals);
+	timer.stop();
+	timings["integral_constraints"] = timer.getElapsedTime();
 
-	// Step 2: Compute the rest =)
+	// The polyhedra are independent, the entries of mapped_boundary are created here and filled in parallel
+	std::vector<int> polytopes;
 	for (int e = 0; e < mesh.n_elements(); ++e)
 	{
-		if (!mesh.is_polytope(e))
+		if (mesh.is_polytope(e))
 		{
-			continue;
+			polytopes.push_back(e);
+			mapped_boundary[e];
 		}
+	}
+
+	// Step 2: Compute the rest =)
+	const auto build_polyhedron = [&](const int e, LocalThreadPolytopeStorage &storage) {
 		// No boundary polytope
 		// assert(element_type[e] != ElementType::BoundaryPolytope);
 
 		// Kernel distance to polygon boundary
 		const double eps = compute_epsilon(mesh, e);
 
-		std::vector<int> local_to_global; // map local basis id (the ones that are nonzero on the polygon boundary) to global basis id
-		Eigen::MatrixXd collocation_points, kernel_centers, triangulated_vertices;
+		std::vector<int> &local_to_global = storage.local_to_global; // map local basis id (the ones that are nonzero on the polygon boundary) to global basis id
+		Eigen::MatrixXd &collocation_points = storage.collocation_points;
+		Eigen::MatrixXd &kernel_centers = storage.kernel_centers;
+		Eigen::MatrixXd &rhs = storage.rhs; // 1 row per collocation point, 1 column per basis that is nonzero on the polygon boundary
+		Eigen::MatrixXd triangulated_vertices;
 		Eigen::MatrixXi triangulated_faces;
-		Eigen::MatrixXd rhs; // 1 row per collocation point, 1 column per basis that is nonzero on the polygon boundary
 
 		ElementBases &b = bases[e];
 		b.has_parameterization = false;
 
+		igl::Timer phase_timer;
+		phase_timer.start();
+
 		Quadrature tmp_quadrature;
 		double scaling;
 		Eigen::RowVector3d translation;
@@ -614,39 +658,10 @@ int PolygonalBasis3d::build_bases(
 						 triangulated_faces, tmp_quadrature, scaling, translation);
 
 		b.set_quadrature([tmp_quadrature](Quadrature &quad) { quad = tmp_quadrature; });
-		// b.scaling_ = scaling;
-		// b.translation_ = translation;
-
-		// igl::opengl::glfw::Viewer & viewer = UIState::ui_state().viewer;
-		// viewer.data().clear();
-		// viewer.data().set_mesh(triangulated_vertices, triangulated_faces);
-		// viewer.data().add_points(kernel_centers, Eigen::Vector3d(0,1,1).transpose());
-		// add_spheres(viewer, kernel_centers, 0.005);
-
-		// Eigen::MatrixXd pts = triangulated_vertices, normals;
-		// Eigen::MatrixXi tris = triangulated_faces;
-		// igl::per_corner_normals(pts, tris, 20, normals);
-		// viewer.data().set_normals(normals);
-		// viewer.data().set_face_based(false);
-		// viewer.launch();
-
-		// for(int a = 0; rhs.cols();++a)
-		// 	{
-		// 	igl::opengl::glfw::Viewer viewer;
-		// 	Eigen::MatrixXd asd(collocation_points.rows(), 3);
-		// 	asd.col(0)=collocation_points.col(0);
-		// 	asd.col(1)=collocation_points.col(1);
-		// 	asd.col(2)=collocation_points.col(2);
-		// 	Eigen::VectorXd S = rhs.col(a);
-		// 	Eigen::MatrixXd C;
-		// 	igl::colormap(igl::COLOR_MAP_TYPE_VIRIDIS, S, true, C);
-		// 	viewer.data().add_points(asd, C);
-		// 	viewer.launch();
-		// }
-
-		// for(int asd = 0; asd < collocation_points.rows(); ++asd) {
-		//     viewer.data().add_label(collocation_points.row(asd), std::to_string(asd));
-		// }
+
+		phase_timer.stop();
+		storage.sampling_time += phase_timer.getElapsedTime();
+		phase_timer.start();
 
 		// Compute the weights of the RBF kernels
 		Eigen::MatrixXd local_basis_integrals(rhs.cols(), basis_integrals.cols());
@@ -696,17 +711,26 @@ int PolygonalBasis3d::build_bases(
 			set_rbf(std::make_shared<RBFWithLinear>(
 				kernel_centers, collocation_points, local_basis_integrals, tmp_quadrature, rhs));
 		}
-		else if (integral_constraints == 2)
+		else if (cache)
 		{
-			set_rbf(std::make_shared<RBFWithQuadratic>(
-				// set_rbf(std::make_shared<RBFWithQuadraticLagrange>(
-				assembler_name, kernel_centers, collocation_points, local_basis_integrals, tmp_quadrature, rhs));
+			PolytopeBasisCache::Geometry geom;
+			cache->canonicalize(kernel_centers, collocation_points, tmp_quadrature, geom);
+			const auto entry = cache->get(geom);
+
+			Eigen::MatrixXd weights;
+			PolytopeBasisCache::weights(geom, *entry, local_basis_integrals, rhs, weights);
+			set_rbf(std::make_shared<CanonicalRBF>(geom, *entry, weights));
 		}
 		else
 		{
-			throw std::runtime_error("Unsupported constraint order: " + std::to_string(integral_constraints));
+			set_rbf(std::make_shared<RBFWithQuadratic>(
+				// set_rbf(std::make_shared<RBFWithQuadraticLagrange>(
+				assembler_name, kernel_centers, collocation_points, local_basis_integrals, tmp_quadrature, rhs));
 		}
 
+		phase_timer.stop();
+		storage.weights_time += phase_timer.getElapsedTime();
+
 		// Set the bases which are nonzero inside the polygon
 		const int n_poly_bases = int(local_to_global.size());
 		b.bases.resize(n_poly_bases);
@@ -717,8 +741,46 @@ int PolygonalBasis3d::build_bases(
 
 		// Polygon boundary after geometric mapping from neighboring elements
 		orient_closed_surface(triangulated_vertices, triangulated_faces, false); // stupid viewer is flipping all the faces
-		mapped_boundary[e].first = triangulated_vertices;
-		mapped_boundary[e].second = triangulated_faces;
+		auto &boundary = mapped_boundary.at(e);
+		boundary.first = triangulated_vertices;
+		boundary.second = triangulated_faces;
+	};
+
+	timer.start();
+	double sampling_time = 0, weights_time = 0;
+#ifdef POLYFEM_WITH_TBB
+	typedef tbb::enumerable_thread_specific<LocalThreadPolytopeStorage> LocalStorage;
+	LocalStorage storages((LocalThreadPolytopeStorage()));
+	tbb::parallel_for(tbb::blocked_range<int>(0, int(polytopes.size())), [&](const tbb::blocked_range<int> &r) {
+		LocalStorage::reference loc_storage = storages.local();
+		for (int i = r.begin(); i != r.end(); ++i)
+			build_polyhedron(polytopes[i], loc_storage);
+	});
+
+	for (LocalStorage::iterator i = storages.begin(); i != storages.end(); ++i)
+	{
+		sampling_time += i->sampling_time;
+		weights_time += i->weights_time;
+	}
+#else
+	LocalThreadPolytopeStorage loc_storage;
+	for (int e : polytopes)
+		build_polyhedron(e, loc_storage);
+
+	sampling_time = loc_storage.sampling_time;
+	weights_time = loc_storage.weights_time;
+#endif
+	timer.stop();
+
+	//the phases are summed over the threads
+	timings["polytopes"] = timer.getElapsedTime();
+	timings["sampling"] = sampling_time;
+	timings["weights"] = weights_time;
+	timings["n_polytopes"] = polytopes.size();
+	if (cache && integral_constraints == 2)
+	{
+		timings["cache_hits"] = cache->hits();
+		timings["cache_misses"] = cache->misses();
 	}
 
 	return 0;
@@ -1,9 +1,11 @@
 #pragma once
 
+#include <polyfem/Common.hpp>
 #include <polyfem/Mesh3D.hpp>
 #include <polyfem/ElementBases.hpp>
 #include <polyfem/ElementAssemblyValues.hpp>
 #include <polyfem/InterfaceData.hpp>
+#include <polyfem/PolytopeBasisCache.hpp>
 
 #include <Eigen/Dense>
 #include <vector>
@@ -56,6 +58,11 @@ namespace polyfem
 		///                                      formed by the image of the collocation points
 		///                                      trough the geometric mapping of the boundary faces
 		///                                      }
+		/// @param[out]    timings               { Time of the integral constraints, the sampling, and the
+		///                                      kernel weights (summed over the threads) }
+		/// @param[in,out] cache                 { Optional cache of the fits, shared by the polyhedra
+		///                                      equal up to rigid motion and scale (quadratic
+		///                                      constraints only) }
 		/// @param[in]  element_types  { Per-element tag indicating the type of each element (see Mesh.hpp) }
 		/// @param[in]  values         { Per-element shape functions for the PDE, evaluated over the element,
 		///                            used for the system matrix assembly (used for linear reproduction) }
@@ -72,7 +79,9 @@ namespace polyfem
 			std::vector< ElementBases > &bases,
 			const std::vector< ElementBases > &gbases,
 			const std::map<int, InterfaceData> &poly_face_to_data,
-			std::map<int, std::pair<Eigen::MatrixXd, Eigen::MatrixXi> > &mapped_boundary);
+			std::map<int, std::pair<Eigen::MatrixXd, Eigen::MatrixXi> > &mapped_boundary,
+			json &timings,
+			PolytopeBasisCache *cache = nullptr);
 	};
 }
 
@@ -0,0 +1,392 @@
+#include <polyfem/PolytopeBasisCache.hpp>
+#include <polyfem/Logger.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <numeric>
+
+namespace polyfem
+{
+	namespace
+	{
+		const std::string cache_magic = "polyfem_polytope_basis_cache";
+		const std::int32_t cache_version = 2;
+
+		//relative gap between the moments of inertia below which the axes are not unique
+		const double frame_tolerance = 1e-4;
+
+		std::int64_t quantize(const double x, const double tolerance)
+		{
+			return std::int64_t(std::llround(x / tolerance));
+		}
+
+		//lexicographic order of the rows, compared after quantization
+		void sorted_rows(const Eigen::MatrixXd &pts, const double tolerance, std::vector<int> &order)
+		{
+			order.resize(pts.rows());
+			std::iota(order.begin(), order.end(), 0);
+			std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+				for (int d = 0; d < pts.cols(); ++d)
+				{
+					const std::int64_t qa = quantize(pts(a, d), tolerance);
+					const std::int64_t qb = quantize(pts(b, d), tolerance);
+					if (qa != qb)
+						return qa < qb;
+				}
+				return false;
+			});
+		}
+
+		void hash_combine(std::size_t &seed, const std::int64_t v)
+		{
+			seed ^= std::hash<std::int64_t>()(v) + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+		}
+
+		void hash_matrix(std::size_t &seed, const Eigen::MatrixXd &mat, const double tolerance)
+		{
+			hash_combine(seed, mat.rows());
+			hash_combine(seed, mat.cols());
+			for (int i = 0; i < mat.rows(); ++i)
+			{
+				for (int j = 0; j < mat.cols(); ++j)
+					hash_combine(seed, quantize(mat(i, j), tolerance));
+			}
+		}
+
+		bool same_matrix(const Eigen::MatrixXd &a, const Eigen::MatrixXd &b, const double tolerance)
+		{
+			if (a.rows() != b.rows() || a.cols() != b.cols())
+				return false;
+			return a.size() == 0 || (a - b).cwiseAbs().maxCoeff() <= tolerance;
+		}
+
+		//axes of inertia of the centered points by decreasing moment, oriented by the sign of their third moment,
+		//identity if two moments are equal (the axes are not unique)
+		Eigen::MatrixXd principal_axes(const Eigen::MatrixXd &centered)
+		{
+			const int dim = centered.cols();
+			Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> solver(centered.transpose() * centered);
+			if (solver.info() != Eigen::Success)
+				return Eigen::MatrixXd::Identity(dim, dim);
+
+			//increasing eigenvalues
+			const Eigen::VectorXd &moments = solver.eigenvalues();
+			for (int d = 1; d < dim; ++d)
+			{
+				if (moments(d) - moments(d - 1) <= frame_tolerance * moments(dim - 1))
+					return Eigen::MatrixXd::Identity(dim, dim);
+			}
+
+			Eigen::MatrixXd axes = solver.eigenvectors().rowwise().reverse();
+			for (int d = 0; d < dim; ++d)
+			{
+				//a vanishing third moment means that the points are symmetric with respect to the axis, both orientations give the same points
+				const Eigen::VectorXd proj = centered * axes.col(d);
+				if (proj.array().cube().sum() < 0)
+					axes.col(d) *= -1;
+			}
+
+			return axes;
+		}
+
+		//column of the monomial x_i x_j in the integral constraints: x, y, z, xy, yz, zx, x², y², z² in 3d, x, y, xy, x², y² in 2d
+		int quadratic_index(const int dim, const int i, const int j)
+		{
+			if (i == j)
+				return 2 * dim + i - (dim == 2 ? 1 : 0);
+			if (dim == 2)
+				return 2;
+			const int a = std::min(i, j);
+			const int b = std::max(i, j);
+			return a == 0 && b == 2 ? 5 : 3 + a;
+		}
+
+		void write_matrix(std::ofstream &out, const Eigen::MatrixXd &mat)
+		{
+			const std::int64_t rows = mat.rows(), cols = mat.cols();
+			out.write(reinterpret_cast<const char *>(&rows), sizeof(rows));
+			out.write(reinterpret_cast<const char *>(&cols), sizeof(cols));
+			out.write(reinterpret_cast<const char *>(mat.data()), sizeof(double) * mat.size());
+		}
+
+		bool read_matrix(std::ifstream &in, Eigen::MatrixXd &mat)
+		{
+			std::int64_t rows = 0, cols = 0;
+			in.read(reinterpret_cast<char *>(&rows), sizeof(rows));
+			in.read(reinterpret_cast<char *>(&cols), sizeof(cols));
+			if (!in || rows < 0 || cols < 0)
+				return false;
+			mat.resize(rows, cols);
+			in.read(reinterpret_cast<char *>(mat.data()), sizeof(double) * mat.size());
+			return bool(in);
+		}
+	} // namespace
+
+	PolytopeBasisCache::PolytopeBasisCache(const double tolerance)
+		: tolerance_(tolerance), hits_(0), misses_(0)
+	{
+		assert(tolerance_ > 0);
+	}
+
+	void PolytopeBasisCache::canonicalize(const Eigen::MatrixXd &centers, const Eigen::MatrixXd &collocation_points, const Quadrature &quadr, Geometry &geom) const
+	{
+		const int dim = collocation_points.cols();
+		assert(dim == 2 || dim == 3);
+
+		geom.translation = collocation_points.colwise().mean();
+		const Eigen::MatrixXd centered = collocation_points.rowwise() - geom.translation;
+		geom.rotation = principal_axes(centered);
+		const Eigen::MatrixXd aligned = centered * geom.rotation;
+		geom.scaling = (aligned.colwise().maxCoeff() - aligned.colwise().minCoeff()).maxCoeff();
+		if (geom.scaling <= 0)
+			geom.scaling = 1;
+		const double volume_scaling = std::pow(geom.scaling, dim);
+
+		const auto to_canonical = [&](const Eigen::MatrixXd &pts) {
+			return Eigen::MatrixXd((pts.rowwise() - geom.translation) * geom.rotation / geom.scaling);
+		};
+
+		std::vector<int> order;
+
+		const Eigen::MatrixXd colloc = aligned / geom.scaling;
+		sorted_rows(colloc, tolerance_, geom.collocation_order);
+		geom.collocation_points.resize(colloc.rows(), dim);
+		for (int i = 0; i < colloc.rows(); ++i)
+			geom.collocation_points.row(i) = colloc.row(geom.collocation_order[i]);
+
+		const Eigen::MatrixXd kernels = to_canonical(centers);
+		sorted_rows(kernels, tolerance_, order);
+		geom.centers.resize(kernels.rows(), dim);
+		for (int i = 0; i < kernels.rows(); ++i)
+			geom.centers.row(i) = kernels.row(order[i]);
+
+		const Eigen::MatrixXd qpts = to_canonical(quadr.points);
+		sorted_rows(qpts, tolerance_, order);
+		geom.quadrature.points.resize(qpts.rows(), dim);
+		geom.quadrature.weights.resize(qpts.rows());
+		for (int i = 0; i < qpts.rows(); ++i)
+		{
+			geom.quadrature.points.row(i) = qpts.row(order[i]);
+			geom.quadrature.weights(i) = quadr.weights(order[i]) / volume_scaling;
+		}
+
+		geom.key = compute_key(geom.centers, geom.collocation_points, geom.quadrature);
+	}
+
+	std::size_t PolytopeBasisCache::compute_key(const Eigen::MatrixXd &centers, const Eigen::MatrixXd &collocation_points, const Quadrature &quadr) const
+	{
+		std::size_t seed = 0;
+		hash_matrix(seed, centers, tolerance_);
+		hash_matrix(seed, collocation_points, tolerance_);
+		hash_matrix(seed, quadr.points, tolerance_);
+		hash_matrix(seed, quadr.weights, tolerance_);
+
+		return seed;
+	}
+
+	bool PolytopeBasisCache::matches(const Geometry &geom, const Entry &entry) const
+	{
+		return same_matrix(geom.centers, entry.centers, tolerance_) && same_matrix(geom.collocation_points, entry.collocation_points, tolerance_) && same_matrix(geom.quadrature.points, entry.quadrature.points, tolerance_) && same_matrix(geom.quadrature.weights, entry.quadrature.weights, tolerance_);
+	}
+
+	std::shared_ptr<const PolytopeBasisCache::Entry> PolytopeBasisCache::find(const Geometry &geom) const
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		const auto range = entries_.equal_range(geom.key);
+		for (auto it = range.first; it != range.second; ++it)
+		{
+			if (matches(geom, *it->second))
+				return it->second;
+		}
+
+		return nullptr;
+	}
+
+	std::shared_ptr<const PolytopeBasisCache::Entry> PolytopeBasisCache::get(const Geometry &geom)
+	{
+		auto res = find(geom);
+		if (res)
+		{
+			++hits_;
+			return res;
+		}
+		++misses_;
+
+		//the fit is computed outside of the lock, two threads can compute the same entry, the first one is kept
+		auto entry = std::make_shared<Entry>();
+		entry->centers = geom.centers;
+		entry->collocation_points = geom.collocation_points;
+		entry->quadrature = geom.quadrature;
+		RBFWithQuadratic::compute_fit_operators(entry->centers, entry->collocation_points, entry->quadrature, entry->P, entry->R);
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		const auto range = entries_.equal_range(geom.key);
+		for (auto it = range.first; it != range.second; ++it)
+		{
+			if (matches(geom, *it->second))
+				return it->second;
+		}
+		entries_.emplace(geom.key, entry);
+
+		return entry;
+	}
+
+	void PolytopeBasisCache::weights(const Geometry &geom, const Entry &entry, const Eigen::MatrixXd &local_basis_integrals, const Eigen::MatrixXd &rhs, Eigen::MatrixXd &weights)
+	{
+		const int dim = geom.collocation_points.cols();
+		const int n_monomials = dim + dim * (dim + 1) / 2;
+		assert(local_basis_integrals.cols() == n_monomials);
+		assert(rhs.rows() == int(geom.collocation_order.size()));
+
+		//x_hat = A x + b
+		const Eigen::MatrixXd A = geom.rotation.transpose() / geom.scaling;
+		const Eigen::VectorXd b = -A * geom.translation.transpose();
+
+		//C(k_hat, k) is the coefficient of the monomial k of x in the monomial k_hat of x_hat,
+		//the constants are dropped since their constraints vanish
+		Eigen::MatrixXd C = Eigen::MatrixXd::Zero(n_monomials, n_monomials);
+		for (int i = 0; i < dim; ++i)
+		{
+			C.row(i).head(dim) = A.row(i);
+
+			for (int j = i; j < dim; ++j)
+			{
+				const int m = quadratic_index(dim, i, j);
+				for (int k = 0; k < dim; ++k)
+				{
+					for (int l = 0; l < dim; ++l)
+						C(m, quadratic_index(dim, k, l)) += A(i, k) * A(j, l);
+
+					C(m, k) += b(j) * A(i, k) + b(i) * A(j, k);
+				}
+			}
+		}
+
+		//for q(x) = q_hat(x_hat), the integrals of the constraints scale by scaling^(dim - 2)
+		const Eigen::MatrixXd lbi_hat = local_basis_integrals * C.transpose() / std::pow(geom.scaling, dim - 2);
+
+		Eigen::MatrixXd rhs_hat(rhs.rows(), rhs.cols());
+		for (int i = 0; i < rhs.rows(); ++i)
+			rhs_hat.row(i) = rhs.row(geom.collocation_order[i]);
+
+		weights = entry.P * rhs_hat + entry.R * lbi_hat.transpose();
+	}
+
+	bool PolytopeBasisCache::load(const std::string &path)
+	{
+		std::ifstream in(path, std::ios::binary);
+		if (!in.good())
+			return false;
+
+		std::string magic(cache_magic.size(), ' ');
+		in.read(&magic[0], magic.size());
+		std::int32_t version = 0;
+		in.read(reinterpret_cast<char *>(&version), sizeof(version));
+		double tolerance = 0;
+		in.read(reinterpret_cast<char *>(&tolerance), sizeof(tolerance));
+		std::int64_t n_entries = 0;
+		in.read(reinterpret_cast<char *>(&n_entries), sizeof(n_entries));
+		if (!in || magic != cache_magic || version != cache_version || n_entries < 0)
+			return false;
+
+		//the canonical points are sorted after quantization, the entries of another tolerance would not be found
+		if (tolerance != tolerance_)
+		{
+			logger().warn("Ignoring the polytope cache {}, it was saved with tolerance {} (expected {})", path, tolerance, tolerance_);
+			return false;
+		}
+
+		std::vector<std::pair<std::size_t, std::shared_ptr<const Entry>>> loaded;
+		for (std::int64_t k = 0; k < n_entries; ++k)
+		{
+			auto entry = std::make_shared<Entry>();
+			Eigen::MatrixXd qweights;
+			if (!read_matrix(in, entry->centers) || !read_matrix(in, entry->collocation_points) || !read_matrix(in, entry->quadrature.points) || !read_matrix(in, qweights) || !read_matrix(in, entry->P) || !read_matrix(in, entry->R))
+				return false;
+			entry->quadrature.weights = qweights.col(0);
+
+			loaded.emplace_back(compute_key(entry->centers, entry->collocation_points, entry->quadrature), entry);
+		}
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		for (const auto &e : loaded)
+			entries_.emplace(e.first, e.second);
+
+		return true;
+	}
+
+	bool PolytopeBasisCache::save(const std::string &path) const
+	{
+		std::ofstream out(path, std::ios::binary);
+		if (!out.good())
+			return false;
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		out.write(cache_magic.data(), cache_magic.size());
+		out.write(reinterpret_cast<const char *>(&cache_version), sizeof(cache_version));
+		out.write(reinterpret_cast<const char *>(&tolerance_), sizeof(tolerance_));
+		const std::int64_t n_entries = entries_.size();
+		out.write(reinterpret_cast<const char *>(&n_entries), sizeof(n_entries));
+
+		for (const auto &e : entries_)
+		{
+			const Entry &entry = *e.second;
+			write_matrix(out, entry.centers);
+			write_matrix(out, entry.collocation_points);
+			write_matrix(out, entry.quadrature.points);
+			write_matrix(out, entry.quadrature.weights);
+			write_matrix(out, entry.P);
+			write_matrix(out, entry.R);
+		}
+
+		return out.good();
+	}
+
+	int PolytopeBasisCache::size() const
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		return int(entries_.size());
+	}
+
+	void PolytopeBasisCache::reset_stats()
+	{
+		hits_ = 0;
+		misses_ = 0;
+	}
+
+	CanonicalRBF::CanonicalRBF(const PolytopeBasisCache::Geometry &geom, const PolytopeBasisCache::Entry &entry, const Eigen::MatrixXd &weights)
+		: rbf_(entry.centers, weights), translation_(geom.translation), rotation_(geom.rotation), scaling_(geom.scaling)
+	{
+	}
+
+	Eigen::MatrixXd CanonicalRBF::to_canonical(const Eigen::MatrixXd &samples) const
+	{
+		return (samples.rowwise() - translation_) * rotation_ / scaling_;
+	}
+
+	void CanonicalRBF::bases_values(const Eigen::MatrixXd &samples, Eigen::MatrixXd &val) const
+	{
+		rbf_.bases_values(to_canonical(samples), val);
+	}
+
+	void CanonicalRBF::bases_grads(const int axis, const Eigen::MatrixXd &samples, Eigen::MatrixXd &val) const
+	{
+		//d/dx_axis = sum_d rotation(axis, d) / scaling * d/dx_hat_d, only the axes of the frame that are not orthogonal to axis
+		const Eigen::MatrixXd pts = to_canonical(samples);
+		Eigen::MatrixXd tmp;
+		val.resize(0, 0);
+		for (int d = 0; d < rotation_.cols(); ++d)
+		{
+			if (rotation_(axis, d) == 0)
+				continue;
+
+			rbf_.bases_grads(d, pts, tmp);
+			if (val.size() == 0)
+				val = rotation_(axis, d) / scaling_ * tmp;
+			else
+				val += rotation_(axis, d) / scaling_ * tmp;
+		}
+	}
+} // namespace polyfem
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <polyfem/Quadrature.hpp>
+#include <polyfem/RBFWithQuadratic.hpp>
+
+#include <Eigen/Dense>
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace polyfem
+{
+	//Cache of the harmonic fits of the polygonal and polyhedral bases (RBFWithQuadratic, quadratic integral
+	//constraints of the Laplacian). The weights are linear in the boundary conditions and in the integral constraints,
+	//weights = P * rhs + R * local_basis_integrals^T, where P and R depend only on the geometry of the polytope
+	//(kernel centers, collocation points, and quadrature).
+	//
+	//The geometry is canonicalized by centering its collocation points, rotating them to their axes of inertia,
+	//scaling them to the unit box, and by sorting the points. The span of the kernels (1/r in 3d, log(r) in 2d) and of
+	//the quadratic monomials does not change under rigid motions and uniform scaling, so congruent polytopes share
+	//the same operators, only the integral constraints are mapped to the canonical frame.
+	//The axes of inertia of symmetric polytopes (e.g., regular polygons, cubes) are not unique, only their translation
+	//and scale are removed.
+	class PolytopeBasisCache
+	{
+	public:
+		//polytope in the canonical frame: x_hat = (x - translation) * rotation / scaling
+		struct Geometry
+		{
+			Eigen::RowVectorXd translation;
+			//orthogonal, the columns are the axes of the canonical frame
+			Eigen::MatrixXd rotation;
+			double scaling;
+
+			Eigen::MatrixXd centers;
+			Eigen::MatrixXd collocation_points;
+			Quadrature quadrature;
+
+			//canonical collocation point i is the input collocation point collocation_order[i]
+			std::vector<int> collocation_order;
+			std::size_t key;
+		};
+
+		//operators of a canonical geometry
+		struct Entry
+		{
+			Eigen::MatrixXd centers;
+			Eigen::MatrixXd collocation_points;
+			Quadrature quadrature;
+
+			Eigen::MatrixXd P, R;
+		};
+
+		//two geometries match if all their canonical coordinates and quadrature weights are within tolerance
+		explicit PolytopeBasisCache(const double tolerance = 1e-8);
+
+		void canonicalize(const Eigen::MatrixXd &centers, const Eigen::MatrixXd &collocation_points, const Quadrature &quadr, Geometry &geom) const;
+
+		//returns the operators of geom, computing them on a miss (thread safe)
+		std::shared_ptr<const Entry> get(const Geometry &geom);
+
+		//weights of the basis in the canonical frame, to be evaluated with CanonicalRBF
+		static void weights(const Geometry &geom, const Entry &entry, const Eigen::MatrixXd &local_basis_integrals, const Eigen::MatrixXd &rhs, Eigen::MatrixXd &weights);
+
+		//binary persistence, load adds the entries of the file to the cache,
+		//files saved with a different tolerance are rejected
+		bool load(const std::string &path);
+		bool save(const std::string &path) const;
+
+		int size() const;
+		int hits() const { return hits_; }
+		int misses() const { return misses_; }
+		void reset_stats();
+
+		double tolerance() const { return tolerance_; }
+
+	private:
+		double tolerance_;
+
+		mutable std::mutex mutex_;
+		std::unordered_multimap<std::size_t, std::shared_ptr<const Entry>> entries_;
+
+		std::atomic<int> hits_;
+		std::atomic<int> misses_;
+
+		std::size_t compute_key(const Eigen::MatrixXd &centers, const Eigen::MatrixXd &collocation_points, const Quadrature &quadr) const;
+		bool matches(const Geometry &geom, const Entry &entry) const;
+		std::shared_ptr<const Entry> find(const Geometry &geom) const;
+	};
+
+	//rbf fitted in the canonical frame of a PolytopeBasisCache entry, evaluated in the frame of the polytope
+	class CanonicalRBF
+	{
+	public:
+		CanonicalRBF(const PolytopeBasisCache::Geometry &geom, const PolytopeBasisCache::Entry &entry, const Eigen::MatrixXd &weights);
+
+		void bases_values(const Eigen::MatrixXd &samples, Eigen::MatrixXd &val) const;
+		void bases_grads(const int axis, const Eigen::MatrixXd &samples, Eigen::MatrixXd &val) const;
+
+	private:
+		RBFWithQuadratic rbf_;
+		Eigen::RowVectorXd translation_;
+		Eigen::MatrixXd rotation_;
+		double scaling_;
+
+		Eigen::MatrixXd to_canonical(const Eigen::MatrixXd &samples) const;
+	};
+} // namespace polyfem
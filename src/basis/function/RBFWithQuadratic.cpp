@@ -179,6 +179,41 @@ RBFWithQuadratic::RBFWithQuadratic(
 	compute_weights(assembler_name, collocation_points, local_basis_integral, quadr, rhs, with_constraints);
 }
 
+RBFWithQuadratic::RBFWithQuadratic(const Eigen::MatrixXd &centers, const Eigen::MatrixXd &weights)
+	: centers_(centers), weights_(weights)
+{
+	assert(weights_.size() == 0 || weights_.rows() == centers_.rows() + 1 + centers_.cols() + centers_.cols() * (centers_.cols() + 1) / 2);
+}
+
+// -----------------------------------------------------------------------------
+
+void RBFWithQuadratic::compute_fit_operators(const Eigen::MatrixXd &centers, const Eigen::MatrixXd &collocation_points,
+	const Quadrature &quadr, Eigen::MatrixXd &P, Eigen::MatrixXd &R)
+{
+	const int dim = centers.cols();
+	assert(dim == 2 || dim == 3);
+	RBFWithQuadratic rbf(centers, Eigen::MatrixXd());
+
+	// Same steps as compute_weights, with the identity as integral constraints:
+	// t = T * local_basis_integral^T, and weights = t + P * (rhs - A * t)
+	Eigen::MatrixXd A, L;
+	rbf.compute_kernels_matrix(collocation_points, A);
+	const int num_monomials = dim + dim*(dim+1)/2;
+	if (dim == 3) {
+		rbf.compute_constraints_matrix_3d("", num_monomials, quadr, Eigen::MatrixXd::Identity(num_monomials, num_monomials), L, rbf.weights_);
+	} else {
+		rbf.compute_constraints_matrix_2d("Laplacian", num_monomials, quadr, Eigen::MatrixXd::Identity(num_monomials, num_monomials), L, rbf.weights_);
+	}
+	const Eigen::MatrixXd &T = rbf.weights_;
+
+	auto ldlt = (L.transpose() * A.transpose() * A * L).ldlt();
+	if (ldlt.info() == Eigen::NumericalIssue) {
+		logger().error("-- WARNING: Numerical issues when solving the harmonic least square.");
+	}
+	P = L * ldlt.solve(L.transpose() * A.transpose());
+	R = T - P * (A * T);
+}
+
 // -----------------------------------------------------------------------------
 
 void RBFWithQuadratic::basis(const int local_index, const Eigen::MatrixXd &samples, Eigen::MatrixXd &val) const {
@@ -43,6 +43,30 @@ namespace polyfem
 			const Eigen::MatrixXd &local_basis_integral, const Quadrature &quadr,
 			Eigen::MatrixXd &rhs, bool with_constraints = true);
 
+		///
+		/// @brief      { Initialize the RBF functions from weights computed beforehand (e.g.,
+		///             with compute_fit_operators) }
+		///
+		/// @param[in]  centers  { #C x dim positions of the kernels }
+		/// @param[in]  weights  { (#C + 1 + dim + dim*(dim+1)/2) x #B weights of the bases }
+		///
+		RBFWithQuadratic(const Eigen::MatrixXd &centers, const Eigen::MatrixXd &weights);
+
+		///
+		/// @brief      { Linear operators of the constrained fit (integral constraints of the
+		///             Laplacian), they depend only on the geometry:
+		///             weights = P * rhs + R * local_basis_integral^T }
+		///
+		/// @param[in]  centers             { #C x dim positions of the kernels }
+		/// @param[in]  collocation_points  { #S x dim positions of the collocation points }
+		/// @param[in]  quadr               { Quadrature points and weights inside the polytope }
+		/// @param[out] P                   { #W x #S operator applied to the boundary conditions }
+		/// @param[out] R                   { #W x (dim + dim*(dim+1)/2) operator applied to the
+		///                                 integral constraints }
+		///
+		static void compute_fit_operators(const Eigen::MatrixXd &centers, const Eigen::MatrixXd &collocation_points,
+			const Quadrature &quadr, Eigen::MatrixXd &P, Eigen::MatrixXd &R);
+
 		///
 		/// @brief      { Evaluates one RBF function over a list of coordinates }
 		///
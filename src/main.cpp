@@ -193,6 +193,7 @@ int main(int argc, char **argv)
 		state.solve_problem();
 
 		state.compute_errors();
+		state.adaptive_p_refinement();
 
 		state.save_json();
 		state.export_data();
@@ -25,6 +25,7 @@ namespace polyfem
 
 			std::string rbf = "multiquadric";
 			double eps = 0.1;
+			bool partition_of_unity = false;
 
 			read_matrix(data["function"], fun);
 			read_matrix(data["points"], pts);
@@ -40,6 +41,8 @@ namespace polyfem
 				}
 				if(data.find("epsilon") != data.end())
 					eps = data["epsilon"];
+				if(data.find("partition_of_unity") != data.end())
+					partition_of_unity = data["partition_of_unity"];
 			}
 
 			const int coord = data["coordinate"];
@@ -55,7 +58,7 @@ namespace polyfem
 			if(is_tri)
 				init(pts, tri, fun, coord, dd);
 			else
-				init(pts, fun, rbf, eps, coord, dd);
+				init(pts, fun, rbf, eps, coord, dd, partition_of_unity);
 		}
 		else
 		{
@@ -54,9 +54,12 @@ namespace polyfem
 				is_val = false;
 			}
 
-			void init(const Eigen::MatrixXd &pts, const Eigen::MatrixXd &fun, const std::string &rbf, const double eps, const int coord, const Eigen::Matrix<bool, 3, 1> &dd)
+			void init(const Eigen::MatrixXd &pts, const Eigen::MatrixXd &fun, const std::string &rbf, const double eps, const int coord, const Eigen::Matrix<bool, 3, 1> &dd, const bool partition_of_unity = false)
 			{
-				rbf_func.init(fun, pts, rbf, eps);
+				if(partition_of_unity)
+					rbf_func.init_partition_of_unity(fun, pts, rbf, eps);
+				else
+					rbf_func.init(fun, pts, rbf, eps);
 				is_tri = false;
 
 				coordiante_0 = (coord + 1) % 3;
@@ -2,6 +2,7 @@
 
 #include <vector>
 #include <array>
+#include <cassert>
 
 namespace polyfem
 {
@@ -25,10 +26,20 @@ BDF::BDF(int order) : order_(order)
     order_ = std::max(1, std::min(order_, 6));
 }
 
+int BDF::current_order() const
+{
+    return std::max(1, std::min(int(history_.size()), order_));
+}
+
+void BDF::set_order(const int order)
+{
+    order_ = std::max(1, std::min(order, 6));
+}
+
 double BDF::alpha() const
 {
     assert(history_.size() > 0);
-    return alphas[history_.size() - 1];
+    return alphas[current_order() - 1];
 }
 
 void BDF::rhs(Eigen::VectorXd &rhs) const
@@ -36,21 +47,111 @@ void BDF::rhs(Eigen::VectorXd &rhs) const
     assert(history_.size() > 0);
     rhs.resize(history_.front().size());
     rhs.setZero();
-    const auto &w = weights[history_.size() - 1];
-    for (int i = 0; i < history_.size(); ++i)
+    const int n = current_order();
+    const int offset = int(history_.size()) - n;
+    const auto &w = weights[n - 1];
+    for (int i = 0; i < n; ++i)
     {
-        rhs += history_[i] * w[i];
+        rhs += history_[offset + i] * w[i];
     }
 }
 
 void BDF::new_solution(Eigen::VectorXd &rhs)
 {
-    if (history_.size() >= order_)
+    new_solution(rhs, times_.empty() ? 0 : (times_.back() + 1));
+}
+
+void BDF::new_solution(Eigen::VectorXd &rhs, const double t)
+{
+    //one more than the order, the predictor needs it for the error estimate
+    while (history_.size() >= order_ + 1)
     {
         history_.pop_front();
+        times_.pop_front();
     }
 
     history_.push_back(rhs);
-    assert(history_.size() <= order_);
+    times_.push_back(t);
+    assert(history_.size() <= order_ + 1);
+}
+
+double BDF::alpha(const double dt) const
+{
+    assert(history_.size() > 0);
+    const int n = current_order();
+    const double t0 = times_.back() + dt;
+
+    //derivative of the Lagrange polynomial of the new solution, at the new time
+    double res = 0;
+    for (int j = 1; j <= n; ++j)
+        res += 1. / (t0 - times_[times_.size() - j]);
+
+    return dt * res;
+}
+
+void BDF::rhs(const double dt, Eigen::VectorXd &rhs) const
+{
+    assert(history_.size() > 0);
+    rhs.resize(history_.front().size());
+    rhs.setZero();
+
+    const int n = current_order();
+    const double t0 = times_.back() + dt;
+
+    for (int j = 1; j <= n; ++j)
+    {
+        const double tj = times_[times_.size() - j];
+
+        //derivative of the j-th Lagrange polynomial at t0, the (t - t0) factor vanishes there
+        double w = 1. / (tj - t0);
+        for (int m = 1; m <= n; ++m)
+        {
+            if (m == j)
+                continue;
+            const double tm = times_[times_.size() - m];
+            w *= (t0 - tm) / (tj - tm);
+        }
+
+        rhs -= (dt * w) * history_[history_.size() - j];
+    }
+}
+
+void BDF::predict(const double dt, const int degree, Eigen::VectorXd &pred) const
+{
+    assert(history_.size() > 0);
+    pred.resize(history_.back().size());
+    pred.setZero();
+
+    const int n = std::min(degree + 1, int(history_.size()));
+    const double t0 = times_.back() + dt;
+
+    for (int j = 1; j <= n; ++j)
+    {
+        const double tj = times_[times_.size() - j];
+
+        double w = 1;
+        for (int m = 1; m <= n; ++m)
+        {
+            if (m == j)
+                continue;
+            const double tm = times_[times_.size() - m];
+            w *= (t0 - tm) / (tj - tm);
+        }
+
+        pred += w * history_[history_.size() - j];
+    }
+}
+
+void BDF::error_estimate(const double dt, const int order, const Eigen::VectorXd &x, Eigen::VectorXd &err) const
+{
+    assert(history_.size() > 0);
+    const int n = std::min(order + 1, int(history_.size()));
+    const double t0 = times_.back() + dt;
+
+    predict(dt, n - 1, err);
+
+    //for constant steps the factor is 1/(order+1)
+    const double factor = dt / (t0 - times_[times_.size() - n]);
+    err = factor * (x - err);
 }
 } // namespace polyfem
@@ -11,13 +11,35 @@ class BDF
 public:
     BDF(int order);
 
+    //constant time step interface, coefficients are tabulated
     double alpha() const;
     void rhs(Eigen::VectorXd &rhs) const;
 
     void new_solution(Eigen::VectorXd &rhs);
 
+    //variable time step interface, coefficients are computed from the times of the stored solutions
+    //dt is the size of the step from the last stored solution to the unknown one
+    double alpha(const double dt) const;
+    void rhs(const double dt, Eigen::VectorXd &rhs) const;
+
+    void new_solution(Eigen::VectorXd &rhs, const double t);
+
+    //extrapolates the last degree+1 solutions to time last_time + dt
+    void predict(const double dt, const int degree, Eigen::VectorXd &pred) const;
+    //Milne estimate of the local truncation error of the order-th formula, given the solution x at last_time + dt
+    void error_estimate(const double dt, const int order, const Eigen::VectorXd &x, Eigen::VectorXd &err) const;
+
+    //effective order of the next step (limited by the number of stored solutions)
+    int current_order() const;
+    int order() const { return order_; }
+    void set_order(const int order);
+
+    int history_size() const { return int(history_.size()); }
+    double last_time() const { return times_.back(); }
+
 private:
     std::deque<Eigen::VectorXd> history_;
+    std::deque<double> times_;
     int order_;
 };
 } // namespace polyfem
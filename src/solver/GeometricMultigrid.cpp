@@ -0,0 +1,144 @@
+#include <polyfem/GeometricMultigrid.hpp>
+
+#include <polyfem/FEBasis2d.hpp>
+#include <polyfem/FEBasis3d.hpp>
+#include <polyfem/PointProbe.hpp>
+#include <polyfem/MemoryTracker.hpp>
+#include <polyfem/Logger.hpp>
+
+#include <map>
+
+namespace polyfem
+{
+	namespace
+	{
+		//position of every global node, false if a basis is not a single node
+		bool node_positions(const std::vector<ElementBases> &bases, const int n_bases, const int dim, Eigen::MatrixXd &nodes)
+		{
+			nodes.resize(n_bases, dim);
+			std::vector<bool> found(n_bases, false);
+
+			for (const ElementBases &eb : bases)
+			{
+				for (const Basis &b : eb.bases)
+				{
+					if (b.global().size() != 1 || std::abs(b.global()[0].val - 1) > 1e-10)
+						return false;
+
+					const auto &lg = b.global()[0];
+					nodes.row(lg.index) = lg.node.leftCols(dim);
+					found[lg.index] = true;
+				}
+			}
+
+			for (const bool f : found)
+			{
+				if (!f)
+					return false;
+			}
+			return true;
+		}
+
+		int build_level_bases(const Mesh &mesh, const int discr_order, const int quadrature_order, const bool serendipity,
+							  std::vector<ElementBases> &bases, std::vector<ElementBases> &gbases)
+		{
+			std::vector<LocalBoundary> local_boundary;
+			std::map<int, InterfaceData> poly_data;
+
+			int n_bases;
+			gbases.clear();
+			if (mesh.is_volume())
+			{
+				const Mesh3D &tmp_mesh = dynamic_cast<const Mesh3D &>(mesh);
+				n_bases = FEBasis3d::build_bases(tmp_mesh, quadrature_order, discr_order, serendipity, false, false, bases, local_boundary, poly_data);
+				//the refined meshes are linear
+				if (discr_order > 1)
+					FEBasis3d::build_bases(tmp_mesh, quadrature_order, 1, false, false, true, gbases, local_boundary, poly_data);
+			}
+			else
+			{
+				const Mesh2D &tmp_mesh = dynamic_cast<const Mesh2D &>(mesh);
+				n_bases = FEBasis2d::build_bases(tmp_mesh, quadrature_order, discr_order, serendipity, false, false, bases, local_boundary, poly_data);
+				if (discr_order > 1)
+					FEBasis2d::build_bases(tmp_mesh, quadrature_order, 1, false, false, true, gbases, local_boundary, poly_data);
+			}
+
+			if (gbases.empty())
+				gbases = bases;
+
+			return n_bases;
+		}
+	} // namespace
+
+	bool GeometricMultigrid::init(const std::vector<std::unique_ptr<Mesh>> &coarse_meshes, const std::vector<ElementBases> &bases, const int n_bases,
+								  const int discr_order, const int quadrature_order, const bool serendipity)
+	{
+		prolongations_.clear();
+		n_bases_.clear();
+
+		if (coarse_meshes.empty())
+			return false;
+
+		const int dim = coarse_meshes.front()->dimension();
+		Eigen::MatrixXd fine_nodes;
+		if (!node_positions(bases, n_bases, dim, fine_nodes))
+		{
+			logger().warn("Geometric multigrid requires Lagrange bases");
+			return false;
+		}
+
+		std::vector<ElementBases> level_bases, level_gbases;
+		int level_n_bases = build_level_bases(*coarse_meshes.front(), discr_order, quadrature_order, serendipity, level_bases, level_gbases);
+		n_bases_.push_back(level_n_bases);
+
+		for (size_t l = 0; l < coarse_meshes.size(); ++l)
+		{
+			const bool is_last = l + 1 == coarse_meshes.size();
+
+			std::vector<ElementBases> next_bases, next_gbases;
+			int next_n_bases = n_bases;
+			Eigen::MatrixXd next_nodes;
+			if (is_last)
+				next_nodes = fine_nodes;
+			else
+			{
+				next_n_bases = build_level_bases(*coarse_meshes[l + 1], discr_order, quadrature_order, serendipity, next_bases, next_gbases);
+				if (!node_positions(next_bases, next_n_bases, dim, next_nodes))
+				{
+					prolongations_.clear();
+					n_bases_.clear();
+					return false;
+				}
+			}
+
+			//the fine nodes outside the coarse mesh (curved boundaries) have an empty row
+			PointProbe probe;
+			probe.init(*coarse_meshes[l], level_bases, level_gbases, level_n_bases);
+			probe.set_points(next_nodes);
+
+			StiffnessMatrix prolongation = probe.value_operator();
+			prolongation.prune(1e-12, 1);
+			prolongations_.push_back(prolongation);
+
+			const int n_outside = int((probe.elements().array() < 0).count());
+			if (n_outside > 0)
+				logger().debug("Geometric multigrid: {} nodes of level {} are outside level {}", n_outside, l + 1, l);
+
+			level_bases.swap(next_bases);
+			level_gbases.swap(next_gbases);
+			level_n_bases = next_n_bases;
+			n_bases_.push_back(level_n_bases);
+		}
+
+		logger().info("Geometric multigrid with {} levels, {} to {} nodes", n_levels(), n_bases_.front(), n_bases_.back());
+		return true;
+	}
+
+	size_t GeometricMultigrid::memory_bytes() const
+	{
+		size_t res = polyfem::memory_bytes(n_bases_);
+		for (const auto &p : prolongations_)
+			res += polyfem::memory_bytes(p);
+		return res;
+	}
+} // namespace polyfem
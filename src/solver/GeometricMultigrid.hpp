@@ -0,0 +1,36 @@
+#pragma once
+
+#include <polyfem/Common.hpp>
+#include <polyfem/ElementBases.hpp>
+#include <polyfem/Mesh.hpp>
+
+#include <Eigen/Sparse>
+
+#include <memory>
+#include <vector>
+
+namespace polyfem
+{
+	//Hierarchy of Lagrange FE spaces on the n_refs refinements of a mesh. The prolongation from a level to the next
+	//finer one interpolates the coarse bases at the fine nodes, which is exact when the refinement is nested.
+	//The level operators are not stored here, MultigridSolver builds them by Galerkin projection of the fine matrix.
+	class GeometricMultigrid
+	{
+	public:
+		//coarse_meshes are the coarser levels, coarsest first, bases are the ones of the finest mesh
+		//returns false if the bases are not Lagrange bases with one node per basis
+		bool init(const std::vector<std::unique_ptr<Mesh>> &coarse_meshes, const std::vector<ElementBases> &bases, const int n_bases,
+				  const int discr_order, const int quadrature_order, const bool serendipity);
+
+		int n_levels() const { return int(prolongations_.size()) + 1; }
+		//scalar prolongation from level l to l + 1, level 0 is the coarsest
+		const StiffnessMatrix &prolongation(const int l) const { return prolongations_[l]; }
+		int n_bases(const int l) const { return n_bases_[l]; }
+
+		size_t memory_bytes() const;
+
+	private:
+		std::vector<StiffnessMatrix> prolongations_;
+		std::vector<int> n_bases_;
+	};
+} // namespace polyfem
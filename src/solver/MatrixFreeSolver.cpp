@@ -0,0 +1,210 @@
+#include <polyfem/MatrixFreeSolver.hpp>
+
+#include <polyfem/Logger.hpp>
+
+#include <Eigen/Eigenvalues>
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+namespace polyfem
+{
+	namespace
+	{
+		typedef std::function<void(const Eigen::VectorXd &, Eigen::VectorXd &)> Operator;
+
+		//preconditioned conjugate gradient from x, stops after max_iter iterations or when |r| <= threshold
+		//the alphas and betas are the Lanczos coefficients of the preconditioned operator
+		int pcg(const Operator &op, const Eigen::VectorXd &inv_diag, const Eigen::VectorXd &b, const double threshold, const int max_iter,
+				Eigen::VectorXd &x, double &residual, std::vector<double> &alphas, std::vector<double> &betas)
+		{
+			Eigen::VectorXd tmp;
+			op(x, tmp);
+			Eigen::VectorXd r = b - tmp;
+			Eigen::VectorXd z = inv_diag.cwiseProduct(r);
+			Eigen::VectorXd p = z;
+			double rz = r.dot(z);
+			residual = r.norm();
+
+			alphas.clear();
+			betas.clear();
+
+			int it = 0;
+			for (; it < max_iter && residual > threshold; ++it)
+			{
+				op(p, tmp);
+				const double ptap = p.dot(tmp);
+				if (ptap <= 0)
+				{
+					logger().warn("Matrix-free CG: the operator is not positive definite");
+					break;
+				}
+
+				const double alpha = rz / ptap;
+				x += alpha * p;
+				r -= alpha * tmp;
+				residual = r.norm();
+
+				z = inv_diag.cwiseProduct(r);
+				const double rz_new = r.dot(z);
+				const double beta = rz_new / rz;
+				rz = rz_new;
+				p = z + beta * p;
+
+				alphas.push_back(alpha);
+				betas.push_back(beta);
+			}
+
+			return it;
+		}
+
+		//extreme eigenvalues of the Lanczos tridiagonal matrix built from the CG coefficients
+		bool lanczos_bounds(const std::vector<double> &alphas, const std::vector<double> &betas, double &min, double &max)
+		{
+			const int n = int(alphas.size());
+			if (n <= 0)
+				return false;
+
+			Eigen::MatrixXd T = Eigen::MatrixXd::Zero(n, n);
+			for (int j = 0; j < n; ++j)
+			{
+				T(j, j) = 1. / alphas[j] + (j > 0 ? betas[j - 1] / alphas[j - 1] : 0.);
+				if (j + 1 < n)
+				{
+					T(j, j + 1) = std::sqrt(betas[j]) / alphas[j];
+					T(j + 1, j) = T(j, j + 1);
+				}
+			}
+
+			Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> solver(T, Eigen::EigenvaluesOnly);
+			min = solver.eigenvalues().minCoeff();
+			max = solver.eigenvalues().maxCoeff();
+			return min > 0;
+		}
+
+		//Chebyshev iteration on [min, max] from x, see Saad, Iterative Methods for Sparse Linear Systems, algorithm 12.1
+		int chebyshev(const Operator &op, const Eigen::VectorXd &inv_diag, const Eigen::VectorXd &b, const double min, const double max,
+					  const double threshold, const int max_iter, Eigen::VectorXd &x, double &residual)
+		{
+			const double theta = (max + min) / 2;
+			const double delta = (max - min) / 2;
+			const double sigma = theta / delta;
+			double rho = 1 / sigma;
+
+			Eigen::VectorXd tmp;
+			op(x, tmp);
+			Eigen::VectorXd r = b - tmp;
+			Eigen::VectorXd d = inv_diag.cwiseProduct(r) / theta;
+			residual = r.norm();
+
+			int it = 0;
+			for (; it < max_iter && residual > threshold; ++it)
+			{
+				x += d;
+				op(d, tmp);
+				r -= tmp;
+				residual = r.norm();
+
+				const double rho_new = 1 / (2 * sigma - rho);
+				d = (rho_new * rho) * d + (2 * rho_new / delta) * inv_diag.cwiseProduct(r);
+				rho = rho_new;
+			}
+
+			return it;
+		}
+	} // namespace
+
+	MatrixFreeSolver::MatrixFreeSolver(const json &params)
+	{
+		solver_ = params.count("solver") ? params["solver"].get<std::string>() : "cg";
+		tolerance_ = params.count("tolerance") ? double(params["tolerance"]) : 1e-10;
+		max_iter_ = params.count("max_iter") ? int(params["max_iter"]) : 10000;
+		eigenvalue_iterations_ = params.count("eigenvalue_iterations") ? int(params["eigenvalue_iterations"]) : 20;
+
+		if (solver_ != "cg" && solver_ != "chebyshev")
+		{
+			logger().warn("Unknown matrix-free solver {}, using cg", solver_);
+			solver_ = "cg";
+		}
+	}
+
+	void MatrixFreeSolver::solve(const SumFactorizationOperator &op, const Eigen::VectorXd &b, const std::vector<int> &dirichlet_nodes, Eigen::VectorXd &x)
+	{
+		const int n = op.rows();
+		assert(b.size() == n);
+
+		std::vector<bool> fixed(n, false);
+		for (const int i : dirichlet_nodes)
+			fixed[i] = true;
+
+		const auto zero_fixed = [&](Eigen::VectorXd &v) {
+			for (const int i : dirichlet_nodes)
+				v(i) = 0;
+		};
+
+		//dirichlet values, then A_II dx = b_I - A_I x
+		x.setZero(n);
+		for (const int i : dirichlet_nodes)
+			x(i) = b(i);
+
+		Eigen::VectorXd rhs;
+		op.apply(x, rhs);
+		rhs = b - rhs;
+		zero_fixed(rhs);
+
+		const Operator interior_op = [&](const Eigen::VectorXd &v, Eigen::VectorXd &res) {
+			op.apply(v, res);
+			zero_fixed(res);
+		};
+
+		Eigen::VectorXd inv_diag;
+		op.diagonal(inv_diag);
+		for (int i = 0; i < n; ++i)
+		{
+			if (fixed[i])
+				inv_diag(i) = 0;
+			else
+				inv_diag(i) = inv_diag(i) > 0 ? 1. / inv_diag(i) : 1.;
+		}
+
+		const double threshold = tolerance_ * rhs.norm();
+		Eigen::VectorXd dx = Eigen::VectorXd::Zero(n);
+		double residual = 0;
+		std::vector<double> alphas, betas;
+		int iterations = 0;
+
+		solver_info_ = json({});
+		solver_info_["solver"] = solver_;
+		solver_info_["order"] = op.order();
+		solver_info_["operator_memory"] = op.memory_bytes();
+
+		if (solver_ == "chebyshev")
+		{
+			iterations = pcg(interior_op, inv_diag, rhs, threshold, std::min(eigenvalue_iterations_, max_iter_), dx, residual, alphas, betas);
+
+			double min, max;
+			if (residual > threshold && lanczos_bounds(alphas, betas, min, max))
+			{
+				//the Ritz values are inside the spectrum
+				min *= 0.5;
+				max *= 1.1;
+				solver_info_["eigenvalue_bounds"] = {min, max};
+				iterations += chebyshev(interior_op, inv_diag, rhs, min, max, threshold, max_iter_ - iterations, dx, residual);
+			}
+		}
+		else
+			iterations = pcg(interior_op, inv_diag, rhs, threshold, max_iter_, dx, residual, alphas, betas);
+
+		x += dx;
+
+		const double rhs_norm = rhs.norm();
+		solver_info_["iterations"] = iterations;
+		solver_info_["error"] = rhs_norm > 0 ? residual / rhs_norm : 0.;
+
+		if (residual > threshold)
+			logger().warn("Matrix-free {} did not converge in {} iterations, relative residual {}", solver_, iterations, residual / rhs_norm);
+		else
+			logger().debug("Matrix-free {} converged in {} iterations", solver_, iterations);
+	}
+} // namespace polyfem
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <polyfem/Common.hpp>
+#include <polyfem/SumFactorizationOperator.hpp>
+
+#include <Eigen/Dense>
+
+#include <string>
+#include <vector>
+
+namespace polyfem
+{
+	//Jacobi preconditioned Krylov solvers for the matrix-free operators: conjugate gradient, or Chebyshev iteration
+	//(no inner products, the spectrum bounds come from the Lanczos coefficients of a few conjugate gradient iterations)
+	class MatrixFreeSolver
+	{
+	public:
+		//params are args["matrix_free"]
+		explicit MatrixFreeSolver(const json &params);
+
+		//x[i] = b[i] on the dirichlet nodes, like polysolve::dirichlet_solve
+		void solve(const SumFactorizationOperator &op, const Eigen::VectorXd &b, const std::vector<int> &dirichlet_nodes, Eigen::VectorXd &x);
+
+		void getInfo(json &info) const { info = solver_info_; }
+
+	private:
+		std::string solver_;
+		double tolerance_;
+		int max_iter_;
+		int eigenvalue_iterations_;
+
+		json solver_info_;
+	};
+} // namespace polyfem
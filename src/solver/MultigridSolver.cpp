@@ -0,0 +1,201 @@
+#include <polyfem/MultigridSolver.hpp>
+
+#include <polyfem/Logger.hpp>
+
+#include <algorithm>
+
+namespace polyfem
+{
+	MultigridSolver::MultigridSolver(const std::shared_ptr<const GeometricMultigrid> &hierarchy, const int size, const std::vector<int> &dirichlet_nodes, const json &params)
+		: hierarchy_(hierarchy), size_(size), dirichlet_nodes_(dirichlet_nodes)
+	{
+		std::sort(dirichlet_nodes_.begin(), dirichlet_nodes_.end());
+		setParameters({{"multigrid", params}});
+	}
+
+	void MultigridSolver::setParameters(const json &params)
+	{
+		if (!params.count("multigrid"))
+			return;
+
+		const json &mg = params["multigrid"];
+		if (mg.count("tolerance"))
+			tolerance_ = mg["tolerance"];
+		if (mg.count("max_iter"))
+			max_iter_ = mg["max_iter"];
+		if (mg.count("smoothing_steps"))
+			smoothing_steps_ = mg["smoothing_steps"];
+		if (mg.count("omega"))
+			omega_ = mg["omega"];
+	}
+
+	void MultigridSolver::getInfo(json &params) const
+	{
+		params["solver"] = name();
+		params["iterations"] = iterations_;
+		params["error"] = error_;
+		params["levels"] = operators_.size();
+
+		json sizes = json::array();
+		for (const auto &A : operators_)
+			sizes.push_back(A.rows());
+		params["level_sizes"] = sizes;
+	}
+
+	void MultigridSolver::build_prolongations(const int n_dofs)
+	{
+		prolongations_.clear();
+		if (!hierarchy_ || hierarchy_->n_levels() <= 1)
+			return;
+
+		const int n_levels = hierarchy_->n_levels();
+		const int full_size = hierarchy_->n_bases(n_levels - 1) * size_;
+
+		//rows of the finest level, without the dirichlet dofs for the reduced systems
+		std::vector<int> rows(full_size);
+		if (n_dofs == full_size)
+		{
+			for (int i = 0; i < full_size; ++i)
+				rows[i] = i;
+		}
+		else if (n_dofs == full_size - int(dirichlet_nodes_.size()))
+		{
+			int index = 0;
+			size_t kk = 0;
+			for (int i = 0; i < full_size; ++i)
+			{
+				if (kk < dirichlet_nodes_.size() && dirichlet_nodes_[kk] == i)
+				{
+					++kk;
+					rows[i] = -1;
+					continue;
+				}
+
+				rows[i] = index++;
+			}
+		}
+		else
+		{
+			logger().error("Multigrid: the system size {} does not match the hierarchy ({} dofs), using a direct solver", n_dofs, full_size);
+			return;
+		}
+
+		for (int l = n_levels - 2; l >= 0; --l)
+		{
+			const StiffnessMatrix &P = hierarchy_->prolongation(l);
+			const bool is_finest = l == n_levels - 2;
+
+			std::vector<Eigen::Triplet<double>> entries;
+			entries.reserve(P.nonZeros() * size_);
+			for (int k = 0; k < P.outerSize(); ++k)
+			{
+				for (StiffnessMatrix::InnerIterator it(P, k); it; ++it)
+				{
+					for (int d = 0; d < size_; ++d)
+					{
+						const int row = is_finest ? rows[it.row() * size_ + d] : int(it.row()) * size_ + d;
+						if (row >= 0)
+							entries.emplace_back(row, it.col() * size_ + d, it.value());
+					}
+				}
+			}
+
+			StiffnessMatrix vector_P(is_finest ? n_dofs : P.rows() * size_, P.cols() * size_);
+			vector_P.setFromTriplets(entries.begin(), entries.end());
+			prolongations_.push_back(vector_P);
+		}
+	}
+
+	void MultigridSolver::factorize(const StiffnessMatrix &A)
+	{
+		if (prolongations_.empty() || prolongations_.front().rows() != A.rows())
+			build_prolongations(A.rows());
+
+		operators_.clear();
+		inv_diagonals_.clear();
+		operators_.push_back(A);
+
+		for (const StiffnessMatrix &P : prolongations_)
+		{
+			const StiffnessMatrix R = P.transpose();
+			const StiffnessMatrix tmp = operators_.back() * P;
+			operators_.push_back(R * tmp);
+		}
+
+		for (size_t l = 0; l + 1 < operators_.size(); ++l)
+		{
+			Eigen::VectorXd diag = operators_[l].diagonal();
+			for (int i = 0; i < diag.size(); ++i)
+				diag(i) = std::abs(diag(i)) > 1e-30 ? 1. / diag(i) : 0.;
+			inv_diagonals_.push_back(diag);
+		}
+
+		coarse_solver_.compute(operators_.back());
+		if (coarse_solver_.info() != Eigen::Success)
+			logger().error("Multigrid: the factorization of the coarsest level failed");
+	}
+
+	void MultigridSolver::v_cycle(const int level, const Eigen::VectorXd &b, Eigen::VectorXd &x) const
+	{
+		if (level + 1 == int(operators_.size()))
+		{
+			x = coarse_solver_.solve(b);
+			return;
+		}
+
+		const StiffnessMatrix &A = operators_[level];
+		const StiffnessMatrix &P = prolongations_[level];
+		const Eigen::VectorXd &inv_diag = inv_diagonals_[level];
+
+		//the same number of pre and post smoothing steps keeps the cycle symmetric, as CG requires
+		x.setZero(b.size());
+		for (int s = 0; s < smoothing_steps_; ++s)
+			x += omega_ * inv_diag.cwiseProduct(b - A * x);
+
+		const Eigen::VectorXd coarse_b = P.transpose() * (b - A * x);
+		Eigen::VectorXd coarse_x;
+		v_cycle(level + 1, coarse_b, coarse_x);
+		x += P * coarse_x;
+
+		for (int s = 0; s < smoothing_steps_; ++s)
+			x += omega_ * inv_diag.cwiseProduct(b - A * x);
+	}
+
+	void MultigridSolver::solve(const Eigen::Ref<const Eigen::VectorXd> b, Eigen::Ref<Eigen::VectorXd> x)
+	{
+		assert(!operators_.empty());
+		const StiffnessMatrix &A = operators_.front();
+
+		Eigen::VectorXd sol = Eigen::VectorXd::Zero(b.size());
+		Eigen::VectorXd r = b;
+		Eigen::VectorXd z, Ap;
+		v_cycle(0, r, z);
+		Eigen::VectorXd p = z;
+		double rz = r.dot(z);
+
+		const double b_norm = b.norm();
+		const double threshold = tolerance_ * b_norm;
+		double residual = r.norm();
+
+		iterations_ = 0;
+		for (; iterations_ < max_iter_ && residual > threshold; ++iterations_)
+		{
+			Ap = A * p;
+			const double alpha = rz / p.dot(Ap);
+			sol += alpha * p;
+			r -= alpha * Ap;
+			residual = r.norm();
+
+			v_cycle(0, r, z);
+			const double rz_new = r.dot(z);
+			p = z + (rz_new / rz) * p;
+			rz = rz_new;
+		}
+
+		error_ = b_norm > 0 ? residual / b_norm : 0.;
+		if (residual > threshold)
+			logger().warn("Multigrid did not converge in {} iterations, relative residual {}", iterations_, error_);
+
+		x = sol;
+	}
+} // namespace polyfem
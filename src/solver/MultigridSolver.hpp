@@ -0,0 +1,59 @@
+#pragma once
+
+#include <polyfem/Common.hpp>
+#include <polyfem/GeometricMultigrid.hpp>
+
+#include <polysolve/LinearSolver.hpp>
+
+#include <Eigen/Sparse>
+#include <Eigen/SparseCholesky>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace polyfem
+{
+	//Conjugate gradient preconditioned by a geometric multigrid V-cycle: damped Jacobi smoothing, Galerkin
+	//coarse operators P^T A P from the prolongations of the hierarchy, and a sparse Cholesky on the coarsest level.
+	//It is a polysolve::LinearSolver, so it works with dirichlet_solve (full system with identity rows) and with
+	//the Newton steps (system without the dirichlet dofs).
+	class MultigridSolver : public polysolve::LinearSolver
+	{
+	public:
+		//size is the number of components per node, dirichlet_nodes are the dofs removed from the reduced systems
+		MultigridSolver(const std::shared_ptr<const GeometricMultigrid> &hierarchy, const int size, const std::vector<int> &dirichlet_nodes, const json &params);
+
+		//reads params["multigrid"] if present (like args["multigrid"]), the other entries belong to the other solvers
+		void setParameters(const json &params) override;
+		void getInfo(json &params) const override;
+
+		void analyzePattern(const StiffnessMatrix &A, const int precond_num) override {}
+		void factorize(const StiffnessMatrix &A) override;
+		void solve(const Eigen::Ref<const Eigen::VectorXd> b, Eigen::Ref<Eigen::VectorXd> x) override;
+
+		std::string name() const override { return "GeometricMultigrid"; }
+
+	private:
+		std::shared_ptr<const GeometricMultigrid> hierarchy_;
+		int size_;
+		std::vector<int> dirichlet_nodes_;
+
+		double tolerance_ = 1e-10;
+		int max_iter_ = 500;
+		int smoothing_steps_ = 2;
+		double omega_ = 0.6;
+
+		//finest first: operators, inverse diagonals, and prolongations from level l + 1 to l
+		std::vector<StiffnessMatrix> operators_;
+		std::vector<Eigen::VectorXd> inv_diagonals_;
+		std::vector<StiffnessMatrix> prolongations_;
+		Eigen::SimplicialLDLT<StiffnessMatrix> coarse_solver_;
+
+		int iterations_ = 0;
+		double error_ = 0;
+
+		void build_prolongations(const int n_dofs);
+		void v_cycle(const int level, const Eigen::VectorXd &b, Eigen::VectorXd &x) const;
+	};
+} // namespace polyfem
@@ -26,6 +26,18 @@ namespace polyfem
 		this->dt = dt;
 	}
 
+	void NLProblem::set_dt(const double dt)
+	{
+		if (this->dt != dt)
+			rhs_computed = false;
+		this->dt = dt;
+	}
+
+	void NLProblem::predicted_solution(TVector &x) const
+	{
+		x = x_prev + dt * v_prev;
+	}
+
 	void NLProblem::update_quantities(const double t, const TVector &x)
 	{
 		if (is_time_dependent){
@@ -84,9 +96,8 @@ namespace polyfem
 			full = x;
 		assert(full.size() == full_size);
 
-		const auto &gbases = state.iso_parametric() ? state.bases : state.geom_bases;
-
-		const double elastic_energy = assembler.assemble_energy(rhs_assembler.formulation(), state.mesh->is_volume(), state.bases, gbases, full);
+		compute_cached_quantities(full, true, false);
+		const double elastic_energy = cached_energy;
 		const double body_energy = rhs_assembler.compute_energy(full, state.local_neumann_boundary, state.args["n_boundary_samples"], t);
 
 		double intertia_energy = 0;
@@ -110,9 +121,9 @@ namespace polyfem
 			const auto &gbases = state.iso_parametric() ? state.bases : state.geom_bases;
 
 			StiffnessMatrix velocity_stiffness, mixed_stiffness, pressure_stiffness;
-			assembler.assemble_problem(state.formulation(), state.mesh->is_volume(), state.n_bases, state.bases, gbases, velocity_stiffness);
-			assembler.assemble_mixed_problem(state.formulation(), state.mesh->is_volume(), state.n_pressure_bases, state.n_bases, state.pressure_bases, state.bases, gbases, mixed_stiffness);
-			assembler.assemble_pressure_problem(state.formulation(), state.mesh->is_volume(), state.n_pressure_bases, state.pressure_bases, gbases, pressure_stiffness);
+			assembler.assemble_problem(state.formulation(), state.mesh->is_volume(), state.n_bases, state.bases, gbases, velocity_stiffness, nullptr, &state.dof_map, &state.colorings);
+			assembler.assemble_mixed_problem(state.formulation(), state.mesh->is_volume(), state.n_pressure_bases, state.n_bases, state.pressure_bases, state.bases, gbases, mixed_stiffness, &state.pressure_dof_map, &state.dof_map, &state.colorings);
+			assembler.assemble_pressure_problem(state.formulation(), state.mesh->is_volume(), state.n_pressure_bases, state.pressure_bases, gbases, pressure_stiffness, &state.pressure_dof_map, &state.colorings);
 
 			const int problem_dim = state.problem->is_scalar() ? 1 : state.mesh->dimension();
 
@@ -122,6 +133,33 @@ namespace polyfem
 		}
 	}
 
+	void NLProblem::compute_cached_quantities(const Eigen::MatrixXd &full, const bool energy, const bool grad, StiffnessMatrix *hessian)
+	{
+		if (cached_x.size() != full.size() || cached_x != full)
+		{
+			cached_x = full;
+			//the formulations without gradient leave it empty
+			cached_grad.resize(0, 0);
+			has_cached_energy = false;
+			has_cached_grad = false;
+		}
+
+		const bool need_energy = energy && !has_cached_energy;
+		const bool need_grad = grad && !has_cached_grad;
+		if (!need_energy && !need_grad && !hessian)
+			return;
+
+		const auto &gbases = state.iso_parametric() ? state.bases : state.geom_bases;
+		assembler.assemble_energy_quantities(rhs_assembler.formulation(), state.mesh->is_volume(), state.n_bases, state.bases, gbases, full,
+											 need_energy ? &cached_energy : nullptr,
+											 need_grad ? &cached_grad : nullptr,
+											 hessian, &state.dof_map, &state.colorings);
+		++n_assembly_passes_;
+
+		has_cached_energy |= need_energy;
+		has_cached_grad |= need_grad;
+	}
+
 	void NLProblem::gradient(const TVector &x, TVector &gradv)
 	{
 		Eigen::MatrixXd grad;
@@ -156,8 +194,9 @@ namespace polyfem
 			full = x;
 		assert(full.size() == full_size);
 
-		const auto &gbases = state.iso_parametric() ? state.bases : state.geom_bases;
-		assembler.assemble_energy_gradient(rhs_assembler.formulation(), state.mesh->is_volume(), state.n_bases, state.bases, gbases, full, grad);
+		//the energy comes almost for free and is usually asked next by the line search
+		compute_cached_quantities(full, true, true);
+		grad = cached_grad;
 
 		if (assembler.is_mixed(state.formulation()))
 		{
@@ -233,8 +272,9 @@ namespace polyfem
 
 		assert(full.size() == full_size);
 
-		const auto &gbases = state.iso_parametric() ? state.bases : state.geom_bases;
-		assembler.assemble_energy_hessian(rhs_assembler.formulation(), state.mesh->is_volume(), state.n_bases, state.bases, gbases, full, hessian);
+		//the newton iteration asks for the gradient and the energy at the same point right after,
+		//the hessian is only asked once per point and goes straight to the output
+		compute_cached_quantities(full, true, true, &hessian);
 		if (is_time_dependent)
 		{
 			hessian *= dt * dt / 2;
@@ -243,11 +283,12 @@ namespace polyfem
 
 		if (assembler.is_mixed(state.formulation()))
 		{
+			const auto &gbases = state.iso_parametric() ? state.bases : state.geom_bases;
 			StiffnessMatrix velocity_stiffness = hessian, mixed_stiffness, pressure_stiffness;
 			const int problem_dim = state.problem->is_scalar() ? 1 : state.mesh->dimension();
 
-			assembler.assemble_mixed_problem(state.formulation(), state.mesh->is_volume(), state.n_pressure_bases, state.n_bases, state.pressure_bases, state.bases, gbases, mixed_stiffness);
-			assembler.assemble_pressure_problem(state.formulation(), state.mesh->is_volume(), state.n_pressure_bases, state.pressure_bases, gbases, pressure_stiffness);
+			assembler.assemble_mixed_problem(state.formulation(), state.mesh->is_volume(), state.n_pressure_bases, state.n_bases, state.pressure_bases, state.bases, gbases, mixed_stiffness, &state.pressure_dof_map, &state.dof_map, &state.colorings);
+			assembler.assemble_pressure_problem(state.formulation(), state.mesh->is_volume(), state.n_pressure_bases, state.pressure_bases, gbases, pressure_stiffness, &state.pressure_dof_map, &state.colorings);
 
 			AssemblerUtils::merge_mixed_matrices(state.n_bases, state.n_pressure_bases, problem_dim, false, //assembler.is_fluid(state.formulation()),
 												 velocity_stiffness, mixed_stiffness, pressure_stiffness,
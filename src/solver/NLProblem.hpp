@@ -19,6 +19,10 @@ namespace polyfem
 
 		NLProblem(State &state, const RhsAssembler &rhs_assembler, const double t);
 		void init_timestep(const TVector &x_prev, const TVector &v_prev, const double dt);
+		//changes the size of the current time step, keeps x_prev and v_prev
+		void set_dt(const double dt);
+		//explicit prediction x_prev + dt * v_prev of the solution at the end of the time step
+		void predicted_solution(TVector &x) const;
 		TVector initial_guess();
 
 		double value(const TVector &x) override;
@@ -88,6 +92,14 @@ namespace polyfem
 
 		const Eigen::MatrixXd &current_rhs();
 
+		//assembles the requested quantities of the formulation at the full solution in one pass, the energy and the gradient
+		//are kept until the solution changes and only assembled if missing, the hessian is never kept and always assembled
+		void compute_cached_quantities(const Eigen::MatrixXd &full, const bool energy, const bool grad, StiffnessMatrix *hessian = nullptr);
+		double cached_energy_value() const { assert(has_cached_energy); return cached_energy; }
+		const Eigen::MatrixXd &cached_gradient() const { assert(has_cached_grad); return cached_grad; }
+		//number of element loops done by compute_cached_quantities
+		int n_assembly_passes() const { return n_assembly_passes_; }
+
 	private:
 		State &state;
 		AssemblerUtils &assembler;
@@ -104,5 +116,15 @@ namespace polyfem
 		TVector x_prev, v_prev;
 
 		void compute_cached_stiffness();
+
+		//energy and gradient of the formulation at cached_x, computed in the same assembly pass as the hessian
+		//so that the line search and the newton step do not loop over the elements again at the same point
+		Eigen::MatrixXd cached_x;
+		double cached_energy;
+		Eigen::MatrixXd cached_grad;
+		bool has_cached_energy = false;
+		bool has_cached_grad = false;
+		int n_assembly_passes_ = 0;
+
 	};
 }
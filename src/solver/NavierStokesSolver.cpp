@@ -29,6 +29,7 @@ void NavierStokesSolver::minimize(const State &state, const Eigen::MatrixXd &rhs
 {
 	auto &assembler = AssemblerUtils::instance();
 	assembler.clear_cache();
+	colorings_.clear();
 
 	// problem_params["viscosity"] = 1;
 	// assembler.set_parameters(problem_params);
@@ -46,9 +47,9 @@ void NavierStokesSolver::minimize(const State &state, const Eigen::MatrixXd &rhs
 	time.start();
 	StiffnessMatrix stoke_stiffness;
 	StiffnessMatrix velocity_stiffness, mixed_stiffness, pressure_stiffness;
-	assembler.assemble_problem(state.formulation(), state.mesh->is_volume(), state.n_bases, state.bases, gbases, velocity_stiffness);
-	assembler.assemble_mixed_problem(state.formulation(), state.mesh->is_volume(), state.n_pressure_bases, state.n_bases, state.pressure_bases, state.bases, gbases, mixed_stiffness);
-	assembler.assemble_pressure_problem(state.formulation(), state.mesh->is_volume(), state.n_pressure_bases, state.pressure_bases, gbases, pressure_stiffness);
+	assembler.assemble_problem(state.formulation(), state.mesh->is_volume(), state.n_bases, state.bases, gbases, velocity_stiffness, nullptr, &state.dof_map, &colorings_);
+	assembler.assemble_mixed_problem(state.formulation(), state.mesh->is_volume(), state.n_pressure_bases, state.n_bases, state.pressure_bases, state.bases, gbases, mixed_stiffness, &state.pressure_dof_map, &state.dof_map, &colorings_);
+	assembler.assemble_pressure_problem(state.formulation(), state.mesh->is_volume(), state.n_pressure_bases, state.pressure_bases, gbases, pressure_stiffness, &state.pressure_dof_map, &colorings_);
 
 	AssemblerUtils::merge_mixed_matrices(state.n_bases, state.n_pressure_bases, problem_dim, state.use_avg_pressure,
 										 velocity_stiffness, mixed_stiffness, pressure_stiffness,
@@ -57,12 +58,18 @@ void NavierStokesSolver::minimize(const State &state, const Eigen::MatrixXd &rhs
 	stokes_matrix_time = time.getElapsedTimeInSec();
 	logger().debug("\tStokes matrix assembly time {}s", time.getElapsedTimeInSec());
 
+	if (!saddle_point_solver)
+		saddle_point_solver = SaddlePointSolver::create(state);
+
 	time.start();
 
-	logger().info("{}...", solver->name());
+	logger().info("{}...", saddle_point_solver ? "SaddlePointSolver" : solver->name());
 
 	Eigen::VectorXd b = rhs;
-	dirichlet_solve(*solver, stoke_stiffness, b, state.boundary_nodes, x, precond_num);
+	if (saddle_point_solver)
+		saddle_point_solver->solve_blocks(velocity_stiffness, mixed_stiffness, pressure_stiffness, state.use_avg_pressure, true, b, state.boundary_nodes, x);
+	else
+		dirichlet_solve(*solver, stoke_stiffness, b, state.boundary_nodes, x, precond_num);
 	// solver->getInfo(solver_info);
 	time.stop();
 	stokes_solve_time = time.getElapsedTimeInSec();
@@ -109,7 +116,7 @@ int NavierStokesSolver::minimize_aux(
 
 
 	time.start();
-	assembler.assemble_energy_hessian(state.formulation() + "Picard", state.mesh->is_volume(), state.n_bases, state.bases, gbases, x, nl_matrix);
+	assembler.assemble_energy_hessian(state.formulation() + "Picard", state.mesh->is_volume(), state.n_bases, state.bases, gbases, x, nl_matrix, &state.dof_map, &colorings_);
 	AssemblerUtils::merge_mixed_matrices(state.n_bases, state.n_pressure_bases, problem_dim, state.use_avg_pressure,
 										 velocity_stiffness + nl_matrix, mixed_stiffness, pressure_stiffness,
 										 total_matrix);
@@ -132,12 +139,15 @@ int NavierStokesSolver::minimize_aux(
 
 		time.start();
 		if (formulation != state.formulation() + "Picard"){
-			assembler.assemble_energy_hessian(formulation, state.mesh->is_volume(), state.n_bases, state.bases, gbases, x, nl_matrix);
+			assembler.assemble_energy_hessian(formulation, state.mesh->is_volume(), state.n_bases, state.bases, gbases, x, nl_matrix, &state.dof_map, &colorings_);
 			AssemblerUtils::merge_mixed_matrices(state.n_bases, state.n_pressure_bases, problem_dim, state.use_avg_pressure,
 												 velocity_stiffness + nl_matrix, mixed_stiffness, pressure_stiffness,
 												 total_matrix);
 		}
-		dirichlet_solve(*solver, total_matrix, nlres, state.boundary_nodes, dx, precond_num);
+		if (saddle_point_solver)
+			saddle_point_solver->solve_blocks(velocity_stiffness + nl_matrix, mixed_stiffness, pressure_stiffness, state.use_avg_pressure, false, nlres, state.boundary_nodes, dx);
+		else
+			dirichlet_solve(*solver, total_matrix, nlres, state.boundary_nodes, dx, precond_num);
 		// for (int i : state.boundary_nodes)
 		// 	dx[i] = 0;
 		time.stop();
@@ -149,7 +159,7 @@ int NavierStokesSolver::minimize_aux(
 		//TODO check for nans
 
 		time.start();
-		assembler.assemble_energy_hessian(state.formulation() + "Picard", state.mesh->is_volume(), state.n_bases, state.bases, gbases, x, nl_matrix);
+		assembler.assemble_energy_hessian(state.formulation() + "Picard", state.mesh->is_volume(), state.n_bases, state.bases, gbases, x, nl_matrix, &state.dof_map, &colorings_);
 		AssemblerUtils::merge_mixed_matrices(state.n_bases, state.n_pressure_bases, problem_dim, state.use_avg_pressure,
 											 velocity_stiffness + nl_matrix, mixed_stiffness, pressure_stiffness,
 											 total_matrix);
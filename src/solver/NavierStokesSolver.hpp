@@ -2,6 +2,7 @@
 
 #include <polyfem/Common.hpp>
 #include <polyfem/State.hpp>
+#include <polyfem/SaddlePointSolver.hpp>
 
 #include <polysolve/LinearSolver.hpp>
 
@@ -45,6 +46,11 @@ private:
 
 	json internal_solver = json::array();
 
+	//block solver of the mixed systems, nullptr uses the direct solve of the merged matrix
+	std::unique_ptr<SaddlePointSolver> saddle_point_solver;
+	//colorings of the dof maps of the state, for the colored assemblies of the Picard and Newton iterations
+	ColoredAssemblyCache colorings_;
+
 	double assembly_time;
 	double inverting_time;
 	double stokes_matrix_time;
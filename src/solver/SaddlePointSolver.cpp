@@ -0,0 +1,542 @@
+#include <polyfem/SaddlePointSolver.hpp>
+
+#include <polyfem/State.hpp>
+#include <polyfem/AssemblerUtils.hpp>
+#include <polyfem/Logger.hpp>
+
+#include <igl/Timer.h>
+
+#include <Eigen/SparseCholesky>
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <stdexcept>
+
+namespace polyfem
+{
+	using namespace polysolve;
+
+	namespace
+	{
+		typedef std::function<void(const Eigen::VectorXd &, Eigen::VectorXd &)> Operator;
+
+		//copies A without the rows and columns of the masked entries, masked diagonal entries are set to diag
+		void filter_block(const StiffnessMatrix &A, const std::vector<bool> &row_mask, const std::vector<bool> &col_mask, const double diag, StiffnessMatrix &res)
+		{
+			std::vector<Eigen::Triplet<double>> entries;
+			entries.reserve(A.nonZeros());
+
+			for (int k = 0; k < A.outerSize(); ++k)
+			{
+				for (StiffnessMatrix::InnerIterator it(A, k); it; ++it)
+				{
+					if (!row_mask[it.row()] && !col_mask[it.col()])
+						entries.emplace_back(it.row(), it.col(), it.value());
+				}
+			}
+
+			if (diag != 0)
+			{
+				assert(A.rows() == A.cols());
+				for (int i = 0; i < int(row_mask.size()); ++i)
+				{
+					if (row_mask[i])
+						entries.emplace_back(i, i, diag);
+				}
+			}
+
+			res.resize(A.rows(), A.cols());
+			res.setFromTriplets(entries.begin(), entries.end());
+			res.makeCompressed();
+		}
+
+		//same pattern and values, both matrices are compressed
+		bool same_matrix(const StiffnessMatrix &a, const StiffnessMatrix &b, const bool check_values)
+		{
+			if (a.rows() != b.rows() || a.cols() != b.cols() || a.nonZeros() != b.nonZeros())
+				return false;
+			assert(a.isCompressed() && b.isCompressed());
+
+			const int nnz = a.nonZeros();
+			if (!std::equal(a.outerIndexPtr(), a.outerIndexPtr() + a.outerSize() + 1, b.outerIndexPtr()) || !std::equal(a.innerIndexPtr(), a.innerIndexPtr() + nnz, b.innerIndexPtr()))
+				return false;
+
+			return !check_values || std::equal(a.valuePtr(), a.valuePtr() + nnz, b.valuePtr());
+		}
+
+		//preconditioned MINRES, the preconditioner must be symmetric positive definite
+		int minres(const Operator &op, const Operator &precond, const Eigen::VectorXd &b, const double tol, const int max_iter, Eigen::VectorXd &x, double &error)
+		{
+			const int n = b.size();
+			const double b_norm2 = b.squaredNorm();
+			if (b_norm2 == 0)
+			{
+				x.setZero();
+				error = 0;
+				return 0;
+			}
+			const double threshold2 = tol * tol * b_norm2;
+
+			Eigen::VectorXd tmp;
+			Eigen::VectorXd v_old(n);
+			Eigen::VectorXd v = Eigen::VectorXd::Zero(n);
+			op(x, tmp);
+			Eigen::VectorXd v_new = b - tmp;
+			double residual_norm2 = v_new.squaredNorm();
+
+			Eigen::VectorXd w(n);
+			Eigen::VectorXd w_new;
+			precond(v_new, w_new);
+			double beta_new = std::sqrt(std::max(0., v_new.dot(w_new)));
+			const double beta_one = beta_new;
+
+			double c = 1, c_old = 1;
+			double s = 0, s_old = 0;
+			Eigen::VectorXd p_oold(n);
+			Eigen::VectorXd p_old = Eigen::VectorXd::Zero(n);
+			Eigen::VectorXd p = p_old;
+			double eta = 1;
+
+			int it = 0;
+			while (it < max_iter && residual_norm2 >= threshold2 && beta_new > 0)
+			{
+				//Lanczos step
+				const double beta = beta_new;
+				v_old = v;
+				v_new /= beta_new;
+				w_new /= beta_new;
+				v = v_new;
+				w = w_new;
+				op(w, tmp);
+				v_new = tmp - beta * v_old;
+				const double alpha = v_new.dot(w);
+				v_new -= alpha * v;
+				precond(v_new, w_new);
+				beta_new = std::sqrt(std::max(0., v_new.dot(w_new)));
+
+				//Givens rotation
+				const double r2 = s * alpha + c * c_old * beta;
+				const double r3 = s_old * beta;
+				const double r1_hat = c * alpha - c_old * s * beta;
+				const double r1 = std::sqrt(r1_hat * r1_hat + beta_new * beta_new);
+				c_old = c;
+				s_old = s;
+				c = r1_hat / r1;
+				s = beta_new / r1;
+
+				p_oold = p_old;
+				p_old = p;
+				p = (w - r2 * p_old - r3 * p_oold) / r1;
+				x += beta_one * c * eta * p;
+
+				//estimate, the true residual might be slightly larger
+				residual_norm2 *= s * s;
+				eta = -s * eta;
+				++it;
+			}
+
+			error = std::sqrt(residual_norm2 / b_norm2);
+			return it;
+		}
+
+		//restarted flexible GMRES, right preconditioned (the preconditioner can change at every iteration)
+		int fgmres(const Operator &op, const Operator &precond, const Eigen::VectorXd &b, const double tol, const int max_iter, const int restart, Eigen::VectorXd &x, double &error)
+		{
+			const int n = b.size();
+			const double b_norm = b.norm();
+			if (b_norm == 0)
+			{
+				x.setZero();
+				error = 0;
+				return 0;
+			}
+
+			const int m = std::max(1, restart);
+			Eigen::MatrixXd V(n, m + 1);
+			Eigen::MatrixXd Z(n, m);
+			Eigen::MatrixXd H = Eigen::MatrixXd::Zero(m + 1, m);
+			Eigen::VectorXd cs(m), sn(m), g(m + 1);
+			Eigen::VectorXd r, w, z;
+
+			int it = 0;
+			error = 1;
+			while (it < max_iter)
+			{
+				op(x, r);
+				r = b - r;
+				const double beta = r.norm();
+				error = beta / b_norm;
+				if (error < tol)
+					break;
+
+				V.col(0) = r / beta;
+				g.setZero();
+				g(0) = beta;
+				H.setZero();
+
+				int k = 0;
+				while (k < m && it < max_iter)
+				{
+					precond(V.col(k), z);
+					Z.col(k) = z;
+					op(z, w);
+
+					//modified Gram-Schmidt
+					for (int i = 0; i <= k; ++i)
+					{
+						H(i, k) = w.dot(V.col(i));
+						w -= H(i, k) * V.col(i);
+					}
+					H(k + 1, k) = w.norm();
+					if (H(k + 1, k) > 0)
+						V.col(k + 1) = w / H(k + 1, k);
+
+					for (int i = 0; i < k; ++i)
+					{
+						const double tmp = cs(i) * H(i, k) + sn(i) * H(i + 1, k);
+						H(i + 1, k) = -sn(i) * H(i, k) + cs(i) * H(i + 1, k);
+						H(i, k) = tmp;
+					}
+
+					const double den = std::sqrt(H(k, k) * H(k, k) + H(k + 1, k) * H(k + 1, k));
+					cs(k) = den > 0 ? H(k, k) / den : 1;
+					sn(k) = den > 0 ? H(k + 1, k) / den : 0;
+					H(k, k) = den;
+					H(k + 1, k) = 0;
+					g(k + 1) = -sn(k) * g(k);
+					g(k) = cs(k) * g(k);
+
+					++k;
+					++it;
+
+					error = std::abs(g(k)) / b_norm;
+					if (error < tol || den == 0)
+						break;
+				}
+
+				const Eigen::VectorXd y = H.topLeftCorner(k, k).triangularView<Eigen::Upper>().solve(g.head(k));
+				x += Z.leftCols(k) * y;
+
+				if (error < tol)
+					break;
+			}
+
+			return it;
+		}
+	} // namespace
+
+	SaddlePointSolver::SaddlePointSolver(const json &params, const double viscosity)
+	{
+		velocity_solver_ = params.count("velocity_solver") ? params["velocity_solver"].get<std::string>() : "";
+		velocity_precond_ = params.count("velocity_precond") ? params["velocity_precond"].get<std::string>() : "";
+		velocity_solver_params_ = params.count("velocity_solver_params") ? params["velocity_solver_params"] : json({});
+		krylov_ = params.count("krylov") ? params["krylov"].get<std::string>() : "auto";
+		tolerance_ = params.count("tolerance") ? double(params["tolerance"]) : 1e-10;
+		max_iter_ = params.count("max_iter") ? int(params["max_iter"]) : 1000;
+		restart_ = params.count("restart") ? int(params["restart"]) : 50;
+
+		const double scale = params.count("viscosity") ? double(params["viscosity"]) : 0;
+		viscosity_ = scale > 0 ? scale : viscosity;
+
+		if (krylov_ != "auto" && krylov_ != "minres" && krylov_ != "gmres")
+			throw std::invalid_argument("[SaddlePointSolver] invalid Krylov method " + krylov_);
+
+		//algebraic multigrid on the velocity block when available
+		if (velocity_solver_.empty())
+		{
+			const auto solvers = LinearSolver::availableSolvers();
+			if (std::find(solvers.begin(), solvers.end(), "Hypre") != solvers.end())
+				velocity_solver_ = "Hypre";
+			else if (std::find(solvers.begin(), solvers.end(), "AMGCL") != solvers.end())
+				velocity_solver_ = "AMGCL";
+			else
+				velocity_solver_ = LinearSolver::defaultSolver();
+		}
+		if (velocity_precond_.empty())
+			velocity_precond_ = LinearSolver::defaultPrecond();
+
+		//an iterative velocity solve changes the preconditioner at every iteration
+		if (krylov_ == "minres" && !is_direct(velocity_solver_))
+		{
+			logger().warn("[SaddlePointSolver] MINRES requires a direct velocity solver, {} is iterative, using GMRES", velocity_solver_);
+			krylov_ = "gmres";
+		}
+	}
+
+	bool SaddlePointSolver::is_direct(const std::string &solver)
+	{
+		for (const std::string iterative : {"Hypre", "AMGCL", "ConjugateGradient", "BiCGSTAB", "GMRES", "MINRES"})
+		{
+			if (solver.find(iterative) != std::string::npos)
+				return false;
+		}
+		return true;
+	}
+
+	void SaddlePointSolver::set_pressure_mass(const StiffnessMatrix &pressure_mass)
+	{
+		pressure_mass_ = pressure_mass;
+		schur_valid_ = false;
+	}
+
+	void SaddlePointSolver::set_pressure_laplacian(const StiffnessMatrix &pressure_laplacian)
+	{
+		pressure_laplacian_ = pressure_laplacian;
+		schur_valid_ = false;
+	}
+
+	void SaddlePointSolver::set_mass_coefficient(const double mass_coefficient)
+	{
+		mass_coefficient_ = mass_coefficient;
+	}
+
+	std::unique_ptr<SaddlePointSolver> SaddlePointSolver::create(const State &state)
+	{
+		const auto &assembler = AssemblerUtils::instance();
+		const json &params = state.args["saddle_point_solver"];
+		if (!assembler.is_mixed(state.formulation()) || !params.count("enabled") || !params["enabled"])
+			return nullptr;
+
+		//the Schur complement scales with the inverse of the viscosity (shear modulus for incompressible elasticity)
+		const json &problem_params = state.args["params"];
+		const std::string key = assembler.is_fluid(state.formulation()) ? "viscosity" : "mu";
+		const double viscosity = problem_params.count(key) ? double(problem_params[key]) : 1.;
+
+		std::unique_ptr<SaddlePointSolver> solver(new SaddlePointSolver(params, viscosity));
+
+		const auto &gbases = state.iso_parametric() ? state.bases : state.geom_bases;
+		StiffnessMatrix pressure_mass, pressure_laplacian;
+		assembler.assemble_mass_matrix("Laplacian", state.mesh->is_volume(), state.n_pressure_bases, state.pressure_bases, gbases, pressure_mass, &state.pressure_dof_map);
+		assembler.assemble_problem("Laplacian", state.mesh->is_volume(), state.n_pressure_bases, state.pressure_bases, gbases, pressure_laplacian, nullptr, &state.pressure_dof_map);
+		solver->set_pressure_mass(pressure_mass);
+		solver->set_pressure_laplacian(pressure_laplacian);
+
+		return solver;
+	}
+
+	void SaddlePointSolver::solve(const StiffnessMatrix &K, const int n_velocity, const int n_pressure, const bool symmetric,
+								  const Eigen::VectorXd &b, const std::vector<int> &dirichlet_nodes, Eigen::VectorXd &x)
+	{
+		assert(K.rows() == K.cols());
+		assert(K.rows() == n_velocity + n_pressure || K.rows() == n_velocity + n_pressure + 1);
+
+		const StiffnessMatrix A = K.topLeftCorner(n_velocity, n_velocity);
+		const StiffnessMatrix B = K.block(0, n_velocity, n_velocity, n_pressure);
+		const StiffnessMatrix C = K.block(n_velocity, n_velocity, n_pressure, n_pressure);
+
+		solve_blocks(A, B, C, K.rows() > n_velocity + n_pressure, symmetric, b, dirichlet_nodes, x);
+	}
+
+	bool SaddlePointSolver::factorize_schur(const StiffnessMatrix &C_free, const std::vector<bool> &pressure_mask)
+	{
+		schur_reused_ = schur_valid_ && cached_mass_coefficient_ == mass_coefficient_ && cached_pressure_mask_ == pressure_mask && same_matrix(cached_pressure_, C_free, true);
+		if (schur_reused_)
+			return true;
+
+		schur_valid_ = false;
+		const int n_pressure = C_free.rows();
+
+		//Schur complement approximation
+		StiffnessMatrix mass_free;
+		filter_block(pressure_mass_, pressure_mask, pressure_mask, 0, mass_free);
+
+		//dirichlet pressures keep the identity of C_free
+		StiffnessMatrix schur = mass_free / viscosity_ - C_free;
+		for (int i = 0; i < n_pressure; ++i)
+		{
+			if (pressure_mask[i])
+				schur.coeffRef(i, i) = 1;
+		}
+
+		schur_solver_.compute(schur);
+		if (schur_solver_.info() != Eigen::Success)
+		{
+			logger().error("Unable to factorize the Schur complement approximation");
+			return false;
+		}
+
+		if (mass_coefficient_ > 0)
+		{
+			if (pressure_laplacian_.rows() != n_pressure)
+			{
+				logger().error("Set the pressure laplacian for transient problems!");
+				return false;
+			}
+
+			//the neumann laplacian is singular, the small shift fixes the constant
+			StiffnessMatrix laplacian_free;
+			filter_block(pressure_laplacian_, pressure_mask, pressure_mask, 1, laplacian_free);
+			const double shift = 1e-8 * laplacian_free.diagonal().sum() / std::max(mass_free.diagonal().sum(), 1e-16);
+			laplacian_free += shift * mass_free;
+
+			laplacian_solver_.compute(laplacian_free);
+			if (laplacian_solver_.info() != Eigen::Success)
+			{
+				logger().error("Unable to factorize the pressure laplacian");
+				return false;
+			}
+		}
+
+		cached_pressure_ = C_free;
+		cached_pressure_mask_ = pressure_mask;
+		cached_mass_coefficient_ = mass_coefficient_;
+		schur_valid_ = true;
+		return true;
+	}
+
+	void SaddlePointSolver::factorize_velocity(const StiffnessMatrix &A_free)
+	{
+		const bool same_pattern = velocity_solver_instance_ && same_matrix(cached_velocity_, A_free, false);
+		velocity_reused_ = same_pattern && same_matrix(cached_velocity_, A_free, true);
+		if (velocity_reused_)
+			return;
+
+		//same pattern (e.g., a Newton step), only the numerical factorization is recomputed
+		if (!same_pattern)
+		{
+			velocity_solver_instance_ = LinearSolver::create(velocity_solver_, velocity_precond_);
+			velocity_solver_instance_->setParameters(velocity_solver_params_);
+			velocity_solver_instance_->analyzePattern(A_free, A_free.rows());
+		}
+		velocity_solver_instance_->factorize(A_free);
+		cached_velocity_ = A_free;
+	}
+
+	void SaddlePointSolver::solve_blocks(const StiffnessMatrix &A, const StiffnessMatrix &B, const StiffnessMatrix &C, const bool add_average, const bool symmetric,
+										 const Eigen::VectorXd &b, const std::vector<int> &dirichlet_nodes, Eigen::VectorXd &x)
+	{
+		if (!has_pressure_mass())
+		{
+			logger().error("Set the pressure mass matrix first!");
+			return;
+		}
+
+		const int n_velocity = A.rows();
+		const int n_pressure = C.rows() > 0 ? C.rows() : B.cols();
+		const int n = n_velocity + n_pressure;
+		assert(b.size() == n + (add_average ? 1 : 0));
+		assert(pressure_mass_.rows() == n_pressure);
+
+		igl::Timer timer;
+		timer.start();
+
+		std::vector<bool> velocity_mask(n_velocity, false);
+		std::vector<bool> pressure_mask(n_pressure, false);
+		Eigen::VectorXd known(n);
+		known.setZero();
+		for (int i : dirichlet_nodes)
+		{
+			if (i < n_velocity)
+				velocity_mask[i] = true;
+			else if (i < n)
+				pressure_mask[i - n_velocity] = true;
+			else
+				continue;
+			known(i) = b(i);
+		}
+
+		StiffnessMatrix A_free, B_free, C_free;
+		filter_block(A, velocity_mask, velocity_mask, 1, A_free);
+		filter_block(B, velocity_mask, pressure_mask, 0, B_free);
+		if (C.size() > 0)
+			filter_block(C, pressure_mask, pressure_mask, 1, C_free);
+		else
+			filter_block(StiffnessMatrix(n_pressure, n_pressure), pressure_mask, pressure_mask, 1, C_free);
+
+		//moves the dirichlet values to the right hand side
+		Eigen::VectorXd g = b.head(n);
+		const auto known_u = known.head(n_velocity);
+		const auto known_p = known.tail(n_pressure);
+		g.head(n_velocity) -= A * known_u + B * known_p;
+		g.tail(n_pressure) -= B.transpose() * known_u;
+		if (C.size() > 0)
+			g.tail(n_pressure) -= C * known_p;
+		for (int i : dirichlet_nodes)
+		{
+			if (i < n)
+				g(i) = b(i);
+		}
+
+		if (!factorize_schur(C_free, pressure_mask))
+			return;
+		factorize_velocity(A_free);
+
+		timer.stop();
+		const double setup_time = timer.getElapsedTimeInSec();
+		logger().debug("\tsaddle point setup time {}s", setup_time);
+
+		const Operator op = [&](const Eigen::VectorXd &in, Eigen::VectorXd &out) {
+			out.resize(n);
+			out.head(n_velocity) = A_free * in.head(n_velocity) + B_free * in.tail(n_pressure);
+			out.tail(n_pressure) = B_free.transpose() * in.head(n_velocity) + C_free * in.tail(n_pressure);
+		};
+
+		const bool use_minres = krylov_ == "minres" || (krylov_ == "auto" && symmetric && is_direct(velocity_solver_));
+
+		const Operator precond = [&](const Eigen::VectorXd &in, Eigen::VectorXd &out) {
+			out.resize(n);
+			Eigen::VectorXd tmp_p = schur_solver_.solve(in.tail(n_pressure));
+			if (mass_coefficient_ > 0)
+			{
+				Eigen::VectorXd tmp_l = laplacian_solver_.solve(in.tail(n_pressure));
+				for (int i = 0; i < n_pressure; ++i)
+				{
+					if (!pressure_mask[i])
+						tmp_p(i) += mass_coefficient_ * tmp_l(i);
+				}
+			}
+			Eigen::VectorXd rhs_u = in.head(n_velocity);
+
+			//block diagonal for MINRES, block upper triangular with S = -schur otherwise
+			if (!use_minres)
+			{
+				for (int i = 0; i < n_pressure; ++i)
+				{
+					if (!pressure_mask[i])
+						tmp_p(i) = -tmp_p(i);
+				}
+				rhs_u -= B_free * tmp_p;
+			}
+
+			Eigen::VectorXd tmp_u(n_velocity);
+			tmp_u.setZero();
+			velocity_solver_instance_->solve(rhs_u, tmp_u);
+
+			out.head(n_velocity) = tmp_u;
+			out.tail(n_pressure) = tmp_p;
+		};
+
+		timer.start();
+		Eigen::VectorXd y = known;
+		double error = 0;
+		const int iterations = use_minres ? minres(op, precond, g, tolerance_, max_iter_, y, error) : fgmres(op, precond, g, tolerance_, max_iter_, restart_, y, error);
+		timer.stop();
+		const double solve_time = timer.getElapsedTimeInSec();
+
+		if (error > tolerance_)
+			logger().warn("Saddle point solver did not converge, relative residual {} after {} iterations", error, iterations);
+		logger().debug("\tsaddle point {} iterations {}, relative residual {}, time {}s", use_minres ? "MINRES" : "GMRES", iterations, error, solve_time);
+
+		x.resize(b.size());
+		x.head(n) = y;
+		if (add_average)
+		{
+			//without dirichlet pressures the system is solved up to a constant pressure, the constraint fixes its mean
+			if (std::none_of(pressure_mask.begin(), pressure_mask.end(), [](bool b) { return b; }))
+				x.segment(n_velocity, n_pressure).array() -= y.tail(n_pressure).mean();
+			x(n) = 0;
+		}
+
+		solver_info_ = json({});
+		solver_info_["solver"] = use_minres ? "MINRES" : "GMRES";
+		solver_info_["velocity_solver"] = velocity_solver_instance_->name();
+		solver_info_["velocity_factorization_reused"] = velocity_reused_;
+		solver_info_["schur_factorization_reused"] = schur_reused_;
+		solver_info_["cahouet_chabard"] = mass_coefficient_ > 0;
+		solver_info_["iterations"] = iterations;
+		solver_info_["error"] = error;
+		solver_info_["time_setup"] = setup_time;
+		solver_info_["time_solve"] = solve_time;
+	}
+} // namespace polyfem
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <polyfem/Common.hpp>
+#include <polyfem/Types.hpp>
+
+#include <polysolve/LinearSolver.hpp>
+
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+#include <Eigen/SparseCholesky>
+
+#include <memory>
+#include <vector>
+
+namespace polyfem
+{
+	class State;
+
+	//Solves the mixed systems [A B; B^T C] [u; p] = [f; g] (Stokes, Navier-Stokes, incompressible elasticity)
+	//block by block, without factorizing the merged matrix.
+	//The Krylov method (MINRES for symmetric systems, flexible GMRES otherwise) is preconditioned with
+	//A^-1, one solve of the velocity solver (e.g., an AMG), and the Schur complement approximation S = M_p / viscosity - C.
+	//For transient problems (A = viscosity K + alpha/dt M_u) the Cahouet-Chabard approximation S^-1 = (M_p / viscosity - C)^-1 + alpha/dt L_p^-1 is used.
+	//MINRES requires a fixed preconditioner, iterative velocity solvers always use flexible GMRES.
+	//The factorizations are kept between solves and recomputed only when the blocks change.
+	class SaddlePointSolver
+	{
+	public:
+		SaddlePointSolver(const json &params, const double viscosity);
+
+		//mass matrix of the pressure bases, required before solving
+		void set_pressure_mass(const StiffnessMatrix &pressure_mass);
+		inline bool has_pressure_mass() const { return pressure_mass_.size() > 0; }
+
+		//laplacian of the pressure bases, required for the Cahouet-Chabard approximation
+		void set_pressure_laplacian(const StiffnessMatrix &pressure_laplacian);
+		//alpha/dt of the time integrator, 0 for steady problems
+		void set_mass_coefficient(const double mass_coefficient);
+
+		//solver configured with args["saddle_point_solver"], nullptr if it is disabled or the formulation is not mixed
+		static std::unique_ptr<SaddlePointSolver> create(const State &state);
+
+		//K is the matrix produced by AssemblerUtils::merge_mixed_matrices (with or without the average pressure constraint)
+		//x[i] = b[i] on the dirichlet nodes, like polysolve::dirichlet_solve
+		void solve(const StiffnessMatrix &K, const int n_velocity, const int n_pressure, const bool symmetric,
+				   const Eigen::VectorXd &b, const std::vector<int> &dirichlet_nodes, Eigen::VectorXd &x);
+
+		void solve_blocks(const StiffnessMatrix &A, const StiffnessMatrix &B, const StiffnessMatrix &C, const bool add_average, const bool symmetric,
+						  const Eigen::VectorXd &b, const std::vector<int> &dirichlet_nodes, Eigen::VectorXd &x);
+
+		void getInfo(json &info) const { info = solver_info_; }
+
+		//true if the velocity solver is a fixed linear operator (a factorization)
+		static bool is_direct(const std::string &solver);
+
+	private:
+		//factorizes the Schur complement approximation, returns false if it is not possible
+		bool factorize_schur(const StiffnessMatrix &C_free, const std::vector<bool> &pressure_mask);
+		void factorize_velocity(const StiffnessMatrix &A_free);
+
+		json velocity_solver_params_;
+		std::string velocity_solver_;
+		std::string velocity_precond_;
+		std::string krylov_;
+		double tolerance_;
+		int max_iter_;
+		int restart_;
+		double viscosity_;
+		double mass_coefficient_ = 0;
+
+		StiffnessMatrix pressure_mass_;
+		StiffnessMatrix pressure_laplacian_;
+
+		//cached factorizations and the blocks they were computed from
+		std::unique_ptr<polysolve::LinearSolver> velocity_solver_instance_;
+		StiffnessMatrix cached_velocity_;
+		bool velocity_reused_ = false;
+
+		Eigen::SimplicialLDLT<StiffnessMatrix> schur_solver_;
+		Eigen::SimplicialLDLT<StiffnessMatrix> laplacian_solver_;
+		StiffnessMatrix cached_pressure_;
+		std::vector<bool> cached_pressure_mask_;
+		double cached_mass_coefficient_ = -1;
+		bool schur_valid_ = false;
+		bool schur_reused_ = false;
+
+		json solver_info_;
+	};
+} // namespace polyfem
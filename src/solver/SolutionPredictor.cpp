@@ -0,0 +1,148 @@
+#include <polyfem/SolutionPredictor.hpp>
+
+#include <polyfem/Logger.hpp>
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
+namespace polyfem
+{
+	using namespace polysolve;
+
+	SolutionPredictor::SolutionPredictor(const json &params, const std::string &solver_type, const std::string &precond_type, const json &solver_params)
+		: history_(1)
+	{
+		const std::string type = params.count("type") ? params["type"].get<std::string>() : "linearized";
+		if (type == "previous")
+			type_ = Type::Previous;
+		else if (type == "linearized")
+			type_ = Type::Linearized;
+		else if (type == "extrapolation")
+			type_ = Type::Extrapolation;
+		else
+			throw std::invalid_argument("[SolutionPredictor] invalid predictor type " + type);
+
+		//the history keeps order + 1 solutions, enough for an extrapolation of degree order
+		order_ = params.count("extrapolation_order") ? int(params["extrapolation_order"]) : 2;
+		order_ = std::max(1, std::min(order_, 6));
+		history_.set_order(order_);
+
+		reuse_factorization_ = params.count("reuse_factorization") ? bool(params["reuse_factorization"]) : false;
+		stokes_skip_tol_ = params.count("stokes_skip_tol") ? double(params["stokes_skip_tol"]) : 0;
+
+		if (reuse_factorization_)
+		{
+			solver_ = LinearSolver::create(solver_type, precond_type);
+			solver_->setParameters(solver_params);
+		}
+
+		factorized_ = false;
+		n_factorizations_ = 0;
+		n_solves_ = 0;
+	}
+
+	void SolutionPredictor::new_solution(const Eigen::VectorXd &x, const double t)
+	{
+		Eigen::VectorXd tmp = x;
+		history_.new_solution(tmp, t);
+	}
+
+	bool SolutionPredictor::extrapolate(const double t, Eigen::VectorXd &x) const
+	{
+		if (history_.history_size() < 2)
+			return false;
+
+		history_.predict(t - history_.last_time(), order_, x);
+		return true;
+	}
+
+	bool SolutionPredictor::needs_factorization() const
+	{
+		return !reuse_factorization_ || !factorized_;
+	}
+
+	void SolutionPredictor::factorize(const StiffnessMatrix &A, const std::vector<int> &dirichlet_nodes, const int precond_num)
+	{
+		assert(solver_);
+		assert(A.rows() == A.cols());
+
+		mat_ = A;
+		dirichlet_nodes_ = dirichlet_nodes;
+
+		Eigen::VectorXd N(A.rows());
+		N.setZero();
+		for (int i : dirichlet_nodes)
+			N(i) = 1;
+
+		std::vector<Eigen::Triplet<double>> entries;
+		entries.reserve(A.nonZeros() + dirichlet_nodes.size());
+		for (int k = 0; k < A.outerSize(); ++k)
+		{
+			for (StiffnessMatrix::InnerIterator it(A, k); it; ++it)
+			{
+				if (N(it.row()) != 1 && N(it.col()) != 1)
+					entries.emplace_back(it.row(), it.col(), it.value());
+			}
+		}
+		for (int i : dirichlet_nodes)
+			entries.emplace_back(i, i, 1);
+
+		StiffnessMatrix mat(A.rows(), A.cols());
+		mat.setFromTriplets(entries.begin(), entries.end());
+
+		solver_->analyzePattern(mat, precond_num);
+		solver_->factorize(mat);
+
+		factorized_ = true;
+		++n_factorizations_;
+	}
+
+	void SolutionPredictor::solve(const Eigen::VectorXd &b, Eigen::VectorXd &x)
+	{
+		assert(factorized_);
+		++n_solves_;
+
+		//moves the known dirichlet values to the right hand side
+		Eigen::VectorXd dirichlet(b.size());
+		dirichlet.setZero();
+		for (int i : dirichlet_nodes_)
+			dirichlet(i) = b(i);
+
+		Eigen::VectorXd g = b - mat_ * dirichlet;
+		for (int i : dirichlet_nodes_)
+			g(i) = b(i);
+
+		x.resize(b.size());
+		x.setZero();
+		solver_->solve(g, x);
+	}
+
+	void SolutionPredictor::add_step(const int iterations)
+	{
+		iterations_.push_back(iterations);
+	}
+
+	void SolutionPredictor::save_info(json &info) const
+	{
+		switch (type_)
+		{
+		case Type::Previous:
+			info["type"] = "previous";
+			break;
+		case Type::Linearized:
+			info["type"] = "linearized";
+			break;
+		case Type::Extrapolation:
+			info["type"] = "extrapolation";
+			break;
+		}
+
+		info["extrapolation_order"] = order_;
+		info["factorizations"] = n_factorizations_;
+		info["reused_factorizations"] = std::max(0, n_solves_ - n_factorizations_);
+		info["step_iterations"] = iterations_;
+		info["total_iterations"] = std::accumulate(iterations_.begin(), iterations_.end(), 0);
+		info["mean_iterations"] = iterations_.empty() ? 0. : double(info["total_iterations"]) / iterations_.size();
+	}
+} // namespace polyfem
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <polyfem/Common.hpp>
+#include <polyfem/Types.hpp>
+#include <polyfem/BDF.hpp>
+
+#include <polysolve/LinearSolver.hpp>
+
+#include <Eigen/Dense>
+
+#include <memory>
+#include <vector>
+
+namespace polyfem
+{
+	//Initial guess for the nonlinear solve of the next load (or time) step
+	//previous: the last accepted solution
+	//linearized: one linear solve with the tangent matrix of the last solution (optionally factorized once and reused)
+	//extrapolation: polynomial extrapolation of the last accepted solutions
+	class SolutionPredictor
+	{
+	public:
+		enum class Type
+		{
+			Previous,
+			Linearized,
+			Extrapolation
+		};
+
+		SolutionPredictor(const json &params, const std::string &solver_type, const std::string &precond_type, const json &solver_params);
+
+		inline Type type() const { return type_; }
+		inline double stokes_skip_tol() const { return stokes_skip_tol_; }
+
+		//history of accepted solutions, t is the load factor or the time
+		void new_solution(const Eigen::VectorXd &x, const double t);
+		inline int history_size() const { return history_.history_size(); }
+		//extrapolates the stored solutions to t, returns false if there are not enough (at least two) solutions
+		bool extrapolate(const double t, Eigen::VectorXd &x) const;
+
+		//true if the tangent matrix has to be assembled for the linearized predictor
+		bool needs_factorization() const;
+		//factorizes A with the rows and columns of the dirichlet nodes replaced by the identity
+		void factorize(const StiffnessMatrix &A, const std::vector<int> &dirichlet_nodes, const int precond_num);
+		//solves with the last factorization, x[i] = b[i] on the dirichlet nodes
+		void solve(const Eigen::VectorXd &b, Eigen::VectorXd &x);
+		//forces a new factorization at the next step (e.g., after a failed step)
+		inline void invalidate_factorization() { factorized_ = false; }
+		inline bool reuse_factorization() const { return reuse_factorization_; }
+
+		//records the nonlinear iterations of a step started from the predicted solution
+		void add_step(const int iterations);
+		void save_info(json &info) const;
+
+	private:
+		Type type_;
+		int order_;
+		bool reuse_factorization_;
+		double stokes_skip_tol_;
+
+		BDF history_;
+
+		std::unique_ptr<polysolve::LinearSolver> solver_;
+		StiffnessMatrix mat_;
+		std::vector<int> dirichlet_nodes_;
+		bool factorized_;
+
+		int n_factorizations_;
+		int n_solves_;
+		std::vector<int> iterations_;
+	};
+} // namespace polyfem
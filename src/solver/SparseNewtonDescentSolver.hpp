@@ -7,8 +7,7 @@
 #include <polyfem/State.hpp>
 
 #include <polyfem/Logger.hpp>
-
-#include <igl/Timer.h>
+#include <polyfem/Profiler.hpp>
 
 #include <cppoptlib/problem.h>
 #include <cppoptlib/solver/isolver.h>
@@ -16,6 +15,9 @@
 #include <cppoptlib/linesearch/morethuente.h>
 
 #include <cmath>
+#include <deque>
+#include <functional>
+#include <memory>
 
 namespace cppoptlib
 {
@@ -29,6 +31,16 @@ public:
 	using typename Superclass::Scalar;
 	using typename Superclass::TVector;
 
+	enum class HessianPolicy
+	{
+		//new hessian at every iteration
+		Newton,
+		//modified newton, the factorization is reused until the convergence slows down
+		Lagged,
+		//lbfgs updates on top of the lagged factorization
+		LBFGS
+	};
+
 	enum class LineSearch
 	{
 		Armijo,
@@ -46,6 +58,38 @@ public:
 		criteria.gradNorm = solver_param.count("gradNorm") ? double(solver_param["gradNorm"]) : 1e-8;
 		criteria.iterations = solver_param.count("nl_iterations") ? int(solver_param["nl_iterations"]) : 100;
 		this->setStopCriteria(criteria);
+
+		setHessianPolicy(solver_param.count("hessian_policy") ? std::string(solver_param["hessian_policy"]) : "newton");
+		if (solver_param.count("hessian_reuse"))
+			hessian_reuse = std::max(1, int(solver_param["hessian_reuse"]));
+		if (solver_param.count("hessian_refresh_rate"))
+			hessian_refresh_rate = solver_param["hessian_refresh_rate"];
+		if (solver_param.count("lbfgs_history"))
+			lbfgs_history = solver_param["lbfgs_history"];
+	}
+
+	void setHessianPolicy(const std::string &name)
+	{
+		if (name == "newton")
+		{
+			hessian_policy = HessianPolicy::Newton;
+		}
+		else if (name == "lagged")
+		{
+			hessian_policy = HessianPolicy::Lagged;
+		}
+		else if (name == "lbfgs")
+		{
+			hessian_policy = HessianPolicy::LBFGS;
+		}
+		else
+		{
+			polyfem::logger().error("[SparseNewtonDescentSolver] Unknown hessian policy.");
+			throw std::invalid_argument("[SparseNewtonDescentSolver] Unknown hessian policy.");
+		}
+
+		polyfem::logger().debug("\thessian policy {}", name);
+		solver_info["hessian_policy"] = name;
 	}
 
 	void setLineSearch(const std::string &name)
@@ -146,7 +190,7 @@ public:
 		// const json &params = State::state().solver_params();
 		// auto solver = LinearSolver::create(State::state().solver_type(), State::state().precond_type());
 
-		auto solver = polysolve::LinearSolver::create(solver_type, precond_type);
+		auto solver = linear_solver_factory ? linear_solver_factory() : polysolve::LinearSolver::create(solver_type, precond_type);
 		solver->setParameters(solver_param);
 		polyfem::logger().debug("\tinternal solver {}", solver->name());
 
@@ -165,34 +209,69 @@ public:
 		grad_time = 0;
 		assembly_time = 0;
 		inverting_time = 0;
+		factorization_time = 0;
+		solve_time = 0;
 		linesearch_time = 0;
-		igl::Timer time;
+		n_factorizations = 0;
 
 		polyfem::StiffnessMatrix hessian;
 		this->m_current.reset();
 		AssemblerUtils::instance().clear_cache();
 
+		//s_k = x_{k+1} - x_k and y_k = g_{k+1} - g_k since the last factorization, used by the lbfgs policy
+		std::deque<TVector> s_history, y_history;
+		TVector prev_x, prev_grad;
+		double prev_grad_norm = std::nan("");
+
 		size_t next_hessian = 0;
 		// double factor = 1e-5;
 		double old_energy = std::nan("");
 		double first_energy = std::nan("");
 		error_code_ = 0;
+
+		const auto compute_hessian = [&](const size_t iter) {
+			ScopedZone hessian_zone("hessian");
+			objFunc.hessian(x0, hessian);
+			// hessian = 1e-8 * id;
+			//factor *= 1e-1;
+			const double hessian_time = hessian_zone.stop();
+			polyfem::logger().debug("\tassembly time {}s", hessian_time);
+			assembly_time += hessian_time;
+
+			next_hessian = iter + (hessian_policy == HessianPolicy::Newton ? 1 : hessian_reuse);
+			s_history.clear();
+			y_history.clear();
+		};
+
+		const auto factorize = [&]() {
+			ScopedZone factorization_zone("factorization");
+			//TODO: get the correct side
+			solver->analyzePattern(hessian, hessian.rows());
+			solver->factorize(hessian);
+			factorization_time += factorization_zone.stop();
+			++n_factorizations;
+		};
+
+		const auto solve = [&]() {
+			ScopedZone solve_zone("solve");
+			if (hessian_policy == HessianPolicy::LBFGS)
+				lbfgs_direction(*solver, grad, s_history, y_history, delta_x);
+			else
+				solver->solve(grad, delta_x);
+			solve_time += solve_zone.stop();
+
+			delta_x *= -1;
+		};
+
 		do
 		{
+			ScopedZone iteration_zone("newton_iteration");
 			const size_t iter = this->m_current.iterations;
 			bool new_hessian = iter == next_hessian;
 
 			if (new_hessian)
 			{
-				time.start();
-				objFunc.hessian(x0, hessian);
-				// hessian = 1e-8 * id;
-				//factor *= 1e-1;
-				time.stop();
-				polyfem::logger().debug("\tassembly time {}s", time.getElapsedTimeInSec());
-				assembly_time += time.getElapsedTimeInSec();
-
-				next_hessian += 1;
+				compute_hessian(iter);
 
 				if (iter == 0)
 				{
@@ -206,34 +285,74 @@ public:
 				}
 			}
 
-			time.start();
+			ScopedZone grad_zone("gradient");
 			objFunc.gradient(x0, grad);
-			time.stop();
+			const double iter_grad_time = grad_zone.stop();
 
-			polyfem::logger().debug("\tgrad time {}s norm: {}", time.getElapsedTimeInSec(), grad.norm());
-			grad_time += time.getElapsedTimeInSec();
+			polyfem::logger().debug("\tgrad time {}s norm: {}", iter_grad_time, grad.norm());
+			grad_time += iter_grad_time;
+
+			if (!new_hessian)
+			{
+				//the lagged hessian is refreshed when the gradient stops decreasing fast enough
+				if (grad.norm() > hessian_refresh_rate * prev_grad_norm)
+				{
+					polyfem::logger().debug("\tslow convergence ({} -> {}) recompute hessian", prev_grad_norm, grad.norm());
+					compute_hessian(iter);
+					new_hessian = true;
+				}
+				else if (hessian_policy == HessianPolicy::LBFGS)
+				{
+					const TVector s = x0 - prev_x;
+					const TVector y = grad - prev_grad;
+					//curvature condition, keeps the update positive definite
+					if (s.dot(y) > 1e-10 * s.norm() * y.norm())
+					{
+						s_history.push_back(s);
+						y_history.push_back(y);
+						if (int(s_history.size()) > lbfgs_history)
+						{
+							s_history.pop_front();
+							y_history.pop_front();
+						}
+					}
+				}
+			}
 
 			// std::cout<<hessian<<std::endl;
-			time.start();
+			ScopedZone inverting_zone("inverting");
 
 			if (new_hessian)
+				factorize();
+			solve();
+
+			double iter_inverting_time = inverting_zone.stop();
+
+			//an outdated hessian can give an ascent direction
+			if (!new_hessian && delta_x.dot(grad) >= 0)
 			{
-				//TODO: get the correct side
-				solver->analyzePattern(hessian, hessian.rows());
-				solver->factorize(hessian);
+				polyfem::logger().debug("\tnot a descent direction, recompute hessian");
+				compute_hessian(iter);
+				new_hessian = true;
+
+				ScopedZone retry_zone("inverting");
+				factorize();
+				solve();
+				iter_inverting_time += retry_zone.stop();
 			}
-			solver->solve(grad, delta_x);
-
-			delta_x *= -1;
 
 			json tmp;
 			solver->getInfo(tmp);
 			internal_solver.push_back(tmp);
 
-			polyfem::logger().debug("\tinverting time {}s", time.getElapsedTimeInSec());
-			inverting_time += time.getElapsedTimeInSec();
+			polyfem::logger().debug("\tinverting time {}s", iter_inverting_time);
+			inverting_time += iter_inverting_time;
+
+			prev_x = x0;
+			prev_grad = grad;
+			prev_grad_norm = grad.norm();
 
-			time.start();
+			ScopedZone linesearch_zone("linesearch");
 
 			double rate;
 			switch (line_search)
@@ -257,8 +376,9 @@ public:
 
 			x0 += rate * delta_x;
 
-			polyfem::logger().debug("\tlinesearch time {}s", time.getElapsedTimeInSec());
-			linesearch_time += time.getElapsedTimeInSec();
+			const double iter_linesearch_time = linesearch_zone.stop();
+			polyfem::logger().debug("\tlinesearch time {}s", iter_linesearch_time);
+			linesearch_time += iter_linesearch_time;
 
 			++this->m_current.iterations;
 
@@ -320,13 +440,18 @@ public:
 			grad_time /= crit.iterations;
 			assembly_time /= crit.iterations;
 			inverting_time /= crit.iterations;
+			factorization_time /= crit.iterations;
+			solve_time /= crit.iterations;
 			linesearch_time /= crit.iterations;
 		}
 
 		solver_info["time_grad"] = grad_time;
 		solver_info["time_assembly"] = assembly_time;
 		solver_info["time_inverting"] = inverting_time;
+		solver_info["time_factorization"] = factorization_time;
+		solver_info["time_solve"] = solve_time;
 		solver_info["time_linesearch"] = linesearch_time;
+		solver_info["factorizations"] = n_factorizations;
 	}
 
 	void getInfo(json &params)
@@ -336,10 +461,14 @@ public:
 
 	int error_code() const { return error_code_; }
 
+	//replaces polysolve::LinearSolver::create(solver_type, precond_type) for the Newton steps
+	void set_linear_solver_factory(const std::function<std::unique_ptr<polysolve::LinearSolver>()> &factory) { linear_solver_factory = factory; }
+
 private:
 	const json solver_param;
 	const std::string solver_type;
 	const std::string precond_type;
+	std::function<std::unique_ptr<polysolve::LinearSolver>()> linear_solver_factory;
 
 	int error_code_;
 	json solver_info;
@@ -348,10 +477,43 @@ private:
 
 	LineSearch line_search = LineSearch::Armijo;
 
+	HessianPolicy hessian_policy = HessianPolicy::Newton;
+	//maximum number of iterations with the same factorization
+	int hessian_reuse = 5;
+	//the hessian is recomputed when ||g_{k+1}|| > hessian_refresh_rate * ||g_k||
+	double hessian_refresh_rate = 0.5;
+	int lbfgs_history = 6;
+
 	double grad_time;
 	double assembly_time;
 	double inverting_time;
+	double factorization_time;
+	double solve_time;
 	double linesearch_time;
+	int n_factorizations;
+
+	//two loop recursion of lbfgs with the inverse of the factorized hessian as initial matrix
+	void lbfgs_direction(polysolve::LinearSolver &solver, const TVector &grad, const std::deque<TVector> &s_history, const std::deque<TVector> &y_history, TVector &direction) const
+	{
+		const int m = int(s_history.size());
+		std::vector<double> alpha(m), rho(m);
+
+		TVector q = grad;
+		for (int i = m - 1; i >= 0; --i)
+		{
+			rho[i] = 1. / y_history[i].dot(s_history[i]);
+			alpha[i] = rho[i] * s_history[i].dot(q);
+			q -= alpha[i] * y_history[i];
+		}
+
+		solver.solve(q, direction);
+
+		for (int i = 0; i < m; ++i)
+		{
+			const double beta = rho[i] * y_history[i].dot(direction);
+			direction += (alpha[i] - beta) * s_history[i];
+		}
+	}
 
 	bool has_hessian_nans(const polyfem::StiffnessMatrix &hessian)
 	{
@@ -0,0 +1,232 @@
+#include <polyfem/TimeStepController.hpp>
+
+#include <polyfem/Logger.hpp>
+
+#include <cmath>
+#include <algorithm>
+#include <limits>
+
+namespace polyfem
+{
+	TimeStepController::TimeStepController(const json &params, const double tend, const int time_steps)
+		: tend_(tend), fixed_dt_(tend / time_steps)
+	{
+		adaptive_ = params.count("enabled") ? bool(params["enabled"]) : false;
+
+		tol_abs_ = params.count("tol_abs") ? double(params["tol_abs"]) : 1e-6;
+		tol_rel_ = params.count("tol_rel") ? double(params["tol_rel"]) : 1e-4;
+		dt_min_ = params.count("dt_min") ? double(params["dt_min"]) : 1e-10;
+		dt_max_ = params.count("dt_max") ? double(params["dt_max"]) : 0;
+		safety_ = params.count("safety") ? double(params["safety"]) : 0.9;
+		min_factor_ = params.count("min_factor") ? double(params["min_factor"]) : 0.2;
+		max_factor_ = params.count("max_factor") ? double(params["max_factor"]) : 5;
+		max_rejections_ = params.count("max_rejections") ? int(params["max_rejections"]) : 20;
+
+		if (dt_max_ <= 0)
+			dt_max_ = tend_;
+
+		const double dt0 = params.count("dt0") ? double(params["dt0"]) : 0;
+		dt_ = (adaptive_ && dt0 > 0) ? dt0 : fixed_dt_;
+		dt_ = std::max(dt_min_, std::min(dt_, dt_max_));
+
+		time_ = 0;
+		n_accepted_ = 0;
+		n_rejected_ = 0;
+		n_failed_ = 0;
+		consecutive_rejections_ = 0;
+		steps_at_order_ = 0;
+
+		used_dt_min_ = std::numeric_limits<double>::max();
+		used_dt_max_ = 0;
+
+		if (adaptive_)
+			clamp_to_end();
+	}
+
+	bool TimeStepController::finished() const
+	{
+		if (!adaptive_)
+			return n_accepted_ >= int(std::round(tend_ / fixed_dt_));
+
+		return time_ >= tend_ * (1 - 1e-12);
+	}
+
+	double TimeStepController::time() const
+	{
+		//avoids drift when the steps are fixed
+		return adaptive_ ? time_ : n_accepted_ * fixed_dt_;
+	}
+
+	double TimeStepController::next_time() const
+	{
+		return adaptive_ ? (time_ + dt_) : ((n_accepted_ + 1) * fixed_dt_);
+	}
+
+	double TimeStepController::error_norm(const Eigen::VectorXd &err, const Eigen::VectorXd &x) const
+	{
+		assert(err.size() <= x.size());
+		if (err.size() <= 0)
+			return 0;
+
+		const Eigen::ArrayXd scale = tol_abs_ + tol_rel_ * x.head(err.size()).array().abs();
+		return std::sqrt((err.array() / scale).square().mean());
+	}
+
+	double TimeStepController::step_factor(const double err, const int order) const
+	{
+		if (err <= 0)
+			return max_factor_;
+
+		const double factor = safety_ * std::pow(err, -1. / (order + 1));
+		return std::max(min_factor_, std::min(max_factor_, factor));
+	}
+
+	void TimeStepController::clamp_to_end()
+	{
+		const double remaining = tend_ - time_;
+		//avoids leaving a tiny last step
+		if (dt_ >= remaining || remaining - dt_ < 0.1 * dt_)
+			dt_ = remaining;
+	}
+
+	bool TimeStepController::check_step(const double err, const int order)
+	{
+		if (!adaptive_)
+		{
+			++n_accepted_;
+			used_dt_min_ = std::min(used_dt_min_, dt_);
+			used_dt_max_ = std::max(used_dt_max_, dt_);
+			return true;
+		}
+
+		const double factor = step_factor(err, order);
+
+		if (err <= 1 || dt_ <= dt_min_)
+		{
+			if (err > 1)
+				logger().warn("Accepting step with error {} since dt={} is the minimum", err, dt_);
+
+			time_ += dt_;
+			++n_accepted_;
+			++steps_at_order_;
+			used_dt_min_ = std::min(used_dt_min_, dt_);
+			used_dt_max_ = std::max(used_dt_max_, dt_);
+
+			//do not grow right after a rejection
+			const double max_f = consecutive_rejections_ > 0 ? 1. : max_factor_;
+			consecutive_rejections_ = 0;
+
+			dt_ = std::max(dt_min_, std::min(dt_max_, dt_ * std::min(factor, max_f)));
+			clamp_to_end();
+
+			logger().debug("Accepted step, error {}, next dt {}", err, dt_);
+			return true;
+		}
+
+		++n_rejected_;
+		++consecutive_rejections_;
+		dt_ = std::max(dt_min_, dt_ * std::min(factor, 1.));
+		clamp_to_end();
+
+		logger().debug("Rejected step, error {}, retrying with dt {}", err, dt_);
+		return false;
+	}
+
+	void TimeStepController::accept_step()
+	{
+		if (adaptive_)
+			time_ += dt_;
+		++n_accepted_;
+		++steps_at_order_;
+		used_dt_min_ = std::min(used_dt_min_, dt_);
+		used_dt_max_ = std::max(used_dt_max_, dt_);
+		consecutive_rejections_ = 0;
+
+		if (adaptive_)
+			clamp_to_end();
+	}
+
+	bool TimeStepController::step_failed()
+	{
+		++n_failed_;
+
+		if (!adaptive_)
+			return false;
+
+		++consecutive_rejections_;
+		if (dt_ <= dt_min_ || consecutive_rejections_ > max_rejections_)
+			return false;
+
+		dt_ = std::max(dt_min_, dt_ / 2);
+		clamp_to_end();
+
+		logger().debug("Solver failed, retrying with dt {}", dt_);
+		return true;
+	}
+
+	bool TimeStepController::check_bdf_step(BDF &bdf, const int max_order, const double dt, const int n_differential, const Eigen::VectorXd &x)
+	{
+		const int order = bdf.current_order();
+		if (!adaptive_)
+			return check_step(0, order);
+
+		//the estimate needs order+1 previous solutions, with fewer (the first steps, or right after raising
+		//the order) it would be the whole increment. The step is accepted with the current dt
+		if (bdf.history_size() <= order)
+		{
+			accept_step();
+			return true;
+		}
+
+		Eigen::VectorXd err;
+		bdf.error_estimate(dt, order, x, err);
+		const double err_norm = error_norm(err.head(n_differential), x);
+		if (!check_step(err_norm, order))
+			return false;
+
+		double err_lower = err_norm;
+		if (order > 1)
+		{
+			bdf.error_estimate(dt, order - 1, x, err);
+			err_lower = error_norm(err.head(n_differential), x);
+		}
+
+		const int new_order = select_order(err_lower, err_norm, order, max_order);
+		if (new_order != order)
+			bdf.set_order(new_order);
+
+		return true;
+	}
+
+	int TimeStepController::select_order(const double err_lower, const double err, const int order, const int max_order)
+	{
+		if (!adaptive_)
+			return order;
+
+		int new_order = order;
+		if (order > 1 && err_lower <= err)
+			new_order = order - 1;
+		//raise only after order+1 steps at the current order with a comfortable error
+		else if (order < max_order && steps_at_order_ > order && err < 0.5)
+			new_order = order + 1;
+
+		if (new_order != order)
+		{
+			steps_at_order_ = 0;
+			logger().debug("Changing BDF order from {} to {}", order, new_order);
+		}
+
+		return new_order;
+	}
+
+	void TimeStepController::save_info(json &info) const
+	{
+		info["adaptive"] = adaptive_;
+		info["accepted_steps"] = n_accepted_;
+		info["rejected_steps"] = n_rejected_;
+		info["failed_steps"] = n_failed_;
+		info["dt_min"] = n_accepted_ > 0 ? used_dt_min_ : 0;
+		info["dt_max"] = used_dt_max_;
+		info["final_time"] = time();
+	}
+} // namespace polyfem
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <polyfem/Common.hpp>
+#include <polyfem/BDF.hpp>
+
+#include <Eigen/Dense>
+
+namespace polyfem
+{
+	//Step size (and order) controller for transient problems
+	//When adaptivity is disabled it reproduces the fixed dt = tend / time_steps stepping
+	class TimeStepController
+	{
+	public:
+		TimeStepController(const json &params, const double tend, const int time_steps);
+
+		inline bool is_adaptive() const { return adaptive_; }
+
+		//true when the last accepted step reached tend
+		bool finished() const;
+		//size of the step being attempted
+		inline double dt() const { return dt_; }
+		//time of the last accepted solution
+		double time() const;
+		//time of the solution being computed
+		double next_time() const;
+		//number of accepted steps
+		inline int step() const { return n_accepted_; }
+
+		//weighted rms norm of the error estimate err relative to the solution x, the step is accepted if <= 1
+		double error_norm(const Eigen::VectorXd &err, const Eigen::VectorXd &x) const;
+
+		//returns true if the step is accepted, and updates dt for the next step (or for the retry)
+		//order is the order of the method the error estimate refers to
+		bool check_step(const double err, const int order);
+		//accepts the step without an error estimate (e.g., while a multistep method starts), dt is kept
+		void accept_step();
+		//the solver failed, shrinks the step. Returns false if it is not possible to retry
+		bool step_failed();
+
+		//checks the error estimate of a BDF step with solution x, updates step size and order of bdf. Returns true
+		//if the step is accepted. Only the first n_differential entries of x enter the error (e.g., no pressure)
+		bool check_bdf_step(BDF &bdf, const int max_order, const double dt, const int n_differential, const Eigen::VectorXd &x);
+
+		//chooses the order of a BDF method for the next step given the error estimates at order-1 and order
+		int select_order(const double err_lower, const double err, const int order, const int max_order);
+
+		void save_info(json &info) const;
+
+	private:
+		bool adaptive_;
+
+		double tend_;
+		double fixed_dt_;
+
+		double dt_;
+		double time_;
+
+		double tol_abs_, tol_rel_;
+		double dt_min_, dt_max_;
+		double safety_;
+		double min_factor_, max_factor_;
+		int max_rejections_;
+
+		int n_accepted_;
+		int n_rejected_;
+		int n_failed_;
+		int consecutive_rejections_;
+		int steps_at_order_;
+
+		double used_dt_min_, used_dt_max_;
+
+		double step_factor(const double err, const int order) const;
+		void clamp_to_end();
+	};
+} // namespace polyfem
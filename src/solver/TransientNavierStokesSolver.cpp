@@ -22,6 +22,7 @@ TransientNavierStokesSolver::TransientNavierStokesSolver(const json &solver_para
 {
 	gradNorm = solver_param.count("gradNorm") ? double(solver_param["gradNorm"]) : 1e-8;
 	iterations = solver_param.count("nl_iterations") ? int(solver_param["nl_iterations"]) : 100;
+	stokes_skip_tol = 0;
 }
 
 void TransientNavierStokesSolver::minimize(
@@ -32,6 +33,7 @@ void TransientNavierStokesSolver::minimize(
 {
 	auto &assembler = AssemblerUtils::instance();
 	assembler.clear_cache();
+	colorings_.clear();
 
 	auto solver = LinearSolver::create(solver_type, precond_type);
 	solver->setParameters(solver_param);
@@ -62,19 +64,47 @@ void TransientNavierStokesSolver::minimize(
 	logger().debug("\tStokes matrix assembly time {}s", time.getElapsedTimeInSec());
 
 
-	time.start();
-
 	Eigen::VectorXd b = rhs + prev_sol_mass;
 
 	if (state.use_avg_pressure){
 		b[b.size()-1] = 0;
 	}
-	dirichlet_solve(*solver, stoke_stiffness, b, state.boundary_nodes, x, precond_num);
-	// solver->getInfo(solver_info);
-	time.stop();
-	stokes_solve_time = time.getElapsedTimeInSec();
-	logger().debug("\tStokes solve time {}s", time.getElapsedTimeInSec());
-	logger().debug("\tStokes solver error: {}", (stoke_stiffness * x - b).norm());
+
+	//an extrapolated guess close enough to the solution replaces the Stokes solve
+	bool skip_stokes = false;
+	if (stokes_skip_tol > 0 && x.size() == b.size())
+	{
+		for (int i : state.boundary_nodes)
+			x[i] = b[i];
+
+		Eigen::VectorXd b_free = b;
+		for (int i : state.boundary_nodes)
+			b_free[i] = 0;
+
+		const double res = residual_norm(state, velocity_stiffness, mixed_stiffness, pressure_stiffness, velocity_mass, b, x);
+		skip_stokes = res <= stokes_skip_tol * b_free.norm();
+		logger().debug("\tinitial guess residual {}, Stokes solve {}", res, skip_stokes ? "skipped" : "needed");
+	}
+
+	if (!saddle_point_solver)
+		saddle_point_solver = SaddlePointSolver::create(state);
+	if (saddle_point_solver)
+		saddle_point_solver->set_mass_coefficient(alpha / dt);
+
+	stokes_solve_time = 0;
+	if (!skip_stokes)
+	{
+		time.start();
+		if (saddle_point_solver)
+			saddle_point_solver->solve_blocks(velocity_stiffness + velocity_mass, mixed_stiffness, pressure_stiffness, state.use_avg_pressure, true, b, state.boundary_nodes, x);
+		else
+			dirichlet_solve(*solver, stoke_stiffness, b, state.boundary_nodes, x, precond_num);
+		// solver->getInfo(solver_info);
+		time.stop();
+		stokes_solve_time = time.getElapsedTimeInSec();
+		logger().debug("\tStokes solve time {}s", time.getElapsedTimeInSec());
+		logger().debug("\tStokes solver error: {}", (stoke_stiffness * x - b).norm());
+	}
 	// return;
 
 	assembly_time = 0;
@@ -101,10 +131,35 @@ void TransientNavierStokesSolver::minimize(
 	solver_info["time_inverting"] = inverting_time;
 	solver_info["time_stokes_assembly"] = stokes_matrix_time;
 	solver_info["time_stokes_solve"] = stokes_solve_time;
+	solver_info["stokes_skipped"] = skip_stokes;
 
 	polyfem::logger().info("finished with niter: {},  ||g||_2 = {}", it, nlres_norm);
 }
 
+double TransientNavierStokesSolver::residual_norm(const State &state,
+												  const StiffnessMatrix &velocity_stiffness, const StiffnessMatrix &mixed_stiffness, const StiffnessMatrix &pressure_stiffness,
+												  const StiffnessMatrix &velocity_mass,
+												  const Eigen::VectorXd &rhs, const Eigen::VectorXd &x)
+{
+	const auto &assembler = AssemblerUtils::instance();
+	const auto &gbases = state.iso_parametric() ? state.bases : state.geom_bases;
+	const int problem_dim = state.problem->is_scalar() ? 1 : state.mesh->dimension();
+
+	StiffnessMatrix nl_matrix;
+	StiffnessMatrix total_matrix;
+
+	assembler.assemble_energy_hessian(state.formulation() + "Picard", state.mesh->is_volume(), state.n_bases, state.bases, gbases, x, nl_matrix, &state.dof_map, &colorings_);
+	AssemblerUtils::merge_mixed_matrices(state.n_bases, state.n_pressure_bases, problem_dim, state.use_avg_pressure,
+										 (velocity_stiffness + nl_matrix) + velocity_mass, mixed_stiffness, pressure_stiffness,
+										 total_matrix);
+
+	Eigen::VectorXd nlres = -(total_matrix * x) + rhs;
+	for (int i : state.boundary_nodes)
+		nlres[i] = 0;
+
+	return nlres.norm();
+}
+
 int TransientNavierStokesSolver::minimize_aux(
 	const std::string &formulation, const State &state, const double dt,
 	const StiffnessMatrix &velocity_stiffness, const StiffnessMatrix &mixed_stiffness, const StiffnessMatrix &pressure_stiffness,
@@ -124,7 +179,7 @@ int TransientNavierStokesSolver::minimize_aux(
 
 
 	time.start();
-	assembler.assemble_energy_hessian(state.formulation() + "Picard", state.mesh->is_volume(), state.n_bases, state.bases, gbases, x, nl_matrix);
+	assembler.assemble_energy_hessian(state.formulation() + "Picard", state.mesh->is_volume(), state.n_bases, state.bases, gbases, x, nl_matrix, &state.dof_map, &colorings_);
 	AssemblerUtils::merge_mixed_matrices(state.n_bases, state.n_pressure_bases, problem_dim, state.use_avg_pressure,
 										 (velocity_stiffness + nl_matrix) + velocity_mass, mixed_stiffness, pressure_stiffness,
 										 total_matrix);
@@ -148,12 +203,15 @@ int TransientNavierStokesSolver::minimize_aux(
 
 		time.start();
 		if (formulation != state.formulation() + "Picard"){
-			assembler.assemble_energy_hessian(formulation, state.mesh->is_volume(), state.n_bases, state.bases, gbases, x, nl_matrix);
+			assembler.assemble_energy_hessian(formulation, state.mesh->is_volume(), state.n_bases, state.bases, gbases, x, nl_matrix, &state.dof_map, &colorings_);
 			AssemblerUtils::merge_mixed_matrices(state.n_bases, state.n_pressure_bases, problem_dim, state.use_avg_pressure,
 												 (velocity_stiffness + nl_matrix) + velocity_mass, mixed_stiffness, pressure_stiffness,
 												 total_matrix);
 		}
-		dirichlet_solve(*solver, total_matrix, nlres, state.boundary_nodes, dx, precond_num);
+		if (saddle_point_solver)
+			saddle_point_solver->solve_blocks((velocity_stiffness + nl_matrix) + velocity_mass, mixed_stiffness, pressure_stiffness, state.use_avg_pressure, false, nlres, state.boundary_nodes, dx);
+		else
+			dirichlet_solve(*solver, total_matrix, nlres, state.boundary_nodes, dx, precond_num);
 		// for (int i : state.boundary_nodes)
 		// 	dx[i] = 0;
 		time.stop();
@@ -164,7 +222,7 @@ int TransientNavierStokesSolver::minimize_aux(
 		//TODO check for nans
 
 		time.start();
-		assembler.assemble_energy_hessian(state.formulation() + "Picard", state.mesh->is_volume(), state.n_bases, state.bases, gbases, x, nl_matrix);
+		assembler.assemble_energy_hessian(state.formulation() + "Picard", state.mesh->is_volume(), state.n_bases, state.bases, gbases, x, nl_matrix, &state.dof_map, &colorings_);
 		AssemblerUtils::merge_mixed_matrices(state.n_bases, state.n_pressure_bases, problem_dim, state.use_avg_pressure,
 											 (velocity_stiffness + nl_matrix) + velocity_mass, mixed_stiffness, pressure_stiffness,
 											 total_matrix);
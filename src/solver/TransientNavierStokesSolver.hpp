@@ -2,6 +2,7 @@
 
 #include <polyfem/Common.hpp>
 #include <polyfem/State.hpp>
+#include <polyfem/SaddlePointSolver.hpp>
 
 #include <polysolve/LinearSolver.hpp>
 
@@ -28,6 +29,9 @@ public:
 
 	int error_code() const { return 0; }
 
+	//the Stokes solve is skipped when the initial x has a relative residual below tol (0 always solves)
+	void set_stokes_skip_tol(const double tol) { stokes_skip_tol = tol; }
+
 private:
 	int minimize_aux(const std::string &formulation, const State &state, const double dt,
 					 const StiffnessMatrix &velocity_stiffness, const StiffnessMatrix &mixed_stiffness, const StiffnessMatrix &pressure_stiffness,
@@ -36,18 +40,29 @@ private:
 					 std::unique_ptr<polysolve::LinearSolver> &solver, double &nlres_norm,
 					 Eigen::VectorXd &x);
 
+	double residual_norm(const State &state,
+						 const StiffnessMatrix &velocity_stiffness, const StiffnessMatrix &mixed_stiffness, const StiffnessMatrix &pressure_stiffness,
+						 const StiffnessMatrix &velocity_mass,
+						 const Eigen::VectorXd &rhs, const Eigen::VectorXd &x);
+
 	const json solver_param;
 	const std::string solver_type;
 	const std::string precond_type;
 
 	double gradNorm;
 	int iterations;
+	double stokes_skip_tol;
 
 	json solver_info;
 	json problem_params;
 
 	json internal_solver = json::array();
 
+	//block solver of the mixed systems, nullptr uses the direct solve of the merged matrix
+	std::unique_ptr<SaddlePointSolver> saddle_point_solver;
+	//colorings of the dof maps of the state, for the colored assemblies of the Picard and Newton iterations
+	ColoredAssemblyCache colorings_;
+
 	double assembly_time;
 	double inverting_time;
 	double stokes_matrix_time;
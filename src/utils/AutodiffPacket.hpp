@@ -0,0 +1,213 @@
+#pragma once
+
+#include <Eigen/Core>
+
+#include <cmath>
+#include <type_traits>
+
+#ifndef POLYFEM_AUTODIFF_LANES
+#ifdef __AVX512F__
+#define POLYFEM_AUTODIFF_LANES 8
+#else
+#define POLYFEM_AUTODIFF_LANES 4
+#endif
+#endif
+
+namespace polyfem
+{
+	constexpr int AUTODIFF_LANES = POLYFEM_AUTODIFF_LANES;
+
+	//Forward mode autodiff on N variables, evaluated on AUTODIFF_LANES independent points at once (one quadrature
+	//point per lane). The value and every derivative is a fixed size Eigen array of the lanes, so all the operations
+	//are packet operations (4 doubles in an AVX register, 8 with AVX-512) without branches on the variable count.
+	//Order 1 only propagates the gradient, order 2 also the (full, symmetric) hessian stored as N*N columns.
+	template<int N, int Order>
+	class DPacket
+	{
+	public:
+		typedef Eigen::Array<double, AUTODIFF_LANES, 1> Lanes;
+		typedef Eigen::Array<double, AUTODIFF_LANES, N> Gradient;
+		typedef Eigen::Array<double, AUTODIFF_LANES, Order == 2 ? N * N : 0> Hessian;
+
+		EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+		//constant
+		explicit DPacket(const double value_ = 0)
+			: value(Lanes::Constant(value_))
+		{
+			grad.setZero();
+			hess.setZero();
+		}
+
+		explicit DPacket(const Lanes &value_)
+			: value(value_)
+		{
+			grad.setZero();
+			hess.setZero();
+		}
+
+		//variable index, with the given value in every lane
+		DPacket(const int index, const Lanes &value_)
+			: value(value_)
+		{
+			grad.setZero();
+			grad.col(index).setOnes();
+			hess.setZero();
+		}
+
+		inline const Lanes &getValue() const { return value; }
+		inline const Gradient &getGradient() const { return grad; }
+		inline const Hessian &getHessian() const { return hess; }
+
+		//derivatives of the lane l
+		Eigen::Matrix<double, N, 1> gradient(const int l) const { return grad.row(l).transpose(); }
+		Eigen::Matrix<double, N, N> hessian(const int l) const
+		{
+			static_assert(Order == 2, "hessian of a first order DPacket");
+			return Eigen::Map<const Eigen::Matrix<double, N, N>, 0, Eigen::InnerStride<AUTODIFF_LANES>>(hess.data() + l);
+		}
+
+		inline DPacket &operator+=(const DPacket &s)
+		{
+			value += s.value;
+			grad += s.grad;
+			hess += s.hess;
+			return *this;
+		}
+
+		inline DPacket &operator-=(const DPacket &s)
+		{
+			value -= s.value;
+			grad -= s.grad;
+			hess -= s.hess;
+			return *this;
+		}
+
+		inline DPacket &operator*=(const DPacket &s)
+		{
+			*this = *this * s;
+			return *this;
+		}
+
+		inline DPacket &operator+=(const double v)
+		{
+			value += v;
+			return *this;
+		}
+
+		inline DPacket &operator-=(const double v)
+		{
+			value -= v;
+			return *this;
+		}
+
+		inline DPacket &operator*=(const double v)
+		{
+			value *= v;
+			grad *= v;
+			hess *= v;
+			return *this;
+		}
+
+		friend DPacket operator+(DPacket lhs, const DPacket &rhs) { return lhs += rhs; }
+		friend DPacket operator+(DPacket lhs, const double rhs) { return lhs += rhs; }
+		friend DPacket operator+(const double lhs, DPacket rhs) { return rhs += lhs; }
+
+		friend DPacket operator-(DPacket lhs, const DPacket &rhs) { return lhs -= rhs; }
+		friend DPacket operator-(DPacket lhs, const double rhs) { return lhs -= rhs; }
+		friend DPacket operator-(const double lhs, const DPacket &rhs) { return (-rhs) += lhs; }
+		friend DPacket operator-(DPacket s)
+		{
+			s.value = -s.value;
+			s.grad = -s.grad;
+			s.hess = -s.hess;
+			return s;
+		}
+
+		friend DPacket operator*(DPacket lhs, const double rhs) { return lhs *= rhs; }
+		friend DPacket operator*(const double lhs, DPacket rhs) { return rhs *= lhs; }
+		friend DPacket operator*(const DPacket &lhs, const DPacket &rhs)
+		{
+			DPacket res(lhs.value * rhs.value);
+			res.grad = lhs.grad.colwise() * rhs.value + rhs.grad.colwise() * lhs.value;
+
+			product_hessian(lhs, rhs, res, HasHessian());
+			return res;
+		}
+
+		friend DPacket operator/(DPacket lhs, const double rhs) { return lhs *= 1. / rhs; }
+		friend DPacket operator/(const double lhs, const DPacket &rhs) { return inverse(rhs) *= lhs; }
+		friend DPacket operator/(const DPacket &lhs, const DPacket &rhs) { return lhs * inverse(rhs); }
+
+		friend DPacket inverse(const DPacket &s)
+		{
+			const Lanes inv = s.value.inverse();
+			return chain(s, inv, -inv.square(), 2 * inv.cube());
+		}
+
+		friend DPacket sqrt(const DPacket &s)
+		{
+			const Lanes val = s.value.sqrt();
+			const Lanes d1 = 0.5 / val;
+			return chain(s, val, d1, -0.5 * d1 / s.value);
+		}
+
+		friend DPacket pow(const DPacket &s, const double a)
+		{
+			const Lanes val = s.value.pow(a - 2);
+			return chain(s, val * s.value.square(), a * val * s.value, a * (a - 1) * val);
+		}
+
+		friend DPacket exp(const DPacket &s)
+		{
+			const Lanes val = s.value.exp();
+			return chain(s, val, val, val);
+		}
+
+		friend DPacket log(const DPacket &s)
+		{
+			const Lanes inv = s.value.inverse();
+			return chain(s, s.value.log(), inv, -inv.square());
+		}
+
+	private:
+		Lanes value;
+		Gradient grad;
+		Hessian hess;
+
+		//f(s) from the values f, f' and f'' of the lanes
+		static DPacket chain(const DPacket &s, const Lanes &f, const Lanes &d1, const Lanes &d2)
+		{
+			DPacket res(f);
+			res.grad = s.grad.colwise() * d1;
+
+			chain_hessian(s, d1, d2, res, HasHessian());
+			return res;
+		}
+
+		typedef std::integral_constant<bool, Order == 2> HasHessian;
+
+		static void product_hessian(const DPacket &lhs, const DPacket &rhs, DPacket &res, std::true_type)
+		{
+			res.hess = lhs.hess.colwise() * rhs.value + rhs.hess.colwise() * lhs.value;
+			for (int i = 0; i < N; ++i)
+			{
+				for (int j = 0; j < N; ++j)
+					res.hess.col(i * N + j) += lhs.grad.col(i) * rhs.grad.col(j) + lhs.grad.col(j) * rhs.grad.col(i);
+			}
+		}
+
+		static void chain_hessian(const DPacket &s, const Lanes &d1, const Lanes &d2, DPacket &res, std::true_type)
+		{
+			res.hess = s.hess.colwise() * d1;
+			for (int i = 0; i < N; ++i)
+			{
+				for (int j = 0; j < N; ++j)
+					res.hess.col(i * N + j) += d2 * s.grad.col(i) * s.grad.col(j);
+			}
+		}
+
+		static void product_hessian(const DPacket &, const DPacket &, DPacket &, std::false_type) {}
+		static void chain_hessian(const DPacket &, const Lanes &, const Lanes &, DPacket &, std::false_type) {}
+	};
+} // namespace polyfem
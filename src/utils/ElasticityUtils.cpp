@@ -243,7 +243,45 @@ namespace polyfem
 	}
 
 
-	double von_mises_stress_for_stress_tensor(const Eigen::MatrixXd &stress)
+	void compute_local_displacement(const int size, const ElementBases &bs, const Eigen::MatrixXd &displacement, Eigen::MatrixXd &local_displacement)
+	{
+		assert(displacement.cols() == 1);
+
+		local_displacement.resize(bs.bases.size(), size);
+		local_displacement.setZero();
+
+		for(std::size_t j = 0; j < bs.bases.size(); ++j)
+		{
+			const Basis &b = bs.bases[j];
+			for(std::size_t ii = 0; ii < b.global().size(); ++ii)
+			{
+				for(int d = 0; d < size; ++d)
+					local_displacement(j, d) += b.global()[ii].val * displacement(b.global()[ii].index*size + d);
+			}
+		}
+	}
+
+	void compute_diplacement_grad(const int size, const ElementAssemblyValues &vals, const Eigen::MatrixXd &local_displacement, const int p, StressMatrix &displacement_grad)
+	{
+		assert(local_displacement.rows() == int(vals.basis_values.size()));
+		assert(local_displacement.cols() == size);
+
+		StressMatrix grad(size, size);
+		grad.setZero();
+
+		for(std::size_t j = 0; j < vals.basis_values.size(); ++j)
+		{
+			const auto &loc_val = vals.basis_values[j];
+			assert(loc_val.grad.cols() == size);
+
+			for(int d = 0; d < size; ++d)
+				grad.row(d) += local_displacement(j, d) * loc_val.grad.row(p);
+		}
+
+		displacement_grad = grad * vals.jac_it[p];
+	}
+
+	double von_mises_stress_for_stress_tensor(const Eigen::Ref<const Eigen::MatrixXd> &stress)
 	{
 		double von_mises_stress;
 
@@ -485,32 +523,92 @@ namespace polyfem
 		return res;
 	}
 
+	double iflargerthanzerothenelse(double check, double ttrue, double ffalse)
+	{
+		return check >= 0 ? ttrue : ffalse;
+	}
+
+	LameParameters::ExpressionContext::~ExpressionContext()
+	{
+		te_free(lambda);
+		te_free(mu);
+	}
+
 	LameParameters::~LameParameters()
 	{
-		te_free(lambda_expr_);
-		te_free(mu_expr_);
-		delete vals_;
 	}
 
 	LameParameters::LameParameters()
 	{
-		lambda_expr_ = nullptr;
-		mu_expr_ = nullptr;
-		vals_ = new Internal();
 		initialized_ = false;
 	}
 
+	LameParameters::ExpressionContext &LameParameters::expression_context() const
+	{
+#ifdef POLYFEM_WITH_TBB
+		ExpressionContext &context = contexts_.local();
+#else
+		ExpressionContext &context = context_;
+#endif
+		if (!context.lambda)
+			compile(context);
+		return context;
+	}
+
+	bool LameParameters::compile(ExpressionContext &context) const
+	{
+		te_variable vars[4];
+		vars[0] = {"x", &context.x};
+		vars[1] = {"y", &context.y};
+		vars[2] = {"z", &context.z};
+		vars[3].name = "if";
+		vars[3].address = (void *)&iflargerthanzerothenelse;
+		vars[3].type = TE_FUNCTION3;
+
+		te_free(context.lambda);
+		te_free(context.mu);
+
+		int err;
+		context.lambda = te_compile(lambda_str_.c_str(), vars, 4, &err);
+		if (!context.lambda)
+		{
+			logger().error("Unable to parse {}, error, {}", lambda_str_, err);
+			assert(false);
+		}
+
+		context.mu = te_compile(mu_str_.c_str(), vars, 4, &err);
+		if (!context.mu)
+		{
+			logger().error("Unable to parse {}, error, {}", mu_str_, err);
+			assert(false);
+		}
+
+		return context.lambda && context.mu;
+	}
+
+	void LameParameters::set_expressions(const std::string &lambda, const std::string &mu)
+	{
+		lambda_str_ = lambda;
+		mu_str_ = mu;
+#ifdef POLYFEM_WITH_TBB
+		contexts_.clear();
+#endif
+
+		//reports the parsing errors once
+		compile(expression_context());
+	}
+
 	void LameParameters::lambda_mu(double x, double y, double z, int el_id, double &lambda, double &mu) const
 	{
-		if (lambda_expr_)
+		if (!lambda_str_.empty())
 		{
-			assert(mu_expr_);
-			vals_->x = x;
-			vals_->y = y;
-			vals_->z = z;
+			ExpressionContext &context = expression_context();
+			context.x = x;
+			context.y = y;
+			context.z = z;
 
-			double tmpl = te_eval(lambda_expr_);
-			double tmpm = te_eval(mu_expr_);
+			double tmpl = te_eval(context.lambda);
+			double tmpm = te_eval(context.mu);
 			if (!is_lambda_mu_)
 			{
 				lambda = convert_to_lambda(size_ == 3, tmpl, tmpm);
@@ -536,9 +634,61 @@ namespace polyfem
 		}
 	}
 
-	double iflargerthanzerothenelse(double check, double ttrue, double ffalse)
+	void LameParameters::lambda_mu(const ElementAssemblyValues &vals, const int p, double &lambda, double &mu) const
 	{
-		return check >= 0 ? ttrue : ffalse;
+		const int el_id = vals.element_id;
+		//vals computed at other points (e.g., for the stresses) evaluate the expressions
+		if (vals.at_quadrature && el_id >= 0 && el_id + 1 < int(field_offsets_.size()))
+		{
+			const int start = field_offsets_[el_id];
+			const int n_pts = field_offsets_[el_id + 1] - start;
+
+			//the field is stale if the bases changed after precompute
+			if (n_pts == vals.val.rows())
+			{
+				lambda = field_(start + p, 0);
+				mu = field_(start + p, 1);
+				return;
+			}
+		}
+
+		lambda_mu(vals.val(p, 0), vals.val(p, 1), vals.val.cols() == 2 ? 0. : vals.val(p, 2), el_id, lambda, mu);
+	}
+
+	void LameParameters::precompute(const bool is_volume, const std::vector<ElementBases> &bases, const std::vector<ElementBases> &gbases)
+	{
+		field_.resize(0, 2);
+		field_offsets_.clear();
+
+		if (lambda_str_.empty())
+			return;
+
+		field_offsets_.resize(bases.size() + 1);
+		field_offsets_[0] = 0;
+
+		//serial, the expressions share their variables
+		std::vector<double> lambdas, mus;
+		ElementAssemblyValues vals;
+		for (std::size_t e = 0; e < bases.size(); ++e)
+		{
+			vals.compute(e, is_volume, bases[e], gbases[e]);
+			field_offsets_[e + 1] = field_offsets_[e] + vals.val.rows();
+
+			for (long p = 0; p < vals.val.rows(); ++p)
+			{
+				double lambda, mu;
+				lambda_mu(vals.val(p, 0), vals.val(p, 1), vals.val.cols() == 2 ? 0. : vals.val(p, 2), e, lambda, mu);
+				lambdas.push_back(lambda);
+				mus.push_back(mu);
+			}
+		}
+
+		field_.resize(lambdas.size(), 2);
+		for (std::size_t i = 0; i < lambdas.size(); ++i)
+		{
+			field_(i, 0) = lambdas[i];
+			field_(i, 1) = mus[i];
+		}
 	}
 
 	void LameParameters::init_multimaterial(Eigen::MatrixXd &Es, Eigen::MatrixXd &nus)
@@ -560,10 +710,10 @@ namespace polyfem
 
 	void LameParameters::init(const json &params) {
 		size_ = params["size"];
-		te_free(lambda_expr_);
-		te_free(mu_expr_);
-		lambda_expr_ = nullptr;
-		mu_expr_ = nullptr;
+		field_.resize(0, 2);
+		field_offsets_.clear();
+		lambda_str_.clear();
+		mu_str_.clear();
 
 		if(initialized_)
 			return;
@@ -616,39 +766,11 @@ namespace polyfem
 			}
 			else
 			{
-				te_variable vars[4];
-				vars[0] = {"x", &vals_->x};
-				vars[1] = {"y", &vals_->y};
-				vars[2] = {"z", &vals_->z};
-				vars[3].name = "if";
-				vars[3].address = (void *)&iflargerthanzerothenelse;
-				vars[3].type = TE_FUNCTION3;
-
 				assert(params["lambda"].is_string());
 				assert(params["mu"].is_string());
 
-				const std::string lambdas = params["lambda"];
-				const std::string mus = params["mu"];
-
-				int err;
-				lambda_expr_ = te_compile(lambdas.c_str(), vars, 4, &err);
-				mu_expr_ = te_compile(mus.c_str(), vars, 4, &err);
-
 				is_lambda_mu_ = true;
-
-				if (!lambda_expr_)
-				{
-					logger().error("Unable to parse {}, error, {}", lambdas, err);
-
-					assert(false);
-				}
-
-				if (!mu_expr_)
-				{
-					logger().error("Unable to parse {}, error, {}", mus, err);
-
-					assert(false);
-				}
+				set_expressions(params["lambda"], params["mu"]);
 			}
 		}
 	}
@@ -700,39 +822,11 @@ namespace polyfem
 		}
 		else
 		{
-			te_variable vars[4];
-			vars[0] = {"x", &vals_->x};
-			vars[1] = {"y", &vals_->y};
-			vars[2] = {"z", &vals_->z};
-			vars[3].name = "if";
-			vars[3].address = (void *)&iflargerthanzerothenelse;
-			vars[3].type = TE_FUNCTION3;
-
 			assert(E.is_string());
 			assert(nu.is_string());
 
-			const std::string Es = E;
-			const std::string nus = nu;
-
-			int err;
-			lambda_expr_ = te_compile(Es.c_str(), vars, 4, &err);
-			mu_expr_ = te_compile(nus.c_str(), vars, 4, &err);
-
 			is_lambda_mu_ = false;
-
-			if (!lambda_expr_)
-			{
-				logger().error("Unable to parse {}, error, {}", Es, err);
-
-				assert(false);
-			}
-
-			if (!mu_expr_)
-			{
-				logger().error("Unable to parse {}, error, {}", nus, err);
-
-				assert(false);
-			}
+			set_expressions(E, nu);
 		}
 	}
 
@@ -4,6 +4,7 @@
 #include <polyfem/ElementAssemblyValues.hpp>
 #include <polyfem/ElementBases.hpp>
 #include <polyfem/AutodiffTypes.hpp>
+#include <polyfem/AutodiffPacket.hpp>
 #include <polyfem/Types.hpp>
 
 #include <Eigen/Dense>
@@ -11,6 +12,11 @@
 #include <vector>
 #include <array>
 #include <functional>
+#include <string>
+
+#ifdef POLYFEM_WITH_TBB
+#include <tbb/enumerable_thread_specific.h>
+#endif
 
 
 namespace polyfem
@@ -47,9 +53,157 @@ namespace polyfem
 		);
 
 
-	double von_mises_stress_for_stress_tensor(const Eigen::MatrixXd &stress);
+	//Lame parameters at the quadrature point p
+	typedef std::function<void(const int p, double &lambda, double &mu)> LameFunction;
+
+	//hessian += w B^T d2psi B for the lane l, with B the derivative of F w.r.t. the local dofs
+	template<int dim, typename T, typename GMat, typename BMat>
+	void add_density_hessian(const T &psi, const int l, const double w, const GMat &Gl, BMat &B, Eigen::MatrixXd &hessian, std::true_type)
+	{
+		for (int i = 0; i < Gl.rows(); ++i)
+		{
+			for (int d = 0; d < dim; ++d)
+			{
+				for (int c = 0; c < dim; ++c)
+					B(d + c * dim, i * dim + d) = Gl(i, c);
+			}
+		}
+
+		const Eigen::Matrix<double, dim * dim, dim * dim> d2psi = w * psi.hessian(l);
+		hessian.noalias() += B.transpose() * (d2psi * B);
+	}
+
+	template<int dim, typename T, typename GMat, typename BMat>
+	void add_density_hessian(const T &, const int, const double, const GMat &, BMat &, Eigen::MatrixXd &, std::false_type) {}
+
+	//implementation of gradient_from_density (order 1) and hessian_from_density (order 2)
+	template<int dim, int order, typename Density>
+	void derivatives_from_density(const ElementAssemblyValues &vals, const Eigen::MatrixXd &displacement, const QuadratureVector &da,
+		const LameFunction &lame, const Density &density, Eigen::VectorXd &grad, Eigen::MatrixXd *hessian)
+	{
+		constexpr int W = AUTODIFF_LANES;
+		constexpr int N = dim * dim;
+		typedef DPacket<N, order> T;
+		typedef Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic, 0, 3, 3> DefGrad;
+
+		assert(displacement.cols() == 1);
+
+		const int n_bases = int(vals.basis_values.size());
+		const int n_pts = int(da.size());
+
+		//displacement of the local bases, one row per basis
+		Eigen::MatrixXd local_disp = Eigen::MatrixXd::Zero(n_bases, dim);
+		for (int i = 0; i < n_bases; ++i)
+		{
+			for (const auto &g : vals.basis_values[i].global)
+			{
+				for (int d = 0; d < dim; ++d)
+					local_disp(i, d) += g.val * displacement(g.index * dim + d);
+			}
+		}
+
+		grad.setZero(n_bases * dim);
+		Eigen::MatrixXd grad_mat = Eigen::MatrixXd::Zero(n_bases, dim);
+		if (hessian)
+			hessian->setZero(n_bases * dim, n_bases * dim);
+
+		//physical gradients of the bases at the points of the lanes, F = I + local_disp^T G
+		Eigen::MatrixXd G(W * n_bases, dim);
+		Eigen::Matrix<double, N, Eigen::Dynamic> B;
+		if (hessian)
+			B.setZero(N, n_bases * dim);
+
+		for (int p0 = 0; p0 < n_pts; p0 += W)
+		{
+			typename T::Lanes lambda, mu, weights;
+			Eigen::Array<double, W, N> def_grad_lanes;
+
+			//the padding lanes evaluate the rest state with weight 0
+			for (int l = 0; l < W; ++l)
+			{
+				const int p = p0 + l;
+				Eigen::Matrix<double, dim, dim> def_grad = Eigen::Matrix<double, dim, dim>::Identity();
+				lambda(l) = mu(l) = weights(l) = 0;
+
+				if (p < n_pts)
+				{
+					for (int i = 0; i < n_bases; ++i)
+						G.row(l * n_bases + i) = vals.basis_values[i].grad.row(p) * vals.jac_it[p];
+
+					def_grad += local_disp.transpose() * G.middleRows(l * n_bases, n_bases);
+					lame(p, lambda(l), mu(l));
+					weights(l) = da(p);
+				}
+
+				def_grad_lanes.row(l) = Eigen::Map<const Eigen::Matrix<double, 1, N>>(def_grad.data());
+			}
+
+			DefGrad def_grad(dim, dim);
+			for (int k = 0; k < N; ++k)
+				def_grad(k) = T(k, def_grad_lanes.col(k));
+
+			const T psi = density(def_grad, T(lambda), T(mu));
+
+			//chain rule through the linear map from the local dofs (basis i, component d) to F(d, c)
+			for (int l = 0; l < W && p0 + l < n_pts; ++l)
+			{
+				const auto Gl = G.middleRows(l * n_bases, n_bases);
+				const Eigen::Matrix<double, N, 1> dpsi = weights(l) * psi.gradient(l);
+				grad_mat += Gl * Eigen::Map<const Eigen::Matrix<double, dim, dim>>(dpsi.data()).transpose();
+
+				if (hessian)
+					add_density_hessian<dim>(psi, l, weights(l), Gl, B, *hessian, std::integral_constant<bool, order == 2>());
+			}
+		}
+
+		for (int i = 0; i < n_bases; ++i)
+		{
+			for (int d = 0; d < dim; ++d)
+				grad(i * dim + d) = grad_mat(i, d);
+		}
+	}
+
+	//Vectorized backend of gradient_from_energy and hessian_from_energy for the energies \int psi(F, lambda, mu).
+	//The autodiff variables are the size^2 entries of the deformation gradient instead of the size * n_bases local dofs,
+	//every lane of DPacket is a quadrature point, and the chain rule through the linear map from the dofs to F gives
+	//the element gradient and hessian. density is called as density(def_grad, lambda, mu) with DPacket scalars, so a
+	//material only has to write its density as a template (usually a generic lambda).
+	template<typename Density>
+	Eigen::VectorXd gradient_from_density(const int size, const ElementAssemblyValues &vals, const Eigen::MatrixXd &displacement, const QuadratureVector &da,
+		const LameFunction &lame, const Density &density)
+	{
+		Eigen::VectorXd grad;
+		if (size == 2)
+			derivatives_from_density<2, 1>(vals, displacement, da, lame, density, grad, nullptr);
+		else
+			derivatives_from_density<3, 1>(vals, displacement, da, lame, density, grad, nullptr);
+		return grad;
+	}
+
+	template<typename Density>
+	Eigen::MatrixXd hessian_from_density(const int size, const ElementAssemblyValues &vals, const Eigen::MatrixXd &displacement, const QuadratureVector &da,
+		const LameFunction &lame, const Density &density)
+	{
+		Eigen::VectorXd grad;
+		Eigen::MatrixXd hessian;
+		if (size == 2)
+			derivatives_from_density<2, 2>(vals, displacement, da, lame, density, grad, &hessian);
+		else
+			derivatives_from_density<3, 2>(vals, displacement, da, lame, density, grad, &hessian);
+		return hessian;
+	}
+
+
+	//stress, strain, and displacement gradient at one point, on the stack
+	typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, 0, 3, 3> StressMatrix;
+
+	double von_mises_stress_for_stress_tensor(const Eigen::Ref<const Eigen::MatrixXd> &stress);
 	void compute_diplacement_grad(const int size, const ElementBases &bs, const ElementAssemblyValues &vals, const Eigen::MatrixXd &local_pts, const int p, const Eigen::MatrixXd &displacement, Eigen::MatrixXd &displacement_grad);
 
+	//batched version: the displacement of the element bases (one row per basis) is gathered once with compute_local_displacement
+	void compute_local_displacement(const int size, const ElementBases &bs, const Eigen::MatrixXd &displacement, Eigen::MatrixXd &local_displacement);
+	void compute_diplacement_grad(const int size, const ElementAssemblyValues &vals, const Eigen::MatrixXd &local_displacement, const int p, StressMatrix &displacement_grad);
+
 	double convert_to_lambda(const bool is_volume, const double E, const double nu);
 	double convert_to_mu(const double E, const double nu);
 
@@ -91,20 +245,48 @@ namespace polyfem
 			void init_multimaterial(Eigen::MatrixXd &Es, Eigen::MatrixXd &nus);
 
 			void lambda_mu(double x, double y, double z, int el_id, double &lambda, double &mu) const;
+			//lambda and mu at the p-th point of vals, reads the precomputed field when vals are at the quadrature points of the element (vals.at_quadrature)
+			void lambda_mu(const ElementAssemblyValues &vals, const int p, double &lambda, double &mu) const;
+
+			//evaluates the expressions once at the quadrature points of every element
+			//constant and per element parameters are already resolved and need no field
+			void precompute(const bool is_volume, const std::vector<ElementBases> &bases, const std::vector<ElementBases> &gbases);
+			inline bool has_precomputed() const { return !field_offsets_.empty(); }
 
 		private:
-			struct Internal
+			//tinyexpr reads the variables from the context of the expressions, every thread compiles its own copy
+			struct ExpressionContext
 			{
-				double x, y, z;
+				double x = 0, y = 0, z = 0;
+				te_expr *lambda = nullptr;
+				te_expr *mu = nullptr;
+
+				ExpressionContext() {}
+				ExpressionContext(const ExpressionContext &) {}
+				ExpressionContext &operator=(const ExpressionContext &) = delete;
+				~ExpressionContext();
 			};
 			void set_e_nu(const json &E, const json &nu);
+			void set_expressions(const std::string &lambda, const std::string &mu);
+			//context of the calling thread, compiled at the first use
+			ExpressionContext &expression_context() const;
+			bool compile(ExpressionContext &context) const;
 
 			int size_;
 			double lambda_ = 1, mu_ = 1;
 			Eigen::MatrixXd lambda_mat_, mu_mat_;
 
-			te_expr *lambda_expr_, *mu_expr_;
-			Internal *vals_;
+			//lambda and mu at the quadrature points, the points of element e are the rows field_offsets_[e] to field_offsets_[e+1]-1
+			Eigen::MatrixX2d field_;
+			std::vector<int> field_offsets_;
+
+			//lambda and mu expressions (E and nu if !is_lambda_mu_), empty if the parameters are not expressions
+			std::string lambda_str_, mu_str_;
+#ifdef POLYFEM_WITH_TBB
+			mutable tbb::enumerable_thread_specific<ExpressionContext> contexts_;
+#else
+			mutable ExpressionContext context_;
+#endif
 			bool is_lambda_mu_;
 			bool initialized_;
 	};
@@ -1,62 +1,132 @@
 #include <polyfem/InterpolatedFunction.hpp>
 
 #include <igl/in_element.h>
-#include <igl/barycentric_coordinates.h>
 
+#ifdef POLYFEM_WITH_TBB
+#include <tbb/parallel_for.h>
+#endif
+
+#include <cstring>
 #include <iostream>
 
 namespace polyfem
 {
-InterpolatedFunction2d::InterpolatedFunction2d(const Eigen::MatrixXd &fun, const Eigen::MatrixXd &pts, const Eigen::MatrixXi &tris)
+template <int DIM>
+InterpolatedFunction<DIM>::InterpolatedFunction(const Eigen::MatrixXd &fun, const Eigen::MatrixXd &pts, const Eigen::MatrixXi &elements)
 {
-	init(fun, pts, tris);
+	init(fun, pts, elements);
 }
 
-void InterpolatedFunction2d::init(const Eigen::MatrixXd &fun, const Eigen::MatrixXd &pts, const Eigen::MatrixXi &tris)
+template <int DIM>
+void InterpolatedFunction<DIM>::init(const Eigen::MatrixXd &fun, const Eigen::MatrixXd &pts, const Eigen::MatrixXi &elements)
 {
-	assert(pts.cols() == 2);
+	assert(pts.cols() == DIM);
 	assert(pts.rows() == fun.rows());
-	assert(tris.cols() == 3);
+	assert(elements.cols() == DIM + 1);
 
 	fun_ = fun;
 	pts_ = pts;
-	tris_ = tris;
+	elements_ = elements;
+
+	tree_.init(pts_, elements_);
+
+	inverse_maps_.resize(elements_.rows());
+	for (long e = 0; e < elements_.rows(); ++e)
+	{
+		Eigen::Matrix<double, DIM, DIM> map;
+		for (int d = 0; d < DIM; ++d)
+			map.col(d) = (pts_.row(elements_(e, d + 1)) - pts_.row(elements_(e, 0))).transpose();
+		inverse_maps_[e] = map.inverse();
+	}
+
+	cache_ = std::make_shared<LocationCache>();
+}
 
-	tree_.init(pts_, tris_);
+template <int DIM>
+void InterpolatedFunction<DIM>::set_function(const Eigen::MatrixXd &fun)
+{
+	assert(fun.rows() == pts_.rows());
+	fun_ = fun;
 }
 
-Eigen::MatrixXd InterpolatedFunction2d::interpolate(const Eigen::MatrixXd &pts) const
+template <int DIM>
+void InterpolatedFunction<DIM>::locate(const Eigen::MatrixXd &pts, PointLocation &location) const
 {
-	assert(pts.cols() == 2);
+	assert(pts.cols() == DIM);
 
-	Eigen::VectorXi I;
-	igl::in_element(pts_, tris_, pts, tree_, I);
+	igl::in_element(pts_, elements_, pts, tree_, location.elements);
+	location.barycentric.resize(pts.rows(), DIM + 1);
 
-	Eigen::MatrixXd res(pts.rows(), fun_.cols());
-	res.setZero();
+	const auto barycentric = [&](const long i) {
+		const int index = location.elements(i);
+		if (index < 0)
+		{
+			location.barycentric.row(i).setZero();
+			return;
+		}
 
-	Eigen::MatrixXd bc;
+		const Eigen::Matrix<double, DIM, 1> x = (pts.row(i) - pts_.row(elements_(index, 0))).transpose();
+		const Eigen::Matrix<double, DIM, 1> l = inverse_maps_[index] * x;
+		location.barycentric(i, 0) = 1 - l.sum();
+		location.barycentric.row(i).template tail<DIM>() = l.transpose();
+	};
 
+#ifdef POLYFEM_WITH_TBB
+	tbb::parallel_for(tbb::blocked_range<long>(0, pts.rows()), [&](const tbb::blocked_range<long> &r) {
+		for (long i = r.begin(); i != r.end(); ++i)
+			barycentric(i);
+	});
+#else
 	for (long i = 0; i < pts.rows(); ++i)
-	{
-		const int index = I(i);
+		barycentric(i);
+#endif
+}
 
+template <int DIM>
+Eigen::MatrixXd InterpolatedFunction<DIM>::interpolate(const PointLocation &location) const
+{
+	Eigen::MatrixXd res(location.elements.size(), fun_.cols());
+
+	const auto evaluate = [&](const long i) {
+		const int index = location.elements(i);
+		res.row(i).setZero();
 		if (index < 0)
-		{
-			continue;
-		}
+			return;
 
-		const Eigen::MatrixXd pt = pts.row(i);
-		const Eigen::MatrixXd A = pts_.row(tris_(index, 0));
-		const Eigen::MatrixXd B = pts_.row(tris_(index, 1));
-		const Eigen::MatrixXd C = pts_.row(tris_(index, 2));
-		igl::barycentric_coordinates(pt, A, B, C, bc);
-		// std::cout<<pt<<"\tii:"<<index<<"\tr:"<<bc<<std::endl;
+		for (int j = 0; j <= DIM; ++j)
+			res.row(i) += fun_.row(elements_(index, j)) * location.barycentric(i, j);
+	};
 
-		for (int j = 0; j < 3; ++j)
-			res.row(i) += fun_.row(tris_(index, j)) * bc(j);
-	}
+#ifdef POLYFEM_WITH_TBB
+	tbb::parallel_for(tbb::blocked_range<long>(0, res.rows()), [&](const tbb::blocked_range<long> &r) {
+		for (long i = r.begin(); i != r.end(); ++i)
+			evaluate(i);
+	});
+#else
+	for (long i = 0; i < res.rows(); ++i)
+		evaluate(i);
+#endif
 
 	return res;
 }
-} // namespace polyfem
\ No newline at end of file
+
+template <int DIM>
+Eigen::MatrixXd InterpolatedFunction<DIM>::interpolate(const Eigen::MatrixXd &pts) const
+{
+	assert(pts.cols() == DIM);
+	assert(cache_);
+
+	std::lock_guard<std::mutex> lock(cache_->mutex);
+	const bool same_pts = cache_->pts.rows() == pts.rows() && cache_->pts.cols() == pts.cols() && (pts.size() == 0 || std::memcmp(cache_->pts.data(), pts.data(), sizeof(double) * pts.size()) == 0);
+	if (!same_pts)
+	{
+		locate(pts, cache_->location);
+		cache_->pts = pts;
+	}
+
+	return interpolate(cache_->location);
+}
+
+template class InterpolatedFunction<2>;
+template class InterpolatedFunction<3>;
+} // namespace polyfem
@@ -4,21 +4,58 @@
 
 #include <Eigen/Dense>
 
+#include <memory>
+#include <mutex>
+#include <vector>
+
 namespace polyfem
 {
-class InterpolatedFunction2d
+//Piecewise linear interpolation of a function given at the vertices of a triangle (DIM=2) or tet (DIM=3) mesh.
+//Points outside of the mesh get 0.
+template <int DIM>
+class InterpolatedFunction
 {
 public:
-	InterpolatedFunction2d() {}
-	InterpolatedFunction2d(const Eigen::MatrixXd &fun, const Eigen::MatrixXd &pts, const Eigen::MatrixXi &tris);
-	void init(const Eigen::MatrixXd &fun, const Eigen::MatrixXd &pts, const Eigen::MatrixXi &tris);
+	//element containing each point (-1 outside) and its barycentric coordinates
+	struct PointLocation
+	{
+		Eigen::VectorXi elements;
+		Eigen::Matrix<double, Eigen::Dynamic, DIM + 1> barycentric;
+	};
+
+	InterpolatedFunction() {}
+	InterpolatedFunction(const Eigen::MatrixXd &fun, const Eigen::MatrixXd &pts, const Eigen::MatrixXi &elements);
+	void init(const Eigen::MatrixXd &fun, const Eigen::MatrixXd &pts, const Eigen::MatrixXi &elements);
+
+	//changes the values at the vertices, the mesh (and the cached locations) are kept
+	void set_function(const Eigen::MatrixXd &fun);
+
+	void locate(const Eigen::MatrixXd &pts, PointLocation &location) const;
+	Eigen::MatrixXd interpolate(const PointLocation &location) const;
 
+	//the location of the last queried points is cached, repeated queries at the same points skip the point location
 	Eigen::MatrixXd interpolate(const Eigen::MatrixXd &pts) const;
 
 private:
-	igl::AABB<Eigen::MatrixXd, 2> tree_;
+	igl::AABB<Eigen::MatrixXd, DIM> tree_;
 	Eigen::MatrixXd fun_;
 	Eigen::MatrixXd pts_;
-	Eigen::MatrixXi tris_;
+	Eigen::MatrixXi elements_;
+
+	//per element inverse of the affine map [v1-v0, ..., vd-v0], the barycentric coordinates of x are
+	//l = inv * (x - v0), l0 = 1 - sum(l)
+	std::vector<Eigen::Matrix<double, DIM, DIM>, Eigen::aligned_allocator<Eigen::Matrix<double, DIM, DIM>>> inverse_maps_;
+
+	//shared pointer to keep the class copyable, a new cache is created by init
+	struct LocationCache
+	{
+		std::mutex mutex;
+		Eigen::MatrixXd pts;
+		PointLocation location;
+	};
+	std::shared_ptr<LocationCache> cache_;
 };
+
+typedef InterpolatedFunction<2> InterpolatedFunction2d;
+typedef InterpolatedFunction<3> InterpolatedFunction3d;
 } // namespace polyfem
@@ -0,0 +1,112 @@
+#include "KdTree.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+namespace polyfem
+{
+	KdTree::KdTree(const Eigen::MatrixXd &pts, const int leaf_size)
+	{
+		init(pts, leaf_size);
+	}
+
+	void KdTree::init(const Eigen::MatrixXd &pts, const int leaf_size)
+	{
+		assert(leaf_size > 0);
+		pts_ = pts;
+		leaf_size_ = leaf_size;
+		index_.resize(pts_.rows());
+		std::iota(index_.begin(), index_.end(), 0);
+
+		nodes_.clear();
+		nodes_.reserve(2 * (pts_.rows() / leaf_size_ + 1));
+		depth_ = 0;
+		if (pts_.rows() > 0)
+			build(0, int(pts_.rows()), 0);
+		assert(depth_ <= max_depth);
+	}
+
+	int KdTree::build(const int begin, const int end, const int depth)
+	{
+		depth_ = std::max(depth_, depth);
+		const int id = int(nodes_.size());
+		nodes_.emplace_back();
+		nodes_[id].begin = begin;
+		nodes_[id].end = end;
+
+		if (end - begin <= leaf_size_)
+			return id;
+
+		//split at the median of the widest axis
+		Eigen::RowVectorXd min_p = pts_.row(index_[begin]);
+		Eigen::RowVectorXd max_p = min_p;
+		for (int i = begin + 1; i < end; ++i)
+		{
+			min_p = min_p.cwiseMin(pts_.row(index_[i]));
+			max_p = max_p.cwiseMax(pts_.row(index_[i]));
+		}
+		int axis;
+		if ((max_p - min_p).maxCoeff(&axis) <= 0)
+			return id;
+
+		const int mid = (begin + end) / 2;
+		std::nth_element(index_.begin() + begin, index_.begin() + mid, index_.begin() + end, [&](int a, int b) { return pts_(a, axis) < pts_(b, axis); });
+
+		//the recursion reorders index_ and can reallocate nodes_
+		const double split = pts_(index_[mid], axis);
+		const int left = build(begin, mid, depth + 1);
+		const int right = build(mid, end, depth + 1);
+		nodes_[id].axis = axis;
+		nodes_[id].split = split;
+		nodes_[id].left = left;
+		nodes_[id].right = right;
+
+		return id;
+	}
+
+	void KdTree::leaves(std::vector<std::vector<int>> &res) const
+	{
+		res.clear();
+		for (const Node &node : nodes_)
+		{
+			if (node.axis < 0)
+				res.emplace_back(index_.begin() + node.begin, index_.begin() + node.end);
+		}
+	}
+
+	void KdTree::radius_search(const Eigen::RowVectorXd &p, const double radius, std::vector<int> &res) const
+	{
+		assert(p.size() == pts_.cols());
+		res.clear();
+		if (nodes_.empty())
+			return;
+
+		const double radius2 = radius * radius;
+		//depth first, the stack holds at most one pending node per level and the current one
+		int stack[max_depth + 1];
+		int stack_size = 0;
+		stack[stack_size++] = 0;
+
+		while (stack_size > 0)
+		{
+			const Node &node = nodes_[stack[--stack_size]];
+			if (node.axis < 0)
+			{
+				for (int i = node.begin; i < node.end; ++i)
+				{
+					if ((pts_.row(index_[i]) - p).squaredNorm() <= radius2)
+						res.push_back(index_[i]);
+				}
+				continue;
+			}
+
+			//left has the points with coordinate <= split, right the ones >= split
+			const double delta = p(node.axis) - node.split;
+			assert(stack_size + 2 <= max_depth + 1);
+			if (delta <= radius)
+				stack[stack_size++] = node.left;
+			if (delta >= -radius)
+				stack[stack_size++] = node.right;
+		}
+	}
+} // namespace polyfem
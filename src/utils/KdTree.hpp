@@ -0,0 +1,46 @@
+#pragma once
+
+#include <Eigen/Dense>
+
+#include <vector>
+
+namespace polyfem
+{
+	//static k-d tree over a point cloud (one point per row), for fixed radius searches
+	class KdTree
+	{
+	public:
+		KdTree() {}
+		explicit KdTree(const Eigen::MatrixXd &pts, const int leaf_size = 16);
+		void init(const Eigen::MatrixXd &pts, const int leaf_size = 16);
+
+		//indices of the points at distance at most radius from p, unsorted
+		void radius_search(const Eigen::RowVectorXd &p, const double radius, std::vector<int> &res) const;
+
+		//the points of each leaf, the leaves partition the points in groups of at most leaf_size spatially close points
+		void leaves(std::vector<std::vector<int>> &res) const;
+
+		int size() const { return int(pts_.rows()); }
+		const Eigen::MatrixXd &points() const { return pts_; }
+
+	private:
+		struct Node
+		{
+			int begin, end;
+			int axis = -1; //-1 for leaves
+			double split = 0;
+			int left = -1, right = -1;
+		};
+
+		//the splits are at the median, the depth is at most log2(#points) + 1
+		static const int max_depth = 64;
+
+		Eigen::MatrixXd pts_;
+		int leaf_size_ = 16;
+		int depth_ = 0;
+		std::vector<int> index_;
+		std::vector<Node> nodes_;
+
+		int build(const int begin, const int end, const int depth);
+	};
+} // namespace polyfem
@@ -0,0 +1,133 @@
+#include <polyfem/MemoryTracker.hpp>
+
+#include <algorithm>
+
+extern "C" size_t getPeakRSS();
+extern "C" size_t getCurrentRSS();
+
+namespace polyfem
+{
+	MemoryTracker &MemoryTracker::instance()
+	{
+		static MemoryTracker instance;
+		return instance;
+	}
+
+	size_t MemoryTracker::current_rss()
+	{
+		return getCurrentRSS();
+	}
+
+	size_t MemoryTracker::peak_rss()
+	{
+		//the current RSS can be more recent than the peak on some systems
+		return std::max(getPeakRSS(), getCurrentRSS());
+	}
+
+	void MemoryTracker::set_bytes(const std::string &subsystem, const size_t bytes)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		for (auto &s : subsystems_)
+		{
+			if (s.name == subsystem)
+			{
+				s.bytes = bytes;
+				s.peak_bytes = std::max(s.peak_bytes, bytes);
+				return;
+			}
+		}
+
+		subsystems_.push_back({subsystem, bytes, bytes});
+	}
+
+	void MemoryTracker::reset()
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		subsystems_.clear();
+		phases_.clear();
+	}
+
+	json MemoryTracker::summary() const
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		json res;
+		res["subsystems"] = json::array();
+		for (const auto &s : subsystems_)
+			res["subsystems"].push_back({{"name", s.name}, {"bytes", s.bytes}, {"peak_bytes", s.peak_bytes}});
+
+		res["phases"] = json::array();
+		for (const auto &p : phases_)
+		{
+			res["phases"].push_back({{"name", p.name},
+									 {"count", p.count},
+									 {"rss_begin", p.rss_begin},
+									 {"rss_end", p.rss_end},
+									 {"max_rss_increase", p.max_rss_increase},
+									 {"peak_rss", p.peak_rss},
+									 {"peak_increase", p.peak_increase}});
+		}
+
+		res["current_rss"] = current_rss();
+		res["peak_rss"] = peak_rss();
+
+		return res;
+	}
+
+	int MemoryTracker::begin_phase(const std::string &name)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		for (size_t i = 0; i < phases_.size(); ++i)
+		{
+			if (phases_[i].name == name)
+				return int(i);
+		}
+
+		phases_.push_back({name, 0, 0, 0, 0, 0, 0});
+		return int(phases_.size()) - 1;
+	}
+
+	long MemoryTracker::end_phase(const int phase, const size_t rss_begin, const size_t peak_begin)
+	{
+		const size_t rss = current_rss();
+		const size_t peak = std::max(peak_rss(), peak_begin);
+		const long increase = long(rss) - long(rss_begin);
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		//reset while the phase was open
+		if (phase < 0 || phase >= int(phases_.size()))
+			return increase;
+
+		Phase &p = phases_[phase];
+		p.max_rss_increase = p.count == 0 ? increase : std::max(p.max_rss_increase, increase);
+		++p.count;
+		p.rss_begin = rss_begin;
+		p.rss_end = rss;
+		p.peak_rss = std::max(p.peak_rss, peak);
+		p.peak_increase = std::max(p.peak_increase, peak - peak_begin);
+
+		return increase;
+	}
+
+	ScopedMemoryPhase::ScopedMemoryPhase(const std::string &name)
+		: phase_(MemoryTracker::instance().begin_phase(name))
+	{
+		rss_begin_ = MemoryTracker::current_rss();
+		peak_begin_ = MemoryTracker::peak_rss();
+	}
+
+	ScopedMemoryPhase::~ScopedMemoryPhase()
+	{
+		stop();
+	}
+
+	long ScopedMemoryPhase::stop()
+	{
+		if (phase_ < 0)
+			return 0;
+
+		const long res = MemoryTracker::instance().end_phase(phase_, rss_begin_, peak_begin_);
+		phase_ = -1;
+		return res;
+	}
+} // namespace polyfem
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <polyfem/Common.hpp>
+
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace polyfem
+{
+	//Memory accounting: bytes held by each subsystem (with their high water marks) and resident set size
+	//samples at the boundaries of the phases. The peak RSS of the process is monotonic, the peak of a
+	//phase is the process peak when it ends, a phase raised it if peak_increase is positive.
+	//Phases with the same name (e.g., the linear solve of each Newton iteration) share one entry.
+	class MemoryTracker
+	{
+	public:
+		static MemoryTracker &instance();
+
+		static size_t current_rss();
+		static size_t peak_rss();
+
+		//sets the current size of a subsystem, its high water mark is kept
+		void set_bytes(const std::string &subsystem, const size_t bytes);
+		void reset();
+
+		//{subsystems: [{name, bytes, peak_bytes}], phases: [{name, count, rss_begin, rss_end, max_rss_increase, peak_rss, peak_increase}], current_rss, peak_rss}
+		//rss_begin and rss_end are the ones of the last run of the phase, the others are maxima over all runs
+		json summary() const;
+
+		//used by ScopedMemoryPhase, phases can nest and are reported in the order they first started
+		int begin_phase(const std::string &name);
+		//difference of RSS between the end and the beginning of the phase, in bytes
+		long end_phase(const int phase, const size_t rss_begin, const size_t peak_begin);
+
+	private:
+		MemoryTracker() {}
+
+		struct Subsystem
+		{
+			std::string name;
+			size_t bytes, peak_bytes;
+		};
+
+		struct Phase
+		{
+			std::string name;
+			int count;
+			size_t rss_begin, rss_end;
+			long max_rss_increase;
+			size_t peak_rss, peak_increase;
+		};
+
+		mutable std::mutex mutex_;
+		std::vector<Subsystem> subsystems_;
+		std::vector<Phase> phases_;
+	};
+
+	//samples the RSS at the beginning and at the end of its scope
+	class ScopedMemoryPhase
+	{
+	public:
+		explicit ScopedMemoryPhase(const std::string &name);
+		~ScopedMemoryPhase();
+
+		//closes the phase early, returns its RSS difference in bytes
+		long stop();
+
+		POLYFEM_DELETE_MOVE_COPY(ScopedMemoryPhase)
+
+	private:
+		int phase_;
+		size_t rss_begin_, peak_begin_;
+	};
+
+	template <typename T>
+	size_t memory_bytes(const std::vector<T> &v)
+	{
+		return v.capacity() * sizeof(T);
+	}
+
+	template <typename Derived>
+	size_t memory_bytes(const Eigen::PlainObjectBase<Derived> &m)
+	{
+		return m.size() * sizeof(typename Derived::Scalar);
+	}
+
+	template <typename Scalar, int Options, typename Index>
+	size_t memory_bytes(const Eigen::SparseMatrix<Scalar, Options, Index> &m)
+	{
+		//values and inner indices, outer index, and inner non zeros when uncompressed
+		size_t res = m.data().allocatedSize() * (sizeof(Scalar) + sizeof(Index)) + (m.outerSize() + 1) * sizeof(Index);
+		if (!m.isCompressed())
+			res += m.outerSize() * sizeof(Index);
+		return res;
+	}
+} // namespace polyfem
@@ -0,0 +1,475 @@
+#include <polyfem/PointProbe.hpp>
+
+#include <polyfem/ElementAssemblyValues.hpp>
+#include <polyfem/Mesh2D.hpp>
+#include <polyfem/Mesh3D.hpp>
+#include <polyfem/Logger.hpp>
+
+#include <cmath>
+#include <limits>
+
+#ifdef POLYFEM_WITH_TBB
+#include <tbb/parallel_for.h>
+#endif
+
+namespace polyfem
+{
+	namespace
+	{
+		const int max_newton_iterations = 20;
+		//tolerance on the reference coordinates for the inside test
+		const double reference_tolerance = 1e-8;
+
+		bool inside_reference(const Eigen::RowVectorXd &uv, const bool is_simplex)
+		{
+			if (!uv.allFinite() || uv.minCoeff() < -reference_tolerance)
+				return false;
+			if (is_simplex)
+				return uv.sum() <= 1 + reference_tolerance;
+			return uv.maxCoeff() <= 1 + reference_tolerance;
+		}
+
+		//crossing number, the orientation of the polygon does not matter
+		bool inside_polygon(const Eigen::MatrixXd &poly, const Eigen::RowVectorXd &p)
+		{
+			bool inside = false;
+			for (int i = 0, j = int(poly.rows()) - 1; i < poly.rows(); j = i++)
+			{
+				const double yi = poly(i, 1), yj = poly(j, 1);
+				if ((yi > p(1)) != (yj > p(1)) && p(0) < (poly(j, 0) - poly(i, 0)) * (p(1) - yi) / (yj - yi) + poly(i, 0))
+					inside = !inside;
+			}
+
+			return inside;
+		}
+
+		//parity of the intersections of a ray with the triangles, the faces of a cell need not be oriented consistently
+		bool inside_polyhedron(const Eigen::MatrixXd &triangles, const Eigen::RowVectorXd &p)
+		{
+			//generic direction, not aligned with the faces of structured meshes
+			const Eigen::RowVector3d dir = Eigen::RowVector3d(0.5377, 0.6861, 0.4893).normalized();
+
+			bool inside = false;
+			for (int t = 0; t < triangles.rows(); t += 3)
+			{
+				const Eigen::RowVector3d a = triangles.row(t);
+				const Eigen::RowVector3d e1 = triangles.row(t + 1) - a;
+				const Eigen::RowVector3d e2 = triangles.row(t + 2) - a;
+
+				const Eigen::RowVector3d h = dir.cross(e2);
+				const double det = e1.dot(h);
+				if (std::abs(det) <= 1e-14 * e1.squaredNorm())
+					continue;
+
+				const Eigen::RowVector3d s = p - a;
+				const double u = s.dot(h) / det;
+				if (u < 0 || u > 1)
+					continue;
+				const Eigen::RowVector3d q = s.cross(e1);
+				const double v = dir.dot(q) / det;
+				if (v < 0 || u + v > 1)
+					continue;
+
+				if (e2.dot(q) / det > 0)
+					inside = !inside;
+			}
+
+			return inside;
+		}
+	} // namespace
+
+	void PointProbe::init(const Mesh &mesh, const std::vector<ElementBases> &bases, const std::vector<ElementBases> &gbases, const int n_bases)
+	{
+		mesh_ = &mesh;
+		bases_ = &bases;
+		gbases_ = &gbases;
+		n_bases_ = n_bases;
+		dim_ = mesh.dimension();
+
+		const int n_el = int(gbases.size());
+		box_min_.setConstant(n_el, dim_, std::numeric_limits<double>::max());
+		box_max_.setConstant(n_el, dim_, -std::numeric_limits<double>::max());
+
+		//straight boundary of the polytopes from the mesh
+		polytope_boundaries_.assign(n_el, Eigen::MatrixXd());
+		for (int e = 0; e < n_el; ++e)
+		{
+			if (gbases[e].has_parameterization || !mesh.is_polytope(e))
+				continue;
+
+			Eigen::MatrixXd &boundary = polytope_boundaries_[e];
+			if (const Mesh2D *mesh2d = dynamic_cast<const Mesh2D *>(&mesh))
+			{
+				boundary.resize(mesh2d->n_face_vertices(e), 2);
+				for (int lv = 0; lv < boundary.rows(); ++lv)
+					boundary.row(lv) = mesh2d->point(mesh2d->face_vertex(e, lv));
+			}
+			else if (const Mesh3D *mesh3d = dynamic_cast<const Mesh3D *>(&mesh))
+			{
+				//fan triangulation of the faces
+				int n_triangles = 0;
+				for (int lf = 0; lf < mesh3d->n_cell_faces(e); ++lf)
+					n_triangles += mesh3d->n_face_vertices(mesh3d->cell_face(e, lf)) - 2;
+
+				boundary.resize(3 * n_triangles, 3);
+				int index = 0;
+				for (int lf = 0; lf < mesh3d->n_cell_faces(e); ++lf)
+				{
+					const int f = mesh3d->cell_face(e, lf);
+					for (int lv = 1; lv + 1 < mesh3d->n_face_vertices(f); ++lv)
+					{
+						boundary.row(index++) = mesh3d->point(mesh3d->face_vertex(f, 0));
+						boundary.row(index++) = mesh3d->point(mesh3d->face_vertex(f, lv));
+						boundary.row(index++) = mesh3d->point(mesh3d->face_vertex(f, lv + 1));
+					}
+				}
+			}
+		}
+
+		//bounding boxes of the geometric nodes (of the boundary for the polytopes, their nodes have no position), enlarged for curved elements
+		double mean_extent = 0;
+		for (int e = 0; e < n_el; ++e)
+		{
+			if (polytope_boundaries_[e].size() > 0)
+			{
+				box_min_.row(e) = polytope_boundaries_[e].colwise().minCoeff();
+				box_max_.row(e) = polytope_boundaries_[e].colwise().maxCoeff();
+			}
+
+			for (const Basis &b : gbases[e].bases)
+			{
+				for (const auto &lg : b.global())
+				{
+					if (!lg.node.allFinite())
+						continue;
+					box_min_.row(e) = box_min_.row(e).cwiseMin(lg.node);
+					box_max_.row(e) = box_max_.row(e).cwiseMax(lg.node);
+				}
+			}
+			//no geometry, the element is never found
+			if ((box_min_.row(e).array() > box_max_.row(e).array()).any())
+				continue;
+
+			const double extent = (box_max_.row(e) - box_min_.row(e)).maxCoeff();
+			box_min_.row(e).array() -= 0.05 * extent;
+			box_max_.row(e).array() += 0.05 * extent;
+			mean_extent += extent;
+		}
+		if (n_el <= 0)
+			return;
+		mean_extent /= n_el;
+
+		grid_min_ = box_min_.colwise().minCoeff();
+		const Eigen::RowVectorXd grid_extent = box_max_.colwise().maxCoeff() - grid_min_;
+
+		//about one cell per element
+		cell_size_ = mean_extent > 0 ? mean_extent : 1;
+		grid_res_.resize(dim_);
+		while (true)
+		{
+			double n_cells = 1;
+			for (int d = 0; d < dim_; ++d)
+			{
+				grid_res_(d) = std::max(1, int(std::ceil(grid_extent(d) / cell_size_)));
+				n_cells *= grid_res_(d);
+			}
+			if (n_cells <= 8. * n_el + 1)
+				break;
+			cell_size_ *= 1.5;
+		}
+
+		const int n_cells = grid_res_.prod();
+		cell_offsets_.assign(n_cells + 1, 0);
+		const auto for_each_cell = [&](const int e, const std::function<void(const int)> &f) {
+			if ((box_min_.row(e).array() > box_max_.row(e).array()).any())
+				return;
+
+			Eigen::VectorXi from(dim_), to(dim_);
+			for (int d = 0; d < dim_; ++d)
+			{
+				from(d) = std::max(0, int(std::floor((box_min_(e, d) - grid_min_(d)) / cell_size_)));
+				to(d) = std::min(grid_res_(d) - 1, int(std::floor((box_max_(e, d) - grid_min_(d)) / cell_size_)));
+			}
+
+			for (int k = (dim_ == 3 ? from(2) : 0); k <= (dim_ == 3 ? to(2) : 0); ++k)
+			{
+				for (int j = from(1); j <= to(1); ++j)
+				{
+					for (int i = from(0); i <= to(0); ++i)
+						f(i + grid_res_(0) * (j + grid_res_(1) * k));
+				}
+			}
+		};
+
+		for (int e = 0; e < n_el; ++e)
+			for_each_cell(e, [&](const int c) { ++cell_offsets_[c + 1]; });
+		for (int c = 0; c < n_cells; ++c)
+			cell_offsets_[c + 1] += cell_offsets_[c];
+
+		//elements are added in increasing order in each cell
+		cell_elements_.resize(cell_offsets_.back());
+		std::vector<int> pos(cell_offsets_.begin(), cell_offsets_.end() - 1);
+		for (int e = 0; e < n_el; ++e)
+			for_each_cell(e, [&](const int c) { cell_elements_[pos[c]++] = e; });
+
+		pts_.resize(0, 0);
+		elements_.resize(0);
+		local_pts_.resize(0, 0);
+	}
+
+	bool PointProbe::inside_polytope(const int e, const Eigen::RowVectorXd &p) const
+	{
+		const Eigen::MatrixXd &boundary = polytope_boundaries_[e];
+		//no geometry, only the bounding box test
+		if (boundary.size() == 0)
+			return true;
+
+		return dim_ == 2 ? inside_polygon(boundary, p) : inside_polyhedron(boundary, p);
+	}
+
+	int PointProbe::cell_index(const Eigen::RowVectorXd &p) const
+	{
+		int index = 0;
+		for (int d = dim_ - 1; d >= 0; --d)
+		{
+			const double x = std::floor((p(d) - grid_min_(d)) / cell_size_);
+			if (!(x >= 0 && x < grid_res_(d)))
+				return -1;
+			index = index * grid_res_(d) + int(x);
+		}
+
+		return index;
+	}
+
+	void PointProbe::set_points(const Eigen::MatrixXd &pts)
+	{
+		assert(mesh_);
+		assert(pts.cols() == dim_);
+
+		if (pts.rows() == pts_.rows() && pts.cols() == pts_.cols() && pts == pts_)
+			return;
+
+		pts_ = pts;
+		locate();
+		build_operators();
+	}
+
+	void PointProbe::locate()
+	{
+		const int n_pts = int(pts_.rows());
+		const int n_el = int(gbases_->size());
+
+		//points whose box contains each element
+		std::vector<std::vector<int>> element_points(n_el);
+		for (int i = 0; i < n_pts; ++i)
+		{
+			const int c = cell_index(pts_.row(i));
+			if (c < 0)
+				continue;
+
+			for (int k = cell_offsets_[c]; k < cell_offsets_[c + 1]; ++k)
+			{
+				const int e = cell_elements_[k];
+				if ((pts_.row(i).array() >= box_min_.row(e).array()).all() && (pts_.row(i).array() <= box_max_.row(e).array()).all())
+					element_points[e].push_back(i);
+			}
+		}
+
+		//Newton on the geometric mapping, all the points of an element at once
+		std::vector<Eigen::MatrixXd> element_uv(n_el);
+		std::vector<std::vector<bool>> element_inside(n_el);
+		const auto invert = [&](const int e) {
+			const std::vector<int> &ids = element_points[e];
+			if (ids.empty())
+				return;
+
+			const ElementBases &gbs = (*gbases_)[e];
+			Eigen::MatrixXd target(ids.size(), dim_);
+			for (size_t k = 0; k < ids.size(); ++k)
+				target.row(k) = pts_.row(ids[k]);
+
+			Eigen::MatrixXd &uv = element_uv[e];
+			element_inside[e].assign(ids.size(), true);
+
+			//no parameterization, the mapping is the identity
+			if (!gbs.has_parameterization)
+			{
+				uv = target;
+				for (size_t k = 0; k < ids.size(); ++k)
+					element_inside[e][k] = inside_polytope(e, target.row(k));
+				return;
+			}
+
+			const bool is_simplex = mesh_->is_simplex(e);
+			uv.setConstant(ids.size(), dim_, is_simplex ? 1. / (dim_ + 1) : 0.5);
+			const double scale = (box_max_.row(e) - box_min_.row(e)).maxCoeff();
+			const double tol = 1e-12 * scale;
+
+			Eigen::MatrixXd mapped;
+			std::vector<Eigen::MatrixXd> grads;
+			for (int it = 0; it < max_newton_iterations; ++it)
+			{
+				gbs.eval_geom_mapping(uv, mapped);
+				const Eigen::MatrixXd residual = target - mapped;
+				if (residual.rowwise().norm().maxCoeff() <= tol)
+					break;
+
+				//the rows of grads[k] are the derivatives of the mapping in the reference directions
+				gbs.eval_geom_mapping_grads(uv, grads);
+				for (size_t k = 0; k < ids.size(); ++k)
+					uv.row(k) += residual.row(k) * grads[k].inverse();
+			}
+
+			gbs.eval_geom_mapping(uv, mapped);
+			for (size_t k = 0; k < ids.size(); ++k)
+				element_inside[e][k] = (target.row(k) - mapped.row(k)).norm() <= 1e-6 * scale && inside_reference(uv.row(k), is_simplex);
+		};
+
+#ifdef POLYFEM_WITH_TBB
+		tbb::parallel_for(tbb::blocked_range<int>(0, n_el), [&](const tbb::blocked_range<int> &r) {
+			for (int e = r.begin(); e != r.end(); ++e)
+				invert(e);
+		});
+#else
+		for (int e = 0; e < n_el; ++e)
+			invert(e);
+#endif
+
+		//the element with the lowest index containing the point wins (points on shared faces),
+		//elements without parameterization only get the points left
+		elements_.setConstant(n_pts, -1);
+		local_pts_.setZero(n_pts, dim_);
+		for (const bool parameterized : {true, false})
+		{
+			for (int e = 0; e < n_el; ++e)
+			{
+				if ((*gbases_)[e].has_parameterization != parameterized)
+					continue;
+
+				for (size_t k = 0; k < element_points[e].size(); ++k)
+				{
+					const int i = element_points[e][k];
+					if (elements_(i) < 0 && element_inside[e][k])
+					{
+						elements_(i) = e;
+						local_pts_.row(i) = element_uv[e].row(k);
+					}
+				}
+			}
+		}
+
+		const int n_outside = (elements_.array() < 0).count();
+		if (n_outside > 0)
+			logger().debug("{} probe points outside of the mesh", n_outside);
+	}
+
+	void PointProbe::build_operators()
+	{
+		const int n_pts = int(pts_.rows());
+		const int n_el = int(gbases_->size());
+
+		std::vector<int> group_of(n_el, -1);
+		group_elements_.clear();
+		group_probes_.clear();
+		for (int i = 0; i < n_pts; ++i)
+		{
+			const int e = elements_(i);
+			if (e < 0)
+				continue;
+			if (group_of[e] < 0)
+			{
+				group_of[e] = int(group_elements_.size());
+				group_elements_.push_back(e);
+				group_probes_.emplace_back();
+			}
+			group_probes_[group_of[e]].push_back(i);
+		}
+
+		const int n_groups = int(group_elements_.size());
+		std::vector<std::vector<Eigen::Triplet<double>>> val_entries(n_groups), grad_entries(n_groups);
+		const auto compute_group = [&](const int gr) {
+			const int e = group_elements_[gr];
+			const std::vector<int> &probes = group_probes_[gr];
+
+			Eigen::MatrixXd local(probes.size(), dim_);
+			for (size_t k = 0; k < probes.size(); ++k)
+				local.row(k) = local_pts_.row(probes[k]);
+
+			ElementAssemblyValues vals;
+			vals.compute(e, dim_ == 3, local, (*bases_)[e], (*gbases_)[e]);
+
+			for (const AssemblyValues &v : vals.basis_values)
+			{
+				for (const auto &g : v.global)
+				{
+					for (size_t k = 0; k < probes.size(); ++k)
+					{
+						val_entries[gr].emplace_back(probes[k], g.index, g.val * v.val(k));
+						for (int d = 0; d < dim_; ++d)
+							grad_entries[gr].emplace_back(probes[k] * dim_ + d, g.index, g.val * v.grad_t_m(k, d));
+					}
+				}
+			}
+		};
+
+#ifdef POLYFEM_WITH_TBB
+		tbb::parallel_for(tbb::blocked_range<int>(0, n_groups), [&](const tbb::blocked_range<int> &r) {
+			for (int gr = r.begin(); gr != r.end(); ++gr)
+				compute_group(gr);
+		});
+#else
+		for (int gr = 0; gr < n_groups; ++gr)
+			compute_group(gr);
+#endif
+
+		std::vector<Eigen::Triplet<double>> entries;
+		for (const auto &v : val_entries)
+			entries.insert(entries.end(), v.begin(), v.end());
+		val_op_.resize(n_pts, n_bases_);
+		val_op_.setFromTriplets(entries.begin(), entries.end());
+
+		entries.clear();
+		for (const auto &v : grad_entries)
+			entries.insert(entries.end(), v.begin(), v.end());
+		grad_op_.resize(n_pts * dim_, n_bases_);
+		grad_op_.setFromTriplets(entries.begin(), entries.end());
+	}
+
+	void PointProbe::evaluate(const Eigen::MatrixXd &fun, const int actual_dim, Eigen::MatrixXd &result) const
+	{
+		//mixed solutions have the pressure after the n_bases_ nodes
+		assert(fun.size() >= n_bases_ * actual_dim);
+		const Eigen::Map<const Eigen::MatrixXd> coeffs(fun.data(), actual_dim, n_bases_);
+
+		result = val_op_ * coeffs.transpose();
+	}
+
+	void PointProbe::evaluate_grad(const Eigen::MatrixXd &fun, const int actual_dim, Eigen::MatrixXd &result) const
+	{
+		//mixed solutions have the pressure after the n_bases_ nodes
+		assert(fun.size() >= n_bases_ * actual_dim);
+		const Eigen::Map<const Eigen::MatrixXd> coeffs(fun.data(), actual_dim, n_bases_);
+
+		const Eigen::MatrixXd grads = grad_op_ * coeffs.transpose();
+		result.resize(pts_.rows(), actual_dim * dim_);
+		for (int i = 0; i < pts_.rows(); ++i)
+		{
+			for (int c = 0; c < actual_dim; ++c)
+				result.block(i, c * dim_, 1, dim_) = grads.block(i * dim_, c, dim_, 1).transpose();
+		}
+	}
+
+	void PointProbe::for_each_element(const std::function<void(const int el_id, const Eigen::MatrixXd &local_pts, const std::vector<int> &probes)> &f) const
+	{
+		Eigen::MatrixXd local;
+		for (size_t gr = 0; gr < group_elements_.size(); ++gr)
+		{
+			const std::vector<int> &probes = group_probes_[gr];
+			local.resize(probes.size(), dim_);
+			for (size_t k = 0; k < probes.size(); ++k)
+				local.row(k) = local_pts_.row(probes[k]);
+
+			f(group_elements_[gr], local, probes);
+		}
+	}
+} // namespace polyfem
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <polyfem/ElementBases.hpp>
+#include <polyfem/Mesh.hpp>
+
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+
+#include <functional>
+#include <vector>
+
+namespace polyfem
+{
+	//Evaluation of FE functions at arbitrary physical points (probes). The points are mapped back to
+	//(element, reference coordinates) by inverting the geometric mapping with Newton, the candidate
+	//elements come from a uniform grid of element bounding boxes. The location and the interpolation
+	//operators are kept until the points change, so evaluating a new solution is a sparse product.
+	class PointProbe
+	{
+	public:
+		void init(const Mesh &mesh, const std::vector<ElementBases> &bases, const std::vector<ElementBases> &gbases, const int n_bases);
+
+		//locates the points (one per row) and builds the operators, does nothing if the points did not change
+		void set_points(const Eigen::MatrixXd &pts);
+
+		int n_points() const { return int(pts_.rows()); }
+		//element containing each point (-1 outside) and its reference coordinates
+		const Eigen::VectorXi &elements() const { return elements_; }
+		const Eigen::MatrixXd &local_points() const { return local_pts_; }
+
+		//fun has actual_dim interleaved components per node, the entries after n_bases * actual_dim (e.g., the pressure
+		//of the mixed formulations) are ignored, result is #points x actual_dim (0 outside)
+		void evaluate(const Eigen::MatrixXd &fun, const int actual_dim, Eigen::MatrixXd &result) const;
+		//result is #points x (actual_dim * dim), one block of dim columns per component
+		void evaluate_grad(const Eigen::MatrixXd &fun, const int actual_dim, Eigen::MatrixXd &result) const;
+
+		//interpolation operator, #points x n_bases (empty rows outside)
+		const Eigen::SparseMatrix<double, Eigen::RowMajor> &value_operator() const { return val_op_; }
+
+		//calls f once per element containing probes, with the reference coordinates and the indices of its probes
+		void for_each_element(const std::function<void(const int el_id, const Eigen::MatrixXd &local_pts, const std::vector<int> &probes)> &f) const;
+
+	private:
+		const Mesh *mesh_ = nullptr;
+		const std::vector<ElementBases> *bases_ = nullptr;
+		const std::vector<ElementBases> *gbases_ = nullptr;
+		int n_bases_ = 0;
+		int dim_ = 0;
+
+		//enlarged element bounding boxes, and the elements overlapping each grid cell (compressed rows)
+		Eigen::MatrixXd box_min_, box_max_;
+		Eigen::RowVectorXd grid_min_;
+		Eigen::VectorXi grid_res_;
+		double cell_size_ = 1;
+		std::vector<int> cell_offsets_, cell_elements_;
+
+		//boundary of the elements without parameterization (polytopes) for the inside test,
+		//polygon vertices in order in 2d, vertices of the triangles (3 rows each) of the faces in 3d
+		std::vector<Eigen::MatrixXd> polytope_boundaries_;
+
+		Eigen::MatrixXd pts_;
+		Eigen::VectorXi elements_;
+		Eigen::MatrixXd local_pts_;
+
+		//probes grouped by element
+		std::vector<int> group_elements_;
+		std::vector<std::vector<int>> group_probes_;
+
+		//values: #points x n_bases, gradients: (#points * dim) x n_bases
+		Eigen::SparseMatrix<double, Eigen::RowMajor> val_op_, grad_op_;
+
+		int cell_index(const Eigen::RowVectorXd &p) const;
+		bool inside_polytope(const int e, const Eigen::RowVectorXd &p) const;
+		void locate();
+		void build_operators();
+	};
+} // namespace polyfem
@@ -0,0 +1,248 @@
+#include <polyfem/Profiler.hpp>
+
+#include <fstream>
+#include <map>
+
+namespace polyfem
+{
+	namespace
+	{
+		double seconds(const Profiler::Clock::duration &d)
+		{
+			return std::chrono::duration<double>(d).count();
+		}
+
+		//tree merged over the threads
+		struct MergedNode
+		{
+			double time = 0;
+			long count = 0;
+			int threads = 0;
+			std::vector<std::string> order;
+			std::map<std::string, MergedNode> children;
+
+			MergedNode &child(const std::string &name)
+			{
+				auto it = children.find(name);
+				if (it == children.end())
+				{
+					order.push_back(name);
+					it = children.emplace(name, MergedNode()).first;
+				}
+				return it->second;
+			}
+
+			json to_json() const
+			{
+				json res = json::array();
+				for (const std::string &name : order)
+				{
+					const MergedNode &c = children.at(name);
+					res.push_back({{"name", name}, {"time", c.time}, {"count", c.count}, {"threads", c.threads}, {"children", c.to_json()}});
+				}
+				return res;
+			}
+		};
+	} // namespace
+
+	struct Profiler::ThreadData
+	{
+		struct Node
+		{
+			std::string name;
+			std::vector<int> children;
+			double time = 0;
+			long count = 0;
+		};
+
+		struct Frame
+		{
+			int node;
+			Clock::time_point start;
+		};
+
+		struct Event
+		{
+			int node;
+			Clock::time_point start, end;
+		};
+
+		int id;
+		//only contended by summary and reset
+		std::mutex mutex;
+		//node 0 is the root
+		std::vector<Node> nodes;
+		std::vector<Frame> stack;
+		std::vector<Event> events;
+
+		explicit ThreadData(const int id) : id(id), nodes(1) {}
+
+		void merge(const int node, MergedNode &merged) const
+		{
+			for (const int c : nodes[node].children)
+			{
+				MergedNode &m = merged.child(nodes[c].name);
+				m.time += nodes[c].time;
+				m.count += nodes[c].count;
+				++m.threads;
+				merge(c, m);
+			}
+		}
+	};
+
+	Profiler::Profiler()
+		: tracing_(false), origin_(Clock::now())
+	{
+	}
+
+	Profiler &Profiler::instance()
+	{
+		static Profiler instance;
+		return instance;
+	}
+
+	Profiler::ThreadData &Profiler::local()
+	{
+		//the data outlives the thread, the profiler owns it
+		thread_local ThreadData *data = nullptr;
+		if (!data)
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			threads_.emplace_back(new ThreadData(int(threads_.size())));
+			data = threads_.back().get();
+		}
+		return *data;
+	}
+
+	void Profiler::set_tracing(const bool tracing)
+	{
+		tracing_ = tracing;
+	}
+
+	void Profiler::reset()
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		for (auto &t : threads_)
+		{
+			std::lock_guard<std::mutex> tlock(t->mutex);
+			assert(t->stack.empty());
+			t->nodes.assign(1, ThreadData::Node());
+			t->events.clear();
+		}
+		origin_ = Clock::now();
+	}
+
+	void Profiler::begin(const std::string &name)
+	{
+		ThreadData &data = local();
+		std::lock_guard<std::mutex> lock(data.mutex);
+
+		const int parent = data.stack.empty() ? 0 : data.stack.back().node;
+		int node = -1;
+		for (const int c : data.nodes[parent].children)
+		{
+			if (data.nodes[c].name == name)
+			{
+				node = c;
+				break;
+			}
+		}
+		if (node < 0)
+		{
+			node = int(data.nodes.size());
+			data.nodes.emplace_back();
+			data.nodes.back().name = name;
+			data.nodes[parent].children.push_back(node);
+		}
+
+		data.stack.push_back({node, Clock::now()});
+	}
+
+	double Profiler::end()
+	{
+		const Clock::time_point now = Clock::now();
+		ThreadData &data = local();
+		std::lock_guard<std::mutex> lock(data.mutex);
+		assert(!data.stack.empty());
+
+		const ThreadData::Frame frame = data.stack.back();
+		data.stack.pop_back();
+
+		const double duration = seconds(now - frame.start);
+		data.nodes[frame.node].time += duration;
+		++data.nodes[frame.node].count;
+
+		if (tracing_)
+			data.events.push_back({frame.node, frame.start, now});
+
+		return duration;
+	}
+
+	json Profiler::summary() const
+	{
+		MergedNode root;
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		for (const auto &t : threads_)
+		{
+			std::lock_guard<std::mutex> tlock(t->mutex);
+			t->merge(0, root);
+		}
+
+		return root.to_json();
+	}
+
+	bool Profiler::write_chrome_trace(const std::string &path) const
+	{
+		json events = json::array();
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			for (const auto &t : threads_)
+			{
+				std::lock_guard<std::mutex> tlock(t->mutex);
+				for (const auto &e : t->events)
+				{
+					//complete events, times in microseconds
+					events.push_back({{"name", t->nodes[e.node].name},
+									  {"cat", "polyfem"},
+									  {"ph", "X"},
+									  {"ts", 1e6 * seconds(e.start - origin_)},
+									  {"dur", 1e6 * seconds(e.end - e.start)},
+									  {"pid", 0},
+									  {"tid", t->id}});
+				}
+			}
+		}
+
+		std::ofstream out(path);
+		if (!out.good())
+			return false;
+
+		json trace;
+		trace["traceEvents"] = events;
+		trace["displayTimeUnit"] = "ms";
+		out << trace.dump() << std::endl;
+
+		return out.good();
+	}
+
+	ScopedZone::ScopedZone(const std::string &name)
+		: running_(true)
+	{
+		Profiler::instance().begin(name);
+	}
+
+	ScopedZone::~ScopedZone()
+	{
+		stop();
+	}
+
+	double ScopedZone::stop()
+	{
+		if (!running_)
+			return 0;
+
+		running_ = false;
+		return Profiler::instance().end();
+	}
+} // namespace polyfem
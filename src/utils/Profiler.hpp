@@ -0,0 +1,67 @@
+#pragma once
+
+#include <polyfem/Common.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace polyfem
+{
+	//Hierarchical wall clock profiler. Zones nest per thread and each thread aggregates its own tree,
+	//the trees are merged by path when queried. The individual zones are kept only while tracing,
+	//for the Chrome trace (chrome://tracing, Perfetto) export.
+	class Profiler
+	{
+	public:
+		typedef std::chrono::steady_clock Clock;
+
+		static Profiler &instance();
+
+		void set_tracing(const bool tracing);
+		bool tracing() const { return tracing_; }
+
+		//clears the timings of all threads, must not be called while zones are open
+		void reset();
+
+		//array of {name, time, count, threads, children} for the top level zones,
+		//zones of worker threads are merged at the top level of their thread
+		json summary() const;
+		bool write_chrome_trace(const std::string &path) const;
+
+		//used by ScopedZone
+		void begin(const std::string &name);
+		//duration in seconds of the innermost open zone of this thread
+		double end();
+
+	private:
+		Profiler();
+
+		struct ThreadData;
+		ThreadData &local();
+
+		mutable std::mutex mutex_;
+		std::vector<std::unique_ptr<ThreadData>> threads_;
+		std::atomic<bool> tracing_;
+		Clock::time_point origin_;
+	};
+
+	//times its scope, zones opened while it is alive are its children
+	class ScopedZone
+	{
+	public:
+		explicit ScopedZone(const std::string &name);
+		~ScopedZone();
+
+		//closes the zone early, returns its duration in seconds
+		double stop();
+
+		POLYFEM_DELETE_MOVE_COPY(ScopedZone)
+
+	private:
+		bool running_;
+	};
+} // namespace polyfem
@@ -1,11 +1,64 @@
 #include "RBFInterpolation.hpp"
 
 #include <polyfem/Logger.hpp>
+
+#include <Eigen/Sparse>
+
 #include <cmath>
 #include <iostream>
+#include <vector>
 
 namespace polyfem
 {
+	namespace
+	{
+		//Wendland C2 kernel, positive definite up to dimension 3
+		double wendland(const double r, const double support)
+		{
+			const double x = r / support;
+			if (x >= 1)
+				return 0;
+
+			const double tmp = (1 - x) * (1 - x);
+			return tmp * tmp * (4 * x + 1);
+		}
+
+		std::function<double(double)> kernel_from_name(const std::string &rbf, const double eps)
+		{
+			if(rbf == "multiquadric"){
+				return [eps](const double r){ return sqrt((r/eps)*(r/eps) + 1); };
+			}
+			else if(rbf == "inverse" || rbf == "inverse_multiquadric" || rbf == "inverse multiquadric"){
+				return [eps](const double r){ return 1.0/sqrt((r/eps)*(r/eps) + 1); };
+			}
+			else if(rbf == "gaussian"){
+				return [eps](const double r){ return exp(-(r/eps)*(r/eps)); };
+			}
+			else if(rbf == "linear"){
+				return [](const double r){ return r; };
+			}
+			else if(rbf == "cubic"){
+				return [](const double r){ return r*r*r; };
+			}
+			else if(rbf == "quintic"){
+				return [](const double r){ return r*r*r*r*r; };
+			}
+			else if(rbf == "thin_plate" || rbf == "thin-plate"){
+				return [](const double r){ return abs(r) < 1e-10 ? 0 : (r*r * log(r)); };
+			}
+			else if(rbf == "wendland" || rbf == "compact"){
+				return [eps](const double r){ return wendland(r, eps); };
+			}
+
+			logger().warn("Unable to match {} rbf, falling back to multiquadric", rbf);
+			assert(false);
+
+			return [eps](const double r){ return sqrt((r/eps)*(r/eps) + 1); };
+		}
+
+		//patches of the partition of unity are enlarged by this factor to overlap
+		const double patch_overlap = 1.5;
+	}
 
 	RBFInterpolation::RBFInterpolation(const Eigen::MatrixXd &fun, const Eigen::MatrixXd &pts, const std::string &rbf, const double eps)
 	{
@@ -14,6 +67,12 @@ namespace polyfem
 
 	void RBFInterpolation::init(const Eigen::MatrixXd &fun, const Eigen::MatrixXd &pts, const std::string &rbf, const double eps)
 	{
+		if(rbf == "wendland" || rbf == "compact"){
+			init_compact(fun, pts, eps);
+			return;
+		}
+		mode_ = Mode::Global;
+
 #ifdef POLYFEM_OPENCL
 		std::vector<double> pointscl(pts.size());
 		std::vector<double> functioncl(fun.rows());
@@ -38,38 +97,7 @@ namespace polyfem
 			rbf_pum::init(pointscl, functioncl, data_[i], verbose_, rbfcl_, opt_, unit_cube_, num_threads_);
 		}
 #else
-		std::function<double(double)> tmp;
-
-		if(rbf == "multiquadric"){
-			tmp = [eps](const double r){ return sqrt((r/eps)*(r/eps) + 1); };
-		}
-		else if(rbf == "inverse" || rbf == "inverse_multiquadric" || rbf == "inverse multiquadric"){
-			tmp = [eps](const double r){ return 1.0/sqrt((r/eps)*(r/eps) + 1); };
-		}
-		else if(rbf == "gaussian"){
-			tmp = [eps](const double r){ return exp(-(r/eps)*(r/eps)); };
-		}
-		else if(rbf == "linear"){
-			tmp = [](const double r){ return r; };
-		}
-		else if(rbf == "cubic"){
-			tmp = [](const double r){ return r*r*r; };
-		}
-		else if(rbf == "quintic"){
-			tmp = [](const double r){ return r*r*r*r*r; };
-		}
-		else if(rbf == "thin_plate" || rbf == "thin-plate"){
-			tmp = [](const double r){ return abs(r) < 1e-10 ? 0 : (r*r * log(r)); };
-		}
-		else
-		{
-			logger().warn("Unable to match {} rbf, falling back to multiquadric", rbf);
-			assert(false);
-
-			tmp = [eps](const double r){ return sqrt((r/eps)*(r/eps) + 1); };
-		}
-
-		init(fun, pts, tmp);
+		init(fun, pts, kernel_from_name(rbf, eps));
 #endif
 	}
 
@@ -90,6 +118,7 @@ namespace polyfem
 #else
 		assert(pts.rows() == fun.rows());
 
+		mode_ = Mode::Global;
 		rbf_ = rbf;
 		centers_ = pts;
 
@@ -113,8 +142,166 @@ namespace polyfem
 #endif
 	}
 
+	void RBFInterpolation::init_compact(const Eigen::MatrixXd &fun, const Eigen::MatrixXd &pts, const double support)
+	{
+		assert(pts.rows() == fun.rows());
+		assert(support > 0);
+
+		mode_ = Mode::Compact;
+		support_ = support;
+		tree_.init(pts);
+
+		const int n = pts.rows();
+
+		//the kernels do not reproduce constants, the mean is interpolated exactly
+		offset_ = n > 0 ? Eigen::RowVectorXd(fun.colwise().mean()) : Eigen::RowVectorXd::Zero(fun.cols());
+
+		std::vector<Eigen::Triplet<double>> entries;
+		std::vector<int> neighs;
+		for(int i = 0; i < n; ++i){
+			tree_.radius_search(pts.row(i), support_, neighs);
+			for(int j : neighs)
+				entries.emplace_back(i, j, wendland((pts.row(i)-pts.row(j)).norm(), support_));
+		}
+
+		Eigen::SparseMatrix<double> A(n, n);
+		A.setFromTriplets(entries.begin(), entries.end());
+		logger().debug("Compact rbf with {} centers, {} non zeros per row", n, n > 0 ? double(A.nonZeros())/n : 0.);
+
+		Eigen::SimplicialLDLT<Eigen::SparseMatrix<double>> solver(A);
+		if(solver.info() != Eigen::Success)
+			logger().error("Unable to factorize the compact rbf system");
+		compact_weights_ = solver.solve(fun.rowwise() - offset_);
+	}
+
+	void RBFInterpolation::init_partition_of_unity(const Eigen::MatrixXd &fun, const Eigen::MatrixXd &pts, const std::string &rbf, const double eps, const int points_per_patch)
+	{
+		assert(pts.rows() == fun.rows());
+
+		mode_ = Mode::PartitionOfUnity;
+		local_rbf_ = kernel_from_name(rbf, eps);
+		tree_.init(pts, points_per_patch);
+
+		std::vector<std::vector<int>> leaves;
+		tree_.leaves(leaves);
+
+		patches_.clear();
+		patches_.reserve(leaves.size());
+		max_patch_radius_ = 0;
+		Eigen::MatrixXd patch_centers(leaves.size(), pts.cols());
+
+		for(const auto &leaf : leaves){
+			Patch patch;
+			Eigen::RowVectorXd min_p = pts.row(leaf.front());
+			Eigen::RowVectorXd max_p = min_p;
+			for(int i : leaf){
+				min_p = min_p.cwiseMin(pts.row(i));
+				max_p = max_p.cwiseMax(pts.row(i));
+			}
+			patch.center = (min_p + max_p) / 2;
+			patch.radius = 0;
+			for(int i : leaf)
+				patch.radius = std::max(patch.radius, (pts.row(i) - patch.center).norm());
+			patch.radius = patch.radius * patch_overlap + 1e-12;
+
+			//local interpolant on the points of the leaf and its neighbors
+			tree_.radius_search(patch.center, patch.radius, patch.nodes);
+			const int n = patch.nodes.size();
+			Eigen::MatrixXd A(n, n), b(n, fun.cols());
+			for(int i = 0; i < n; ++i){
+				b.row(i) = fun.row(patch.nodes[i]);
+				for(int j = 0; j < n; ++j)
+					A(i,j) = local_rbf_((pts.row(patch.nodes[i])-pts.row(patch.nodes[j])).norm());
+			}
+			patch.weights = Eigen::FullPivLU<Eigen::MatrixXd>(A).solve(b);
+
+			max_patch_radius_ = std::max(max_patch_radius_, patch.radius);
+			patch_centers.row(patches_.size()) = patch.center;
+			patches_.push_back(patch);
+		}
+
+		patch_tree_.init(patch_centers);
+		logger().debug("Partition of unity rbf with {} centers and {} patches", pts.rows(), patches_.size());
+	}
+
+	Eigen::MatrixXd RBFInterpolation::interpolate_compact(const Eigen::MatrixXd &pts) const
+	{
+		assert(pts.cols() == tree_.points().cols());
+		const Eigen::MatrixXd &centers = tree_.points();
+
+		Eigen::MatrixXd res(pts.rows(), compact_weights_.cols());
+		std::vector<int> neighs;
+		for(int i = 0; i < pts.rows(); ++i){
+			res.row(i) = offset_;
+			tree_.radius_search(pts.row(i), support_, neighs);
+			for(int j : neighs)
+				res.row(i) += wendland((centers.row(j)-pts.row(i)).norm(), support_) * compact_weights_.row(j);
+		}
+
+		return res;
+	}
+
+	Eigen::MatrixXd RBFInterpolation::interpolate_partition_of_unity(const Eigen::MatrixXd &pts) const
+	{
+		assert(pts.cols() == tree_.points().cols());
+		const Eigen::MatrixXd &centers = tree_.points();
+
+		const auto local_value = [&](const Patch &patch, const Eigen::RowVectorXd &pt) {
+			Eigen::RowVectorXd val = Eigen::RowVectorXd::Zero(patch.weights.cols());
+			for(size_t j = 0; j < patch.nodes.size(); ++j)
+				val += local_rbf_((centers.row(patch.nodes[j])-pt).norm()) * patch.weights.row(j);
+			return val;
+		};
+
+		Eigen::MatrixXd res(pts.rows(), patches_.empty() ? 0 : patches_.front().weights.cols());
+		res.setZero();
+		std::vector<int> neighs;
+		for(int i = 0; i < pts.rows(); ++i){
+			const Eigen::RowVectorXd pt = pts.row(i);
+			patch_tree_.radius_search(pt, max_patch_radius_, neighs);
+
+			double total = 0;
+			for(int p : neighs){
+				const Patch &patch = patches_[p];
+				const double w = wendland((pt - patch.center).norm(), patch.radius);
+				if(w <= 0)
+					continue;
+
+				res.row(i) += w * local_value(patch, pt);
+				total += w;
+			}
+
+			if(total > 0){
+				res.row(i) /= total;
+				continue;
+			}
+
+			//not covered by the patches (far from the data), the closest patch is extrapolated
+			if(patches_.empty())
+				continue;
+			double radius = max_patch_radius_;
+			while(neighs.empty()){
+				radius *= 2;
+				patch_tree_.radius_search(pt, radius, neighs);
+			}
+			int closest = neighs.front();
+			for(int p : neighs){
+				if((pt - patches_[p].center).squaredNorm() < (pt - patches_[closest].center).squaredNorm())
+					closest = p;
+			}
+			res.row(i) = local_value(patches_[closest], pt);
+		}
+
+		return res;
+	}
+
 	Eigen::MatrixXd RBFInterpolation::interpolate(const Eigen::MatrixXd &pts) const
 	{
+		if(mode_ == Mode::Compact)
+			return interpolate_compact(pts);
+		if(mode_ == Mode::PartitionOfUnity)
+			return interpolate_partition_of_unity(pts);
+
 #ifdef POLYFEM_OPENCL
 		Eigen::MatrixXd res(pts.rows(), data_.size());
 
@@ -1,10 +1,13 @@
 #pragma once
 
 
+#include <polyfem/KdTree.hpp>
+
 #include <Eigen/Dense>
 
 #include <functional>
 #include <string>
+#include <vector>
 
 #ifdef POLYFEM_OPENCL
 #include <rbf_interpolate.hpp>
@@ -20,12 +23,50 @@ namespace polyfem
 		RBFInterpolation(const Eigen::MatrixXd &fun, const Eigen::MatrixXd &pts, const std::function<double(double)> &rbf);
 		void init(const Eigen::MatrixXd &fun, const Eigen::MatrixXd &pts, const std::function<double(double)> &rbf);
 
+		//rbf "wendland" is the compactly supported Wendland C2 kernel with support radius eps,
+		//the system is sparse and the centers are queried with a k-d tree
 		RBFInterpolation(const Eigen::MatrixXd &fun, const Eigen::MatrixXd &pts, const std::string &rbf, const double eps);
 		void init(const Eigen::MatrixXd &fun, const Eigen::MatrixXd &pts, const std::string &rbf, const double eps);
 
+		void init_compact(const Eigen::MatrixXd &fun, const Eigen::MatrixXd &pts, const double support);
+
+		//partition of unity: one small interpolant per leaf of a k-d tree (with the neighboring points),
+		//blended with Wendland weights. Setup and evaluation are linear in the number of points
+		void init_partition_of_unity(const Eigen::MatrixXd &fun, const Eigen::MatrixXd &pts, const std::string &rbf, const double eps, const int points_per_patch = 16);
+
 		Eigen::MatrixXd interpolate(const Eigen::MatrixXd &pts) const;
 
 	private:
+		enum class Mode
+		{
+			Global,
+			Compact,
+			PartitionOfUnity
+		};
+		Mode mode_ = Mode::Global;
+
+		//compactly supported kernel
+		double support_ = 0;
+		KdTree tree_;
+		Eigen::MatrixXd compact_weights_;
+		Eigen::RowVectorXd offset_;
+
+		//partition of unity
+		struct Patch
+		{
+			Eigen::RowVectorXd center;
+			double radius;
+			std::vector<int> nodes;
+			Eigen::MatrixXd weights;
+		};
+		std::vector<Patch> patches_;
+		KdTree patch_tree_;
+		double max_patch_radius_ = 0;
+		std::function<double(double)> local_rbf_;
+
+		Eigen::MatrixXd interpolate_compact(const Eigen::MatrixXd &pts) const;
+		Eigen::MatrixXd interpolate_partition_of_unity(const Eigen::MatrixXd &pts) const;
+
 #ifdef POLYFEM_OPENCL
 		int verbose_ = 0;
 		const std::string rbfcl_ = "GA";
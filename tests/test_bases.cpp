@@ -12,8 +12,13 @@
 
 
 #include <polyfem/MVPolygonalBasis2d.hpp>
+#include <polyfem/ElementDofMap.hpp>
+#include <polyfem/DofRenumbering.hpp>
+#include <polyfem/PolytopeBasisCache.hpp>
+#include <polyfem/RBFWithQuadratic.hpp>
 
 #include <catch.hpp>
+#include <cstdio>
 #include <iostream>
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -965,3 +970,258 @@ TEST_CASE("MV_2d", "[bases]") {
 		}
 	}
 }
+
+TEST_CASE("element_dof_map", "[bases]") {
+	std::vector<ElementBases> bases(2);
+	const RowVectorNd node = RowVectorNd::Zero(2);
+
+	bases[0].bases.resize(3);
+	for(int j = 0; j < 3; ++j)
+		bases[0].bases[j].init(1, j, j, node);
+
+	//second element: one conforming node and one weighted combination of two nodes
+	bases[1].bases.resize(2);
+	bases[1].bases[0].init(1, 2, 0, node);
+	bases[1].bases[1].global().emplace_back(3, node, 0.25);
+	bases[1].bases[1].global().emplace_back(1, node, 0.75);
+
+	ElementDofMap dof_map;
+	dof_map.build(bases, 4);
+
+	REQUIRE(dof_map.n_elements() == 2);
+	REQUIRE(dof_map.is_conforming(0));
+	REQUIRE(!dof_map.is_conforming(1));
+	REQUIRE(dof_map.n_local_bases(1) == 2);
+	REQUIRE(dof_map.element_dofs(0)[2] == 2);
+	REQUIRE(dof_map.constraints().rows() == 1);
+
+	for(int e = 0; e < 2; ++e)
+	{
+		for(int j = 0; j < dof_map.n_local_bases(e); ++j)
+		{
+			Eigen::VectorXd expected = Eigen::VectorXd::Zero(4);
+			for(const auto &g : bases[e].bases[j].global())
+				expected(g.index) += g.val;
+
+			Eigen::VectorXd weights = Eigen::VectorXd::Zero(4);
+			dof_map.for_each_node(e, j, [&](const int index, const double weight) { weights(index) += weight; });
+
+			REQUIRE((weights - expected).norm() == Approx(0).margin(1e-14));
+		}
+	}
+}
+
+TEST_CASE("dof_renumbering", "[bases]") {
+	//chain of segments with scrambled node indices
+	const int n = 40;
+	std::vector<int> perm(n);
+	for(int i = 0; i < n; ++i)
+		perm[i] = (i * 17) % n;
+
+	std::vector<ElementBases> bases(n - 1);
+	for(int e = 0; e < n - 1; ++e)
+	{
+		bases[e].bases.resize(2);
+		for(int j = 0; j < 2; ++j)
+		{
+			RowVectorNd node(2);
+			node << e + j, 0;
+			bases[e].bases[j].init(1, perm[e + j], j, node);
+		}
+	}
+	REQUIRE(DofRenumbering::bandwidth(bases) > 1);
+
+	const Eigen::MatrixXd fun = Eigen::MatrixXd::Random(n * 2 + 5, 1);
+	for(const std::string type : {"rcm", "morton"})
+	{
+		Eigen::VectorXi new_index;
+		DofRenumbering::compute(type, bases, n, new_index);
+
+		//permutation
+		std::vector<int> sorted(new_index.data(), new_index.data() + n);
+		std::sort(sorted.begin(), sorted.end());
+		for(int i = 0; i < n; ++i)
+			REQUIRE(sorted[i] == i);
+
+		std::vector<ElementBases> renumbered = bases;
+		DofRenumbering::apply(new_index, renumbered);
+		REQUIRE(DofRenumbering::bandwidth(renumbered) == 1);
+
+		//round trip of a vector field followed by a pressure field and the average constraint
+		Eigen::VectorXi pressure_new_index(3);
+		pressure_new_index << 2, 0, 1;
+		Eigen::MatrixXd moved = fun;
+		for(int i = 0; i < n; ++i)
+		{
+			for(int d = 0; d < 2; ++d)
+				moved(new_index(i) * 2 + d) = fun(i * 2 + d);
+		}
+		for(int i = 0; i < 3; ++i)
+			moved(2 * n + pressure_new_index(i)) = fun(2 * n + i);
+
+		Eigen::MatrixXd original;
+		DofRenumbering::to_original(new_index, 2, pressure_new_index, moved, original);
+		REQUIRE((original - fun).norm() == Approx(0).margin(1e-14));
+
+		DofRenumbering::to_original(new_index, 2, moved, original);
+		REQUIRE((original.topRows(2 * n) - fun.topRows(2 * n)).norm() == Approx(0).margin(1e-14));
+	}
+}
+
+namespace
+{
+	//irregular simplex (triangle or tetrahedron) with its collocation points on the facets,
+	//kernels outside of it, and its quadrature
+	void polytope_fit_data(const Eigen::MatrixXd &V, Eigen::MatrixXd &collocation_points, Eigen::MatrixXd &centers, Quadrature &quadr)
+	{
+		const int dim = V.cols();
+		const int n = 5;
+		const Eigen::RowVectorXd barycenter = V.colwise().mean();
+
+		std::vector<Eigen::RowVectorXd> pts;
+		for(int f = 0; f <= dim; ++f)
+		{
+			//facet opposite to vertex f
+			std::vector<int> fv;
+			for(int v = 0; v <= dim; ++v)
+			{
+				if(v != f)
+					fv.push_back(v);
+			}
+
+			for(int i = 1; i < n; ++i)
+			{
+				if(dim == 2)
+				{
+					pts.push_back((i * V.row(fv[0]) + (n - i) * V.row(fv[1])) / n);
+					continue;
+				}
+
+				for(int j = 1; i + j < n; ++j)
+					pts.push_back((i * V.row(fv[0]) + j * V.row(fv[1]) + (n - i - j) * V.row(fv[2])) / n);
+			}
+		}
+
+		collocation_points.resize(pts.size(), dim);
+		for(size_t i = 0; i < pts.size(); ++i)
+			collocation_points.row(i) = pts[i];
+
+		centers.resize((pts.size() + 1) / 2, dim);
+		for(int i = 0; i < centers.rows(); ++i)
+			centers.row(i) = barycenter + 1.5 * (collocation_points.row(2 * i) - barycenter);
+
+		Quadrature ref;
+		if(dim == 2)
+			TriQuadrature().get_quadrature(4, ref);
+		else
+			TetQuadrature().get_quadrature(4, ref);
+
+		Eigen::MatrixXd jac(dim, dim);
+		for(int d = 0; d < dim; ++d)
+			jac.row(d) = V.row(d + 1) - V.row(0);
+		quadr.points = (ref.points * jac).rowwise() + V.row(0);
+		quadr.weights = ref.weights * std::abs(jac.determinant());
+	}
+
+	void check_cached_fit(const int dim)
+	{
+		Eigen::MatrixXd V(dim + 1, dim);
+		if(dim == 2)
+			V << 0, 0, 1.3, 0.1, 0.2, 0.9;
+		else
+			V << 0, 0, 0, 1.3, 0.1, 0, 0.2, 0.9, 0.1, 0.3, 0.2, 1.1;
+
+		//congruent copy, x' = scaling * x * rotation^T + translation
+		Eigen::MatrixXd rotation;
+		if(dim == 2)
+			rotation = Eigen::Rotation2Dd(0.7).toRotationMatrix();
+		else
+			rotation = (Eigen::AngleAxisd(0.7, Eigen::Vector3d::UnitZ()) * Eigen::AngleAxisd(-1.1, Eigen::Vector3d::UnitX())).toRotationMatrix();
+		const double scaling = 2.5;
+		const Eigen::RowVectorXd translation = Eigen::RowVectorXd::LinSpaced(dim, 1, -2);
+
+		const Eigen::MatrixXd V2 = (scaling * V * rotation.transpose()).rowwise() + translation;
+
+		PolytopeBasisCache cache;
+		const int n_monomials = dim + dim * (dim + 1) / 2;
+		for(const Eigen::MatrixXd &vertices : {V, V2})
+		{
+			Eigen::MatrixXd collocation_points, centers;
+			Quadrature quadr;
+			polytope_fit_data(vertices, collocation_points, centers, quadr);
+
+			Eigen::MatrixXd rhs(collocation_points.rows(), 3);
+			for(int i = 0; i < rhs.rows(); ++i)
+			{
+				for(int j = 0; j < rhs.cols(); ++j)
+					rhs(i, j) = std::sin(i + 3 * j);
+			}
+			Eigen::MatrixXd local_basis_integrals(rhs.cols(), n_monomials);
+			for(int i = 0; i < local_basis_integrals.rows(); ++i)
+			{
+				for(int j = 0; j < n_monomials; ++j)
+					local_basis_integrals(i, j) = std::cos(2 * i + j);
+			}
+
+			PolytopeBasisCache::Geometry geom;
+			cache.canonicalize(centers, collocation_points, quadr, geom);
+			const auto entry = cache.get(geom);
+			Eigen::MatrixXd weights;
+			PolytopeBasisCache::weights(geom, *entry, local_basis_integrals, rhs, weights);
+			const CanonicalRBF cached(geom, *entry, weights);
+
+			const RBFWithQuadratic direct("Laplacian", centers, collocation_points, local_basis_integrals, quadr, rhs);
+
+			Eigen::MatrixXd expected, val;
+			direct.bases_values(quadr.points, expected);
+			cached.bases_values(quadr.points, val);
+			REQUIRE((expected - val).cwiseAbs().maxCoeff() == Approx(0).margin(1e-6 * expected.cwiseAbs().maxCoeff()));
+
+			for(int d = 0; d < dim; ++d)
+			{
+				direct.bases_grads(d, quadr.points, expected);
+				cached.bases_grads(d, quadr.points, val);
+				REQUIRE((expected - val).cwiseAbs().maxCoeff() == Approx(0).margin(1e-6 * expected.cwiseAbs().maxCoeff()));
+			}
+		}
+
+		//the rotated copy reuses the fit of the first one
+		REQUIRE(cache.misses() == 1);
+		REQUIRE(cache.hits() == 1);
+		REQUIRE(cache.size() == 1);
+	}
+}
+
+TEST_CASE("polytope_basis_cache_2d", "[bases]") {
+	check_cached_fit(2);
+}
+
+TEST_CASE("polytope_basis_cache_3d", "[bases]") {
+	check_cached_fit(3);
+
+	PolytopeBasisCache cache;
+	Eigen::MatrixXd collocation_points, centers;
+	Quadrature quadr;
+	Eigen::MatrixXd V(4, 3);
+	V << 0, 0, 0, 1.3, 0.1, 0, 0.2, 0.9, 0.1, 0.3, 0.2, 1.1;
+	polytope_fit_data(V, collocation_points, centers, quadr);
+	PolytopeBasisCache::Geometry geom;
+	cache.canonicalize(centers, collocation_points, quadr, geom);
+	cache.get(geom);
+
+	const std::string path = "polytope_basis_cache_test.bin";
+	REQUIRE(cache.save(path));
+
+	PolytopeBasisCache same(cache.tolerance());
+	REQUIRE(same.load(path));
+	REQUIRE(same.size() == 1);
+	same.get(geom);
+	REQUIRE(same.hits() == 1);
+
+	//the keys depend on the tolerance
+	PolytopeBasisCache other(1e-6);
+	REQUIRE(!other.load(path));
+	REQUIRE(other.size() == 0);
+
+	std::remove(path.c_str());
+}
@@ -2,6 +2,7 @@
 #include <polyfem/MatrixUtils.hpp>
 #include <polyfem/auto_eigs.hpp>
 #include <polyfem/AutodiffTypes.hpp>
+#include <polyfem/AutodiffPacket.hpp>
 
 #include <iostream>
 #include <cmath>
@@ -196,3 +197,43 @@ TEST_CASE("eigs3idautodiff", "[matrix]") {
     	}
     }
 }
+
+
+TEST_CASE("autodiff_packet", "[matrix]") {
+    typedef DScalar2<double, Eigen::Matrix<double, 9, 1>, Eigen::Matrix<double, 9, 9>> T;
+    typedef DPacket<9, 2> P;
+
+    //one random deformation gradient per lane
+    Eigen::Array<double, AUTODIFF_LANES, 9> lanes;
+    lanes.setRandom();
+    lanes *= 0.2;
+    for (int d = 0; d < 3; ++d)
+        lanes.col(d * 4) += 1;
+
+    Eigen::Matrix<P, Eigen::Dynamic, Eigen::Dynamic, 0, 3, 3> packet_mat(3, 3);
+    for (int i = 0; i < 9; ++i)
+        packet_mat(i) = P(i, lanes.col(i));
+
+    //neo hookean like energy, exercises the products, log, sqrt, pow, exp and divisions
+    const auto energy = [](const auto &mat) {
+        const auto det = polyfem::determinant(mat);
+        const auto tr = (mat.transpose() * mat).trace();
+        return 0.3 * (tr - 3 - 2 * log(det)) + log(det) * log(det) / 2 + sqrt(tr) / det + pow(tr, 1.5) - exp(det / 4) / (2 + tr);
+    };
+
+    const P packet_val = energy(packet_mat);
+
+    DiffScalarBase::setVariableCount(9);
+    for (int l = 0; l < AUTODIFF_LANES; ++l)
+    {
+        Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic, 0, 3, 3> mat(3, 3);
+        for (int i = 0; i < 9; ++i)
+            mat(i) = T(i, lanes(l, i));
+
+        const T val = energy(mat);
+
+        REQUIRE(packet_val.getValue()(l) == Approx(val.getValue()).margin(1e-12));
+        REQUIRE((packet_val.gradient(l) - val.getGradient()).norm() < 1e-10);
+        REQUIRE((packet_val.hessian(l) - val.getHessian()).norm() < 1e-10);
+    }
+}
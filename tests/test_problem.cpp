@@ -2,9 +2,17 @@
 #include <polyfem/Problem.hpp>
 #include <polyfem/AssemblerUtils.hpp>
 #include <polyfem/Common.hpp>
+#include <polyfem/State.hpp>
+#include <polyfem/DofRenumbering.hpp>
+#include <polyfem/NLProblem.hpp>
+#include <polyfem/RhsAssembler.hpp>
 
 #include <catch.hpp>
 #include <iostream>
+
+#ifdef POLYFEM_WITH_TBB
+#include <tbb/task_arena.h>
+#endif
 ////////////////////////////////////////////////////////////////////////////////
 
 using namespace polyfem;
@@ -530,4 +538,355 @@ TEST_CASE("elasticity 3d", "[problem]") {
 
         REQUIRE(diff.array().abs().maxCoeff() < 1e-10);
     }
-}
\ No newline at end of file
+}
+
+
+TEST_CASE("generic_tensor_parallel_errors", "[problem]") {
+    //u = (x^2, xy) is the solution of the linear elasticity with lambda = mu = 1 and this body force
+    const json problem_params = {
+        {"rhs", {"8", "0"}},
+        {"exact", {"x^2", "x*y"}},
+        {"exact_grad", {"2*x", "0", "y", "x"}},
+        {"dirichlet_boundary", {{{"id", "all"}, {"value", {"x^2", "x*y"}}}}}
+    };
+
+    const json args = {
+        {"problem", "GenericTensor"},
+        {"problem_params", problem_params},
+        {"tensor_formulation", "LinearElasticity"},
+        {"discr_order", 2},
+        {"n_refs", 3},
+        {"params", {{"lambda", 1}, {"mu", 1}}}
+    };
+
+    Eigen::MatrixXd V(4, 2);
+    V << 0, 0, 1, 0, 1, 1, 0, 1;
+    Eigen::MatrixXi F(2, 3);
+    F << 0, 1, 2, 0, 2, 3;
+
+    State state;
+    state.init(args);
+    state.load_mesh(V, F);
+    state.compute_mesh_stats();
+    state.build_basis();
+    state.assemble_rhs();
+    state.assemble_stiffness_mat();
+    state.solve_problem();
+
+    state.compute_errors();
+    const double l2 = state.l2_err, h1 = state.h1_err, linf = state.linf_err;
+    const Eigen::MatrixXd element_errors = state.element_errors;
+
+    //P2 reproduces the quadratic solution
+    REQUIRE(l2 < 1e-8);
+    REQUIRE(h1 < 1e-8);
+
+#ifdef POLYFEM_WITH_TBB
+    tbb::task_arena serial(1);
+    serial.execute([&] { state.compute_errors(); });
+#else
+    state.compute_errors();
+#endif
+
+    REQUIRE(std::abs(state.l2_err - l2) < 1e-12);
+    REQUIRE(std::abs(state.h1_err - h1) < 1e-12);
+    REQUIRE(std::abs(state.linf_err - linf) < 1e-12);
+    REQUIRE((state.element_errors - element_errors).norm() < 1e-12);
+}
+
+TEST_CASE("stress_recovery", "[problem]") {
+    Eigen::MatrixXd V(4, 2);
+    V << 0, 0, 1, 0, 1, 1, 0, 1;
+    Eigen::MatrixXi F(2, 3);
+    F << 0, 1, 2, 0, 2, 3;
+
+    State state;
+    state.init({{"problem", "GenericScalar"}, {"discr_order", 2}, {"n_refs", 2}});
+    state.load_mesh(V, F);
+    state.compute_mesh_stats();
+    state.build_basis();
+
+    Eigen::MatrixXd nodes(state.n_bases, 2);
+    for (const ElementBases &eb : state.bases)
+    {
+        for (const Basis &b : eb.bases)
+            nodes.row(b.global()[0].index) = b.global()[0].node;
+    }
+    const Eigen::ArrayXd x = nodes.col(0).array();
+    const Eigen::ArrayXd y = nodes.col(1).array();
+
+    Eigen::MatrixXd recovered;
+    Eigen::VectorXd errors;
+
+    //the gradient of a quadratic field is linear, the patch fit reproduces it at every node
+    const Eigen::MatrixXd quadratic = (x * x + 2 * x * y - 0.5 * y * y).matrix();
+    state.recover_stresses(quadratic, recovered, errors);
+    REQUIRE(recovered.rows() == state.n_bases);
+    REQUIRE(recovered.cols() == 3);
+    REQUIRE((recovered.col(0).array() - (2 * x + 2 * y)).abs().maxCoeff() < 1e-10);
+    REQUIRE((recovered.col(1).array() - (2 * x - y)).abs().maxCoeff() < 1e-10);
+
+    //constant gradient, no recovery error
+    const Eigen::MatrixXd linear = (3 * x - y + 1).matrix();
+    state.recover_stresses(linear, recovered, errors);
+    REQUIRE(errors.size() == int(state.bases.size()));
+    REQUIRE(errors.maxCoeff() < 1e-12);
+    REQUIRE((recovered.col(0).array() - 3).abs().maxCoeff() < 1e-12);
+    REQUIRE((recovered.col(1).array() + 1).abs().maxCoeff() < 1e-12);
+}
+
+TEST_CASE("solution_predictor", "[problem]") {
+    const json problem_params = {
+        {"rhs", {"0.5", "-0.2"}},
+        {"dirichlet_boundary", {{{"id", "all"}, {"value", {"0.2*x", "-0.1*x*y"}}}}}
+    };
+
+    Eigen::MatrixXd V(4, 2);
+    V << 0, 0, 1, 0, 1, 1, 0, 1;
+    Eigen::MatrixXi F(2, 3);
+    F << 0, 1, 2, 0, 2, 3;
+
+    const int steps = 5;
+    const auto solve = [&](const std::string &nl_solver, const std::string &predictor, Eigen::MatrixXd &sol) {
+        State state;
+        state.init({
+            {"problem", "GenericTensor"},
+            {"problem_params", problem_params},
+            {"tensor_formulation", "NeoHookean"},
+            {"discr_order", 1},
+            {"n_refs", 2},
+            {"nl_solver", nl_solver},
+            {"nl_solver_rhs_steps", steps},
+            {"predictor", {{"type", predictor}}},
+            {"params", {{"lambda", 1.7}, {"mu", 0.6}}}
+        });
+        state.load_mesh(V, F);
+        state.compute_mesh_stats();
+        state.build_basis();
+        state.assemble_rhs();
+        state.assemble_stiffness_mat();
+        state.solve_problem();
+
+        sol = state.sol;
+        return state.solver_info["predictor"];
+    };
+
+    //the run without prediction starts every load step from the last solution
+    Eigen::MatrixXd reference, sol;
+    const json previous = solve("newton", "previous", reference);
+    REQUIRE(int(previous["step_iterations"].size()) == steps);
+
+    for (const std::string type : {"linearized", "extrapolation"})
+    {
+        const json info = solve("newton", type, sol);
+        REQUIRE(int(info["step_iterations"].size()) == steps);
+        REQUIRE((sol - reference).norm() < 1e-6 * std::max(1., reference.norm()));
+        REQUIRE(int(info["total_iterations"]) < int(previous["total_iterations"]));
+    }
+
+    //the lbfgs load steps are recorded as well
+    const json lbfgs = solve("lbfgs", "linearized", sol);
+    REQUIRE(int(lbfgs["step_iterations"].size()) == steps);
+}
+
+TEST_CASE("nl_problem_cached_quantities", "[problem]") {
+    Eigen::MatrixXd V(4, 2);
+    V << 0, 0, 1, 0, 1, 1, 0, 1;
+    Eigen::MatrixXi F(2, 3);
+    F << 0, 1, 2, 0, 2, 3;
+
+    State state;
+    state.init({
+        {"problem", "GenericTensor"},
+        {"tensor_formulation", "NeoHookean"},
+        {"discr_order", 2},
+        {"n_refs", 1},
+        {"params", {{"lambda", 1.7}, {"mu", 0.6}}}
+    });
+    state.load_mesh(V, F);
+    state.compute_mesh_stats();
+    state.build_basis();
+    state.assemble_rhs();
+
+    RhsAssembler rhs_assembler(*state.mesh, state.n_bases, 2, state.bases, state.bases, state.formulation(), *state.problem);
+    NLProblem nl_problem(state, rhs_assembler, 0);
+    AssemblerUtils &assembler = AssemblerUtils::instance();
+
+    const auto check = [&](const Eigen::MatrixXd &x, const double energy, const Eigen::MatrixXd &grad) {
+        double expected_energy;
+        Eigen::MatrixXd expected_grad;
+        assembler.assemble_energy_quantities("NeoHookean", false, state.n_bases, state.bases, state.bases, x, &expected_energy, &expected_grad, nullptr);
+        REQUIRE(energy == Approx(expected_energy).epsilon(1e-12));
+        REQUIRE((grad - expected_grad).norm() < 1e-12 * std::max(1., expected_grad.norm()));
+    };
+
+    Eigen::MatrixXd x = 0.05 * Eigen::MatrixXd::Random(state.n_bases * 2, 1);
+
+    //the hessian pass fills the energy and the gradient
+    StiffnessMatrix hessian, expected_hessian;
+    nl_problem.compute_cached_quantities(x, true, true, &hessian);
+    REQUIRE(nl_problem.n_assembly_passes() == 1);
+    assembler.assemble_energy_quantities("NeoHookean", false, state.n_bases, state.bases, state.bases, x, nullptr, nullptr, &expected_hessian);
+    REQUIRE((hessian - expected_hessian).norm() < 1e-12 * expected_hessian.norm());
+    check(x, nl_problem.cached_energy_value(), nl_problem.cached_gradient());
+
+    //same point, served from the cache
+    nl_problem.compute_cached_quantities(x, true, true);
+    REQUIRE(nl_problem.n_assembly_passes() == 1);
+    check(x, nl_problem.cached_energy_value(), nl_problem.cached_gradient());
+
+    //the hessian is not kept
+    nl_problem.compute_cached_quantities(x, true, true, &hessian);
+    REQUIRE(nl_problem.n_assembly_passes() == 2);
+
+    //a new point invalidates the cache
+    const double prev_energy = nl_problem.cached_energy_value();
+    x(0) += 0.01;
+    nl_problem.compute_cached_quantities(x, true, false);
+    REQUIRE(nl_problem.n_assembly_passes() == 3);
+    REQUIRE(nl_problem.cached_energy_value() != prev_energy);
+
+    //only the missing gradient is assembled at the new point
+    nl_problem.compute_cached_quantities(x, true, true);
+    REQUIRE(nl_problem.n_assembly_passes() == 4);
+    nl_problem.compute_cached_quantities(x, true, true);
+    REQUIRE(nl_problem.n_assembly_passes() == 4);
+    check(x, nl_problem.cached_energy_value(), nl_problem.cached_gradient());
+}
+
+TEST_CASE("dof_renumbering_stokes", "[problem]") {
+    Eigen::MatrixXd V(4, 2);
+    V << 0, 0, 1, 0, 1, 1, 0, 1;
+    Eigen::MatrixXi F(2, 3);
+    F << 0, 1, 2, 0, 2, 3;
+
+    Eigen::MatrixXd reference;
+    for (const std::string renumbering : {"none", "rcm", "morton"})
+    {
+        State state;
+        state.init({
+            {"problem", "DrivenCavity"},
+            {"tensor_formulation", "Stokes"},
+            {"discr_order", 2},
+            {"pressure_discr_order", 1},
+            {"n_refs", 2},
+            {"dof_renumbering", renumbering}
+        });
+        state.load_mesh(V, F);
+        state.compute_mesh_stats();
+        state.build_basis();
+        state.assemble_rhs();
+        state.assemble_stiffness_mat();
+        state.solve_problem();
+
+        //velocity and pressure back in the input numbering
+        Eigen::MatrixXd sol;
+        DofRenumbering::to_original(state.bases_new_index, 2, state.pressure_bases_new_index, state.sol, sol);
+
+        if (renumbering == "none")
+        {
+            REQUIRE(state.bases_new_index.size() == 0);
+            reference = sol;
+            continue;
+        }
+
+        REQUIRE(state.bases_new_index.size() == state.n_bases);
+        REQUIRE(state.pressure_bases_new_index.size() == state.n_pressure_bases);
+        REQUIRE(sol.rows() == reference.rows());
+        REQUIRE((sol - reference).norm() < 1e-8 * std::max(1., reference.norm()));
+    }
+}
+
+TEST_CASE("stress_recovery_stokes", "[problem]") {
+    Eigen::MatrixXd V(4, 2);
+    V << 0, 0, 1, 0, 1, 1, 0, 1;
+    Eigen::MatrixXi F(2, 3);
+    F << 0, 1, 2, 0, 2, 3;
+
+    State state;
+    state.init({
+        {"problem", "DrivenCavity"},
+        {"tensor_formulation", "Stokes"},
+        {"discr_order", 2},
+        {"pressure_discr_order", 1},
+        {"n_refs", 2}
+    });
+    state.load_mesh(V, F);
+    state.compute_mesh_stats();
+    state.build_basis();
+    state.assemble_rhs();
+    state.assemble_stiffness_mat();
+    state.solve_problem();
+    state.compute_errors();
+
+    //the velocity gradient is recovered, one indicator per element
+    const int n_el = int(state.bases.size());
+    REQUIRE(state.stress_recovery_errors.size() == n_el);
+    REQUIRE(state.stress_recovery_errors.allFinite());
+    REQUIRE(state.stress_recovery_errors.maxCoeff() > 0);
+    REQUIRE((state.element_errors.col(3) - state.stress_recovery_errors).norm() == Approx(0).margin(1e-14));
+
+    //velocity gradient and its norm at the nodes
+    Eigen::MatrixXd recovered;
+    Eigen::VectorXd errors;
+    state.recover_stresses(state.sol, recovered, errors);
+    REQUIRE(recovered.rows() == state.n_bases);
+    REQUIRE(recovered.cols() == 5);
+    REQUIRE(recovered.allFinite());
+}
+
+TEST_CASE("adaptive_p_refinement", "[problem]") {
+    //harmonic solution, the rhs is zero
+    const json problem_params = {
+        {"rhs", 0},
+        {"exact", "exp(2*x)*sin(2*y)"},
+        {"exact_grad", {"2*exp(2*x)*sin(2*y)", "2*exp(2*x)*cos(2*y)"}},
+        {"dirichlet_boundary", {{{"id", "all"}, {"value", "exp(2*x)*sin(2*y)"}}}}
+    };
+
+    Eigen::MatrixXd V(4, 2);
+    V << 0, 0, 1, 0, 1, 1, 0, 1;
+    Eigen::MatrixXi F(2, 3);
+    F << 0, 1, 2, 0, 2, 3;
+
+    State state;
+    state.init({
+        {"problem", "GenericScalar"},
+        {"problem_params", problem_params},
+        {"discr_order", 1},
+        {"discr_order_max", 3},
+        {"n_refs", 2},
+        {"adaptive_p", {{"max_cycles", 2}, {"fraction", 0.3}}}
+    });
+    state.load_mesh(V, F);
+    state.compute_mesh_stats();
+    state.build_basis();
+    state.assemble_rhs();
+    state.assemble_stiffness_mat();
+    state.solve_problem();
+    state.compute_errors();
+
+    //with an exact solution the indicator is the H1 error
+    REQUIRE((state.element_errors.col(3) - state.element_errors.col(1)).norm() == Approx(0).margin(1e-14));
+
+    state.adaptive_p_refinement();
+
+    const json &info = state.adaptive_info;
+    REQUIRE(info.size() == 3);
+    const int n_el = int(state.bases.size());
+    for (int cycle = 1; cycle < 3; ++cycle)
+    {
+        REQUIRE(info[cycle]["num_dofs"] > info[cycle - 1]["num_dofs"]);
+        REQUIRE(info[cycle]["err_h1"] < info[cycle - 1]["err_h1"]);
+
+        //only the marked elements are integrated again
+        REQUIRE(info[cycle]["reused_elements"] > 0);
+        REQUIRE(info[cycle]["reused_elements"] < n_el);
+    }
+    REQUIRE(state.disc_orders.maxCoeff() > 1);
+
+    //the reused element matrices give the same system as a full assembly
+    StiffnessMatrix full;
+    AssemblerUtils::instance().assemble_problem("Laplacian", false, state.n_bases, state.bases, state.iso_parametric() ? state.bases : state.geom_bases, full);
+    REQUIRE((full - state.stiffness).norm() < 1e-12 * full.norm());
+}
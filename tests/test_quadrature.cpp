@@ -2,7 +2,10 @@
 #include <polyfem/LineQuadrature.hpp>
 #include <polyfem/TriQuadrature.hpp>
 #include <polyfem/TetQuadrature.hpp>
+#include <polyfem/BDF.hpp>
+#include <polyfem/TimeStepController.hpp>
 #include <iostream>
+#include <vector>
 #include <cmath>
 #include <Eigen/Dense>
 #include <Eigen/Geometry>
@@ -69,6 +72,85 @@ TEST_CASE("weights", "[quadrature]") {
 	}
 }
 
+TEST_CASE("bdf_variable_step", "[quadrature]") {
+	const double dt = 0.1;
+	for (int order = 1; order <= 6; ++order) {
+		BDF fixed(order), variable(order);
+		Eigen::VectorXd rhs_fixed, rhs_variable;
+
+		for (int i = 0; i < 8; ++i) {
+			Eigen::VectorXd x(1); x << std::sin(i * dt);
+
+			if (i > 0) {
+				// Variable step coefficients reduce to the tabulated ones for constant steps
+				REQUIRE(variable.alpha(dt) == Approx(fixed.alpha()).margin(1e-10));
+				fixed.rhs(rhs_fixed);
+				variable.rhs(dt, rhs_variable);
+				REQUIRE((rhs_fixed - rhs_variable).norm() == Approx(0).margin(1e-10));
+			}
+
+			fixed.new_solution(x);
+			variable.new_solution(x, i * dt);
+		}
+	}
+
+	// The predictor, and thus the error estimate, is exact for polynomials of degree order
+	BDF bdf(2);
+	const std::vector<double> times = {0, 0.1, 0.3};
+	for (double t : times) {
+		Eigen::VectorXd x(1); x << 1 + 2 * t - t * t;
+		bdf.new_solution(x, t);
+	}
+	Eigen::VectorXd x(1), err;
+	x << 1 + 2 * 0.35 - 0.35 * 0.35;
+	bdf.error_estimate(0.05, 2, x, err);
+	REQUIRE(err.norm() == Approx(0).margin(1e-12));
+}
+
+TEST_CASE("time_step_controller", "[quadrature]") {
+	// y' = -y, y(0) = 1, with the variable step BDF2. Only the tolerances are given, the other parameters use their defaults
+	const json params = {{"enabled", true}, {"tol_abs", 1e-6}, {"tol_rel", 1e-4}, {"dt0", 0.05}};
+	const double tend = 2;
+	TimeStepController controller(params, tend, 10);
+	BDF bdf(2);
+
+	Eigen::VectorXd x(1), rhs;
+	x << 1;
+	bdf.new_solution(x, 0);
+
+	int n_attempts = 0;
+	while (!controller.finished() && n_attempts < 1000) {
+		++n_attempts;
+		const double dt = controller.dt();
+		const double time = controller.next_time();
+		const bool starting = bdf.history_size() <= bdf.current_order();
+
+		bdf.rhs(dt, rhs);
+		x = rhs / (bdf.alpha(dt) + dt);
+
+		const bool accepted = controller.check_bdf_step(bdf, 2, dt, 1, x);
+		if (starting) {
+			// Without enough history there is no estimate, the step is accepted and dt kept
+			REQUIRE(accepted);
+			REQUIRE(controller.dt() == Approx(dt).margin(1e-14));
+		}
+		if (!accepted)
+			continue;
+
+		bdf.new_solution(x, time);
+	}
+
+	REQUIRE(controller.finished());
+	REQUIRE(controller.time() == Approx(tend).margin(1e-12));
+	REQUIRE(std::abs(x(0) - std::exp(-tend)) < 1e-3);
+
+	json info;
+	controller.save_info(info);
+	// The step grows past the start, and is not rejected over and over
+	REQUIRE(double(info["dt_max"]) > 0.05);
+	REQUIRE(int(info["rejected_steps"]) < int(info["accepted_steps"]));
+}
+
 //TEST_CASE("triangle", "[quadrature]") {
 //	for (int order = 1; order < 10; ++order) {
 //		Quadrature quadr;
@@ -2,6 +2,21 @@
 
 #include <polyfem/TriQuadrature.hpp>
 #include <polyfem/FEBasis2d.hpp>
+#include <polyfem/SaddlePointSolver.hpp>
+#include <polyfem/FEBasis3d.hpp>
+#include <polyfem/Mesh3D.hpp>
+#include <polyfem/AssemblerUtils.hpp>
+#include <polyfem/SumFactorizationOperator.hpp>
+#include <polyfem/MatrixFreeSolver.hpp>
+#include <polyfem/StaticCondensation.hpp>
+#include <polyfem/Mesh2D.hpp>
+#include <polyfem/GeometricMultigrid.hpp>
+#include <polyfem/MultigridSolver.hpp>
+#include <polyfem/SparseNewtonDescentSolver.hpp>
+#include <polyfem/ElasticityUtils.hpp>
+#include <polyfem/ElementAssemblyValues.hpp>
+
+#include <polysolve/LinearSolver.hpp>
 
 #include <catch.hpp>
 #include <iostream>
@@ -26,6 +41,69 @@ public:
     }
 };
 
+//neo hookean on the bases, the nodes at x = 0 are fixed and the ones at x = 1 are pulled by stretch
+class StretchedNeoHookean : public cppoptlib::Problem<double> {
+public:
+    typedef StiffnessMatrix THessian;
+
+    StretchedNeoHookean(const std::vector<ElementBases> &bases, const int n_bases, const double stretch)
+        : bases(bases), n_bases(n_bases)
+    {
+        fixed.setZero(n_bases * 2);
+        std::vector<bool> visited(n_bases, false);
+        std::vector<Eigen::Triplet<double>> entries;
+        int n_free = 0;
+        for (const auto &eb : bases)
+        {
+            for (const auto &b : eb.bases)
+            {
+                const int index = b.global().front().index;
+                if (visited[index])
+                    continue;
+                visited[index] = true;
+
+                const double x = b.global().front().node(0);
+                if (x < 1e-10)
+                    continue;
+                if (x > 1 - 1e-10)
+                {
+                    fixed(index * 2) = stretch;
+                    continue;
+                }
+                for (int d = 0; d < 2; ++d)
+                    entries.emplace_back(index * 2 + d, n_free++, 1.);
+            }
+        }
+        selection.resize(n_bases * 2, n_free);
+        selection.setFromTriplets(entries.begin(), entries.end());
+    }
+
+    int n_free() const { return int(selection.cols()); }
+
+    double value(const TVector &x) override {
+        const Eigen::MatrixXd full = fixed + selection * x;
+        return AssemblerUtils::instance().assemble_energy("NeoHookean", false, bases, bases, full);
+    }
+    void gradient(const TVector &x, TVector &grad) override {
+        const Eigen::MatrixXd full = fixed + selection * x;
+        Eigen::MatrixXd full_grad;
+        AssemblerUtils::instance().assemble_energy_gradient("NeoHookean", false, n_bases, bases, bases, full, full_grad);
+        grad = selection.transpose() * full_grad;
+    }
+    void hessian(const TVector &x, THessian &hessian) {
+        const Eigen::MatrixXd full = fixed + selection * x;
+        StiffnessMatrix full_hessian;
+        AssemblerUtils::instance().assemble_energy_hessian("NeoHookean", false, n_bases, bases, bases, full, full_hessian);
+        hessian = selection.transpose() * full_hessian * selection;
+    }
+
+private:
+    const std::vector<ElementBases> &bases;
+    const int n_bases;
+    Eigen::VectorXd fixed;
+    StiffnessMatrix selection;
+};
+
 TEST_CASE("solver", "[solver]") {
     Rosenbrock f;
     cppoptlib::BfgsSolver<Rosenbrock> solver;
@@ -36,3 +114,848 @@ TEST_CASE("solver", "[solver]") {
     REQUIRE(f(x) < 1e-10);
 }
 
+
+TEST_CASE("saddle_point", "[solver]") {
+    const int nv = 20, np = 5;
+    Eigen::MatrixXd A = Eigen::MatrixXd::Random(nv, nv);
+    A = A * A.transpose() + nv * Eigen::MatrixXd::Identity(nv, nv);
+    const Eigen::MatrixXd B = Eigen::MatrixXd::Random(nv, np);
+
+    Eigen::MatrixXd K = Eigen::MatrixXd::Zero(nv + np, nv + np);
+    K.topLeftCorner(nv, nv) = A;
+    K.topRightCorner(nv, np) = B;
+    K.bottomLeftCorner(np, nv) = B.transpose();
+
+    StiffnessMatrix mass(np, np);
+    mass.setIdentity();
+
+    const std::vector<int> dirichlet = {0, 5};
+    const Eigen::VectorXd b = Eigen::VectorXd::Random(nv + np);
+
+    //reference: rows and columns of the dirichlet nodes replaced by the identity
+    Eigen::MatrixXd Kd = K;
+    Eigen::VectorXd known = Eigen::VectorXd::Zero(nv + np);
+    for (int i : dirichlet)
+        known(i) = b(i);
+    Eigen::VectorXd g = b - K * known;
+    for (int i : dirichlet)
+    {
+        Kd.row(i).setZero();
+        Kd.col(i).setZero();
+        Kd(i, i) = 1;
+        g(i) = b(i);
+    }
+    const Eigen::VectorXd expected = Kd.fullPivLu().solve(g);
+
+    for (const std::string krylov : {"minres", "gmres"})
+    {
+        json params = {{"krylov", krylov}, {"tolerance", 1e-12}, {"velocity_solver", polysolve::LinearSolver::defaultSolver()}};
+        SaddlePointSolver solver(params, 1);
+        solver.set_pressure_mass(mass);
+
+        Eigen::VectorXd x;
+        const StiffnessMatrix Ks = K.sparseView();
+        solver.solve(Ks, nv, np, true, b, dirichlet, x);
+        REQUIRE((x - expected).norm() < 1e-8 * expected.norm());
+
+        //same matrix, the factorizations are reused
+        json info;
+        solver.getInfo(info);
+        REQUIRE(!info["velocity_factorization_reused"]);
+        REQUIRE(!info["schur_factorization_reused"]);
+        solver.solve(Ks, nv, np, true, b, dirichlet, x);
+        REQUIRE((x - expected).norm() < 1e-8 * expected.norm());
+        solver.getInfo(info);
+        REQUIRE(info["velocity_factorization_reused"]);
+        REQUIRE(info["schur_factorization_reused"]);
+    }
+
+    //an iterative velocity solver is not a fixed preconditioner
+    {
+        json params = {{"krylov", "minres"}, {"tolerance", 1e-12}, {"velocity_solver", "Eigen::ConjugateGradient"}};
+        SaddlePointSolver solver(params, 1);
+        solver.set_pressure_mass(mass);
+
+        Eigen::VectorXd x;
+        const StiffnessMatrix Ks = K.sparseView();
+        solver.solve(Ks, nv, np, true, b, dirichlet, x);
+        REQUIRE((x - expected).norm() < 1e-8 * expected.norm());
+
+        json info;
+        solver.getInfo(info);
+        REQUIRE(info["solver"] == "GMRES");
+    }
+
+    //the average constraint does not move dirichlet pressures
+    {
+        const std::vector<int> dirichlet_p = {0, 5, nv + 2};
+        Eigen::MatrixXd Kp = K;
+        known.setZero();
+        for (int i : dirichlet_p)
+            known(i) = b(i);
+        g = b - K * known;
+        for (int i : dirichlet_p)
+        {
+            Kp.row(i).setZero();
+            Kp.col(i).setZero();
+            Kp(i, i) = 1;
+            g(i) = b(i);
+        }
+        const Eigen::VectorXd expected_p = Kp.fullPivLu().solve(g);
+
+        Eigen::MatrixXd Kavg = Eigen::MatrixXd::Zero(nv + np + 1, nv + np + 1);
+        Kavg.topLeftCorner(nv + np, nv + np) = K;
+        Kavg.block(nv + np, nv, 1, np).setOnes();
+        Kavg.block(nv, nv + np, np, 1).setOnes();
+        Eigen::VectorXd bavg(nv + np + 1);
+        bavg << b, 0;
+
+        json params = {{"tolerance", 1e-12}, {"velocity_solver", polysolve::LinearSolver::defaultSolver()}};
+        SaddlePointSolver solver(params, 1);
+        solver.set_pressure_mass(mass);
+
+        Eigen::VectorXd x;
+        const StiffnessMatrix Ks = Kavg.sparseView();
+        solver.solve(Ks, nv, np, true, bavg, dirichlet_p, x);
+        REQUIRE(x.size() == nv + np + 1);
+        REQUIRE(x(nv + 2) == Approx(b(nv + 2)));
+        REQUIRE((x.head(nv + np) - expected_p).norm() < 1e-8 * expected_p.norm());
+    }
+}
+
+TEST_CASE("saddle_point_transient", "[solver]") {
+    //A = K + alpha/dt M with a 1D laplacian and lumped mass
+    const int nv = 30, np = 10;
+    const double coeff = 1.5 / 0.01;
+    Eigen::MatrixXd A = Eigen::MatrixXd::Zero(nv, nv);
+    for (int i = 0; i < nv; ++i)
+    {
+        A(i, i) = 2 + coeff;
+        if (i > 0)
+            A(i, i - 1) = A(i - 1, i) = -1;
+    }
+    //discrete gradient, B^T B is the pressure laplacian
+    Eigen::MatrixXd B = Eigen::MatrixXd::Zero(nv, np);
+    for (int i = 0; i + 1 < np; ++i)
+    {
+        B(i, i) = -1;
+        B(i, i + 1) = 1;
+    }
+
+    Eigen::MatrixXd K = Eigen::MatrixXd::Zero(nv + np, nv + np);
+    K.topLeftCorner(nv, nv) = A;
+    K.topRightCorner(nv, np) = B;
+    K.bottomLeftCorner(np, nv) = B.transpose();
+
+    StiffnessMatrix mass(np, np);
+    mass.setIdentity();
+    Eigen::MatrixXd L = Eigen::MatrixXd::Zero(np, np);
+    for (int i = 0; i + 1 < np; ++i)
+    {
+        L(i, i) += 1;
+        L(i + 1, i + 1) += 1;
+        L(i, i + 1) = L(i + 1, i) = -1;
+    }
+
+    //the first pressure fixes the constant
+    const std::vector<int> dirichlet = {nv - 1, nv};
+    const Eigen::VectorXd b = Eigen::VectorXd::Random(nv + np);
+
+    Eigen::MatrixXd Kd = K;
+    Eigen::VectorXd g = b;
+    for (int i : dirichlet)
+        g -= K.col(i) * b(i);
+    for (int i : dirichlet)
+    {
+        Kd.row(i).setZero();
+        Kd.col(i).setZero();
+        Kd(i, i) = 1;
+        g(i) = b(i);
+    }
+    const Eigen::VectorXd expected = Kd.fullPivLu().solve(g);
+
+    int iterations[2];
+    for (int cc = 0; cc < 2; ++cc)
+    {
+        json params = {{"tolerance", 1e-10}, {"velocity_solver", polysolve::LinearSolver::defaultSolver()}};
+        SaddlePointSolver solver(params, 1);
+        solver.set_pressure_mass(mass);
+        solver.set_pressure_laplacian(L.sparseView());
+        if (cc)
+            solver.set_mass_coefficient(coeff);
+
+        Eigen::VectorXd x;
+        const StiffnessMatrix Ks = K.sparseView();
+        solver.solve(Ks, nv, np, true, b, dirichlet, x);
+        REQUIRE((x - expected).norm() < 1e-7 * expected.norm());
+
+        json info;
+        solver.getInfo(info);
+        REQUIRE(info["cahouet_chabard"] == bool(cc));
+        iterations[cc] = info["iterations"];
+    }
+
+    //the mass term dominates the Schur complement, Cahouet-Chabard needs fewer iterations
+    REQUIRE(iterations[1] < iterations[0]);
+}
+
+TEST_CASE("lame_parameters_field", "[solver]") {
+    Eigen::MatrixXd V(4, 2);
+    V << 0, 0, 1, 0, 1.2, 1, 0, 0.9;
+    Eigen::MatrixXi F(2, 3);
+    F << 0, 1, 2, 0, 2, 3;
+
+    Mesh2D mesh;
+    REQUIRE(mesh.build_from_matrices(V, F));
+    std::vector<int> parents;
+    mesh.refine(1, 0, parents);
+
+    std::vector<ElementBases> bases;
+    std::vector<LocalBoundary> local_boundary;
+    std::map<int, InterfaceData> poly_edge_to_data;
+    FEBasis2d::build_bases(mesh, 4, 2, false, false, false, bases, local_boundary, poly_edge_to_data);
+
+    LameParameters params;
+    params.init({{"lambda", "1+x*y"}, {"mu", "2+x"}, {"size", 2}});
+    params.precompute(false, bases, bases);
+    REQUIRE(params.has_precomputed());
+
+    ElementAssemblyValues vals;
+    for (std::size_t e = 0; e < bases.size(); ++e)
+    {
+        vals.compute(e, false, bases[e], bases[e]);
+        REQUIRE(vals.at_quadrature);
+        for (long p = 0; p < vals.val.rows(); ++p)
+        {
+            double lambda, mu;
+            params.lambda_mu(vals, p, lambda, mu);
+            REQUIRE(lambda == Approx(1 + vals.val(p, 0) * vals.val(p, 1)));
+            REQUIRE(mu == Approx(2 + vals.val(p, 0)));
+        }
+
+        //other points with as many rows as the quadrature do not read the field
+        const Eigen::MatrixXd pts = 0.25 * (Eigen::MatrixXd::Random(vals.quadrature.points.rows(), 2).array() + 1);
+        vals.compute(e, false, pts, bases[e], bases[e]);
+        REQUIRE(!vals.at_quadrature);
+        for (long p = 0; p < vals.val.rows(); ++p)
+        {
+            double lambda, mu;
+            params.lambda_mu(vals, p, lambda, mu);
+            REQUIRE(lambda == Approx(1 + vals.val(p, 0) * vals.val(p, 1)));
+            REQUIRE(mu == Approx(2 + vals.val(p, 0)));
+        }
+    }
+}
+
+TEST_CASE("stress_and_von_mises", "[solver]") {
+    Eigen::MatrixXd V(4, 2);
+    V << 0, 0, 1, 0, 1.2, 1, 0, 0.9;
+    Eigen::MatrixXi F(2, 3);
+    F << 0, 1, 2, 0, 2, 3;
+
+    Mesh2D mesh;
+    REQUIRE(mesh.build_from_matrices(V, F));
+    std::vector<int> parents;
+    mesh.refine(1, 0, parents);
+
+    std::vector<ElementBases> bases;
+    std::vector<LocalBoundary> local_boundary;
+    std::map<int, InterfaceData> poly_edge_to_data;
+    const int n_bases = FEBasis2d::build_bases(mesh, 4, 2, false, false, false, bases, local_boundary, poly_edge_to_data);
+
+    const double lambda = 1.7, mu = 0.6;
+    auto &assembler = AssemblerUtils::instance();
+    assembler.set_parameters({{"lambda", lambda}, {"mu", mu}, {"size", 2}});
+
+    srand(42);
+    const Eigen::MatrixXd displacement = 0.1 * Eigen::MatrixXd::Random(n_bases * 2, 1);
+
+    for(const std::string name : {"LinearElasticity", "HookeLinearElasticity", "SaintVenant", "NeoHookean"})
+    {
+        for (std::size_t e = 0; e < bases.size(); ++e)
+        {
+            ElementAssemblyValues vals;
+            vals.compute(e, false, bases[e], bases[e]);
+            const Eigen::MatrixXd &pts = vals.quadrature.points;
+
+            //batched tensor and von mises against the separate evaluations
+            Eigen::MatrixXd tensor, von_mises, expected_tensor, expected_von_mises;
+            assembler.compute_stress_and_von_mises(name, e, bases[e], bases[e], pts, displacement, tensor, von_mises);
+            assembler.compute_tensor_value(name, e, bases[e], bases[e], pts, displacement, expected_tensor);
+            assembler.compute_scalar_value(name, e, bases[e], bases[e], pts, displacement, expected_von_mises);
+
+            REQUIRE(tensor.rows() == pts.rows());
+            REQUIRE(tensor.cols() == 4);
+            REQUIRE((tensor - expected_tensor).cwiseAbs().maxCoeff() == Approx(0).margin(1e-12));
+            REQUIRE((von_mises - expected_von_mises).cwiseAbs().maxCoeff() == Approx(0).margin(1e-12));
+
+            if(name != "LinearElasticity")
+                continue;
+
+            //per point displacement gradient from the global nodes
+            for(long p = 0; p < pts.rows(); ++p)
+            {
+                Eigen::Matrix2d grad = Eigen::Matrix2d::Zero();
+                for(std::size_t j = 0; j < bases[e].bases.size(); ++j)
+                {
+                    for(const auto &g : bases[e].bases[j].global())
+                    {
+                        for(int d = 0; d < 2; ++d)
+                            grad.row(d) += g.val * vals.basis_values[j].grad_t_m.row(p) * displacement(g.index * 2 + d);
+                    }
+                }
+
+                const Eigen::Matrix2d strain = (grad + grad.transpose()) / 2;
+                const Eigen::Matrix2d stress = 2 * mu * strain + lambda * strain.trace() * Eigen::Matrix2d::Identity();
+
+                for(int k = 0; k < 4; ++k)
+                    REQUIRE(tensor(p, k) == Approx(stress(k)).margin(1e-12));
+                REQUIRE(von_mises(p) == Approx(von_mises_stress_for_stress_tensor(stress)).margin(1e-12));
+            }
+        }
+    }
+}
+
+TEST_CASE("assembly_dof_map", "[solver]") {
+    Eigen::MatrixXd V(4, 2);
+    V << 0, 0, 1, 0, 1.2, 1, 0, 0.9;
+    Eigen::MatrixXi F(2, 3);
+    F << 0, 1, 2, 0, 2, 3;
+
+    Mesh2D mesh;
+    REQUIRE(mesh.build_from_matrices(V, F));
+    std::vector<int> parents;
+    mesh.refine(2, 0, parents);
+
+    auto &assembler = AssemblerUtils::instance();
+    assembler.set_parameters({{"lambda", 1.7}, {"mu", 0.6}, {"size", 2}});
+
+    //two basis sets with their own maps, the assemblies only use the map they are given
+    for (const int order : {2, 1})
+    {
+        std::vector<ElementBases> bases;
+        std::vector<LocalBoundary> local_boundary;
+        std::map<int, InterfaceData> poly_edge_to_data;
+        const int n_bases = FEBasis2d::build_bases(mesh, 4, order, false, false, false, bases, local_boundary, poly_edge_to_data);
+
+        ElementDofMap dof_map;
+        dof_map.build(bases, n_bases);
+
+        StiffnessMatrix stiffness, mapped_stiffness, hessian, mapped_hessian;
+        assembler.assemble_problem("LinearElasticity", false, n_bases, bases, bases, stiffness);
+        assembler.assemble_problem("LinearElasticity", false, n_bases, bases, bases, mapped_stiffness, nullptr, &dof_map);
+        REQUIRE(mapped_stiffness.rows() == n_bases * 2);
+        REQUIRE((mapped_stiffness - stiffness).norm() < 1e-12 * std::max(1., stiffness.norm()));
+
+        const Eigen::MatrixXd displacement = 0.05 * Eigen::MatrixXd::Random(n_bases * 2, 1);
+        assembler.assemble_energy_hessian("NeoHookean", false, n_bases, bases, bases, displacement, hessian);
+        assembler.assemble_energy_hessian("NeoHookean", false, n_bases, bases, bases, displacement, mapped_hessian, &dof_map);
+        REQUIRE((mapped_hessian - hessian).norm() < 1e-12 * std::max(1., hessian.norm()));
+    }
+}
+
+
+TEST_CASE("matrix_free", "[solver]") {
+    //two hexes of [0,2]x[0,1]x[0,1], sheared so that the jacobian is not diagonal
+    Eigen::MatrixXd V(12, 3);
+    Eigen::MatrixXi F(2, 8);
+    for (int z = 0; z < 2; ++z)
+        for (int y = 0; y < 2; ++y)
+            for (int x = 0; x < 3; ++x)
+                V.row((z * 2 + y) * 3 + x) << x + 0.2 * y, y + 0.1 * z, z + 0.1 * x;
+    for (int e = 0; e < 2; ++e)
+        F.row(e) << e, e + 1, e + 3, e + 4, e + 6, e + 7, e + 9, e + 10;
+
+    Mesh3D mesh;
+    REQUIRE(mesh.build_from_matrices(V, F));
+    mesh.compute_elements_tag();
+
+    auto &assembler = AssemblerUtils::instance();
+    assembler.set_parameters({{"lambda", 1.7}, {"mu", 0.6}, {"size", 3}});
+
+    for (int k = 1; k <= 3; ++k)
+    {
+        std::vector<ElementBases> bases;
+        std::vector<LocalBoundary> local_boundary;
+        std::map<int, InterfaceData> poly_face_to_data;
+        const int n_bases = FEBasis3d::build_bases(mesh, 2 * k + 1, k, false, false, false, bases, local_boundary, poly_face_to_data);
+        assembler.precompute_material_parameters(true, bases, bases);
+
+        for (const std::string formulation : {"Laplacian", "LinearElasticity"})
+        {
+            const int size = formulation == "Laplacian" ? 1 : 3;
+            StiffnessMatrix stiffness;
+            assembler.assemble_problem(formulation, true, n_bases, bases, bases, stiffness);
+
+            SumFactorizationOperator op;
+            REQUIRE(op.init(formulation, size, mesh, bases, bases, n_bases, &assembler.lame_params()));
+            REQUIRE(op.rows() == stiffness.rows());
+
+            const Eigen::VectorXd x = Eigen::VectorXd::Random(op.rows());
+            Eigen::VectorXd y;
+            op.apply(x, y);
+            const Eigen::VectorXd expected = stiffness * x;
+            REQUIRE((y - expected).norm() < 1e-10 * expected.norm());
+
+            Eigen::VectorXd diag;
+            op.diagonal(diag);
+            REQUIRE((diag - Eigen::VectorXd(stiffness.diagonal())).norm() < 1e-10 * diag.norm());
+
+            //the nodes of the sheared face x = 0.2 y
+            std::vector<int> dirichlet;
+            for (const auto &b : bases[0].bases)
+            {
+                const RowVectorNd &p = b.global()[0].node;
+                if (std::abs(p(0) - 0.2 * p(1)) < 1e-10)
+                    for (int d = 0; d < size; ++d)
+                        dirichlet.push_back(b.global()[0].index * size + d);
+            }
+
+            const Eigen::VectorXd b = Eigen::VectorXd::Random(op.rows());
+            Eigen::MatrixXd Kd = stiffness;
+            for (int i : dirichlet)
+            {
+                Kd.row(i).setZero();
+                Kd(i, i) = 1;
+            }
+            const Eigen::VectorXd reference = Kd.fullPivLu().solve(b);
+
+            for (const std::string solver_name : {"cg", "chebyshev"})
+            {
+                const json params = {{"solver", solver_name}, {"tolerance", 1e-12}, {"max_iter", 10000}};
+                MatrixFreeSolver solver(params);
+                Eigen::VectorXd sol;
+                solver.solve(op, b, dirichlet, sol);
+                REQUIRE((sol - reference).norm() < 1e-8 * reference.norm());
+            }
+        }
+    }
+}
+
+
+TEST_CASE("static_condensation", "[solver]") {
+    //chain of 3 elements with 4 nodes, the two middle nodes of each element are interior
+    const int n_elements = 3, n_loc = 4, size = 2;
+    const int n_bases = n_elements * (n_loc - 1) + 1;
+    const int n_dofs = n_bases * size;
+
+    std::vector<ElementBases> bases(n_elements);
+    std::vector<Eigen::MatrixXd> locals(n_elements);
+    Eigen::MatrixXd K = Eigen::MatrixXd::Zero(n_dofs, n_dofs);
+    for (int e = 0; e < n_elements; ++e)
+    {
+        bases[e].bases.resize(n_loc);
+        for (int j = 0; j < n_loc; ++j)
+        {
+            RowVectorNd node(1);
+            node << e * (n_loc - 1) + j;
+            bases[e].bases[j].init(1, e * (n_loc - 1) + j, j, node);
+        }
+
+        const Eigen::MatrixXd R = Eigen::MatrixXd::Random(n_loc * size, n_loc * size);
+        locals[e] = R * R.transpose() + Eigen::MatrixXd::Identity(n_loc * size, n_loc * size);
+        K.block(e * (n_loc - 1) * size, e * (n_loc - 1) * size, n_loc * size, n_loc * size) += locals[e];
+    }
+
+    const std::vector<int> dirichlet = {0, 1};
+    const Eigen::VectorXd b = Eigen::VectorXd::Random(n_dofs);
+
+    Eigen::MatrixXd Kd = K;
+    for (int i : dirichlet)
+    {
+        Kd.row(i).setZero();
+        Kd(i, i) = 1;
+    }
+    const Eigen::VectorXd expected = Kd.fullPivLu().solve(b);
+
+    StaticCondensation condensation;
+    //the interior nodes and the last node, which is only in the last element
+    REQUIRE(condensation.build(bases, n_bases, size, dirichlet) == (n_elements * 2 + 1) * size);
+
+    Eigen::MatrixXd S = Eigen::MatrixXd::Zero(condensation.n_skeleton_dofs(), condensation.n_skeleton_dofs());
+    for (int e = 0; e < n_elements; ++e)
+    {
+        REQUIRE(condensation.has_condensed_dofs(e));
+
+        Eigen::MatrixXd schur;
+        condensation.condense_element(e, locals[e], schur);
+        const std::vector<int> &dofs = condensation.element_skeleton_dofs(e);
+        for (int i = 0; i < schur.rows(); ++i)
+            for (int j = 0; j < schur.cols(); ++j)
+                S(dofs[i], dofs[j]) += schur(i, j);
+    }
+
+    Eigen::VectorXd skeleton_b;
+    std::vector<int> skeleton_dirichlet;
+    condensation.condense_rhs(b, skeleton_b);
+    condensation.condense_boundary_nodes(dirichlet, skeleton_dirichlet);
+    for (int i : skeleton_dirichlet)
+    {
+        S.row(i).setZero();
+        S(i, i) = 1;
+    }
+    const Eigen::VectorXd skeleton_x = S.fullPivLu().solve(skeleton_b);
+
+    Eigen::VectorXd x;
+    condensation.recover(skeleton_x, b, x);
+    REQUIRE((x - expected).norm() < 1e-10 * expected.norm());
+}
+
+
+TEST_CASE("geometric_multigrid", "[solver]") {
+    Eigen::MatrixXd V(4, 2);
+    V << 0, 0, 1, 0, 1, 1, 0, 1;
+    Eigen::MatrixXi F(2, 3);
+    F << 0, 1, 2, 0, 2, 3;
+
+    const int n_refs = 4;
+    std::vector<std::unique_ptr<Mesh>> coarse_meshes;
+    for (int l = 0; l < n_refs; ++l)
+    {
+        auto level = std::make_unique<Mesh2D>();
+        REQUIRE(level->build_from_matrices(V, F));
+        std::vector<int> parents;
+        level->refine(l, 0, parents);
+        coarse_meshes.push_back(std::move(level));
+    }
+
+    Mesh2D mesh;
+    REQUIRE(mesh.build_from_matrices(V, F));
+    std::vector<int> parents;
+    mesh.refine(n_refs, 0, parents);
+
+    for (int discr_order = 1; discr_order <= 2; ++discr_order)
+    {
+        std::vector<ElementBases> bases;
+        std::vector<LocalBoundary> local_boundary;
+        std::map<int, InterfaceData> poly_edge_to_data;
+        const int n_bases = FEBasis2d::build_bases(mesh, 4, discr_order, false, false, false, bases, local_boundary, poly_edge_to_data);
+
+        auto hierarchy = std::make_shared<GeometricMultigrid>();
+        REQUIRE(hierarchy->init(coarse_meshes, bases, n_bases, discr_order, 4, false));
+        REQUIRE(hierarchy->n_levels() == n_refs + 1);
+        REQUIRE(hierarchy->n_bases(n_refs) == n_bases);
+
+        //the nested spaces contain the linear functions
+        for (int l = 0; l < n_refs; ++l)
+        {
+            const StiffnessMatrix &P = hierarchy->prolongation(l);
+            REQUIRE((P * Eigen::VectorXd::Ones(P.cols()) - Eigen::VectorXd::Ones(P.rows())).norm() < 1e-10);
+        }
+
+        //dirichlet on the boundary of the square
+        std::vector<bool> is_boundary_node(n_bases, false);
+        for (const auto &eb : bases)
+        {
+            for (const auto &b : eb.bases)
+            {
+                const RowVectorNd &p = b.global()[0].node;
+                if (std::min(p.minCoeff(), 1 - p.maxCoeff()) < 1e-10)
+                    is_boundary_node[b.global()[0].index] = true;
+            }
+        }
+
+        //scalar and vector problems, the vector dofs are interleaved
+        for (const int size : {1, 2})
+        {
+            const std::string formulation = size == 1 ? "Laplacian" : "LinearElasticity";
+            AssemblerUtils::instance().set_parameters({{"lambda", 1.7}, {"mu", 0.6}, {"size", size}});
+            StiffnessMatrix A;
+            AssemblerUtils::instance().assemble_problem(formulation, false, n_bases, bases, bases, A);
+            const int n_dofs = n_bases * size;
+            REQUIRE(A.rows() == n_dofs);
+
+            std::vector<int> dirichlet;
+            for (int i = 0; i < n_bases; ++i)
+            {
+                for (int d = 0; d < size && is_boundary_node[i]; ++d)
+                    dirichlet.push_back(i * size + d);
+            }
+            std::vector<bool> is_dirichlet(n_dofs, false);
+            for (int i : dirichlet)
+                is_dirichlet[i] = true;
+
+            //full system with identity rows and columns like dirichlet_solve
+            StiffnessMatrix full = A;
+            full.prune([&](const int i, const int j, const double) { return i == j || (!is_dirichlet[i] && !is_dirichlet[j]); });
+            for (int i : dirichlet)
+                full.coeffRef(i, i) = 1;
+
+            //reduced system without the dirichlet rows and columns, as in the Newton steps
+            std::vector<int> reduced_index(n_dofs, -1);
+            int n_reduced = 0;
+            for (int i = 0; i < n_dofs; ++i)
+            {
+                if (!is_dirichlet[i])
+                    reduced_index[i] = n_reduced++;
+            }
+            REQUIRE(n_reduced == n_dofs - int(dirichlet.size()));
+
+            std::vector<Eigen::Triplet<double>> entries;
+            for (int k = 0; k < A.outerSize(); ++k)
+            {
+                for (StiffnessMatrix::InnerIterator it(A, k); it; ++it)
+                {
+                    if (reduced_index[it.row()] >= 0 && reduced_index[it.col()] >= 0)
+                        entries.emplace_back(reduced_index[it.row()], reduced_index[it.col()], it.value());
+                }
+            }
+            StiffnessMatrix reduced(n_reduced, n_reduced);
+            reduced.setFromTriplets(entries.begin(), entries.end());
+
+            for (const StiffnessMatrix *system : {&full, &reduced})
+            {
+                const Eigen::VectorXd b = Eigen::VectorXd::Random(system->rows());
+                Eigen::SimplicialLDLT<StiffnessMatrix> direct(*system);
+                const Eigen::VectorXd expected = direct.solve(b);
+
+                const json params = {{"tolerance", 1e-12}, {"max_iter", 200}};
+                MultigridSolver solver(hierarchy, size, dirichlet, params);
+                solver.analyzePattern(*system, system->rows());
+                solver.factorize(*system);
+                Eigen::VectorXd x(system->rows());
+                solver.solve(b, x);
+
+                json info;
+                solver.getInfo(info);
+                REQUIRE(info["levels"] == n_refs + 1);
+                REQUIRE(int(info["iterations"]) < (size == 1 ? 30 : 100));
+                REQUIRE((x - expected).norm() < 1e-8 * expected.norm());
+            }
+        }
+    }
+}
+
+
+TEST_CASE("fused_energy_assembly", "[solver]") {
+    Eigen::MatrixXd V(4, 2);
+    V << 0, 0, 1, 0, 1.2, 1, 0, 0.9;
+    Eigen::MatrixXi F(2, 3);
+    F << 0, 1, 2, 0, 2, 3;
+
+    Mesh2D mesh;
+    REQUIRE(mesh.build_from_matrices(V, F));
+    std::vector<int> parents;
+    mesh.refine(2, 0, parents);
+
+    std::vector<ElementBases> bases;
+    std::vector<LocalBoundary> local_boundary;
+    std::map<int, InterfaceData> poly_edge_to_data;
+    const int n_bases = FEBasis2d::build_bases(mesh, 4, 2, false, false, false, bases, local_boundary, poly_edge_to_data);
+
+    auto &assembler = AssemblerUtils::instance();
+    assembler.set_parameters({{"lambda", 1.7}, {"mu", 0.6}, {"size", 2}});
+
+    const Eigen::MatrixXd displacement = 0.05 * Eigen::MatrixXd::Random(n_bases * 2, 1);
+
+    const double energy = assembler.assemble_energy("NeoHookean", false, bases, bases, displacement);
+    Eigen::MatrixXd grad;
+    assembler.assemble_energy_gradient("NeoHookean", false, n_bases, bases, bases, displacement, grad);
+    StiffnessMatrix hessian;
+    assembler.assemble_energy_hessian("NeoHookean", false, n_bases, bases, bases, displacement, hessian);
+
+    double fused_energy;
+    Eigen::MatrixXd fused_grad;
+    StiffnessMatrix fused_hessian;
+    assembler.assemble_energy_quantities("NeoHookean", false, n_bases, bases, bases, displacement, &fused_energy, &fused_grad, &fused_hessian);
+
+    REQUIRE(std::abs(fused_energy - energy) < 1e-12 * std::max(1., std::abs(energy)));
+    REQUIRE((fused_grad - grad).norm() < 1e-12 * std::max(1., grad.norm()));
+    REQUIRE((fused_hessian - hessian).norm() < 1e-12 * std::max(1., hessian.norm()));
+
+    //only the requested quantities are computed
+    Eigen::MatrixXd grad_only;
+    assembler.assemble_energy_quantities("NeoHookean", false, n_bases, bases, bases, displacement, nullptr, &grad_only, nullptr);
+    REQUIRE((grad_only - grad).norm() < 1e-12 * std::max(1., grad.norm()));
+}
+
+TEST_CASE("newton_hessian_policies", "[solver]") {
+    Eigen::MatrixXd V(4, 2);
+    V << 0, 0, 1, 0, 1, 1, 0, 1;
+    Eigen::MatrixXi F(2, 3);
+    F << 0, 1, 2, 0, 2, 3;
+
+    Mesh2D mesh;
+    REQUIRE(mesh.build_from_matrices(V, F));
+    std::vector<int> parents;
+    mesh.refine(2, 0, parents);
+
+    std::vector<ElementBases> bases;
+    std::vector<LocalBoundary> local_boundary;
+    std::map<int, InterfaceData> poly_edge_to_data;
+    const int n_bases = FEBasis2d::build_bases(mesh, 2, 1, false, false, false, bases, local_boundary, poly_edge_to_data);
+
+    auto &assembler = AssemblerUtils::instance();
+    assembler.set_parameters({{"lambda", 1.7}, {"mu", 0.6}, {"size", 2}});
+
+    StretchedNeoHookean problem(bases, n_bases, 0.1);
+    REQUIRE(problem.n_free() > 0);
+
+    std::map<std::string, Eigen::VectorXd> solutions;
+    std::map<std::string, int> factorizations;
+    for (const std::string policy : {"newton", "lagged", "lbfgs"})
+    {
+        cppoptlib::SparseNewtonDescentSolver<StretchedNeoHookean> solver({{"hessian_policy", policy}}, polysolve::LinearSolver::defaultSolver(), polysolve::LinearSolver::defaultPrecond());
+        Eigen::VectorXd x = Eigen::VectorXd::Zero(problem.n_free());
+        solver.minimize(problem, x);
+        REQUIRE(solver.error_code() == 0);
+
+        Eigen::VectorXd grad;
+        problem.gradient(x, grad);
+        REQUIRE(grad.norm() < 1e-7);
+
+        json solver_info;
+        solver.getInfo(solver_info);
+        solutions[policy] = x;
+        factorizations[policy] = solver_info["factorizations"];
+    }
+
+    const Eigen::VectorXd &reference = solutions["newton"];
+    REQUIRE((solutions["lagged"] - reference).norm() < 1e-6 * std::max(1., reference.norm()));
+    REQUIRE((solutions["lbfgs"] - reference).norm() < 1e-6 * std::max(1., reference.norm()));
+
+    //the lagged policies reuse the factorization of the hessian
+    REQUIRE(factorizations["lagged"] < factorizations["newton"]);
+    REQUIRE(factorizations["lbfgs"] < factorizations["newton"]);
+}
+
+TEST_CASE("autodiff_packet_assembly", "[solver]") {
+    auto &assembler = AssemblerUtils::instance();
+
+    for (const bool is_volume : {false, true})
+    {
+        const int size = is_volume ? 3 : 2;
+        std::vector<ElementBases> bases;
+        std::vector<LocalBoundary> local_boundary;
+        std::map<int, InterfaceData> poly_to_data;
+        int n_bases;
+
+        if (is_volume)
+        {
+            Eigen::MatrixXd V(5, 3);
+            V << 0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0, 1, 1, 1.1, 0.9;
+            Eigen::MatrixXi F(2, 4);
+            F << 0, 1, 2, 3, 1, 2, 3, 4;
+
+            Mesh3D mesh;
+            REQUIRE(mesh.build_from_matrices(V, F));
+            mesh.compute_elements_tag();
+            n_bases = FEBasis3d::build_bases(mesh, 4, 2, false, false, false, bases, local_boundary, poly_to_data);
+        }
+        else
+        {
+            Eigen::MatrixXd V(4, 2);
+            V << 0, 0, 1, 0, 1.2, 1, 0, 0.9;
+            Eigen::MatrixXi F(2, 3);
+            F << 0, 1, 2, 0, 2, 3;
+
+            Mesh2D mesh;
+            REQUIRE(mesh.build_from_matrices(V, F));
+            std::vector<int> parents;
+            mesh.refine(1, 0, parents);
+            n_bases = FEBasis2d::build_bases(mesh, 4, 2, false, false, false, bases, local_boundary, poly_to_data);
+        }
+
+        //the first local basis becomes a weighted combination of two nodes, as for a non-conforming element
+        std::vector<Local2Global> &global = bases[0].bases[0].global();
+        Local2Global other = bases[0].bases[1].global().front();
+        global.front().val = 0.6;
+        other.val = 0.4;
+        global.push_back(other);
+
+        const Eigen::MatrixXd displacement = 0.05 * Eigen::MatrixXd::Random(n_bases * size, 1);
+
+        json params = {{"lambda", 1.7}, {"mu", 0.6}, {"size", size}};
+
+        Eigen::MatrixXd grad;
+        StiffnessMatrix hessian;
+        params["autodiff_backend"] = "dofs";
+        assembler.set_parameters(params);
+        assembler.assemble_energy_gradient("NeoHookean", is_volume, n_bases, bases, bases, displacement, grad);
+        assembler.assemble_energy_hessian("NeoHookean", is_volume, n_bases, bases, bases, displacement, hessian);
+
+        Eigen::MatrixXd packet_grad;
+        StiffnessMatrix packet_hessian;
+        params["autodiff_backend"] = "packet";
+        assembler.set_parameters(params);
+        assembler.assemble_energy_gradient("NeoHookean", is_volume, n_bases, bases, bases, displacement, packet_grad);
+        assembler.assemble_energy_hessian("NeoHookean", is_volume, n_bases, bases, bases, displacement, packet_hessian);
+
+        params["autodiff_backend"] = "dofs";
+        assembler.set_parameters(params);
+
+        REQUIRE(packet_grad.size() == grad.size());
+        REQUIRE(packet_hessian.rows() == hessian.rows());
+        REQUIRE((packet_grad - grad).norm() < 1e-12 * std::max(1., grad.norm()));
+        REQUIRE((packet_hessian - hessian).norm() < 1e-12 * std::max(1., hessian.norm()));
+    }
+}
+
+TEST_CASE("colored_assembly", "[solver]") {
+    Eigen::MatrixXd V(4, 2);
+    V << 0, 0, 1, 0, 1.2, 1, 0, 0.9;
+    Eigen::MatrixXi F(2, 3);
+    F << 0, 1, 2, 0, 2, 3;
+
+    Mesh2D mesh;
+    REQUIRE(mesh.build_from_matrices(V, F));
+    std::vector<int> parents;
+    mesh.refine(3, 0, parents);
+
+    std::vector<ElementBases> bases, pressure_bases;
+    std::vector<LocalBoundary> local_boundary;
+    std::map<int, InterfaceData> poly_edge_to_data;
+    const int n_bases = FEBasis2d::build_bases(mesh, 4, 2, false, false, false, bases, local_boundary, poly_edge_to_data);
+    const int n_pressure_bases = FEBasis2d::build_bases(mesh, 4, 1, false, false, false, pressure_bases, local_boundary, poly_edge_to_data);
+
+    auto &assembler = AssemblerUtils::instance();
+    const json params = {{"lambda", 1.7}, {"mu", 0.6}, {"size", 2}};
+    json colored_params = params;
+    colored_params["parallel_assembly"] = "coloring";
+
+    const Eigen::MatrixXd displacement = 0.05 * Eigen::MatrixXd::Random(n_bases * 2, 1);
+
+    StiffnessMatrix stiffness, mixed, hessian;
+    Eigen::MatrixXd grad;
+    double energy;
+    assembler.set_parameters(params);
+    assembler.assemble_problem("LinearElasticity", false, n_bases, bases, bases, stiffness);
+    assembler.assemble_mixed_problem("Stokes", false, n_pressure_bases, n_bases, pressure_bases, bases, bases, mixed);
+    assembler.assemble_energy_quantities("NeoHookean", false, n_bases, bases, bases, displacement, &energy, &grad, &hessian);
+
+    StiffnessMatrix colored_stiffness, colored_mixed, colored_hessian;
+    Eigen::MatrixXd colored_grad;
+    double colored_energy;
+    assembler.set_parameters(colored_params);
+    assembler.assemble_problem("LinearElasticity", false, n_bases, bases, bases, colored_stiffness);
+    assembler.assemble_mixed_problem("Stokes", false, n_pressure_bases, n_bases, pressure_bases, bases, bases, colored_mixed);
+    assembler.assemble_energy_quantities("NeoHookean", false, n_bases, bases, bases, displacement, &colored_energy, &colored_grad, &colored_hessian);
+
+    //colorings kept in a cache for the given maps, the second assembly reuses them
+    ElementDofMap dof_map, pressure_dof_map;
+    dof_map.build(bases, n_bases);
+    pressure_dof_map.build(pressure_bases, n_pressure_bases);
+    ColoredAssemblyCache colorings;
+    StiffnessMatrix cached_stiffness, cached_mixed;
+    assembler.assemble_problem("LinearElasticity", false, n_bases, bases, bases, cached_stiffness, nullptr, &dof_map, &colorings);
+    assembler.assemble_mixed_problem("Stokes", false, n_pressure_bases, n_bases, pressure_bases, bases, bases, cached_mixed, &pressure_dof_map, &dof_map, &colorings);
+    const size_t cache_bytes = colorings.memory_bytes();
+    REQUIRE(cache_bytes > 0);
+    REQUIRE((cached_stiffness - stiffness).norm() < 1e-12 * std::max(1., stiffness.norm()));
+    REQUIRE((cached_mixed - mixed).norm() < 1e-12 * std::max(1., mixed.norm()));
+
+    assembler.assemble_problem("LinearElasticity", false, n_bases, bases, bases, cached_stiffness, nullptr, &dof_map, &colorings);
+    REQUIRE(colorings.memory_bytes() == cache_bytes);
+    REQUIRE((cached_stiffness - stiffness).norm() < 1e-12 * std::max(1., stiffness.norm()));
+    assembler.set_parameters(params);
+
+    REQUIRE(colored_stiffness.rows() == stiffness.rows());
+    REQUIRE(colored_mixed.rows() == mixed.rows());
+    REQUIRE(colored_mixed.cols() == mixed.cols());
+
+    REQUIRE((colored_stiffness - stiffness).norm() < 1e-12 * std::max(1., stiffness.norm()));
+    REQUIRE((colored_mixed - mixed).norm() < 1e-12 * std::max(1., mixed.norm()));
+    REQUIRE(std::abs(colored_energy - energy) < 1e-12 * std::max(1., std::abs(energy)));
+    REQUIRE((colored_grad - grad).norm() < 1e-12 * std::max(1., grad.norm()));
+    REQUIRE((colored_hessian - hessian).norm() < 1e-12 * std::max(1., hessian.norm()));
+}
@@ -7,6 +7,9 @@
 #include <tbb/parallel_for.h>
 #include <tbb/task_scheduler_init.h>
 #include <tbb/enumerable_thread_specific.h>
+
+#include <polyfem/ElasticityUtils.hpp>
+#include <Eigen/Dense>
 ////////////////////////////////////////////////////////////////////////////////
 
 
@@ -37,4 +40,22 @@ TEST_CASE("parallel_for_memory", "[tbb_test]") {
 	}
 }
 
+TEST_CASE("lame_parameters_parallel", "[tbb_test]") {
+	polyfem::LameParameters params;
+	params.init({{"E", "100+10*x*y+z"}, {"nu", "0.3+0.1*x"}, {"size", 3}});
+
+	const int n = 20000;
+	const Eigen::MatrixXd pts = Eigen::MatrixXd::Random(n, 3);
+	Eigen::MatrixXd expected(n, 2), res(n, 2);
+	for(int i = 0; i < n; ++i)
+		params.lambda_mu(pts(i, 0), pts(i, 1), pts(i, 2), 0, expected(i, 0), expected(i, 1));
+
+	//every thread evaluates its own copy of the expressions
+	tbb::parallel_for( 0, n, [&]( int i ) {
+		params.lambda_mu(pts(i, 0), pts(i, 1), pts(i, 2), 0, res(i, 0), res(i, 1));
+	} );
+
+	REQUIRE((res - expected).norm() == 0);
+}
+
 #endif
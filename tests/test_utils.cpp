@@ -1,14 +1,22 @@
 ////////////////////////////////////////////////////////////////////////////////
 #include <polyfem/InterpolatedFunction.hpp>
 #include <polyfem/RBFInterpolation.hpp>
+#include <polyfem/KdTree.hpp>
 #include <polyfem/Bessel.hpp>
 #include <polyfem/ExpressionValue.hpp>
 #include <polyfem/MshReader.hpp>
 #include <polyfem/Mesh.hpp>
 #include <polyfem/VTUWriter.hpp>
+#include <polyfem/Profiler.hpp>
+#include <polyfem/MemoryTracker.hpp>
+#include <polyfem/PointProbe.hpp>
+#include <polyfem/Mesh2D.hpp>
+#include <polyfem/FEBasis2d.hpp>
 
 #include <Eigen/Dense>
 
+#include <algorithm>
+
 #include <catch.hpp>
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -31,6 +39,43 @@ TEST_CASE("interpolated_fun_2d", "[utils]") {
     REQUIRE((fun.colwise().mean() - res).norm() == Approx(0).margin(1e-10));
 }
 
+TEST_CASE("interpolated_fun_3d", "[utils]") {
+    Eigen::MatrixXd pts(5, 3); pts <<
+    0, 0, 0,
+    1, 0, 0,
+    0, 1, 0,
+    0, 0, 1,
+    1, 1, 1;
+
+    Eigen::MatrixXi tets(2, 4); tets <<
+    0, 1, 2, 3,
+    1, 2, 3, 4;
+
+    //linear functions are reproduced exactly
+    Eigen::MatrixXd fun(5, 2);
+    fun.col(0) = pts.col(0) + 2 * pts.col(1) - pts.col(2);
+    fun.col(1).setConstant(3);
+
+    Eigen::MatrixXd pt(3, 3); pt <<
+    0.1, 0.2, 0.3,
+    0.5, 0.4, 0.6,
+    2, 2, 2;
+
+    InterpolatedFunction3d i_fun(fun, pts, tets);
+    const Eigen::MatrixXd res = i_fun.interpolate(pt);
+
+    for(int i = 0; i < 2; ++i)
+    {
+        REQUIRE(res(i, 0) == Approx(pt(i, 0) + 2 * pt(i, 1) - pt(i, 2)).margin(1e-10));
+        REQUIRE(res(i, 1) == Approx(3).margin(1e-10));
+    }
+    REQUIRE(res.row(2).norm() == Approx(0).margin(1e-10));
+
+    //same points, cached location with the new values
+    i_fun.set_function(2 * fun);
+    REQUIRE((i_fun.interpolate(pt) - 2 * res).norm() == Approx(0).margin(1e-10));
+}
+
 
 TEST_CASE("rbf_interpolate", "[utils]") {
 #ifndef POLYFEM_OPENCL
@@ -63,6 +108,43 @@ TEST_CASE("rbf_interpolate", "[utils]") {
 #endif
 }
 
+TEST_CASE("rbf_interpolate_compact", "[utils]") {
+    srand(42);
+    Eigen::MatrixXd in_pts(2000, 2); in_pts.setRandom();
+    Eigen::MatrixXd fun(in_pts.rows(), 2);
+    fun.col(0) = in_pts.col(0).array().sin() + in_pts.col(1).array();
+    fun.col(1) = in_pts.rowwise().squaredNorm();
+
+    const double support = 0.2;
+
+    KdTree tree(in_pts);
+    std::vector<int> neighs;
+    for(int i = 0; i < 10; ++i)
+    {
+        tree.radius_search(in_pts.row(i), support, neighs);
+        int expected = 0;
+        for(int j = 0; j < in_pts.rows(); ++j)
+            expected += (in_pts.row(j) - in_pts.row(i)).norm() <= support;
+        REQUIRE(int(neighs.size()) == expected);
+    }
+
+    RBFInterpolation rbf_fun(fun, in_pts, "wendland", support);
+    const auto actual = rbf_fun.interpolate(in_pts);
+    REQUIRE((actual - fun).cwiseAbs().maxCoeff() == Approx(0).margin(1e-8));
+
+    Eigen::MatrixXd out_pts(1, 2); out_pts << 0.1, 0.2;
+    const auto res = rbf_fun.interpolate(out_pts);
+    REQUIRE(res(0) == Approx(sin(0.1) + 0.2).margin(1e-2));
+    REQUIRE(res(1) == Approx(0.05).margin(1e-2));
+
+    RBFInterpolation pum_fun;
+    pum_fun.init_partition_of_unity(fun, in_pts, "multiquadric", 0.1);
+    REQUIRE((pum_fun.interpolate(in_pts) - fun).cwiseAbs().maxCoeff() == Approx(0).margin(1e-6));
+    const auto pum_res = pum_fun.interpolate(out_pts);
+    REQUIRE(pum_res(0) == Approx(sin(0.1) + 0.2).margin(1e-3));
+    REQUIRE(pum_res(1) == Approx(0.05).margin(1e-3));
+}
+
 
 TEST_CASE("bessel", "[utils]") {
     REQUIRE(bessy0(0.1)    == Approx(-1.534238651350367).margin(1e-8));
@@ -120,4 +202,192 @@ TEST_CASE("vtu_writer", "[utils]")
     VTUWriter writer;
     writer.add_field("test", v);
     writer.write_tet_mesh("test.vtu", pts, tris);
-}
\ No newline at end of file
+}
+
+TEST_CASE("profiler", "[utils]")
+{
+    Profiler &profiler = Profiler::instance();
+    profiler.reset();
+    profiler.set_tracing(true);
+
+    for (int i = 0; i < 3; ++i)
+    {
+        ScopedZone outer("outer");
+        {
+            ScopedZone inner("inner");
+        }
+        ScopedZone other("other");
+        REQUIRE(other.stop() >= 0);
+    }
+
+    const json summary = profiler.summary();
+    REQUIRE(summary.size() == 1);
+    REQUIRE(summary[0]["name"] == "outer");
+    REQUIRE(summary[0]["count"] == 3);
+    REQUIRE(summary[0]["children"].size() == 2);
+    REQUIRE(summary[0]["children"][0]["name"] == "inner");
+    REQUIRE(summary[0]["children"][1]["count"] == 3);
+    REQUIRE(summary[0]["children"][0]["time"].get<double>() <= summary[0]["time"].get<double>());
+
+    REQUIRE(profiler.write_chrome_trace("profile.json"));
+    profiler.set_tracing(false);
+    profiler.reset();
+}
+
+TEST_CASE("memory_tracker", "[utils]")
+{
+    MemoryTracker &tracker = MemoryTracker::instance();
+    tracker.reset();
+
+    std::vector<double> buffer;
+    buffer.reserve(1000);
+    REQUIRE(memory_bytes(buffer) == 1000 * sizeof(double));
+
+    Eigen::MatrixXd mat(10, 20);
+    REQUIRE(memory_bytes(mat) == 200 * sizeof(double));
+
+    tracker.set_bytes("buffer", memory_bytes(buffer));
+    tracker.set_bytes("buffer", 10);
+
+    {
+        ScopedMemoryPhase outer("outer");
+        ScopedMemoryPhase inner("inner");
+        std::vector<char> tmp(1 << 24, 1);
+        REQUIRE(tmp.back() == 1);
+    }
+
+    const json summary = tracker.summary();
+    REQUIRE(summary["subsystems"].size() == 1);
+    REQUIRE(summary["subsystems"][0]["bytes"] == 10);
+    REQUIRE(summary["subsystems"][0]["peak_bytes"] == 1000 * sizeof(double));
+    REQUIRE(summary["phases"].size() == 2);
+    REQUIRE(summary["phases"][0]["name"] == "outer");
+    REQUIRE(summary["phases"][1]["peak_rss"].get<size_t>() <= summary["phases"][0]["peak_rss"].get<size_t>());
+
+    //repeated phases keep one entry
+    for (int i = 0; i < 100; ++i)
+    {
+        ScopedMemoryPhase phase("inner");
+        std::vector<char> tmp((i + 1) << 12, 1);
+        REQUIRE(tmp.back() == 1);
+    }
+
+    const json repeated = tracker.summary();
+    REQUIRE(repeated["phases"].size() == 2);
+    REQUIRE(repeated["phases"][1]["name"] == "inner");
+    REQUIRE(repeated["phases"][1]["count"] == 101);
+    REQUIRE(repeated["phases"][1]["max_rss_increase"].get<long>() >= summary["phases"][1]["max_rss_increase"].get<long>());
+    REQUIRE(repeated["phases"][1]["peak_rss"].get<size_t>() >= summary["phases"][1]["peak_rss"].get<size_t>());
+
+    tracker.reset();
+}
+
+TEST_CASE("kd_tree_radius_search", "[utils]") {
+    //one point per leaf and a radius that covers all of them, every node is visited
+    srand(42);
+    Eigen::MatrixXd pts(5000, 3); pts.setRandom();
+
+    KdTree tree(pts, 1);
+    std::vector<int> neighs;
+    tree.radius_search(pts.row(0), 10, neighs);
+    REQUIRE(int(neighs.size()) == pts.rows());
+
+    std::sort(neighs.begin(), neighs.end());
+    for(int i = 0; i < pts.rows(); ++i)
+        REQUIRE(neighs[i] == i);
+}
+
+TEST_CASE("point_probe", "[utils]") {
+    Eigen::MatrixXd V(4, 2);
+    V << 0, 0, 1, 0, 1, 1, 0, 1;
+    Eigen::MatrixXi F(2, 3);
+    F << 0, 1, 2, 0, 2, 3;
+
+    Mesh2D mesh;
+    REQUIRE(mesh.build_from_matrices(V, F));
+    std::vector<int> parents;
+    mesh.refine(1, 0, parents);
+
+    std::vector<ElementBases> bases;
+    std::vector<LocalBoundary> local_boundary;
+    std::map<int, InterfaceData> poly_edge_to_data;
+    const int n_bases = FEBasis2d::build_bases(mesh, 4, 2, false, false, false, bases, local_boundary, poly_edge_to_data);
+
+    //linear vector field followed by the entries of a pressure, as in the mixed solutions
+    const int n_pressure = 7;
+    Eigen::MatrixXd fun = Eigen::MatrixXd::Constant(n_bases * 2 + n_pressure, 1, 42);
+    for(const ElementBases &bs : bases)
+    {
+        for(const Basis &b : bs.bases)
+        {
+            for(const auto &g : b.global())
+            {
+                fun(g.index * 2) = 1 + 2 * g.node(0) - g.node(1);
+                fun(g.index * 2 + 1) = 3 * g.node(0) + g.node(1);
+            }
+        }
+    }
+
+    srand(42);
+    Eigen::MatrixXd pts(21, 2);
+    pts.topRows(20) = 0.5 * (Eigen::MatrixXd::Random(20, 2).array() + 1);
+    pts.row(20) << 2, 2;
+
+    PointProbe probe;
+    probe.init(mesh, bases, bases, n_bases);
+    probe.set_points(pts);
+    REQUIRE(probe.elements()(20) == -1);
+
+    Eigen::MatrixXd values, grads;
+    probe.evaluate(fun, 2, values);
+    probe.evaluate_grad(fun, 2, grads);
+    REQUIRE(values.rows() == pts.rows());
+    REQUIRE(grads.cols() == 4);
+    for(int i = 0; i < 20; ++i)
+    {
+        REQUIRE(probe.elements()(i) >= 0);
+        REQUIRE(values(i, 0) == Approx(1 + 2 * pts(i, 0) - pts(i, 1)).margin(1e-10));
+        REQUIRE(values(i, 1) == Approx(3 * pts(i, 0) + pts(i, 1)).margin(1e-10));
+        REQUIRE(grads(i, 0) == Approx(2).margin(1e-10));
+        REQUIRE(grads(i, 1) == Approx(-1).margin(1e-10));
+        REQUIRE(grads(i, 2) == Approx(3).margin(1e-10));
+        REQUIRE(grads(i, 3) == Approx(1).margin(1e-10));
+    }
+    REQUIRE(values.row(20).norm() == 0);
+}
+
+TEST_CASE("point_probe_polygon", "[utils]") {
+    //L-shaped polygon, its bounding box contains the notch
+    Eigen::MatrixXd V(6, 2);
+    V << 0, 0, 2, 0, 2, 1, 1, 1, 1, 2, 0, 2;
+    Eigen::MatrixXi F(1, 6);
+    F << 0, 1, 2, 3, 4, 5;
+
+    Mesh2D mesh;
+    REQUIRE(mesh.build_from_matrices(V, F));
+    REQUIRE(mesh.is_polytope(0));
+
+    //one constant basis without parameterization
+    std::vector<ElementBases> bases(1);
+    bases[0].has_parameterization = false;
+    bases[0].bases.resize(1);
+    bases[0].bases[0].init(-2, 0, 0, Eigen::MatrixXd::Constant(1, 2, std::nan("")));
+    bases[0].bases[0].set_basis([](const Eigen::MatrixXd &uv, Eigen::MatrixXd &val) { val.setOnes(uv.rows(), 1); });
+    bases[0].bases[0].set_grad([](const Eigen::MatrixXd &uv, Eigen::MatrixXd &val) { val.setZero(uv.rows(), 2); });
+
+    Eigen::MatrixXd pts(4, 2);
+    pts << 0.5, 0.5, 1.5, 0.5, 0.5, 1.5, 1.5, 1.5;
+
+    PointProbe probe;
+    probe.init(mesh, bases, bases, 1);
+    probe.set_points(pts);
+    REQUIRE(probe.elements()(0) == 0);
+    REQUIRE(probe.elements()(1) == 0);
+    REQUIRE(probe.elements()(2) == 0);
+    REQUIRE(probe.elements()(3) == -1);
+
+    Eigen::MatrixXd values;
+    probe.evaluate(Eigen::MatrixXd::Constant(1, 1, 3), 1, values);
+    REQUIRE(values(0) == Approx(3));
+    REQUIRE(values(3) == 0);
+}